@@ -14,9 +14,9 @@ float, bytes, and str (unicode text)"""
 SQLiteValues = tuple[()] | tuple[SQLiteValue, ...]
 "A sequence of zero or more SQLiteValue"
 
-Bindings = Sequence[SQLiteValue | zeroblob] | Mapping[str, SQLiteValue | zeroblob]
+Bindings = Sequence[SQLiteValue | zeroblob | carray] | Mapping[str, SQLiteValue | zeroblob | carray]
 """Query bindings are either a sequence of SQLiteValue, or a dict mapping names
-to SQLiteValues.  You can also provide zeroblob in Bindings. You can use
+to SQLiteValues.  You can also provide zeroblob and carray in Bindings. You can use
 dict subclasses or any type registered with :class:`collections.abc.Mapping`
 for named bindings"""
 
@@ -127,6 +127,10 @@ Authorizer = Callable[[int, Optional[str], Optional[str], Optional[str], Optiona
 """Authorizers are called with an operation code and 4 strings (which could be None) depending
 on the operatation.  Return SQLITE_OK, SQLITE_DENY, or SQLITE_IGNORE"""
 
+AuthorizerRule = tuple[Optional[int], Optional[str], Optional[str], int]
+"""Operation code (None for any), patterns for the first two authorizer strings
+(None for any), and the result SQLITE_OK, SQLITE_DENY, or SQLITE_IGNORE"""
+
 CommitHook = Callable[[], bool]
 """Commit hook is called with no arguments and should return True to abort the commit and False
 to let it continue"""
@@ -161,6 +165,17 @@ def apsw_version() -> str:
 
 apswversion = apsw_version ## OLD-NAME
 
+def augment_tracebacks(value: bool) -> bool:
+    """When an exception passes through APSW's C code, a frame is added to
+    the traceback showing the C function and relevant values (see
+    :ref:`augmented stack traces <augmentedstacktraces>`).  This is
+    useful for debugging, but has a cost.  If your code deliberately
+    triggers errors at high rates, such as relying on constraint errors,
+    then call this with *False* to skip adding the frames.
+
+    The previous value is returned."""
+    ...
+
 compile_options: tuple[str, ...]
 """A tuple of the options used to compile SQLite.  For example it
 will be something like this::
@@ -702,6 +717,18 @@ class Blob:
         Calls: `sqlite3_blob_write <https://sqlite.org/c3ref/blob_write.html>`__"""
         ...
 
+@final
+class carray:
+    """Values bound as a pointer for the ``carray`` table valued function.
+    See :ref:`carray`."""
+    def __init__(self, values: array.array[Any] | memoryview | Sequence[int | float] | Sequence[str]):
+        """:param values: A buffer of 32 or 64 bit signed integers or 64 bit
+            floats such as :class:`array.array` with typecode ``q`` or
+            ``d`` which is used in place without copying.  Alternately a
+            sequence of int and float (converted to 64 bit integers, or 64
+            bit floats if any are float), or a sequence of str."""
+        ...
+
 class Connection:
     """This object wraps a `sqlite3 pointer
     <https://sqlite.org/c3ref/sqlite3.html>`_."""
@@ -731,9 +758,35 @@ class Connection:
 
       * :ref:`Example <example_authorizer>`
       * :ref:`statementcache`
+      * :meth:`set_authorizer_rules`
 
     Calls: `sqlite3_set_authorizer <https://sqlite.org/c3ref/set_authorizer.html>`__"""
 
+    auto_parameterize: bool
+    """When True, :meth:`Cursor.execute` without bindings replaces numeric
+    and string literals in the query with parameters, and binds the
+    values.  Queries that differ only in their literal values then
+    share one :meth:`statement cache <cache_stats>` entry instead of
+    each being prepared.  This is intended for code that builds
+    queries with the values inline such as ``WHERE id = 123``.
+
+    Only single ``SELECT``, ``VALUES``, ``WITH``, ``INSERT``,
+    ``REPLACE``, ``UPDATE``, and ``DELETE`` statements are changed.
+    Literals in result columns and ``ORDER BY`` / ``GROUP BY`` are
+    left alone, since they determine column names and column numbers.
+    Function arguments are left alone too.  If the changed query can't
+    be prepared then the original is used.  :attr:`exec_trace` sees the
+    changed query and the values as bindings.
+
+    An `index on an expression <https://sqlite.org/expridx.html>`__ is
+    only used when the query contains the same expression, including
+    its literals.  Function arguments are kept for that reason (eg
+    ``json_extract(j, '$.a')``), but other expressions such as
+    ``a + 1`` become ``a + ?`` and no longer match an index on
+    ``a + 1``.  (Bound values can still select a `partial index
+    <https://sqlite.org/partialindex.html>`__ because SQLite reprepares
+    the statement when a binding could change the plan.)"""
+
     def autovacuum_pages(self, callable: Optional[Callable[[str, int, int, int], int]]) -> None:
         """Calls `callable` to find out how many pages to autovacuum.  The callback has 4 parameters:
 
@@ -753,6 +806,34 @@ class Connection:
         Calls: `sqlite3_autovacuum_pages <https://sqlite.org/c3ref/autovacuum_pages.html>`__"""
         ...
 
+    def background_checkpoint_stats(self) -> dict[str, int]:
+        """Returns statistics from :meth:`set_background_checkpoint`, covering
+        all connections to the same database.  They are reset when the
+        background thread is stopped.
+
+        .. list-table::
+          :header-rows: 1
+          :widths: auto
+
+          * - Key
+            - Meaning
+          * - passive
+            - Number of PASSIVE checkpoints after *pages* were added
+          * - idle
+            - Number of *idle_mode* checkpoints after there were no commits
+          * - busy
+            - Number of checkpoints that could not be completed because
+              the database was busy
+          * - checkpoint_ns
+            - Total nanoseconds spent checkpointing
+          * - max_checkpoint_ns
+            - Longest checkpoint in nanoseconds
+          * - wal_high_water
+            - Largest WAL size in pages seen after a commit
+          * - wal_pages
+            - WAL size in pages after the most recent commit or checkpoint"""
+        ...
+
     def backup(self, databasename: str, sourceconnection: Connection, sourcedatabasename: str)  -> Backup:
         """Opens a :ref:`backup object <Backup>`.  All data will be copied from source
         database to this database.
@@ -792,6 +873,30 @@ class Connection:
 
     blobopen = blob_open ## OLD-NAME
 
+    def busy_stats(self) -> dict[str, int]:
+        """Returns statistics from the busy handler installed by
+        :meth:`set_busy_backoff`.  They are reset each time that method is
+        called.
+
+        .. list-table::
+          :header-rows: 1
+          :widths: auto
+
+          * - Key
+            - Meaning
+          * - busy
+            - How many times a lock was busy, starting a wait
+          * - retries
+            - How many times SQLite was told to retry after sleeping
+          * - timeouts
+            - How many waits exceeded the timeout, returning :class:`BusyError`
+          * - wait_ns
+            - Total nanoseconds spent sleeping
+          * - max_wait_ns
+            - Longest single wait in nanoseconds, from the lock first being
+              busy until the final sleep ended"""
+        ...
+
     def cache_flush(self) -> None:
         """Flushes caches to disk mid-transaction.
 
@@ -835,6 +940,17 @@ class Connection:
           * - too_big
             - UTF8 query size was larger than considered for caching.  These are also included
               in the misses count.
+          * - reprepares
+            - While :meth:`plan monitoring <set_plan_monitor>`, how many times
+              cached statements were found to have been reprepared by SQLite
+          * - plan_changes
+            - How many of the reprepares resulted in a different query plan
+          * - normalized
+            - With :attr:`auto_parameterize`, misses that were prepared with
+              literals replaced by parameters
+          * - normalized_hits
+            - With :attr:`auto_parameterize`, hits found after literals were
+              replaced by parameters
           * - max_cacheable_bytes
             - Maximum size of query (in bytes of utf8) that will be considered for caching
           * - entries
@@ -860,7 +976,10 @@ class Connection:
             - How many times this entry has been (re)used
           * - has_more
             - Boolean indicating if there was more query text than
-              the first statement"""
+              the first statement
+          * - plan
+            - The query plan as text if recorded by :meth:`set_plan_monitor`,
+              else None"""
         ...
 
     def changes(self) -> int:
@@ -955,6 +1074,34 @@ class Connection:
         Calls: `sqlite3_db_config <https://sqlite.org/c3ref/db_config.html>`__"""
         ...
 
+    convert_json: bool
+    """When True, JSON is converted directly between SQLite and Python
+    objects in C, without intermediate strings or calling
+    :func:`json.loads` and :func:`json.dumps`.  Default is False.
+
+    Column values are returned as :class:`dict`, :class:`list`,
+    :class:`str`, :class:`int`, :class:`float`, :class:`bool`, or None
+    when the column is declared as ``JSON`` or ``JSONB`` in the table
+    definition, or the value comes from a SQLite `JSON function
+    <https://sqlite.org/json1.html>`__ that returns JSON text.  Text
+    is parsed as strict JSON, while blobs are parsed as `JSONB
+    <https://sqlite.org/jsonb.html>`__.  :exc:`ValueError` is raised
+    for values that are not valid.
+
+    :class:`dict` and :class:`list` bindings are encoded as JSON text.
+    Nested tuples are encoded as arrays, and dictionary keys must be
+    :class:`str`.
+
+    .. code-block:: python
+
+      connection.convert_json = True
+      connection.execute("create table config(name, settings JSON)")
+      connection.execute("insert into config values(?, ?)",
+                         ("main", {"retries": 3, "hosts": ["a", "b"]}))
+
+      # {'retries': 3, 'hosts': ['a', 'b']}
+      connection.execute("select settings from config").get"""
+
     def create_aggregate_function(self, name: str, factory: Optional[AggregateFactory], numargs: int = -1, *, flags: int = 0) -> None:
         """Registers an aggregate function.  Aggregate functions operate on all
         the relevant rows such as counting how many there are.
@@ -1240,6 +1387,47 @@ class Connection:
         See :meth:`Cursor.execute` for more details, and the :ref:`example <example_executing_sql>`."""
         ...
 
+    def execute_cached(self, statements: str, bindings: Optional[Bindings] = None) -> tuple[SQLiteValues, ...]:
+        """Executes the query returning all the rows.  If the result cache has
+        been enabled with :meth:`set_result_cache` then the rows are kept,
+        and returned again for the same *statements* and *bindings* without
+        running the query as long as no database has changed.  This is
+        intended for dashboards and similar that issue the same queries
+        repeatedly.
+
+        Changes are detected with `data versions
+        <https://sqlite.org/c3ref/c_fcntl_begin_atomic_write.html#sqlitefcntldataversion>`__
+        which cover changes made by this connection, and by other
+        connections and processes.  Any change discards all the cached
+        results.
+
+        Results are only cached outside of a transaction, and when there is
+        no :attr:`exec_trace` or :attr:`row_trace` on the connection or on
+        the cursor returned by :attr:`cursor_factory`, which must be a
+        :class:`Cursor`.  The query must be a
+        single statement that is read only, is not a pragma, does not use
+        virtual tables, and all its functions must be deterministic (see
+        :meth:`create_scalar_function`) or builtin aggregate and window
+        functions.  The date and time functions are not deterministic
+        because they can use ``'now'``.  Bindings must be ``None``, a
+        :class:`tuple`, :class:`list`, or :class:`dict` of the basic
+        :class:`SQLiteValue` types.
+
+        The same tuple can be returned to multiple callers so results should
+        be treated as read only.  Registering or removing a function,
+        collation, or virtual table module, or changing
+        :attr:`cursor_factory` discards all the cached results.
+
+        .. seealso::
+
+           * :meth:`result_cache_stats`
+
+        Calls:
+          * `sqlite3_file_control <https://sqlite.org/c3ref/file_control.html>`__
+          * `sqlite3_stmt_readonly <https://sqlite.org/c3ref/stmt_readonly.html>`__
+          * `sqlite3_stmt_explain <https://sqlite.org/c3ref/stmt_explain.html>`__"""
+        ...
+
     def executemany(self, statements: str, sequenceofbindings:Sequence[Bindings], *, can_cache: bool = True, prepare_flags: int = 0, explain: int = -1) -> Cursor:
         """This method is for when you want to execute the same statements over a
         sequence of bindings, such as inserting into a database.  (A cursor is
@@ -1501,6 +1689,32 @@ class Connection:
         Calls: `sqlite3_db_release_memory <https://sqlite.org/c3ref/db_release_memory.html>`__"""
         ...
 
+    def result_cache_stats(self) -> dict[str, int]:
+        """Returns statistics about :meth:`execute_cached` since
+        :meth:`set_result_cache` was called.
+
+        .. list-table::
+          :header-rows: 1
+          :widths: auto
+
+          * - Key
+            - Meaning
+          * - entries
+            - Number of results currently cached
+          * - bytes
+            - Estimated memory used by the cached results
+          * - hits
+            - Results returned from the cache
+          * - misses
+            - Queries run whose results were then cached
+          * - uncacheable
+            - Queries run whose results could not be cached
+          * - invalidations
+            - Times cached results were discarded because a database changed
+          * - evictions
+            - Results discarded to keep within the limits"""
+        ...
+
     row_trace: Optional[RowTracer]
     """Called with the cursor and row being returned for
     :class:`cursors <Cursor>` associated with this Connection, unless
@@ -1541,6 +1755,111 @@ class Connection:
 
     setauthorizer = set_authorizer ## OLD-NAME
 
+    def set_authorizer_rules(self, rules: Optional[Sequence[AuthorizerRule]]) -> None:
+        """Sets rules checked by the authorizer in C, without calling any
+        Python code or needing the GIL.  This is considerably faster than
+        an :attr:`authorizer` callback which is called for every table and
+        column access, function call etc in every statement prepared.
+
+        Each rule is a tuple of the operation code (or *None* for any
+        operation), patterns for the two operation dependent strings
+        described in :attr:`authorizer`, and the result which is one of
+        *SQLITE_OK*, *SQLITE_DENY*, or *SQLITE_IGNORE*.  A pattern of *None*
+        matches anything, and otherwise `*` matches zero or more characters
+        and `?` matches exactly one, ignoring ASCII case.  For example the
+        table and column for *SQLITE_READ*, or the function name for
+        *SQLITE_FUNCTION* which is the second string.
+
+        The rules are checked in order with the first match deciding the
+        result.  If no rule matches then the :attr:`authorizer` callback is
+        called if there is one, else the action is allowed.  End with
+        `(None, None, None, apsw.SQLITE_DENY)` to deny everything not
+        explicitly allowed.
+
+        .. code-block:: python
+
+          connection.set_authorizer_rules([
+            (apsw.SQLITE_READ, "users", "password", apsw.SQLITE_IGNORE),
+            (apsw.SQLITE_READ, None, None, apsw.SQLITE_OK),
+            (apsw.SQLITE_SELECT, None, None, apsw.SQLITE_OK),
+            (apsw.SQLITE_FUNCTION, None, "json*", apsw.SQLITE_OK),
+            (None, None, None, apsw.SQLITE_DENY),
+          ])
+
+        Use *None* to remove all rules.
+
+        Calls: `sqlite3_set_authorizer <https://sqlite.org/c3ref/set_authorizer.html>`__"""
+        ...
+
+    def set_background_checkpoint(self, pages: int, *, idle: float = 1.0, idle_mode: int = SQLITE_CHECKPOINT_TRUNCATE) -> None:
+        """Does :ref:`wal` checkpoints in a background thread instead of
+        during commits.
+
+        Normally SQLite automatically checkpoints when a commit makes the
+        WAL larger than :meth:`wal_autocheckpoint` pages, and that commit
+        takes considerably longer while the checkpoint runs.  With
+        background checkpointing the size of the WAL is checked after each
+        commit, and when at least *pages* have been added since the last
+        checkpoint a `PASSIVE <https://sqlite.org/c3ref/wal_checkpoint_v2.html>`__
+        checkpoint is started in a background thread using its own
+        connection.  Passive checkpoints do not interfere with readers or
+        writers.  Once there have been no commits for *idle* seconds a
+        checkpoint is done using *idle_mode*, with the default of TRUNCATE
+        resetting the WAL to zero bytes.
+
+        The background thread and its connection are shared by all
+        connections in this process with background checkpointing enabled on
+        the same database, and the most recent settings are used.  The
+        thread is stopped when the last of them is closed or disables it.
+        The thread does not use the GIL unless the :doc:`VFS <vfs>` is
+        implemented in Python.
+
+        :param pages: Checkpoint when this many pages have been added to the
+           WAL.  Zero or less disables background checkpointing for this
+           connection.
+
+        This replaces automatic checkpointing on this connection, which
+        :meth:`wal_autocheckpoint` will turn back on, replacing this.
+        Disabling background checkpointing restores the automatic
+        checkpointing that was in effect when it was enabled.  A
+        :meth:`wal hook <set_wal_hook>` is still called.
+
+        .. seealso::
+
+           * :meth:`background_checkpoint_stats`
+
+        Calls:
+          * `sqlite3_wal_hook <https://sqlite.org/c3ref/wal_hook.html>`__
+          * `sqlite3_wal_checkpoint_v2 <https://sqlite.org/c3ref/wal_checkpoint_v2.html>`__"""
+        ...
+
+    def set_busy_backoff(self, *, initial: float = 0.001, multiplier: float = 2.0, maximum: float = 0.1, jitter: float = 0.25, timeout: float = 5.0) -> None:
+        """Installs a busy handler implemented in C that retries with
+        exponential backoff.  Unlike :meth:`set_busy_handler` no Python code
+        runs while waiting, and unlike :meth:`set_busy_timeout` the delays
+        can be tuned.  The GIL is released while sleeping.
+
+        The first retry waits *initial* seconds, and each subsequent retry
+        waits *multiplier* times longer than the previous, up to *maximum*.
+        Each wait is randomly varied by up to *jitter* times its length in
+        either direction, which stops multiple waiters retrying in lock
+        step.  :class:`BusyError` is returned once *timeout* seconds have
+        been spent waiting.  Sleeping is done by this connection's
+        :doc:`VFS <vfs>`, as SQLite's own busy handler does.
+
+        Calling :meth:`set_busy_handler` or :meth:`set_busy_timeout`
+        replaces this handler.
+
+        .. seealso::
+
+           * :meth:`busy_stats`
+           * :ref:`Busy handling <busyhandling>`
+
+        Calls:
+          * `sqlite3_busy_handler <https://sqlite.org/c3ref/busy_handler.html>`__
+          * `sqlite3_file_control <https://sqlite.org/c3ref/file_control.html>`__"""
+        ...
+
     def set_busy_handler(self, callable: Optional[Callable[[int], bool]]) -> None:
         """Sets the busy handler to callable. callable will be called with one
         integer argument which is the number of prior calls to the busy
@@ -1613,6 +1932,35 @@ class Connection:
         Calls: `sqlite3_set_last_insert_rowid <https://sqlite.org/c3ref/set_last_insert_rowid.html>`__"""
         ...
 
+    def set_plan_monitor(self, callable: Optional[Callable[[str, str, str], None]]) -> None:
+        """Records the `query plan <https://sqlite.org/eqp.html>`__ of each
+        statement as it is added to the :meth:`statement cache
+        <cache_stats>`.  SQLite automatically reprepares statements when the
+        schema changes or `ANALYZE <https://sqlite.org/lang_analyze.html>`__
+        statistics are updated, which can result in a different plan such
+        as a full table scan instead of using an index.  When a reprepared
+        statement returns to the cache its plan is compared, and if
+        different *callable* is called with the query, old plan, and new
+        plan.  The plans are the same text as the ``.eqp`` output in the
+        SQLite shell.
+
+        Use *None* to stop monitoring.  The reprepares and plan_changes
+        counters in :meth:`cache_stats` are only updated while monitoring.
+
+        Getting the plan prepares and runs a separate ``EXPLAIN QUERY
+        PLAN`` of the statement each time one is added to the cache, and
+        when a reprepared statement returns to the cache.  That roughly
+        doubles the cost of preparing, which matters if the cache has a low
+        hit rate.  Statements that aren't cached are not monitored.
+
+        *callable* is called while the statement is returning to the cache,
+        so using this connection from it raises
+        :exc:`ThreadingViolationError`.  Any exception it raises is reported
+        via :func:`sys.unraisablehook`.
+
+        Calls: `sqlite3_stmt_status <https://sqlite.org/c3ref/stmt_status.html>`__"""
+        ...
+
     def set_profile(self, callable: Optional[Callable[[str, int], None]]) -> None:
         """Sets a callable which is invoked at the end of execution of each
         statement and passed the statement string and how long it took to
@@ -1640,6 +1988,19 @@ class Connection:
 
     setprogresshandler = set_progress_handler ## OLD-NAME
 
+    def set_result_cache(self, max_entries: int, max_bytes: int = 16777216) -> None:
+        """Enables caching the results of :meth:`execute_cached`.  Calling this
+        again discards the existing results and statistics.
+
+        :param max_entries: Maximum number of results kept.  Zero or less
+           disables the cache.
+        :param max_bytes: Maximum estimated memory used by the results.  A
+           result larger than this is not cached.
+
+        The least recently used results are discarded to keep within the
+        limits."""
+        ...
+
     def set_rollback_hook(self, callable: Optional[Callable[[], None]]) -> None:
         """Sets a callable which is invoked during a rollback.  If *callable*
         is *None* then any existing rollback hook is unregistered.
@@ -1657,6 +2018,50 @@ class Connection:
 
     setrowtrace = set_row_trace ## OLD-NAME
 
+    def set_statement_limits(self, vm_steps: int = 0, rows: int = 0) -> None:
+        """Limits the resources each statement run by a :class:`Cursor` on
+        this connection can use, such as when running queries supplied by
+        users.  Zero means no limit, and calling with no arguments removes
+        all limits.
+
+        :param vm_steps: Maximum virtual machine instructions run by the statement
+           (`SQLITE_STMTSTATUS_VM_STEP <https://sqlite.org/c3ref/c_stmtstatus_counter.html>`__)
+        :param rows: Maximum number of rows the statement returns
+
+        The statement is stopped with :exc:`ResourceLimitError` when a limit
+        is exceeded.  Its :attr:`~ResourceLimitError.usage` gives how much
+        of each resource was used.
+
+        *vm_steps* is checked from the progress handler every 100
+        instructions so the statement can run slightly past it.  A handler
+        from :meth:`set_progress_handler` is still called at approximately
+        its *nsteps*.
+
+        SQLite doesn't track memory or temporary files per statement.
+        :func:`apsw.hard_heap_limit` limits memory for the whole process,
+        and with `pragma temp_store=memory
+        <https://sqlite.org/pragma.html#pragma_temp_store>`__ temporary
+        storage counts towards it.
+
+        Calls:
+          * `sqlite3_progress_handler <https://sqlite.org/c3ref/progress_handler.html>`__
+          * `sqlite3_stmt_status <https://sqlite.org/c3ref/stmt_status.html>`__"""
+        ...
+
+    def set_trace_recorder(self, recorder: Optional[TraceRecorder]) -> None:
+        """Starts recording statement executions on this connection into the
+        :class:`TraceRecorder`, or stops if *recorder* is *None*.  A
+        recorder can be shared by any number of connections, across
+        threads.  Recording is independent of :meth:`set_profile` and
+        :meth:`trace_v2` which can be used at the same time.
+
+        .. seealso::
+
+          * :ref:`tracerecorder`
+
+        Calls: `sqlite3_trace_v2 <https://sqlite.org/c3ref/trace_v2.html>`__"""
+        ...
+
     def set_update_hook(self, callable: Optional[Callable[[int, str, str, int], None]]) -> None:
         """Calls *callable* whenever a row is updated, deleted or inserted.  If
         *callable* is *None* then any existing update hook is
@@ -1700,6 +2105,45 @@ class Connection:
 
     setwalhook = set_wal_hook ## OLD-NAME
 
+    def set_writer_queue(self, milliseconds: int) -> None:
+        """Makes this connection take its turn in an in process queue before
+        writing, which gives first come first served fairness amongst the
+        connections in this process writing to the same database file.
+
+        SQLite only allows one writer at a time.  Normally a connection that
+        wants to write while another is writing gets a busy error, and
+        :ref:`busy handling <busyhandling>` sleeps and retries.  A waiter
+        can sleep past the point the other writer finished, and an unlucky
+        waiter can keep losing.  With the queue, the connection waits before
+        executing its first statement that writes (including ``BEGIN
+        IMMEDIATE``) and is woken as soon as the previous writer's
+        transaction ends.  The queue is released when this connection's
+        write transaction commits or rolls back.
+
+        Only connections that have called this method take part, and
+        connections in other processes are not affected.  Files are
+        identified by :attr:`filename`, so in memory and temporary databases
+        are not queued.
+
+        :param milliseconds: Maximum thousandths of a second to wait in the
+           queue.  If exceeded then the statement runs anyway with the usual
+           busy handling.  Zero or less stops using the queue.
+
+        Do not use the queue if this connection holds a read transaction
+        in rollback journal mode while waiting for the queue, since the
+        writer ahead of it can't commit until the read transaction ends.
+        The timeout will resolve that, but only after waiting.
+
+        .. seealso::
+
+           * :meth:`writer_queue_stats`
+           * :meth:`set_busy_timeout`
+
+        Calls:
+          * `sqlite3_txn_state <https://sqlite.org/c3ref/txn_state.html>`__
+          * `sqlite3_stmt_readonly <https://sqlite.org/c3ref/stmt_readonly.html>`__"""
+        ...
+
     def sqlite3_pointer(self) -> int:
         """Returns the underlying `sqlite3 *
         <https://sqlite.org/c3ref/sqlite3.html>`_ for the connection. This
@@ -1784,6 +2228,12 @@ class Connection:
               *"SQLITE_STMTSTATUS_VM_STEP"* and corresponding integer values.
               The counters are reset each time a statement
               starts execution.
+          * - scanstatus
+            - :class:`list`
+            - SQLITE_TRACE_PROFILE only, and only present if
+              SQLITE_ENABLE_STMT_SCANSTATUS was defined at compile time:
+              the same as :meth:`Cursor.scanstatus`.  The counters are
+              reset each time a statement starts execution.
 
         .. seealso::
 
@@ -1791,7 +2241,9 @@ class Connection:
 
         Calls:
           * `sqlite3_trace_v2 <https://sqlite.org/c3ref/trace_v2.html>`__
-          * `sqlite3_stmt_status <https://sqlite.org/c3ref/stmt_status.html>`__"""
+          * `sqlite3_stmt_status <https://sqlite.org/c3ref/stmt_status.html>`__
+          * `sqlite3_stmt_scanstatus_v2 <https://sqlite.org/c3ref/stmt_scanstatus_v2.html>`__
+          * `sqlite3_stmt_scanstatus_reset <https://sqlite.org/c3ref/stmt_scanstatus_reset.html>`__"""
         ...
 
     def txn_state(self, schema: Optional[str] = None) -> int:
@@ -1838,6 +2290,29 @@ class Connection:
         Calls: `sqlite3_wal_checkpoint_v2 <https://sqlite.org/c3ref/wal_checkpoint_v2.html>`__"""
         ...
 
+    def writer_queue_stats(self) -> dict[str, int]:
+        """Returns statistics about this connection's use of the queue from
+        :meth:`set_writer_queue`.  They are reset each time that method is
+        called.
+
+        .. list-table::
+          :header-rows: 1
+          :widths: auto
+
+          * - Key
+            - Meaning
+          * - acquired
+            - How many times this connection got its turn to write
+          * - waited
+            - How many times another connection was ahead in the queue
+          * - timeouts
+            - How many of those waits exceeded the timeout
+          * - wait_ns
+            - Total nanoseconds spent waiting
+          * - max_wait_ns
+            - Longest single wait in nanoseconds"""
+        ...
+
 class Cursor:
     """"""
     def close(self, force: bool = False) -> None:
@@ -1926,7 +2401,8 @@ class Cursor:
           * `sqlite3_bind_text64 <https://sqlite.org/c3ref/bind_blob.html>`__
           * `sqlite3_bind_double <https://sqlite.org/c3ref/bind_blob.html>`__
           * `sqlite3_bind_blob64 <https://sqlite.org/c3ref/bind_blob.html>`__
-          * `sqlite3_bind_zeroblob <https://sqlite.org/c3ref/bind_blob.html>`__"""
+          * `sqlite3_bind_zeroblob <https://sqlite.org/c3ref/bind_blob.html>`__
+          * `sqlite3_bind_pointer <https://sqlite.org/c3ref/bind_pointer.html>`__"""
         ...
 
     def executemany(self, statements: str, sequenceofbindings: Sequence[Bindings], *, can_cache: bool = True, prepare_flags: int = 0, explain: int = -1) -> Cursor:
@@ -2088,6 +2564,61 @@ class Cursor:
 
     rowtrace = row_trace ## OLD-NAME
 
+    def scanstatus(self) -> list[dict[str, int | float | str | None]]:
+        """Only present if SQLITE_ENABLE_STMT_SCANSTATUS was defined at
+        compile time.
+
+        Returns `scan status <https://sqlite.org/c3ref/stmt_scanstatus.html>`__
+        counters for each element of the query plan of the currently
+        executing statement, showing where the time went.  Each element is
+        a dict:
+
+        .. list-table::
+          :header-rows: 1
+          :widths: auto
+
+          * - Key
+            - Meaning
+          * - id
+            - Identifier of this element
+          * - parent
+            - *id* of the parent element, or zero for top level elements
+          * - loops
+            - How many times the loop was run
+          * - visits
+            - How many rows were visited
+          * - estimated_rows
+            - How many rows the query planner estimated each loop would visit
+          * - cycles
+            - CPU cycles spent in this element (not all platforms)
+          * - name
+            - Table or index name, or None
+          * - explain
+            - Query plan text for this element as shown by EXPLAIN QUERY PLAN
+
+        Counters accumulate across executions of a statement until
+        :meth:`scanstatus_reset` is called.  When :meth:`Connection.trace_v2`
+        is used with :attr:`SQLITE_TRACE_PROFILE` they are instead reset as
+        each execution starts, so they cover only that execution.
+        Statements are completed and returned to the statement cache as soon
+        as their last row has been read, so call this before then, or use
+        :meth:`Connection.trace_v2` which includes the counters when each
+        statement completes.
+        :func:`apsw.ext.format_scanstatus` shows them as a tree.
+
+        Calls: `sqlite3_stmt_scanstatus_v2 <https://sqlite.org/c3ref/stmt_scanstatus_v2.html>`__"""
+        ...
+
+    def scanstatus_reset(self) -> None:
+        """Only present if SQLITE_ENABLE_STMT_SCANSTATUS was defined at
+        compile time.
+
+        Zeroes the :meth:`scanstatus` counters for the currently executing
+        statement.
+
+        Calls: `sqlite3_stmt_scanstatus_reset <https://sqlite.org/c3ref/stmt_scanstatus_reset.html>`__"""
+        ...
+
     def set_exec_trace(self, callable: Optional[ExecTracer]) -> None:
         """Sets the :attr:`execution tracer <Cursor.exec_trace>`"""
         ...
@@ -2210,6 +2741,37 @@ class IndexInfo:
         """Sets *omit* for *aConstraintUsage[which]*"""
         ...
 
+@final
+class TraceRecorder:
+    """Records statement execution into a memory mapped ring file."""
+    def close(self) -> None:
+        """Stops recording and unmaps the file.  Connections still attached
+        silently stop recording.  It is ok to call this method multiple
+        times."""
+        ...
+
+    filename: str
+    """The file being recorded into."""
+
+    def __init__(self, filename: str, size: int = 16777216):
+        """Creates (or truncates) *filename* and memory maps it as the ring.
+
+        :param filename: File to record into
+        :param size: Size of the file in bytes.  It is rounded up to a multiple
+           of 8 and has a minimum of 64kb.  Larger sizes keep more history.
+
+        .. seealso::
+
+          * :meth:`Connection.set_trace_recorder`
+          * :func:`apsw.trace.read_trace_recording`"""
+        ...
+
+    def stats(self) -> dict[str, int]:
+        """Returns a dictionary with the *size* of the ring, bytes *used*,
+        number of *records* written, and how many have been *overwritten*
+        because the ring wrapped."""
+        ...
+
 @final
 class URIFilename:
     """SQLite packs `uri parameters
@@ -2279,7 +2841,12 @@ class VFSFcntlPragma:
 class VFSFile:
     """Wraps access to a file.  You only need to derive from this class
     if you want the file object returned from :meth:`VFS.xOpen` to
-    inherit from an existing VFS implementation."""
+    inherit from an existing VFS implementation.
+
+    If your class does not override :meth:`~VFSFile.xRead` and
+    :meth:`~VFSFile.xWrite` then `memory mapped I/O
+    <https://sqlite.org/mmap.html>`__ is passed through to the
+    inherited file when enabled with ``pragma mmap_size``."""
     def excepthook(self, etype: type[BaseException], evalue: BaseException, etraceback: Optional[types.TracebackType]) ->None:
         """Called when there has been an exception in a :class:`VFSFile`
         routine, and it can't be reported to the caller as usual.
@@ -4360,6 +4927,19 @@ class ReadOnlyError(Error):
     """`SQLITE_READONLY <https://sqlite.org/rescode.html#readonly>`__.
     Attempt to write to a readonly database."""
 
+class ResourceLimitError(Error):
+    """  A statement exceeded a limit set by
+      :meth:`Connection.set_statement_limits`.
+
+    .. attribute:: ResourceLimitError.limit
+
+      Which limit was exceeded - ``vm_steps`` or ``rows``.
+
+    .. attribute:: ResourceLimitError.usage
+
+      A :class:`dict` with the ``vm_steps`` and ``rows`` used
+      by the statement when the limit was exceeded."""
+
 class SQLError(Error):
     """`SQLITE_ERROR <https://sqlite.org/rescode.html#error>`__.  The
     standard error code, unless a more specific one is  applicable."""
@@ -3,11 +3,13 @@
 from __future__ import annotations
 import collections
 import collections.abc
+import concurrent.futures
+import contextlib
 
 import dataclasses
 from dataclasses import dataclass, make_dataclass, is_dataclass
 
-from typing import Union, Any, Callable, Sequence, TextIO, Literal, Iterator, Generator
+from typing import Union, Any, Callable, Sequence, TextIO, Literal, Iterator, Generator, Iterable
 import types
 
 import functools
@@ -22,6 +24,10 @@ import string
 import textwrap
 import apsw
 import sys
+import zlib
+import queue
+import threading
+import time
 
 try:
     from keyword import iskeyword as _iskeyword
@@ -289,6 +295,336 @@ class TypesConverterCursorFactory:
                 explain=explain)
 
 
+class GroupCommitWriter:
+    """Applies transactions submitted from many threads on one writer
+    connection, committing them together
+
+    Each commit makes SQLite wait until the data is durable on storage,
+    which takes a fixed amount of time no matter how small the
+    transaction is.  Spinning and network disks are especially slow.
+    This class runs a writer thread with its own connection.
+    Submissions are collected for up to *max_delay* seconds or
+    *max_batch* submissions, then applied inside one outer
+    transaction, each in its own savepoint so that a submission raising
+    an exception is rolled back without affecting the others.  The
+    :class:`~concurrent.futures.Future` returned by :meth:`submit` is
+    completed only once the outer transaction has been committed.
+
+    :param database: Filename to open
+    :param max_batch: Most submissions to commit together
+    :param max_delay: Most seconds to wait for more submissions once
+        the first has arrived
+    :param setup: Called with the connection in the writer thread
+        before any submissions, for example to set pragmas
+    :param kwargs: Passed to :class:`apsw.Connection`
+
+    .. code-block:: python
+
+        writer = apsw.ext.GroupCommitWriter("app.db")
+
+        # from any thread
+        writer.execute("insert into log values(?, ?)", (when, message)).result()
+
+        writer.close()
+    """
+
+    def __init__(self,
+                 database: str,
+                 *,
+                 max_batch: int = 100,
+                 max_delay: float = 0.005,
+                 setup: Callable[[apsw.Connection], None] | None = None,
+                 **kwargs):
+        self.max_batch = max_batch
+        self.max_delay = max_delay
+        self._queue: queue.Queue = queue.Queue()
+        self._closed = False
+        self._lock = threading.Lock()
+        self.stats = {"submissions": 0, "failed": 0, "commits": 0, "largest_batch": 0}
+        "Counts of submissions, how many raised exceptions, commits, and the largest batch committed together"
+        started: concurrent.futures.Future = concurrent.futures.Future()
+        self._thread = threading.Thread(target=self._writer,
+                                        args=(database, setup, kwargs, started),
+                                        name="apsw GroupCommitWriter",
+                                        daemon=True)
+        self._thread.start()
+        started.result()
+
+    def submit(self, callable: Callable[[apsw.Connection], Any]) -> concurrent.futures.Future:
+        """Queues *callable* to be called with the writer connection,
+        returning a :class:`~concurrent.futures.Future` for its return
+        value
+
+        *callable* must not start or end transactions, but can use
+        savepoints (including ``with connection:``) and do any
+        number of statements.  The future is set once the changes
+        have been committed, or with the exception if *callable*
+        raised or the commit failed."""
+        future: concurrent.futures.Future = concurrent.futures.Future()
+        with self._lock:
+            if self._closed:
+                raise ValueError("The GroupCommitWriter has been closed")
+            self._queue.put((callable, future))
+        return future
+
+    def execute(self, statements: str, bindings: apsw.Bindings | None = None) -> concurrent.futures.Future:
+        "Convenience wrapper around :meth:`submit` for a statement with bindings"
+        return self.submit(lambda con: con.execute(statements, bindings).fetchall())
+
+    def close(self) -> None:
+        "Commits outstanding submissions, then stops the writer thread and closes its connection"
+        with self._lock:
+            if self._closed:
+                return
+            self._closed = True
+            self._queue.put(None)
+        self._thread.join()
+
+    def __enter__(self) -> GroupCommitWriter:
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+    def _writer(self, database: str, setup: Callable[[apsw.Connection], None] | None, kwargs: dict[str, Any],
+                started: concurrent.futures.Future) -> None:
+        try:
+            con = apsw.Connection(database, **kwargs)
+            if setup:
+                setup(con)
+        except BaseException as exc:
+            started.set_exception(exc)
+            return
+        started.set_result(None)
+
+        done = False
+        while not done:
+            item = self._queue.get()
+            if item is None:
+                break
+            batch = [item]
+            deadline = time.monotonic() + self.max_delay
+            while len(batch) < self.max_batch:
+                try:
+                    item = self._queue.get(timeout=max(0, deadline - time.monotonic()))
+                except queue.Empty:
+                    break
+                if item is None:
+                    done = True
+                    break
+                batch.append(item)
+
+            running = [(callable, future) for callable, future in batch if future.set_running_or_notify_cancel()]
+            results: list[tuple[concurrent.futures.Future, bool, Any]] = []
+            try:
+                con.execute("BEGIN IMMEDIATE")
+                for callable, future in running:
+                    try:
+                        with con:
+                            results.append((future, True, callable(con)))
+                    except BaseException as exc:
+                        results.append((future, False, exc))
+                con.execute("COMMIT")
+                self.stats["commits"] += 1
+            except BaseException as exc:
+                try:
+                    if not con.get_autocommit():
+                        con.execute("ROLLBACK")
+                except BaseException:
+                    pass
+                results = [(future, False, exc) for _, future in running]
+
+            self.stats["submissions"] += len(results)
+            self.stats["failed"] += sum(1 for r in results if not r[1])
+            self.stats["largest_batch"] = max(self.stats["largest_batch"], len(batch))
+            for future, ok, value in results:
+                if ok:
+                    future.set_result(value)
+                else:
+                    future.set_exception(value)
+
+        con.close()
+
+
+class ConnectionCache:
+    """Keeps connections open for reuse, closing the least recently
+    used and idle ones
+
+    Opening a :class:`apsw.Connection` opens the file, and the first
+    query has to parse the schema.  When many databases are used, such
+    as one per tenant, opening a connection per request repeats that
+    work.  This cache keeps connections open keyed by *filename*,
+    *flags*, and *vfs*, so the connections stay warm including their
+    :meth:`statement caches <apsw.Connection.cache_stats>`.
+
+    A checked out connection is only used by one caller at a time, so
+    several connections can be open to the same database.  Before
+    opening a connection, the least recently used ones not checked out
+    are closed so that no more than *max_open* are open.  (It can only
+    be exceeded while more than *max_open* are checked out at once.)
+    Connections not used for *idle_timeout* seconds are closed by
+    :meth:`prune` which is also called on each checkout.
+
+    :param max_open: Most connections to keep open
+    :param idle_timeout: Seconds a connection can be unused before it
+        is closed
+    :param setup: Called with each newly opened connection, for
+        example to set pragmas
+    :param kwargs: Passed to :class:`apsw.Connection`
+
+    .. code-block:: python
+
+        cache = apsw.ext.ConnectionCache(max_open=200)
+
+        # from any thread
+        with cache.checkout(f"tenants/{tenant}.db") as con:
+            con.execute("insert into log values(?, ?)", (when, message))
+
+        cache.close()
+    """
+
+    def __init__(self,
+                 *,
+                 max_open: int = 100,
+                 idle_timeout: float = 300,
+                 setup: Callable[[apsw.Connection], None] | None = None,
+                 **kwargs):
+        if max_open < 1:
+            raise ValueError(f"max_open must be at least 1, not {max_open}")
+        self.max_open = max_open
+        self.idle_timeout = idle_timeout
+        self._setup = setup
+        self._kwargs = kwargs
+        self._lock = threading.Lock()
+        self._closed = False
+        # key is (filename, flags, vfs, id(connection)) with least
+        # recently used first, value is (connection, last used time)
+        self._idle: collections.OrderedDict[tuple, tuple[apsw.Connection, float]] = collections.OrderedDict()
+        # (filename, flags, vfs) to its keys in _idle, oldest first
+        self._available: dict[tuple, list[tuple]] = {}
+        self._in_use = 0
+        self.stats = {"hits": 0, "opens": 0, "closes": 0}
+        "Counts of checkouts using an already open connection, connections opened, and connections closed"
+
+    @contextlib.contextmanager
+    def checkout(self,
+                 filename: str,
+                 flags: int = apsw.SQLITE_OPEN_READWRITE | apsw.SQLITE_OPEN_CREATE,
+                 vfs: str | None = None) -> Iterator[apsw.Connection]:
+        """Context manager providing a connection to *filename*, returned
+        to the cache on exit
+
+        A connection left inside a transaction is rolled back when
+        returned, and one that was closed is discarded."""
+        con = self._get(filename, flags, vfs)
+        try:
+            yield con
+        finally:
+            self._put(con, (filename, flags, vfs))
+
+    def prune(self) -> None:
+        "Closes connections that have been idle longer than *idle_timeout*"
+        cutoff = time.monotonic() - self.idle_timeout
+        to_close: list[apsw.Connection] = []
+        with self._lock:
+            while self._idle and next(iter(self._idle.values()))[1] < cutoff:
+                to_close.append(self._pop_oldest())
+        self._close(to_close)
+
+    def close(self) -> None:
+        """Closes all connections not checked out, with those checked out
+        closed as they are returned"""
+        with self._lock:
+            self._closed = True
+            to_close = [con for con, _ in self._idle.values()]
+            self._idle.clear()
+            self._available.clear()
+        self._close(to_close)
+
+    def __len__(self) -> int:
+        "How many connections are open, including those checked out"
+        with self._lock:
+            return len(self._idle) + self._in_use
+
+    def __enter__(self) -> ConnectionCache:
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+    def _get(self, filename: str, flags: int, vfs: str | None) -> apsw.Connection:
+        self.prune()
+        with self._lock:
+            if self._closed:
+                raise ValueError("The ConnectionCache has been closed")
+            self._in_use += 1
+            keys = self._available.get((filename, flags, vfs))
+            if keys:
+                key = keys.pop()
+                if not keys:
+                    del self._available[key[:3]]
+                self.stats["hits"] += 1
+                return self._idle.pop(key)[0]
+            # make room before opening
+            to_close: list[apsw.Connection] = []
+            while self._idle and len(self._idle) + self._in_use > self.max_open:
+                to_close.append(self._pop_oldest())
+        self._close(to_close)
+        try:
+            con = apsw.Connection(filename, flags=flags, vfs=vfs, **self._kwargs)
+            try:
+                if self._setup:
+                    self._setup(con)
+            except BaseException:
+                con.close()
+                raise
+        except BaseException:
+            with self._lock:
+                self._in_use -= 1
+            raise
+        with self._lock:
+            self.stats["opens"] += 1
+        return con
+
+    def _put(self, con: apsw.Connection, key: tuple[str, int, str | None]) -> None:
+        to_close: list[apsw.Connection] = []
+        try:
+            if not con.get_autocommit():
+                con.execute("ROLLBACK")
+        except apsw.ConnectionClosedError:
+            with self._lock:
+                self._in_use -= 1
+            return
+        except BaseException:
+            to_close.append(con)
+        with self._lock:
+            self._in_use -= 1
+            if self._closed or to_close:
+                to_close = [con]
+            else:
+                self._idle[key + (id(con), )] = (con, time.monotonic())
+                self._available.setdefault(key, []).append(key + (id(con), ))
+            while self._idle and len(self._idle) + self._in_use > self.max_open:
+                to_close.append(self._pop_oldest())
+        self._close(to_close)
+
+    def _pop_oldest(self) -> apsw.Connection:
+        # caller must hold the lock
+        key, (con, _) = self._idle.popitem(last=False)
+        keys = self._available[key[:3]]
+        keys.pop(0)
+        if not keys:
+            del self._available[key[:3]]
+        return con
+
+    def _close(self, connections: list[apsw.Connection]) -> None:
+        for con in connections:
+            con.close()
+        if connections:
+            with self._lock:
+                self.stats["closes"] += len(connections)
+
+
 def log_sqlite(*, level: int = logging.ERROR, logger: logging.Logger | None = None) -> None:
     """Send SQLite `log messages <https://www.sqlite.org/errlog.html>`__ to :mod:`logging`
 
@@ -1485,6 +1821,255 @@ def query_info(db: apsw.Connection,
     return QueryDetails(**res)
 
 
+def index_advisor(db: apsw.Connection, queries: Iterable[str], *, schema: str = "main") -> IndexAdvice:
+    """Recommends indexes that would be used by *queries*, without
+    changing *db*.
+
+    This works the same way as the `SQLite expert extension
+    <https://sqlite.org/cli.html#index_recommendations_sqlite_expert_>`__.
+    The schema is copied into a scratch database where each table is
+    replaced by a virtual table, so that preparing each query reveals
+    which columns are constrained by equality, by range, and used for
+    ordering.  Candidate indexes are built from those, and created in
+    a second scratch database with the original schema.  Candidates
+    that appear in the query plans are recommended.  Statistics from
+    `ANALYZE <https://sqlite.org/lang_analyze.html>`__ are copied if
+    present which gives better recommendations.
+
+    A workload can be collected from the statement cache::
+
+        queries = [entry["query"] for entry in db.cache_stats(True)["entries"]]
+        advice = apsw.ext.index_advisor(db, queries)
+        for recommendation in advice.recommendations:
+            print(recommendation.sql)
+
+    Only the first statement of each query is examined.  Queries
+    using virtual tables or functions that don't exist in a plain
+    connection will have :attr:`QueryAdvice.error` set.
+    """
+    qschema = _quote_identifier(schema)
+    objects = list(
+        db.execute(f"""select type, name, tbl_name, sql from { qschema }.sqlite_schema
+                      where sql is not null and name not like 'sqlite_%'"""))
+    tables: dict[str, list[str]] = {}
+    existing: dict[str, set[tuple[str, ...]]] = {}
+    for kind, name, tbl_name, sql in objects:
+        if kind == "table" and not sql.upper().startswith("CREATE VIRTUAL"):
+            # xinfo includes generated columns
+            tables[name] = [row[0] for row in db.execute("select name from pragma_table_xinfo(?, ?)", (name, schema))]
+            existing[name] = set()
+    for table in tables:
+        for (index, ) in db.execute("select name from pragma_index_list(?, ?)", (table, schema)):
+            existing[table].add(
+                tuple(row[0] for row in db.execute("select name from pragma_index_info(?, ?)", (index, schema))))
+
+    # discover constraints using virtual tables in place of the real ones
+    # table, and list of column name, index column definition
+    usage: list[tuple[str, list[tuple[str, str]]]] = []
+
+    class Table:
+
+        def __init__(self, name: str):
+            self.name = name
+
+        def BestIndexObject(self, index_info: apsw.IndexInfo) -> bool:
+            columns = tables[self.name]
+
+            def colspec(n: int) -> tuple[str, str]:
+                collation = index_info.get_aConstraint_collation(n)
+                name = columns[index_info.get_aConstraint_iColumn(n)]
+                spec = _quote_identifier(name)
+                return name, spec if collation.upper() == "BINARY" else f"{ spec } COLLATE { collation }"
+
+            eq: list[tuple[str, str]] = []
+            rng: list[tuple[str, str]] = []
+            for n in range(index_info.nConstraint):
+                if not index_info.get_aConstraint_usable(n) or index_info.get_aConstraint_iColumn(n) < 0:
+                    continue
+                op = index_info.get_aConstraint_op(n)
+                spec = colspec(n)
+                if op in (apsw.SQLITE_INDEX_CONSTRAINT_EQ, apsw.SQLITE_INDEX_CONSTRAINT_IS):
+                    if spec not in eq:
+                        eq.append(spec)
+                elif op in (apsw.SQLITE_INDEX_CONSTRAINT_GT, apsw.SQLITE_INDEX_CONSTRAINT_GE,
+                            apsw.SQLITE_INDEX_CONSTRAINT_LT, apsw.SQLITE_INDEX_CONSTRAINT_LE):
+                    rng.append(spec)
+            rng = [r for r in rng if r[0] not in (e[0] for e in eq)]
+            if eq or rng:
+                usage.append((self.name, eq + rng[:1]))
+            order = []
+            for n in range(index_info.nOrderBy):
+                if index_info.get_aOrderBy_iColumn(n) < 0:
+                    break
+                name = columns[index_info.get_aOrderBy_iColumn(n)]
+                if name not in (e[0] for e in eq):
+                    order.append(
+                        (name, _quote_identifier(name) + (" DESC" if index_info.get_aOrderBy_desc(n) else "")))
+            else:
+                if order:
+                    usage.append((self.name, eq + order))
+            index_info.estimatedCost = 1e6
+            return True
+
+        def Disconnect(self) -> None:
+            pass
+
+        Destroy = Disconnect
+
+    class Module:
+
+        def Create(self, connection, modulename, databasename, tablename, *args):
+            return f"CREATE TABLE x({ ', '.join(_quote_identifier(c) for c in tables[tablename]) })", Table(tablename)
+
+        Connect = Create
+
+    discover = apsw.Connection("")
+    plans = apsw.Connection("")
+    try:
+        discover.create_module("index_advisor", Module(), use_bestindex_object=True)
+        for table in tables:
+            discover.execute(f"CREATE VIRTUAL TABLE { _quote_identifier(table) } USING index_advisor")
+        for kind, name, tbl_name, sql in objects:
+            if kind == "view":
+                discover.execute(sql)
+            if kind in ("table", "index", "view", "trigger") and (kind != "table" or name in tables):
+                plans.execute(sql)
+        if db.execute(f"select count(*) from { qschema }.sqlite_schema where name='sqlite_stat1'").get:
+            plans.execute("ANALYZE sqlite_schema")
+            with plans:
+                plans.executemany("insert into sqlite_stat1 values(?,?,?)",
+                                  db.execute(f"select tbl, idx, stat from { qschema }.sqlite_stat1"))
+            plans.execute("ANALYZE sqlite_schema")
+
+        advice: list[QueryAdvice] = []
+        for query in queries:
+            try:
+                _index_advisor_plan(discover, query)
+                before = _index_advisor_plan(plans, query)
+                advice.append(QueryAdvice(query=query, before=before, after=None, indexes=[], error=None))
+            except apsw.Error as e:
+                advice.append(QueryAdvice(query=query, before=None, after=None, indexes=[], error=str(e)))
+
+        # index name -> create sql, table, column names
+        candidates: dict[str, tuple[str, str, tuple[str, ...]]] = {}
+        for table, columns in usage:
+            names = tuple(c[0] for c in columns)
+            if any(index[:len(names)] == names for index in existing[table]):
+                continue
+            text = ", ".join(c[1] for c in columns)
+            name = f"{ table }_idx_{ zlib.crc32(f'{ table }({ text })'.encode('utf8')):08x}"
+            candidates[name] = (f"CREATE INDEX { _quote_identifier(name) } ON { _quote_identifier(table) }({ text })",
+                                table, names)
+        with plans:
+            for sql, _, _ in candidates.values():
+                plans.execute(sql)
+
+        used: dict[str, list[str]] = {}
+        for qa in advice:
+            if qa.error is None:
+                qa.after = _index_advisor_plan(plans, qa.query)
+                # a candidate doing the same work as an existing index isn't needed
+                if _query_plan_text(qa.before) != _query_plan_text(qa.after):
+                    qa.indexes = [name for name in _query_plan_indexes(qa.after) if name in candidates]
+                for name in qa.indexes:
+                    used.setdefault(name, []).append(qa.query)
+    finally:
+        discover.close()
+        plans.close()
+
+    return IndexAdvice(recommendations=[
+        IndexRecommendation(sql=candidates[name][0],
+                            name=name,
+                            table=candidates[name][1],
+                            columns=candidates[name][2],
+                            queries=queries) for name, queries in used.items()
+    ],
+                       queries=advice)
+
+
+def _index_advisor_plan(db: apsw.Connection, query: str) -> QueryPlan | None:
+    "Query plan binding None to all parameters"
+    try:
+        return query_info(db, query, explain_query_plan=True).query_plan
+    except apsw.BindingsError as e:
+        m = re.search(r"Statement has (\d+) bindings", str(e))
+        if not m:
+            raise
+        return query_info(db, query, (None, ) * int(m.group(1)), explain_query_plan=True).query_plan
+
+
+def _query_plan_text(plan: QueryPlan | None) -> str:
+    "Plan as text without index names"
+    if plan is None:
+        return ""
+    return re.sub(r"INDEX \S+", "INDEX", plan.detail) + "(" + ",".join(_query_plan_text(sub)
+                                                                    for sub in plan.sub or []) + ")"
+
+
+def _quote_identifier(name: str) -> str:
+    return '"' + name.replace('"', '""') + '"'
+
+
+def _query_plan_indexes(plan: QueryPlan | None) -> list[str]:
+    "Names of indexes used in the plan"
+    if plan is None:
+        return []
+    res = []
+    m = re.search(r"USING (?:COVERING )?INDEX (\S+)", plan.detail)
+    if m and m.group(1) not in res:
+        res.append(m.group(1))
+    for sub in plan.sub or []:
+        for name in _query_plan_indexes(sub):
+            if name not in res:
+                res.append(name)
+    return res
+
+
+def format_scanstatus(scanstatus: list[dict[str, Any]]) -> str:
+    """Formats scan status counters as a query plan tree
+
+    *scanstatus* comes from :meth:`Cursor.scanstatus` or the
+    ``scanstatus`` key of :meth:`Connection.trace_v2` profile events.
+    Each line is the query plan text followed by the loops, rows
+    visited, estimated rows, and cycles with the percentage of the total.
+    Use it to see which part of a slow query took the time, for example
+    by logging it from a :meth:`Connection.trace_v2` callback when
+    the ``nanoseconds`` are too high.
+
+    .. code-block:: text
+
+        QUERY PLAN (cycles=18335 [100%])
+        |--SCAN t (loops=1 rows=1000 est=1048576 cycles=16080 [88%])
+        `--USE TEMP B-TREE FOR ORDER BY (cycles=2255 [12%])
+    """
+    children: dict[int, list[dict[str, Any]]] = {}
+    for item in scanstatus:
+        children.setdefault(item["parent"], []).append(item)
+    total = sum(item["cycles"] for item in children.get(0, []) if item["cycles"] > 0)
+
+    def counters(item: dict[str, Any]) -> str:
+        res = []
+        if item["loops"] > 0 or item["visits"] > 0:
+            res.append(f"loops={ item['loops'] } rows={ item['visits'] } est={ round(item['estimated_rows']) }")
+        if total:
+            res.append(f"cycles={ item['cycles'] } [{ round(100 * item['cycles'] / total) }%]")
+        return f" ({ ' '.join(res) })" if res else ""
+
+    lines = ["QUERY PLAN" + (f" (cycles={ total } [100%])" if total else "")]
+
+    def show(parent: int, prefix: str) -> None:
+        items = children.get(parent, [])
+        for i, item in enumerate(items):
+            last = i == len(items) - 1
+            lines.append(prefix + ("`--" if last else "|--") + (item["explain"] or item["name"] or "") +
+                         counters(item))
+            if item["id"] != parent:
+                show(item["id"], prefix + ("   " if last else "|  "))
+
+    show(0, "")
+    return "\n".join(lines)
+
+
 @dataclass
 class QueryDetails:
     "A :mod:`dataclass <dataclasses>` that provides detailed information about a query, returned by :func:`query_info`"
@@ -1577,6 +2162,45 @@ class VDBEInstruction:
     "Fifth opcode parameter"
 
 
+@dataclass
+class QueryAdvice:
+    "A :mod:`dataclass <dataclasses>` with the plans for one query from :func:`index_advisor`"
+    query: str
+    "The query"
+    before: QueryPlan | None
+    "Query plan with the existing indexes"
+    after: QueryPlan | None
+    "Query plan with the existing and candidate indexes"
+    indexes: list[str]
+    "Names of recommended indexes used in the *after* plan"
+    error: str | None
+    "If the query could not be examined, the error message"
+
+
+@dataclass
+class IndexRecommendation:
+    "A :mod:`dataclass <dataclasses>` for an index recommended by :func:`index_advisor`"
+    sql: str
+    "The CREATE INDEX statement"
+    name: str
+    "Index name"
+    table: str
+    "Table being indexed"
+    columns: tuple[str, ...]
+    "Columns in the index"
+    queries: list[str]
+    "Queries that would use the index"
+
+
+@dataclass
+class IndexAdvice:
+    "A :mod:`dataclass <dataclasses>` returned by :func:`index_advisor`"
+    recommendations: list[IndexRecommendation]
+    "Indexes that would be used"
+    queries: list[QueryAdvice]
+    "Before and after plans for each query"
+
+
 @dataclass
 class DatabaseFileInfo:
     """Information about the main database file returned by :meth:`dbinfo`
@@ -0,0 +1,443 @@
+#!/usr/bin/env python3
+#
+# See the accompanying LICENSE file.
+#
+# Captures the SQL workload of a program using APSW, and replays it
+# against a database reporting latencies.
+
+from __future__ import annotations
+
+import base64
+import collections
+import dataclasses
+import hashlib
+import json
+import math
+import threading
+import time
+import sys
+
+from typing import Any, Iterator, TextIO
+
+import apsw
+
+
+def statement_hash(sql: str) -> str:
+    "Returns the hash used to group executions of the same statement"
+    return hashlib.sha1(sql.strip().encode("utf8")).hexdigest()[:16]
+
+
+def _encode_value(v: apsw.SQLiteValue) -> Any:
+    if v is None or isinstance(v, (int, float, str)):
+        return v
+    if isinstance(v, (bytes, bytearray, memoryview)):
+        return {"blob": base64.b64encode(bytes(v)).decode("ascii")}
+    if isinstance(v, apsw.zeroblob):
+        return {"zeroblob": v.length()}
+    # such as carray - replayed as the repr text
+    return {"repr": repr(v)}
+
+
+def _decode_value(v: Any) -> apsw.SQLiteValue:
+    if isinstance(v, dict):
+        if "blob" in v:
+            return base64.b64decode(v["blob"])
+        if "repr" in v:
+            return v["repr"]
+        return apsw.zeroblob(v["zeroblob"])
+    return v
+
+
+def _encode_bindings(bindings: apsw.Bindings | None) -> Any:
+    if bindings is None:
+        return None
+    if isinstance(bindings, dict):
+        return {k: _encode_value(v) for k, v in bindings.items()}
+    return [_encode_value(v) for v in bindings]
+
+
+def _decode_bindings(bindings: Any) -> apsw.Bindings | None:
+    if bindings is None:
+        return None
+    if isinstance(bindings, dict):
+        return {k: _decode_value(v) for k, v in bindings.items()}
+    return tuple(_decode_value(v) for v in bindings)
+
+
+@dataclasses.dataclass
+class Execution:
+    "One captured statement execution"
+    seq: int
+    "Order the execution was captured in"
+    start: float
+    "Seconds since the start of capture"
+    connection: int
+    "Identifies the connection"
+    thread: int
+    "Identifies the thread"
+    sql: str
+    "The statement text"
+    bindings: apsw.Bindings | None
+    "Bindings used"
+    nanoseconds: int | None = None
+    "How long the original execution took, if it completed"
+
+
+@dataclasses.dataclass
+class Workload:
+    "A captured workload"
+    connections: dict[int, str]
+    "Connection id to database filename"
+    executions: list[Execution]
+    "Executions in start order"
+
+    @classmethod
+    def load(cls, filename: str) -> Workload:
+        """Loads a capture made by :class:`Capture`, or a recording
+        made by :class:`apsw.TraceRecorder`"""
+        with open(filename, "rb") as f:
+            magic = f.read(8)
+        if magic == b"APSWTRC1":
+            return cls._load_trace_recording(filename)
+
+        connections: dict[int, str] = {}
+        executions: dict[int, Execution] = {}
+        with open(filename, "rt", encoding="utf8") as f:
+            for line in f:
+                event = json.loads(line)
+                if event["event"] == "open":
+                    connections[event["connection"]] = event["filename"]
+                elif event["event"] == "exec":
+                    executions[event["seq"]] = Execution(seq=event["seq"],
+                                                         start=event["start"],
+                                                         connection=event["connection"],
+                                                         thread=event["thread"],
+                                                         sql=event["sql"],
+                                                         bindings=_decode_bindings(event["bindings"]))
+                elif event["event"] == "done":
+                    if event["seq"] in executions:
+                        executions[event["seq"]].nanoseconds = event["nanoseconds"]
+        return cls(connections, sorted(executions.values(), key=lambda e: (e.start, e.seq)))
+
+    @classmethod
+    def _load_trace_recording(cls, filename: str) -> Workload:
+        import apsw.trace
+        connections: dict[int, str] = {}
+        executions: list[Execution] = []
+        for record in apsw.trace.read_trace_recording(filename):
+            if record["type"] == "open":
+                connections[record["connection"]] = record["filename"]
+            elif record["type"] == "exec" and record["sql"] is not None:
+                executions.append(
+                    Execution(seq=len(executions),
+                              start=record["start"],
+                              connection=record["connection"],
+                              thread=record["thread"],
+                              sql=record["sql"],
+                              bindings=record["bindings"],
+                              nanoseconds=record["nanoseconds"]))
+        if executions:
+            base = min(e.start for e in executions)
+            for e in executions:
+                e.start -= base
+        executions.sort(key=lambda e: (e.start, e.seq))
+        return cls(connections, executions)
+
+
+class Capture:
+    """Captures all SQL executed on :class:`connections <apsw.Connection>`
+    opened after it is created, writing to *output*.
+
+    The :attr:`exec tracer <apsw.Connection.exec_trace>` records each
+    statement with its bindings, connection and thread as it starts,
+    and :meth:`~apsw.Connection.trace_v2` profiling records how long
+    it took when it completes.  Both replace any tracers the program
+    sets on the connections.  Call :meth:`close` when done.
+    """
+
+    def __init__(self, output: str | TextIO):
+        self.out: TextIO = open(output, "wt", encoding="utf8") if isinstance(output, str) else output
+        self.lock = threading.Lock()
+        self.start = time.monotonic()
+        self.seq = 0
+        self.connection_ids: dict[int, int] = {}
+        # (connection, stripped sql) -> seq of executions awaiting profile
+        self.pending: dict[tuple[int, str], collections.deque[int]] = collections.defaultdict(collections.deque)
+        apsw.connection_hooks.append(self.connection_hook)
+
+    def _write(self, event: dict) -> None:
+        self.out.write(json.dumps(event) + "\n")
+
+    def connection_hook(self, con: apsw.Connection) -> None:
+        with self.lock:
+            cid = self.connection_ids[id(con)] = len(self.connection_ids) + 1
+            self._write({"event": "open", "connection": cid, "filename": con.filename})
+        con.exec_trace = self.exec_tracer
+        con.trace_v2(apsw.SQLITE_TRACE_PROFILE, self.profile)
+
+    def exec_tracer(self, cursor: apsw.Cursor | apsw.Connection, sql: str, bindings: apsw.Bindings | None) -> bool:
+        # capture problems must never stop the program's statement
+        try:
+            con = cursor if isinstance(cursor, apsw.Connection) else cursor.connection
+            start = time.monotonic() - self.start
+            try:
+                encoded = _encode_bindings(bindings)
+                json.dumps(encoded)
+            except Exception:
+                encoded = None
+            with self.lock:
+                cid = self.connection_ids.get(id(con))
+                if cid is None:
+                    return True
+                self.seq += 1
+                self.pending[(cid, sql.strip())].append(self.seq)
+                self._write({
+                    "event": "exec",
+                    "seq": self.seq,
+                    "start": start,
+                    "connection": cid,
+                    "thread": threading.get_ident(),
+                    "sql": sql,
+                    "bindings": encoded
+                })
+        except Exception:
+            pass
+        return True
+
+    def profile(self, event: dict) -> None:
+        with self.lock:
+            cid = self.connection_ids.get(id(event["connection"]))
+            pending = self.pending.get((cid, event["sql"].strip()))
+            if pending:
+                self._write({"event": "done", "seq": pending.popleft(), "nanoseconds": event["nanoseconds"]})
+
+    def close(self) -> None:
+        "Stops capturing and closes the output"
+        if self.connection_hook in apsw.connection_hooks:
+            apsw.connection_hooks.remove(self.connection_hook)
+        with self.lock:
+            self.out.close()
+
+
+@dataclasses.dataclass
+class StatementLatency:
+    "Latencies for one statement hash"
+    sql: str
+    "Statement text"
+    count: int
+    "How many times it was executed"
+    errors: int
+    "How many executions raised an exception"
+    p50: float
+    "Median latency in seconds"
+    p90: float
+    "90th percentile latency in seconds"
+    p99: float
+    "99th percentile latency in seconds"
+    max: float
+    "Longest latency in seconds"
+    total: float
+    "Total time in seconds"
+
+
+@dataclasses.dataclass
+class ReplayResult:
+    "Results of :func:`replay`"
+    elapsed: float
+    "Wall clock seconds for the whole replay"
+    executions: int
+    "Number of statements executed"
+    errors: int
+    "Number of statements that raised an exception"
+    statements: dict[str, StatementLatency]
+    "Latencies keyed by :func:`statement_hash`"
+    original: dict[str, StatementLatency]
+    "Latencies from the capture, where known"
+
+
+def _percentile(values: list[float], pct: float) -> float:
+    "Nearest rank percentile of sorted values"
+    if not values:
+        return 0.0
+    rank = max(0, min(len(values) - 1, math.ceil(pct / 100 * len(values)) - 1))
+    return values[rank]
+
+
+def _latencies(by_hash: dict[str, list[float]], sql: dict[str, str], errors: dict[str, int]) -> dict[str, StatementLatency]:
+    res = {}
+    for h, values in by_hash.items():
+        values.sort()
+        res[h] = StatementLatency(sql=sql[h],
+                                  count=len(values),
+                                  errors=errors.get(h, 0),
+                                  p50=_percentile(values, 50),
+                                  p90=_percentile(values, 90),
+                                  p99=_percentile(values, 99),
+                                  max=values[-1] if values else 0.0,
+                                  total=sum(values))
+    return res
+
+
+def replay(workload: Workload,
+           database: str | None = None,
+           *,
+           paced: bool = True,
+           speed: float = 1.0,
+           flags: int = apsw.SQLITE_OPEN_READWRITE | apsw.SQLITE_OPEN_CREATE) -> ReplayResult:
+    """Re-executes a :class:`Workload`, returning latencies per statement.
+
+    Each original thread is replayed in its own thread, executing its
+    statements in the original order on a new connection for each
+    original connection.  You should replay against a copy of the
+    database because changes are made.
+
+    :param database: Filename used for all connections.  If *None*
+        then each connection uses the filename it was captured with.
+    :param paced: If True each statement starts at the same offset
+        from the beginning as it did originally (divided by *speed*).
+        If False statements are issued as fast as possible.  Either
+        way statements start in the same order they originally did, so
+        work in one thread depending on another is not run too early.
+    :param speed: Speedup factor when *paced*
+    :param flags: Flags used to open connections
+    """
+    connections: dict[int, apsw.Connection] = {}
+    conlock = threading.Lock()
+
+    def get_connection(cid: int) -> apsw.Connection:
+        with conlock:
+            if cid not in connections:
+                con = apsw.Connection(database if database is not None else workload.connections.get(cid, ""),
+                                      flags=flags)
+                con.set_busy_timeout(60000)
+                connections[cid] = con
+            return connections[cid]
+
+    by_thread: dict[int, list[tuple[int, Execution]]] = collections.defaultdict(list)
+    for i, e in enumerate(workload.executions):
+        by_thread[e.thread].append((i, e))
+
+    # next execution index allowed to start
+    started = 0
+    order = threading.Condition()
+
+    sql: dict[str, str] = {}
+    results: dict[str, list[float]] = collections.defaultdict(list)
+    errors: dict[str, int] = collections.defaultdict(int)
+    original: dict[str, list[float]] = collections.defaultdict(list)
+    for e in workload.executions:
+        h = statement_hash(e.sql)
+        sql.setdefault(h, e.sql.strip())
+        if e.nanoseconds is not None:
+            original[h].append(e.nanoseconds / 1000000000.0)
+
+    reslock = threading.Lock()
+    start = time.monotonic()
+
+    def run(executions: list[tuple[int, Execution]]) -> None:
+        nonlocal started
+        for i, e in executions:
+            if paced:
+                delay = start + e.start / speed - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+            with order:
+                order.wait_for(lambda: started == i)
+                started += 1
+                order.notify_all()
+            h = statement_hash(e.sql)
+            t = time.perf_counter()
+            failed = False
+            try:
+                con = get_connection(e.connection)
+                for _ in con.execute(e.sql, e.bindings):
+                    pass
+            except BaseException:
+                failed = True
+            t = time.perf_counter() - t
+            with reslock:
+                results[h].append(t)
+                if failed:
+                    errors[h] += 1
+
+    threads = [threading.Thread(target=run, args=(executions, )) for executions in by_thread.values()]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    for con in connections.values():
+        con.close()
+
+    return ReplayResult(elapsed=elapsed,
+                        executions=sum(len(v) for v in results.values()),
+                        errors=sum(errors.values()),
+                        statements=_latencies(results, sql, errors),
+                        original=_latencies(original, sql, {}))
+
+
+def format_result(result: ReplayResult, width: int = 60) -> str:
+    "Returns the result as a text report"
+    out = []
+    out.append(f"Executions {result.executions}  errors {result.errors}  elapsed {result.elapsed:.3f}s  "
+               f"throughput {result.executions / result.elapsed if result.elapsed else 0:.1f}/s")
+    out.append("")
+    out.append(f"{'hash':16} {'count':>7} {'err':>5} {'p50 ms':>9} {'p90 ms':>9} {'p99 ms':>9} {'max ms':>9} "
+               f"{'orig p50':>9} sql")
+    for h, s in sorted(result.statements.items(), key=lambda kv: -kv[1].total):
+        orig = result.original.get(h)
+        text = " ".join(s.sql.split())
+        if len(text) > width:
+            text = text[:width - 2] + ".."
+        out.append(f"{h:16} {s.count:7} {s.errors:5} {s.p50*1000:9.3f} {s.p90*1000:9.3f} {s.p99*1000:9.3f} "
+                   f"{s.max*1000:9.3f} {(orig.p50*1000 if orig else float('nan')):9.3f} {text}")
+    return "\n".join(out) + "\n"
+
+
+def main() -> None:
+    import argparse
+    import os
+    import runpy
+
+    parser = argparse.ArgumentParser(prog="python3 -m apsw.replay",
+                                     description="Capture the SQL workload of a program using APSW, "
+                                     "and replay it reporting latency per statement")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("capture", help="Run a Python program capturing its workload")
+    p.add_argument("-o", "--output", default="workload.jsonl", help="Capture file [%(default)s]")
+    p.add_argument("script", help="Python script to run")
+    p.add_argument("args", nargs=argparse.REMAINDER, help="Arguments for the script")
+
+    p = sub.add_parser("run", help="Replay a capture (or TraceRecorder file) and report latencies")
+    p.add_argument("--database",
+                   help="Database to replay against instead of the captured filenames.  Use a copy!")
+    p.add_argument("--fast", action="store_true", help="Don't pace statements, issue them as fast as possible")
+    p.add_argument("--speed", type=float, default=1.0, help="Speedup factor when pacing [%(default)s]")
+    p.add_argument("--json", metavar="FILE", help="Also write results as JSON to FILE")
+    p.add_argument("capture", help="Capture file")
+
+    options = parser.parse_args()
+
+    if options.command == "capture":
+        if not os.path.exists(options.script):
+            parser.error(f"Unable to find script { options.script }")
+        capture = Capture(options.output)
+        sys.argv = [options.script] + options.args
+        sys.path[0] = os.path.split(os.path.abspath(options.script))[0]
+        try:
+            runpy.run_path(options.script, run_name="__main__")
+        finally:
+            capture.close()
+        return
+
+    result = replay(Workload.load(options.capture), options.database, paced=not options.fast, speed=options.speed)
+    sys.stdout.write(format_result(result))
+    if options.json:
+        with open(options.json, "wt", encoding="utf8") as f:
+            json.dump(dataclasses.asdict(result), f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -14,13 +14,79 @@ import time
 import gc
 import argparse
 import statistics
+import json
+import threading
+import tempfile
 
 timerfn = time.process_time
 
+# tests that were modelled on speedtest.tcl
+classic_tests = ("bigstmt", "statements", "statements_nobindings")
+# tests that need a database file, using a temporary one if necessary
+file_tests = ("vfs", "concurrent")
+# tests only available for APSW
+apsw_only_tests = ("vtable", "vfs")
+all_tests = classic_tests + ("executemany", "bulkfetch", "textscan", "udf", "errors", "transactions", "vtable", "vfs",
+                             "concurrent")
+
+
+def percentile(values, pct):
+    "Nearest rank percentile of sorted values"
+    if not values:
+        return 0
+    return values[max(0, min(len(values) - 1, int(pct / 100 * len(values) + 0.5) - 1))]
+
+
+def latency_summary(values):
+    "Returns count and percentiles of latencies in nanoseconds"
+    values = sorted(values)
+    return {
+        "count": len(values),
+        "p50": percentile(values, 50),
+        "p99": percentile(values, 99),
+        "p999": percentile(values, 99.9),
+        "max": values[-1] if values else 0
+    }
+
+
+def compare(old, new, threshold):
+    """Compares two JSON results files, returning lines of text and
+    how many regressions there were"""
+    lines = []
+    regressions = 0
+    metrics = []
+    for name in sorted(set(old["results"]) & set(new["results"])):
+        o, n = old["results"][name], new["results"][name]
+        metrics.append((name, "elapsed", o["elapsed"], n["elapsed"]))
+        metrics.append((name, "cpu", o["cpu"], n["cpu"]))
+        for op in sorted(set(o["latency"]) & set(n["latency"])):
+            for pct in ("p50", "p99", "p999"):
+                metrics.append((name + (f":{ op }" if op else ""), pct, o["latency"][op][pct] / 1000,
+                                n["latency"][op][pct] / 1000))
+    w = max([len(m[0]) for m in metrics] + [4])
+    lines.append(f"{ 'test':{ w }}  metric  {'old':>12} {'new':>12} {'change':>8}")
+    for name, metric, o, n in metrics:
+        change = (n - o) / o * 100 if o else 0.0
+        flag = ""
+        if change > threshold:
+            flag = "REGRESSION"
+            regressions += 1
+        elif change < -threshold:
+            flag = "improved"
+        lines.append(f"{ name:{ w }}  { metric:7} { o:12.3f} { n:12.3f} { change:+7.1f}% { flag }".rstrip())
+    for name in sorted(set(old["results"]) ^ set(new["results"])):
+        lines.append(f"{ name } only present in { 'old' if name in old['results'] else 'new' }")
+    lines.append("")
+    lines.append(f"{ regressions } regression(s) beyond { threshold }%.  "
+                 "Elapsed and cpu are in seconds, percentiles in microseconds.")
+    return lines, regressions
+
 
 def doit():
     random.seed(0)
     options.tests = [t.strip() for t in options.tests.split(",")]
+    if options.tests == ["all"]:
+        options.tests = list(all_tests)
 
     print("         Python", sys.executable, sys.version_info)
     print("          Scale", options.scale)
@@ -29,6 +95,7 @@ def doit():
     print("          Tests", ", ".join(options.tests))
     print("     Iterations", options.iterations)
     print("Statement Cache", options.scsize)
+    print("        Threads", options.threads, "readers,", options.writers, "writers")
 
     print("\n")
     if options.apsw:
@@ -39,6 +106,8 @@ def doit():
         print("       SQLite lib version ", apsw.sqlite_lib_version())
         print("   SQLite headers version ", apsw.SQLITE_VERSION_NUMBER, end="\n\n")
 
+        apsw.augment_tracebacks(options.augment_tracebacks)
+
         def apsw_setup(dbfile):
             con = apsw.Connection(dbfile, statementcachesize=options.scsize, vfs=options.vfs)
             con.create_scalar_function("number_name", number_name, 1)
@@ -291,6 +360,8 @@ def doit():
                 continue
 
             for test in options.tests:
+                if test not in classic_tests:
+                    continue
                 name = driver + "_" + test
 
                 print(name + '\t')
@@ -367,16 +438,24 @@ def doit():
     def apsw_statements(con, bindings=withbindings):
         "APSW individual statements with bindings"
         cursor = con.cursor()
+        latencies = []
         for b in bindings:
+            t = time.perf_counter_ns()
             for row in cursor.execute(*b):
                 pass
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
 
     def sqlite3_statements(con, bindings=withbindings):
         "sqlite3 individual statements with bindings"
         cursor = con.cursor()
+        latencies = []
         for b in bindings:
+            t = time.perf_counter_ns()
             for row in cursor.execute(*b):
                 pass
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
 
     def apsw_statements_nobindings(con):
         "APSW individual statements without bindings"
@@ -386,12 +465,251 @@ def doit():
         "sqlite3 individual statements without bindings"
         return sqlite3_statements(con, withoutbindings)
 
+    # The remaining tests use the same table, and return latencies in
+    # nanoseconds of each operation.  The same code works with both
+    # drivers except where noted.
+
+    rows = None
+    if set(options.tests) - set(classic_tests):
+        random.seed(0)
+        rows = [(i, random.randint(0, 500000), number_name(i)) for i in range(options.scale * 10000)]
+
+    def fill(con):
+        cursor = con.cursor()
+        cursor.execute("CREATE TABLE t(a INTEGER PRIMARY KEY, b INTEGER, c TEXT)")
+        cursor.execute("BEGIN")
+        cursor.executemany("INSERT INTO t VALUES(?,?,?)", rows)
+        cursor.execute("COMMIT")
+
+    def executemany(con):
+        cursor = con.cursor()
+        cursor.execute("CREATE TABLE t(a INTEGER PRIMARY KEY, b INTEGER, c TEXT)")
+        latencies = []
+        for i in range(0, len(rows), 1000):
+            t = time.perf_counter_ns()
+            cursor.execute("BEGIN")
+            cursor.executemany("INSERT INTO t VALUES(?,?,?)", rows[i:i + 1000])
+            cursor.execute("COMMIT")
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def bulkfetch(con):
+        fill(con)
+        cursor = con.cursor()
+        latencies = []
+        for i in range(10):
+            t = time.perf_counter_ns()
+            cursor.execute("SELECT * FROM t").fetchall()
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def textscan(con):
+        fill(con)
+        cursor = con.cursor()
+        latencies = []
+        for i in range(10):
+            t = time.perf_counter_ns()
+            cursor.execute("SELECT c, upper(c), c || ' and ' || c, substr(c, 1, 5) FROM t").fetchall()
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def udf(con):
+        fill(con)
+        cursor = con.cursor()
+        latencies = []
+        for i in range(0, len(rows), 1000):
+            t = time.perf_counter_ns()
+            cursor.execute("SELECT sum(length(number_name(b))) FROM t WHERE a BETWEEN ? AND ?", (i, i + 999)).fetchall()
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def errors(con):
+        fill(con)
+        cursor = con.cursor()
+        rng = random.Random(0)
+        latencies = []
+        for i in range(options.scale * 100):
+            t = time.perf_counter_ns()
+            # each insert fails with a constraint error
+            for j in range(10):
+                try:
+                    cursor.execute("INSERT INTO t VALUES(?,?,?)", rows[rng.randrange(len(rows))])
+                except Exception:
+                    pass
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def transactions(con, begin, end):
+        fill(con)
+        cursor = con.cursor()
+        rng = random.Random(0)
+        latencies = []
+        for i in range(options.scale * 1000):
+            t = time.perf_counter_ns()
+            begin(0)
+            cursor.execute("UPDATE t SET b=? WHERE a=?", (rng.randint(0, 500000), rng.randrange(len(rows))))
+            begin(1)
+            cursor.execute("UPDATE t SET b=? WHERE a=?", (rng.randint(0, 500000), rng.randrange(len(rows))))
+            end(1)
+            end(0)
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def concurrent(con, setup):
+        fill(con)
+        con.cursor().execute("PRAGMA journal_mode=WAL").fetchall()
+        latencies = {"read": [], "write": []}
+        errors = []
+        lock = threading.Lock()
+        operations = options.scale * 200
+
+        def worker(kind, seed):
+            try:
+                rng = random.Random(seed)
+                db = setup(dbfile)
+                cursor = db.cursor()
+                cursor.execute("PRAGMA busy_timeout=60000").fetchall()
+                lat = []
+                if kind == "read":
+                    for i in range(operations):
+                        t = time.perf_counter_ns()
+                        cursor.execute("SELECT c FROM t WHERE a=?", (rng.randrange(len(rows)), )).fetchall()
+                        lat.append(time.perf_counter_ns() - t)
+                else:
+                    # each write is a transaction of 10 updates
+                    for i in range(operations // 10):
+                        t = time.perf_counter_ns()
+                        cursor.execute("BEGIN IMMEDIATE")
+                        for j in range(10):
+                            cursor.execute("UPDATE t SET b=? WHERE a=?",
+                                           (rng.randint(0, 500000), rng.randrange(len(rows))))
+                        cursor.execute("COMMIT")
+                        lat.append(time.perf_counter_ns() - t)
+                db.close()
+                with lock:
+                    latencies[kind].extend(lat)
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=worker, args=("read", i)) for i in range(options.threads)]
+        threads.extend(
+            threading.Thread(target=worker, args=("write", -1 - i)) for i in range(options.writers))
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if errors:
+            raise errors[0]
+        return latencies
+
+    def apsw_executemany(con):
+        "APSW executemany inserts in batches of 1,000"
+        return executemany(con)
+
+    def sqlite3_executemany(con):
+        "sqlite3 executemany inserts in batches of 1,000"
+        return executemany(con)
+
+    def apsw_bulkfetch(con):
+        "APSW fetchall of the whole table"
+        return bulkfetch(con)
+
+    def sqlite3_bulkfetch(con):
+        "sqlite3 fetchall of the whole table"
+        return bulkfetch(con)
+
+    def apsw_textscan(con):
+        "APSW fetchall of text columns"
+        return textscan(con)
+
+    def sqlite3_textscan(con):
+        "sqlite3 fetchall of text columns"
+        return textscan(con)
+
+    def apsw_udf(con):
+        "APSW scalar Python function calls"
+        return udf(con)
+
+    def sqlite3_udf(con):
+        "sqlite3 scalar Python function calls"
+        return udf(con)
+
+    def apsw_errors(con):
+        "APSW inserts failing with constraint errors, 10 per operation"
+        return errors(con)
+
+    def sqlite3_errors(con):
+        "sqlite3 inserts failing with constraint errors, 10 per operation"
+        return errors(con)
+
+    def apsw_transactions(con):
+        "APSW nested transactions using the connection as a context manager"
+        return transactions(con, lambda level: con.__enter__(), lambda level: con.__exit__(None, None, None))
+
+    def sqlite3_transactions(con):
+        "sqlite3 nested transactions using SAVEPOINT and RELEASE"
+        cursor = con.cursor()
+        return transactions(con, lambda level: cursor.execute(f"SAVEPOINT sp{ level }"),
+                            lambda level: cursor.execute(f"RELEASE sp{ level }"))
+
+    def apsw_vtable(con):
+        "APSW scans of a Python virtual table"
+        import apsw.ext
+
+        def vtrows():
+            return rows
+
+        vtrows.columns = ("a", "b", "c")
+        vtrows.column_access = apsw.ext.VTColumnAccess.By_Index
+        apsw.ext.make_virtual_module(con, "speedtest_rows", vtrows)
+        latencies = []
+        for i in range(10):
+            t = time.perf_counter_ns()
+            con.execute("SELECT count(*), sum(b), max(length(c)) FROM speedtest_rows").fetchall()
+            latencies.append(time.perf_counter_ns() - t)
+        return latencies
+
+    def apsw_vfs(con):
+        "APSW random lookups through a Python VFS with a small cache"
+        if "speedtest_passthru" not in apsw.vfs_names():
+
+            class passthru(apsw.VFS):
+
+                def __init__(self):
+                    super().__init__("speedtest_passthru", "")
+
+                def xOpen(self, name, flags):
+                    return apsw.VFSFile("", name, flags)
+
+            doit.vfs = passthru()
+        fill(con)
+        db = apsw.Connection(dbfile, vfs="speedtest_passthru", statementcachesize=options.scsize)
+        db.execute("PRAGMA cache_size=-64")
+        rng = random.Random(0)
+        latencies = []
+        for i in range(options.scale * 1000):
+            t = time.perf_counter_ns()
+            db.execute("SELECT c FROM t WHERE a=?", (rng.randrange(len(rows)), )).fetchall()
+            latencies.append(time.perf_counter_ns() - t)
+        db.close()
+        return latencies
+
+    def apsw_concurrent(con):
+        "APSW concurrent readers and writers"
+        return concurrent(con, apsw_setup)
+
+    def sqlite3_concurrent(con):
+        "sqlite3 concurrent readers and writers"
+        return concurrent(con, sqlite3_setup)
+
     # Do the work
     print("\nRunning tests ", end="", flush=True)
     if options.showruns:
         print("- elapsed, CPU (in seconds, lower is better)\n")
 
     timings = {}
+    latencies = {}
+    tempdb = os.path.join(tempfile.gettempdir(), f"apsw-speedtest-{ os.getpid() }.db")
 
     for i in range(options.iterations):
         if options.showruns:
@@ -405,21 +723,27 @@ def doit():
                     name = driver + "_" + test
                     func = locals().get(name, None)
                     if not func:
+                        if driver != "apsw" and test in apsw_only_tests:
+                            continue
                         sys.exit("No such test " + name + "\n")
                     if driver not in timings:
                         timings[driver] = {}
                     if test not in timings[driver]:
                         timings[driver][test] = []
 
-                    if os.path.exists(options.database):
-                        os.remove(options.database)
+                    dbfile = options.database
+                    if test in file_tests and dbfile in (":memory:", ""):
+                        dbfile = tempdb
+                    for suffix in ("", "-wal", "-shm"):
+                        if os.path.exists(dbfile + suffix):
+                            os.remove(dbfile + suffix)
                     if options.showruns:
                         print("\t" + func.__name__ + (" " * (40 - len(func.__name__))), end="")
-                    con = locals().get(driver + "_setup")(options.database)
+                    con = locals().get(driver + "_setup")(dbfile)
                     gc.collect(2)
                     b4cpu = timerfn()
                     b4 = time.time()
-                    func(con)
+                    res = func(con)
                     con.close()  # see note above as to why we include this in the timing
                     gc.collect(2)
                     after = time.time()
@@ -427,14 +751,22 @@ def doit():
                     if options.showruns:
                         print("%0.3f %0.3f" % (after - b4, aftercpu - b4cpu))
                     timings[driver][test].append((after - b4, aftercpu - b4cpu))
+                    if res is not None:
+                        for op, values in (res.items() if isinstance(res, dict) else (("", res), )):
+                            latencies.setdefault(name, {}).setdefault(op, []).extend(values)
+
+    for suffix in ("", "-wal", "-shm"):
+        if os.path.exists(tempdb + suffix):
+            os.remove(tempdb + suffix)
 
     vals = []
     for driver in timings.keys():
         for test in timings[driver].keys():
             elapsed = [t[0] for t in timings[driver][test]]
             cpu = [t[1] for t in timings[driver][test]]
-            vals.append((test, driver, f"{ driver }_{ test }", statistics.median(elapsed), statistics.stdev(elapsed),
-                         statistics.median(cpu), statistics.stdev(cpu)))
+            vals.append((test, driver, f"{ driver }_{ test }", statistics.median(elapsed),
+                         statistics.stdev(elapsed) if len(elapsed) > 1 else 0.0, statistics.median(cpu),
+                         statistics.stdev(cpu) if len(cpu) > 1 else 0.0))
 
     print("\nMedian (standard deviation) for elapsed, CPU time - in seconds, lower is better\n")
     vals.sort()
@@ -443,6 +775,52 @@ def doit():
         print(v[2], " " * (w - len(v[2])), "\t%0.3f (%0.3f)\t%0.3f (%0.3f)" % v[3:])
     print()
 
+    summaries = {
+        name: {op: latency_summary(values)
+               for op, values in ops.items()}
+        for name, ops in latencies.items()
+    }
+
+    if summaries:
+        print("Latency per operation across all iterations - in microseconds, lower is better\n")
+        lines = [(name + (f":{ op }" if op else ""), s) for name, ops in sorted(summaries.items())
+                 for op, s in sorted(ops.items())]
+        w = max(len(l[0]) for l in lines)
+        print(" " * w, "\t   count         p50         p99        p999")
+        for label, s in lines:
+            print(label, " " * (w - len(label)), "\t%8d %11.1f %11.1f %11.1f" %
+                  (s["count"], s["p50"] / 1000, s["p99"] / 1000, s["p999"] / 1000))
+        print()
+
+    if options.json:
+        out = {
+            "python": sys.version,
+            "options": {
+                k: getattr(options, k)
+                for k in ("scale", "database", "vfs", "iterations", "scsize", "unicode", "size", "sqlite_cache_mb",
+                          "threads", "writers", "tests")
+            },
+            "results": {
+                v[2]: {
+                    "driver": v[1],
+                    "test": v[0],
+                    "elapsed": v[3],
+                    "elapsed_stdev": v[4],
+                    "cpu": v[5],
+                    "cpu_stdev": v[6],
+                    "latency": summaries.get(v[2], {})
+                }
+                for v in vals
+            }
+        }
+        if options.apsw:
+            out["apsw_version"] = apsw.apsw_version()
+            out["apsw_sqlite_version"] = apsw.sqlite_lib_version()
+        if options.sqlite3:
+            out["sqlite3_sqlite_version"] = sqlite3.sqlite_version
+        with open(options.json, "wt", encoding="utf8") as f:
+            json.dump(out, f, indent=2)
+
 
 parser = argparse.ArgumentParser(prog="apsw.speedtest", description="Tests performance of apsw and sqlite3 packages")
 parser.add_argument("--apsw",
@@ -470,8 +848,8 @@ parser.add_argument(
 parser.add_argument("--database", dest="database", default=":memory:", help="The database file to use [%(default)s]")
 parser.add_argument("--tests",
                     dest="tests",
-                    default="bigstmt,statements,statements_nobindings",
-                    help="What tests to run [%(default)s]")
+                    default=",".join(classic_tests),
+                    help=f"What tests to run, comma separated from { ', '.join(all_tests) } or all [%(default)s]")
 parser.add_argument("--iterations",
                     dest="iterations",
                     default=4,
@@ -505,6 +883,11 @@ parser.add_argument(
     default=0,
     metavar="SIZE",
     help="Duplicate the ~50 byte text column value up to this many times (amount randomly selected per row)")
+parser.add_argument("--no-augment-tracebacks",
+                    dest="augment_tracebacks",
+                    action="store_false",
+                    default=True,
+                    help="Turn off APSW augmented tracebacks, which is most visible in the errors test")
 parser.add_argument("--hide-runs",
                     dest="showruns",
                     action="store_false",
@@ -521,6 +904,26 @@ parser.add_argument(
     default=2,
     dest="sqlite_cache_mb",
     help="Size of the SQLite in memory cache in megabytes.  Working data outside of this size causes disk I/O. [%(default)s]")
+parser.add_argument("--threads",
+                    type=int,
+                    default=4,
+                    metavar="N",
+                    help="How many reader threads in the concurrent test [%(default)s]")
+parser.add_argument("--writers",
+                    type=int,
+                    default=1,
+                    metavar="N",
+                    help="How many writer threads in the concurrent test [%(default)s]")
+parser.add_argument("--json", metavar="FILENAME", help="Also write results to FILENAME as JSON")
+parser.add_argument("--compare",
+                    nargs=2,
+                    metavar=("OLD", "NEW"),
+                    help="Compare two JSON results files showing regressions.  (Does not run the tests)")
+parser.add_argument("--threshold",
+                    type=float,
+                    default=10,
+                    metavar="PERCENT",
+                    help="Percentage change that is flagged when comparing [%(default)s]")
 tests_detail = """\
 bigstmt:
 
@@ -555,6 +958,54 @@ statements_nobindings:
   In theory all the tests above should run in almost identical time
   as well as when using the SQLite command line shell.  This tool
   shows you what happens in practise.
+
+The following tests use a table of scale * 10,000 rows, and also
+report latency percentiles for each operation.  Filling the table is
+included in the elapsed and CPU times.
+
+executemany:
+
+  Inserts the rows using executemany in transactions of 1,000 rows.
+
+bulkfetch:
+
+  Uses fetchall to get the whole table.
+
+textscan:
+
+  Uses fetchall to get several text values from each row of the whole
+  table.
+
+udf:
+
+  Calls a Python scalar function on every row, 1,000 rows per query.
+
+errors:
+
+  Inserts rows with existing primary keys so every statement fails
+  with a constraint error, measuring the error path.  Use
+  --no-augment-tracebacks to compare without augmented tracebacks.
+
+transactions:
+
+  Small nested transactions each updating two random rows.  apsw uses
+  the connection as a context manager which issues the savepoints,
+  while sqlite3 runs SAVEPOINT and RELEASE statements.
+
+vtable:
+
+  Scans a virtual table implemented in Python.  (APSW only)
+
+vfs:
+
+  Random single row lookups through a Python VFS with a 64kb page
+  cache, so most lookups do I/O.  (APSW only)
+
+concurrent:
+
+  Reader threads do random single row lookups while writer threads do
+  transactions of 10 random updates, in WAL mode.  Read and write
+  latencies are reported separately.
     \n"""
 
 if __name__ == "__main__":
@@ -564,6 +1015,12 @@ if __name__ == "__main__":
         print(tests_detail)
         sys.exit(0)
 
+    if options.compare:
+        old, new = (json.load(open(fname, "rt", encoding="utf8")) for fname in options.compare)
+        lines, regressions = compare(old, new, options.threshold)
+        print("\n".join(lines))
+        sys.exit(1 if regressions else 0)
+
     if not options.apsw and not options.sqlite3 and not options.dump_filename:
         parser.error("You should select at least one of --apsw or --sqlite3 or --dump-sql")
 
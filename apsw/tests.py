@@ -37,6 +37,7 @@ import time
 import traceback
 import typing
 import warnings
+import weakref
 
 
 def ShouldFault(name, pending_exception):
@@ -687,6 +688,67 @@ class APSW(unittest.TestCase):
         db2.cursor_factory = big
         del big
 
+    def testDefaultCursor(self):
+        "Test default cursors and dependent tracking"
+        db = apsw.Connection("")
+        # a new cursor must not share state with a previous one
+        cur = db.cursor()
+        cur.exec_trace = lambda *args: True
+        cur.execute("select 3")
+        wr = weakref.ref(cur)
+        del cur
+        self.assertIsNone(wr())
+        for i in range(10):
+            cur = db.cursor()
+            self.assertIsNone(cur.exec_trace)
+            self.assertIsNone(cur.row_trace)
+            self.assertIs(cur.connection, db)
+            self.assertRaises(apsw.ExecutionCompleteError, lambda: cur.description)
+            self.assertRaises(RuntimeError, cur.__init__, db)
+            self.assertEqual(db.execute("select ?", (i, )).get, i)
+        del cur
+
+        # unfinished statements are still finalized on release
+        db.execute("create table foo(x); insert into foo values(1),(2),(3)")
+        self.assertEqual(next(db.execute("select * from foo")), (1, ))
+        # this fails with a locked error if the select is still active
+        db.execute("drop table foo; create table foo(x); insert into foo values(x'aabb')")
+
+        # Connection subclasses overriding cursor are still used by execute
+        class Sub(apsw.Connection):
+
+            def cursor(self):
+                self.count = getattr(self, "count", 0) + 1
+                return super().cursor()
+
+        sub = Sub("")
+        sub.execute("select 3")
+        sub.executemany("select ?", ((1, ), (2, )))
+        self.assertEqual(sub.count, 2)
+        sub.close()
+
+        # dead dependents are all discarded before backup checks there are none
+        db2 = apsw.Connection("")
+        db2.execute("create table foo(x); insert into foo values(x'aabb')")
+        cursors = [db.cursor() for _ in range(500)]
+        del cursors
+        db.backup("main", db2, "main").close()
+        self.assertEqual(db.execute("select count(*) from foo").get, 1)
+
+        # many outstanding dependents get closed with the connection
+        cursors = [db.cursor() for _ in range(50)]
+        for i, c in enumerate(cursors):
+            c.execute("select ?", (i, ))
+        blob = db.blob_open("main", "foo", "x", 1, False)
+        # backup needs the destination to have no dependents
+        self.assertRaises(apsw.ThreadingViolationError, db.backup, "main", db2, "main")
+        del cursors[::2]
+        db.close()
+        self.assertRaises(apsw.CursorClosedError, cursors[0].execute, "select 3")
+        self.assertRaises(ValueError, blob.read)
+        db2.close()
+        del cursors
+
     def testMemoryLeaks(self):
         "MemoryLeaks: Run with a memory profiler such as valgrind and debug Python"
         # make and toss away a bunch of db objects, cursors, functions etc - if you use memory profiling then
@@ -1233,6 +1295,13 @@ class APSW(unittest.TestCase):
         # check nothing got inserted
         self.assertEqual(0, curnext(c.execute("select count(*) from foo where row=9999"))[0])
 
+        # text is checked for being ascii in blocks so try non-ascii in
+        # each position
+        for length in (0, 1, 7, 8, 15, 16, 17, 33, 70):
+            for pos in range(-1, length):
+                text = "".join("\u00e9" if i == pos else chr(65 + i % 26) for i in range(length))
+                self.assertEqual((text, text), self.db.execute("select ?, snap(?)", (text, text)).get)
+
     def testMissingDictBindings(self):
         "How missing bindings are handled"
         orig = apsw.allow_missing_dict_bindings(True)
@@ -1985,6 +2054,281 @@ class APSW(unittest.TestCase):
         c.execute("create table shouldsucceed(x)")
         self.assertTableExists("shouldsucceed")
 
+    def testAuthorizerRules(self):
+        "Verify authorizer rules evaluated in C"
+        self.db.execute("create table users(name, password); insert into users values('a', 'secret')")
+        self.db.execute("create table other(x); insert into other values(1)")
+
+        self.db.set_authorizer_rules([
+            (apsw.SQLITE_READ, "USERS", "pass*", apsw.SQLITE_IGNORE),
+            (apsw.SQLITE_READ, None, None, apsw.SQLITE_OK),
+            (apsw.SQLITE_SELECT, None, None, apsw.SQLITE_OK),
+            (apsw.SQLITE_FUNCTION, None, "up?er", apsw.SQLITE_OK),
+            (None, None, None, apsw.SQLITE_DENY),
+        ])
+        self.assertEqual(self.db.execute("select name, password from users").get, ("a", None))
+        self.assertEqual(self.db.execute("select upper(name) from users").get, "A")
+        self.assertRaises(apsw.SQLError, self.db.execute, "select lower(name) from users")
+        self.assertRaises(apsw.AuthError, self.db.execute, "insert into other values(2)")
+        self.assertRaises(apsw.AuthError, self.db.execute, "create table private(x)")
+
+        # unmatched actions go to the Python authorizer
+        calls = []
+
+        def authorizer(operation, paramone, paramtwo, databasename, triggerorview):
+            calls.append(operation)
+            return apsw.SQLITE_OK
+
+        self.db.set_authorizer_rules([
+            (apsw.SQLITE_READ, None, None, apsw.SQLITE_OK),
+            (apsw.SQLITE_INSERT, "other", None, apsw.SQLITE_DENY),
+        ])
+        self.db.authorizer = authorizer
+        self.assertEqual(self.db.execute("select x from other").get, 1)
+        self.assertNotIn(apsw.SQLITE_READ, calls)
+        self.assertIn(apsw.SQLITE_SELECT, calls)
+        self.assertRaises(apsw.AuthError, self.db.execute, "insert into other values(2)")
+        self.db.authorizer = None
+
+        # with no authorizer unmatched actions are allowed
+        self.db.execute("insert into users values('b', 'c')")
+        self.assertRaises(apsw.AuthError, self.db.execute, "insert into other values(2)")
+
+        self.db.set_authorizer_rules(None)
+        self.db.execute("insert into other values(2)")
+        self.db.set_authorizer_rules([])
+        self.db.execute("insert into other values(3)")
+
+        for bad in (
+            3,
+            [3],
+            [(1, 2, 3)],
+            [("x", None, None, apsw.SQLITE_OK)],
+            [(-1, None, None, apsw.SQLITE_OK)],
+            [(None, 3, None, apsw.SQLITE_OK)],
+            [(None, None, b"x", apsw.SQLITE_OK)],
+            [(None, None, None, 99)],
+            [(None, None, None, "ok")],
+        ):
+            self.assertRaises((TypeError, ValueError), self.db.set_authorizer_rules, bad)
+        # failures leave the existing rules alone
+        self.db.set_authorizer_rules([(apsw.SQLITE_INSERT, None, None, apsw.SQLITE_DENY)])
+        self.assertRaises(ValueError, self.db.set_authorizer_rules, [(None, None, None, 99)])
+        self.assertRaises(apsw.AuthError, self.db.execute, "insert into other values(4)")
+
+    def testCArray(self):
+        "Verify carray binding and table valued function"
+        self.db.execute("create table items(id integer primary key, name)")
+        self.db.executemany("insert into items values(?, ?)", ((i, f"item{ i }") for i in range(1000)))
+
+        for values in (
+                array.array("q", [5, 900, 17, 4000]),
+                array.array("i", [5, 900, 17, 4000]),
+                memoryview(array.array("l", [5, 900, 17, 4000])),
+            [5, 900, 17, 4000],
+            (5, 900, 17, 4000),
+        ):
+            ca = apsw.carray(values)
+            self.assertEqual(len(ca), 4)
+            self.assertIn("carray", str(ca))
+            self.assertEqual([5, 17, 900],
+                             self.db.execute("select id from items where id in carray(?) order by id", (ca, )).get)
+            self.assertEqual([5, 900, 17, 4000], self.db.execute("select value from carray(?)", (ca, )).get)
+
+        # same cached statement for any size
+        sql = "select count(*) from items where id in carray(:ids)"
+        for n in (0, 1, 10, 500, 5000):
+            self.assertEqual(min(n, 1000), self.db.execute(sql, {"ids": apsw.carray(range(n))}).get)
+
+        self.assertEqual([1.5, 2.0], self.db.execute("select value from carray(?)", (apsw.carray([1.5, 2]), )).get)
+        self.assertEqual([1.5, 2.0],
+                         self.db.execute("select value from carray(?)", (apsw.carray(array.array("d", [1.5, 2])), )).get)
+        self.assertEqual(["item3", "item7"],
+                         self.db.execute("select name from items where name in carray(?) order by id",
+                                         (apsw.carray(["item7", "item3", "\N{SNOWMAN}"]), )).get)
+        self.assertEqual(["\N{SNOWMAN}", ""], self.db.execute("select value from carray(?)", (apsw.carray(["\N{SNOWMAN}", ""]), )).get)
+
+        # buffer is held without copying
+        a = array.array("q", [1, 2])
+        ca = apsw.carray(a)
+        a[0] = 3
+        self.assertEqual([3, 2], self.db.execute("select value from carray(?)", (ca, )).get)
+        self.assertRaises(BufferError, a.append, 4)
+        del ca
+        gc.collect()
+        a.append(4)
+
+        # the binding keeps the carray alive
+        cur = self.db.cursor()
+        cur.execute("select value from carray(?)", (apsw.carray(range(100)), ))
+        gc.collect()
+        self.assertEqual(list(range(100)), [row[0] for row in cur])
+
+        # not a carray
+        self.assertIsNone(self.db.execute("select value from carray(?)", ("abc", )).get)
+        self.assertIsNone(self.db.execute("select value from carray(3)").get)
+        self.assertIsNone(self.db.execute("select value from carray").get)
+
+        for bad in (3, "abc", b"abc", array.array("f", [1]), array.array("Q", [1]), [1, "a"], ["a", 1], [None],
+                    [2**70], memoryview(bytes(16)).cast("q", (2, 1))):
+            self.assertRaises((TypeError, OverflowError), apsw.carray, bad)
+
+    def testConvertJSON(self):
+        "Verify JSON conversion in C"
+        self.assertFalse(self.db.convert_json)
+        self.db.execute("create table t(a JSON, b JSONB, c)")
+        value = {"x": [1, -2.5, "s\N{SNOWMAN}\n\"", None, True, False, 2**70, {}, []], "": {"k": "v"}}
+
+        self.db.convert_json = True
+        self.assertTrue(self.db.convert_json)
+        self.db.execute("insert into t values(?, jsonb(?), ?)", (value, [1, (2, 3)], "[1]"))
+        self.assertEqual(self.db.execute("select * from t").get, (value, [1, [2, 3]], "[1]"))
+        # round trips through the standard module
+        self.assertEqual(json.loads(self.db.execute("select cast(a as text) from t").get), value)
+        # JSON function results
+        self.assertEqual(self.db.execute("select json_object('a', 1, 'b', json_array(2, 'c'))").get, {"a": 1, "b": [2, "c"]})
+        self.assertEqual(self.db.execute("select json_extract(a, '$.x[1]'), json_valid(?) from t", ({"a": 1}, )).get,
+                         (-2.5, 1))
+        # cursors of all kinds
+        self.assertEqual(self.db.execute("select b from t").fetchall(), [([1, [2, 3]], )])
+        self.assertEqual(next(self.db.cursor().execute("select b, c from t")), ([1, [2, 3]], "[1]"))
+
+        self.db.convert_json = False
+        self.assertIsInstance(self.db.execute("select a from t").get, str)
+        self.assertIsInstance(self.db.execute("select b from t").get, bytes)
+        self.assertRaises(TypeError, self.db.execute, "select ?", ([1], ))
+        self.db.convert_json = True
+
+        # JSONB with JSON5 values
+        self.db.execute("insert into t(b) values(jsonb(?))",
+                        (r"""{a: 0x1F, b: Infinity, c: 'x\x41\u00e9', d: .5, e: -0x10, "f": [null]}""", ))
+        self.assertEqual(self.db.execute("select b from t where a is null").get,
+                         {"a": 31, "b": math.inf, "c": "xA\u00e9", "d": 0.5, "e": -16, "f": [None]})
+
+        self.db.execute("delete from t")
+        for text, expected in (
+            (' [ 1 , 0.5e-3, 1E+2, "\\/\\b\\f\\u0041\\ud83d\\ude00" ] ', [1, 0.0005, 100.0, "/\b\fA\U0001F600"]),
+            ('"\\ud800"', "\ud800"),
+            ('"plain"', "plain"),
+            ('{"a": {"b": {"c": [[[]]]}}}', {"a": {"b": {"c": [[[]]]}}}),
+        ):
+            self.db.execute("delete from t; insert into t(a) values(cast(? as text))", (text, ))
+            self.assertEqual(self.db.execute("select a from t").get, expected)
+        for text in ("[1,", "[1]x", '"\\q"', "{'a':1}", "nul", '"\x01"', "[1e]", "-", "[1,]", "{\"a\" 1}", "x"):
+            self.db.execute("delete from t; insert into t(a) values(cast(? as text))", (text, ))
+            self.assertRaises(ValueError, lambda: self.db.execute("select a from t").get)
+        self.db.execute("delete from t; insert into t(b) values(x'cc')")
+        self.assertRaises(ValueError, lambda: self.db.execute("select b from t").get)
+
+        for bad in ([math.nan], {1: 2}, [object()]):
+            self.assertRaises((ValueError, TypeError), self.db.execute, "select ?", (bad, ))
+        recursive = []
+        recursive.append(recursive)
+        self.assertRaises(RecursionError, self.db.execute, "select ?", (recursive, ))
+
+    def testResultCache(self):
+        "Verify caching results of read only queries"
+        db = self.db
+        db.execute("create table foo(x, y); insert into foo values(1, 'one'), (2, 'two')")
+        query = "select sum(x), group_concat(y) from foo where x >= ?"
+
+        # works without the cache
+        self.assertEqual(((3, "one,two"), ), db.execute_cached(query, (1, )))
+        self.assertEqual({"entries": 0, "bytes": 0, "hits": 0, "misses": 0, "uncacheable": 0, "invalidations": 0,
+                          "evictions": 0}, db.result_cache_stats())
+
+        db.set_result_cache(2)
+        first = db.execute_cached(query, (1, ))
+        self.assertIs(first, db.execute_cached(query, (1, )))
+        # types are part of the key
+        self.assertEqual(((2, "two"), ), db.execute_cached(query, (1.5, )))
+        stats = db.result_cache_stats()
+        self.assertEqual((2, 1, 2), (stats["entries"], stats["hits"], stats["misses"]))
+        self.assertGreater(stats["bytes"], 0)
+
+        # changes by this connection
+        db.execute("insert into foo values(3, 'three')")
+        self.assertEqual(((6, "one,two,three"), ), db.execute_cached(query, (1, )))
+        self.assertEqual(1, db.result_cache_stats()["invalidations"])
+
+        # changes by another connection
+        db2 = apsw.Connection(self.db.filename)
+        db2.execute("delete from foo where x = 3")
+        self.assertEqual(((3, "one,two"), ), db.execute_cached(query, [1]))
+        db2.close()
+
+        # dict bindings and eviction
+        self.assertEqual(((1, ), ), db.execute_cached("select x from foo where y = :y", {"y": "one"}))
+        self.assertEqual(((2, ), ), db.execute_cached("select x from foo where y = :y", {"y": "two"}))
+        self.assertEqual(((1, ), ), db.execute_cached("select x from foo where y = :y", {"y": "one"}))
+        self.assertEqual(2, db.result_cache_stats()["entries"])
+        self.assertGreater(db.result_cache_stats()["evictions"], 0)
+
+        # not cacheable
+        before = db.result_cache_stats()["uncacheable"]
+        for q in ("select random()", "select datetime('now')", "select * from pragma_function_list",
+                  "select 1; select 2", "insert into foo values(4, 'four') returning x"):
+            db.execute_cached(q)
+        db.execute_cached("select x from foo where x = ?", (apsw.zeroblob(3), ))
+        self.assertEqual(before + 6, db.result_cache_stats()["uncacheable"])
+        with db:
+            db.execute_cached(query, (1, ))
+        self.assertEqual(before + 7, db.result_cache_stats()["uncacheable"])
+
+        # deterministic user functions are fine
+        db.create_scalar_function("double", lambda x: x * 2, deterministic=True)
+        db.create_scalar_function("triple", lambda x: x * 3)
+        self.assertIs(db.execute_cached("select double(x) from foo"), db.execute_cached("select double(x) from foo"))
+        self.assertIsNot(db.execute_cached("select triple(x) from foo"), db.execute_cached("select triple(x) from foo"))
+
+        # replacing a function discards results and decisions
+        self.assertEqual(((2, ), (4, )), db.execute_cached("select double(x) from foo where x < 3"))
+        db.create_scalar_function("double", lambda x: x * 20, deterministic=True)
+        self.assertEqual(((20, ), (40, )), db.execute_cached("select double(x) from foo where x < 3"))
+        db.create_scalar_function("double", lambda x: x * 200)
+        self.assertEqual(((200, ), (400, )), db.execute_cached("select double(x) from foo where x < 3"))
+        self.assertIsNot(db.execute_cached("select double(x) from foo where x < 3"), db.execute_cached("select double(x) from foo where x < 3"))
+        db.create_collation("rev", lambda x, y: (x < y) - (x > y))
+        self.assertEqual((("two", ), ("one", )), db.execute_cached("select y from foo where x < 3 order by y collate rev"))
+        db.create_collation("rev", lambda x, y: (x > y) - (x < y))
+        self.assertEqual((("one", ), ("two", )), db.execute_cached("select y from foo where x < 3 order by y collate rev"))
+
+        # a row tracer set by the cursor factory
+        before = db.result_cache_stats()["uncacheable"]
+
+        def factory(connection):
+            cursor = apsw.Cursor(connection)
+            cursor.row_trace = lambda cursor, row: row[0]
+            return cursor
+
+        db.cursor_factory = factory
+        self.assertEqual((1, 2), db.execute_cached("select x from foo where x < 3"))
+        self.assertEqual((1, 2), db.execute_cached("select x from foo where x < 3"))
+        self.assertEqual(before + 2, db.result_cache_stats()["uncacheable"])
+        db.cursor_factory = apsw.Cursor
+
+        # pragmas are connection state not covered by the data version
+        self.assertEqual(((-2000, ), ), db.execute_cached("pragma cache_size"))
+        db.execute("pragma cache_size=123")
+        self.assertEqual(((123, ), ), db.execute_cached(" /* x */ PRAGMA cache_size"))
+        self.assertIsNot(db.execute_cached("pragma cache_size"), db.execute_cached("pragma cache_size"))
+
+        # changing json conversion discards results
+        db.execute("""create table js(j JSON); insert into js values('{"a": 1}')""")
+        self.assertEqual((('{"a": 1}', ), ), db.execute_cached("select j from js"))
+        db.convert_json = True
+        self.assertEqual((({"a": 1}, ), ), db.execute_cached("select j from js"))
+        db.convert_json = False
+
+        # size limit
+        db.set_result_cache(10, 100)
+        db.execute_cached("select * from foo")
+        self.assertEqual(0, db.result_cache_stats()["entries"])
+
+        self.assertRaises(apsw.SQLError, db.execute_cached, "select nonsense from foo")
+        db.set_result_cache(0)
+        self.assertEqual(0, db.result_cache_stats()["entries"])
+
     def testExecTracing(self):
         "Verify tracing of executed statements and bindings"
         self.db.set_exec_trace(None)
@@ -2807,6 +3151,70 @@ class APSW(unittest.TestCase):
         self.db.set_progress_handler(ph, 1)
         self.assertRaises(ZeroDivisionError, c.execute, "update foo set x=-10")
 
+    def testStatementLimits(self):
+        "Verify per statement resource limits"
+        forever = "with recursive c(x) as (select 1 union all select x+1 from c) "
+        self.assertRaises(TypeError, self.db.set_statement_limits, vm_steps="foo")
+        self.assertRaises(ValueError, self.db.set_statement_limits, rows=-1)
+
+        self.db.set_statement_limits(vm_steps=5000)
+        try:
+            self.db.execute(forever + "select count(*) from c").get
+            self.fail("Expected exception")
+        except apsw.ResourceLimitError as e:
+            self.assertIsInstance(e, apsw.Error)
+            self.assertEqual(e.limit, "vm_steps")
+            self.assertGreater(e.usage["vm_steps"], 5000)
+            self.assertLess(e.usage["vm_steps"], 5000 + 200)
+            self.assertEqual(e.usage, {"vm_steps": e.usage["vm_steps"], "rows": 0})
+        self.assertRaises(TypeError, self.db.set_statement_limits, memory=1000)
+
+        # counts are per statement, including reused statements from the cache
+        query = forever + "select count(*) from (select * from c limit 100)"
+        for i in range(5):
+            self.assertEqual(self.db.execute(query).get, 100)
+        self.assertRaises(apsw.ResourceLimitError,
+                          self.db.execute(query + "; " + forever + "select count(*) from c").fetchall)
+
+        self.db.set_statement_limits(rows=10)
+        rows = []
+        try:
+            for row in self.db.execute(forever + "select x from c"):
+                rows.append(row)
+            self.fail("Expected exception")
+        except apsw.ResourceLimitError as e:
+            self.assertEqual(e.limit, "rows")
+            self.assertEqual(e.usage["rows"], 11)
+            self.assertGreater(e.usage["vm_steps"], 0)
+        self.assertEqual(len(rows), 10)
+        self.assertEqual(len(self.db.execute(forever + "select x from c limit 10").fetchall()), 10)
+        # and for each statement of executemany
+        self.db.executemany(forever + "select x from c limit ?", ((i, ) for i in range(11)))
+        self.assertEqual(len(self.db.execute("select 1 union all select 2; " * 6).fetchall()), 12)
+
+        # the progress handler keeps working alongside
+        called = []
+
+        def ph():
+            called.append(1)
+            return False
+
+        self.db.set_progress_handler(ph, 1000)
+        self.db.set_statement_limits(vm_steps=100_000)
+        self.assertRaises(apsw.ResourceLimitError, self.db.execute, forever + "select count(*) from c")
+        self.assertTrue(90 <= len(called) <= 101, len(called))
+        self.db.set_progress_handler(lambda: True, 1000)
+        self.assertRaises(apsw.InterruptError, self.db.execute, forever + "select count(*) from c")
+        self.db.set_progress_handler(None)
+
+        # nested statements from functions have their own counts
+        self.db.set_statement_limits(vm_steps=2000)
+        self.db.create_scalar_function("inner", lambda: self.db.execute(forever + "select count(*) from (select * from c limit 20)").get)
+        self.assertEqual(self.db.execute(forever + "select sum(inner()) from (select * from c limit 20)").get, 400)
+
+        self.db.set_statement_limits()
+        self.assertEqual(self.db.execute(forever + "select count(*) from (select * from c limit 100000)").get, 100000)
+
     def testChanges(self):
         "Verify reporting of changes"
         c = self.db.cursor()
@@ -3499,6 +3907,30 @@ class APSW(unittest.TestCase):
             self.assertIn("NumberOfArguments", l)
             self.assertEqual(l["NumberOfArguments"], 3)
 
+        def c_frames(sql):
+            try:
+                self.db.execute(sql)
+                self.fail("Exception should have occurred")
+            except ZeroDivisionError as exc:
+                return [f for f, _ in traceback.walk_tb(exc.__traceback__) if f.f_code.co_filename.endswith(".c")]
+
+        # same call sites with different names must not get each others frames
+        self.db.create_scalar_function("otherfunc", badfunc)
+        for i in range(3):
+            for name in "badfunc", "otherfunc":
+                frames = c_frames(f"select { name }({ i })")
+                self.assertTrue(frames[-1].f_code.co_name.endswith("-" + name))
+                if platform.python_implementation() != "PyPy":
+                    self.assertEqual(frames[-1].f_locals["NumberOfArguments"], 1)
+
+        self.assertRaises(TypeError, apsw.augment_tracebacks, object)
+        self.assertTrue(apsw.augment_tracebacks(False))
+        try:
+            self.assertEqual(c_frames("select badfunc(1)"), [])
+        finally:
+            self.assertFalse(apsw.augment_tracebacks(True))
+        self.assertTrue(c_frames("select badfunc(1)"))
+
     def testLoadExtension(self):
         "Check loading of extensions"
         # unicode issues
@@ -4736,6 +5168,57 @@ class APSW(unittest.TestCase):
         for row in self.db.cursor().execute("select * from foo where x=6"):
             self.fail("Transaction was not rolled back")
 
+    def testContextManagerSavepoints(self):
+        "Context manager savepoints at many nesting levels"
+        self.db.execute("create table foo(x)")
+        depth = 12  # deeper than the prepared statement levels
+
+        def nest(level, fail_at):
+            with self.db:
+                self.db.execute("insert into foo values(?)", (level, ))
+                if level == fail_at:
+                    raise ValueError(level)
+                if level < depth:
+                    try:
+                        nest(level + 1, fail_at)
+                    except ValueError:
+                        pass
+
+        for fail_at in (None, 1, 3, 10, depth):
+            self.db.execute("delete from foo")
+            nest(0, fail_at)
+            expected = list(range(depth + 1)) if fail_at is None else list(range(fail_at))
+            self.assertEqual(expected, [r[0] for r in self.db.execute("select x from foo order by x")])
+            self.assertTrue(self.db.in_transaction is False)
+
+        # tracer sees the statements and can veto them
+        traced = []
+
+        def tracer(cur, sql, bindings):
+            traced.append(sql)
+            return True
+
+        self.db.set_exec_trace(tracer)
+        with self.db:
+            with self.db:
+                pass
+        self.db.set_exec_trace(None)
+        self.assertEqual(traced, [
+            'SAVEPOINT "_apsw-0"', 'SAVEPOINT "_apsw-1"', 'RELEASE SAVEPOINT "_apsw-1"', 'RELEASE SAVEPOINT "_apsw-0"'
+        ])
+        self.db.set_exec_trace(lambda *args: False)
+        self.assertRaises(apsw.ExecTraceAbort, self.db.__enter__)
+        self.db.set_exec_trace(None)
+        self.assertTrue(self.db.in_transaction is False)
+
+        # statements are discarded on close
+        fname = self.db.filename
+        self.db.close()
+        self.db = apsw.Connection(fname)
+        with self.db:
+            self.db.execute("insert into foo values(99)")
+        self.assertEqual(1, self.db.execute("select count(*) from foo where x=99").get)
+
     def testIssue103(self):
         "Issue 103: Error handling when sqlite3_declare_vtab fails"
 
@@ -5285,6 +5768,84 @@ class APSW(unittest.TestCase):
         self.db = apsw.Connection(TESTFILEPREFIX + "testdb", statementcachesize=17000)
         self.testStatementCache(170000)
 
+    def testAutoParameterize(self):
+        "Verify replacing literals with parameters"
+        db = self.db
+        db.execute("create table foo(id integer primary key, name, v)")
+        self.assertFalse(db.auto_parameterize)
+        db.auto_parameterize = True
+        self.assertTrue(db.auto_parameterize)
+        self.assertRaises(TypeError, setattr, db, "auto_parameterize", "yes")
+
+        for i in range(10):
+            db.execute(f"insert into foo values({ i }, 'it''s { i }', { i }.5)")
+        stats = db.cache_stats()
+        self.assertEqual(1, stats["normalized"])
+        self.assertEqual(9, stats["normalized_hits"])
+        self.assertEqual((3, "it's 3", 3.5), db.execute("select * from foo where id = 3").get)
+        self.assertEqual("it's 4", db.execute("select name from foo where id = 4 /* comment */").get)
+
+        queries = []
+
+        def tracer(cursor, sql, bindings):
+            queries.append((sql, bindings))
+            return True
+
+        db.exec_trace = tracer
+        db.execute("select name from foo where id=5 and v > -1.5e0").get
+        self.assertEqual(("select name from foo where id=? and v > -?", [5, 1.5]), queries[-1])
+
+        # left alone
+        for sql, traced, expected in (
+            ("select id, v from foo order by 2 desc limit 1", "select id, v from foo order by 2 desc limit ?",
+             [(9, 9.5)]),
+            ("select 1, 'a', upper('b') from foo where id = 1", "select 1, 'a', upper('b') from foo where id = ?",
+             [(1, "a", "B")]),
+            ("select (select 5 where 7 = 7) from foo where id = 1", "select (select 5 where 7 = 7) from foo where id = ?",
+             [(5, )]),
+            ("select id from foo where v > 0x10 or name = x'00' or v = 9223372036854775808", None, []),
+            ("select name from foo where id = ?", None, [("it's 1", )]),
+            ("pragma user_version = 3", None, []),
+        ):
+            self.assertEqual(expected, db.execute(sql, (1, ) if "?" in sql else None).fetchall())
+            self.assertEqual(traced or sql, queries[-1][0])
+        self.assertEqual("1", db.execute("select 1 from foo where id = 2").description[0][0])
+        self.assertEqual(3, db.pragma("user_version"))
+
+        # function arguments are kept so expression indexes still match
+        db.execute("""create table js(j); create index js_a on js(json_extract(j, '$.a'))""")
+        sql = "select * from js where json_extract(j, '$.a') = 6 and replace (j, 'a', 'b') != 'c'"
+        db.execute(sql).fetchall()
+        self.assertEqual("select * from js where json_extract(j, '$.a') = ? and replace (j, 'a', 'b') != ?",
+                         queries[-1][0])
+        self.assertIn("js_a", db.execute("explain query plan " + sql).fetchall()[0][3])
+        db.execute("select * from js where j in (1, 'x') and \"json\"('7') is not null").fetchall()
+        self.assertEqual("select * from js where j in (?, ?) and \"json\"('7') is not null", queries[-1][0])
+
+        # bindings supplied
+        db.execute("select name from foo where id = 2", tuple()).get
+        self.assertEqual(("select name from foo where id = 2", tuple()), queries[-1])
+
+        # prepare fails so the original is used
+        sql = "select id from 'foo' where id = 1"
+        self.assertEqual([(1, )], db.execute(sql).fetchall())
+        self.assertEqual((sql, None), queries[-1])
+        self.assertRaises(apsw.SQLError, db.execute, "select id from nosuchtable where id = 1")
+
+        # but not when preparing raised a Python exception
+        calls = 0
+
+        def authorizer(*args):
+            nonlocal calls
+            calls += 1
+            if calls == 1:
+                1 / 0
+            return apsw.SQLITE_OK
+
+        db.authorizer = authorizer
+        self.assertRaises(ZeroDivisionError, db.execute, "select id from foo where id = 3")
+        db.authorizer = None
+
     def testStmtExplain(self):
         "Verify sqlite3_stmt_explain operation"
 
@@ -5322,10 +5883,356 @@ class APSW(unittest.TestCase):
 
         self.assertRaises(apsw.SQLError, self.db.execute, "select 6", explain=7)
 
+    def testPlanMonitor(self):
+        "Connection.set_plan_monitor"
+        self.assertRaises(TypeError, self.db.set_plan_monitor, 3)
+        self.db.execute("create table t(a, b); create index ta on t(a)")
+        changes = []
+        self.db.set_plan_monitor(lambda *args: changes.append(args))
+        query = "select * from t where a=? and b in (select a from t where b>2)"
+        for i in range(3):
+            self.db.execute(query, (i, )).fetchall()
+        plans = [e["plan"] for e in self.db.cache_stats(True)["entries"] if e["query"] == query]
+        self.assertEqual(1, len(plans))
+        self.assertIn("INDEX ta", plans[0])
+        self.assertIn("\n  SCAN t", plans[0])
+        # explain queries have no plan recorded
+        self.db.execute(query, (1, ), explain=1).fetchall()
+        self.assertEqual([None], [
+            e["plan"] for e in self.db.cache_stats(True)["entries"] if e["query"] == query and e["explain"] == 1
+        ])
+
+        self.db.execute("drop index ta")
+        self.db.execute(query, (1, )).fetchall()
+        self.assertEqual(1, len(changes))
+        self.assertEqual((query, plans[0]), changes[0][:2])
+        self.assertIn("SCAN t", changes[0][2])
+        self.assertNotIn("INDEX", changes[0][2])
+        stats = self.db.cache_stats()
+        self.assertEqual(1, stats["plan_changes"])
+        self.assertGreaterEqual(stats["reprepares"], 1)
+
+        # reprepare with the same plan
+        self.db.execute("create table other(x)")
+        self.db.execute(query, (1, )).fetchall()
+        self.assertEqual(1, len(changes))
+        self.assertGreater(self.db.cache_stats()["reprepares"], stats["reprepares"])
+
+        def bad(*args):
+            1 / 0
+
+        self.db.set_plan_monitor(bad)
+        self.db.execute("create index tab on t(a, b)")
+        self.assertRaisesUnraisable(ZeroDivisionError, lambda: self.db.execute(query, (1, )).fetchall())
+
+        def reentrant(*args):
+            changes.append(args)
+            self.db.execute("select 3")
+
+        # the connection can't be used from the monitor
+        self.db.set_plan_monitor(reentrant)
+        self.db.execute("drop index tab; create index ta on t(a)")
+        self.assertRaisesUnraisable(apsw.ThreadingViolationError, lambda: self.db.execute(query, (1, )).fetchall())
+        self.assertEqual(2, len(changes))
+        self.assertEqual(self.db.execute("select 4").get, 4)
+
+        self.db.set_plan_monitor(None)
+        self.db.execute("drop index ta")
+        self.db.execute(query, (1, )).fetchall()
+        self.assertEqual(3, self.db.cache_stats()["plan_changes"])
+
     # the text also includes characters that can't be represented in 16 bits (BMP)
     wikipedia_text = """Wikipedia\nThe Free Encyclopedia\nEnglish\n6 383 000+ articles\n日本語\n1 292 000+ 記事\nРусский\n1 756 000+ статей\nDeutsch\n2 617 000+ Artikel\nEspañol\n1 717 000+ artículos\nFrançais\n2 362 000+ articles\nItaliano\n1 718 000+ voci\n中文\n1 231 000+ 條目\nPolski\n1 490 000+ haseł\nPortuguês\n1 074 000+ artigos\nSearch Wikipedia\nEN\nEnglish\n\n Read Wikipedia in your language\n1 000 000+ articles\nPolski\nالعربية\nDeutsch\nEnglish\nEspañol\nFrançais\nItaliano\nمصرى\nNederlands\n日本語\nPortuguês\nРусский\nSinugboanong Binisaya\nSvenska\nУкраїнська\nTiếng Việt\nWinaray\n中文\n100 000+ articles\nAfrikaans\nSlovenčina\nAsturianu\nAzərbaycanca\nБългарски\nBân-lâm-gú / Hō-ló-oē\nবাংলা\nБеларуская\nCatalà\nČeština\nCymraeg\nDansk\nEesti\nΕλληνικά\nEsperanto\nEuskara\nفارسی\nGalego\n한국어\nՀայերեն\nहिन्दी\nHrvatski\nBahasa Indonesia\nעברית\nქართული\nLatina\nLatviešu\nLietuvių\nMagyar\nМакедонски\nBahasa Melayu\nBahaso Minangkabau\nNorskbokmålnynorsk\nНохчийн\nOʻzbekcha / Ўзбекча\nҚазақша / Qazaqşa / قازاقشا\nRomână\nSimple English\nSlovenščina\nСрпски / Srpski\nSrpskohrvatski / Српскохрватски\nSuomi\nதமிழ்\nТатарча / Tatarça\nภาษาไทย\nТоҷикӣ\nتۆرکجه\nTürkçe\nاردو\nVolapük\n粵語\nမြန်မာဘာသာ\n10 000+ articles\nBahsa Acèh\nAlemannisch\nአማርኛ\nAragonés\nBasa Banyumasan\nБашҡортса\nБеларуская (Тарашкевіца)\nBikol Central\nবিষ্ণুপ্রিয়া মণিপুরী\nBoarisch\nBosanski\nBrezhoneg\nЧӑвашла\nDiné Bizaad\nEmigliàn–Rumagnòl\nFøroyskt\nFrysk\nGaeilge\nGàidhlig\nગુજરાતી\nHausa\nHornjoserbsce\nIdo\nIlokano\nInterlingua\nИрон æвзаг\nÍslenska\nJawa\nಕನ್ನಡ\nKreyòl Ayisyen\nKurdî / كوردی\nکوردیی ناوەندی\nКыргызча\nКырык Мары\nLëtzebuergesch\nLimburgs\nLombard\nLìgure\nमैथिली\nMalagasy\nമലയാളം\n文言\nमराठी\nმარგალური\nمازِرونی\nMìng-dĕ̤ng-ngṳ̄ / 閩東語\nМонгол\nनेपाल भाषा\nनेपाली\nNnapulitano\nNordfriisk\nOccitan\nМарий\nଓଡି଼ଆ\nਪੰਜਾਬੀ (ਗੁਰਮੁਖੀ)\nپنجابی (شاہ مکھی)\nپښتو\nPiemontèis\nPlattdüütsch\nQırımtatarca\nRuna Simi\nसंस्कृतम्\nСаха Тыла\nScots\nShqip\nSicilianu\nසිංහල\nسنڌي\nŚlůnski\nBasa Sunda\nKiswahili\nTagalog\nతెలుగు\nᨅᨔ ᨕᨙᨁᨗ / Basa Ugi\nVèneto\nWalon\n吳語\nייִדיש\nYorùbá\nZazaki\nŽemaitėška\nisiZulu\n1 000+ articles\nАдыгэбзэ\nÆnglisc\nAkan\nаԥсшәа\nԱրեւմտահայերէն\nArmãneashce\nArpitan\nܐܬܘܪܝܐ\nAvañe’ẽ\nАвар\nAymar\nBasa Bali\nBahasa Banjar\nभोजपुरी\nBislama\nབོད་ཡིག\nБуряад\nChavacano de Zamboanga\nCorsu\nVahcuengh / 話僮\nDavvisámegiella\nDeitsch\nދިވެހިބަސް\nDolnoserbski\nЭрзянь\nEstremeñu\nFiji Hindi\nFurlan\nGaelg\nGagauz\nGĩkũyũ\nگیلکی\n贛語\nHak-kâ-ngî / 客家語\nХальмг\nʻŌlelo Hawaiʻi\nIgbo\nInterlingue\nKabɩyɛ\nKapampangan\nKaszëbsczi\nKernewek\nភាសាខ្មែរ\nKinyarwanda\nКоми\nKongo\nकोंकणी / Konknni\nKriyòl Gwiyannen\nພາສາລາວ\nDzhudezmo / לאדינו\nЛакку\nLatgaļu\nЛезги\nLingála\nlojban\nLuganda\nMalti\nReo Mā’ohi\nMāori\nMirandés\nМокшень\nߒߞߏ\nNa Vosa Vaka-Viti\nNāhuatlahtōlli\nDorerin Naoero\nNedersaksisch\nNouormand / Normaund\nNovial\nAfaan Oromoo\nঅসমীযা়\nपालि\nPangasinán\nPapiamentu\nПерем Коми\nPfälzisch\nPicard\nКъарачай–Малкъар\nQaraqalpaqsha\nRipoarisch\nRumantsch\nРусиньскый Язык\nGagana Sāmoa\nSardu\nSeeltersk\nSesotho sa Leboa\nChiShona\nSoomaaliga\nSranantongo\nTaqbaylit\nTarandíne\nTetun\nTok Pisin\nfaka Tonga\nTürkmençe\nТыва дыл\nУдмурт\nئۇيغۇرچه\nVepsän\nVõro\nWest-Vlams\nWolof\nisiXhosa\nZeêuws\n100+ articles\nBamanankan\nChamoru\nChichewa\nEʋegbe\nFulfulde\n𐌲𐌿𐍄𐌹𐍃𐌺\nᐃᓄᒃᑎᑐᑦ / Inuktitut\nIñupiak\nKalaallisut\nكٲشُر\nLi Niha\nNēhiyawēwin / ᓀᐦᐃᔭᐍᐏᐣ\nNorfuk / Pitkern\nΠοντιακά\nརྫོང་ཁ\nRomani\nKirundi\nSängö\nSesotho\nSetswana\nСловѣ́ньскъ / ⰔⰎⰑⰂⰡⰐⰠⰔⰍⰟ\nSiSwati\nThuɔŋjäŋ\nᏣᎳᎩ\nTsėhesenėstsestotse\nTshivenḓa\nXitsonga\nchiTumbuka\nTwi\nትግርኛ\nဘာသာ မန်\n"""
     assert (any(ord(c) > 65536 for c in wikipedia_text))
 
+    def testWriterQueue(self):
+        "Connection.set_writer_queue"
+        self.assertRaises(TypeError, self.db.set_writer_queue, "x")
+        zero = {"acquired": 0, "waited": 0, "timeouts": 0, "wait_ns": 0, "max_wait_ns": 0}
+        self.assertEqual(zero, self.db.writer_queue_stats())
+        mem = apsw.Connection("")
+        mem.set_writer_queue(1000)
+        mem.execute("create table x(y); insert into x values(1)")
+        self.assertEqual(zero, mem.writer_queue_stats())
+        mem.close()
+        self.assertRaises(apsw.ConnectionClosedError, mem.writer_queue_stats)
+
+        self.db.execute("pragma journal_mode=wal").get
+        self.db.execute("create table t(x, y)")
+        self.db.set_writer_queue(60000)
+        self.db.execute("insert into t values(0, 0)")
+        self.assertEqual(1, self.db.writer_queue_stats()["acquired"])
+
+        # many writers with no busy handler never get busy
+        nthreads, per = 6, 50
+
+        def writer(n):
+            con = apsw.Connection(self.db.filename)
+            con.set_writer_queue(60000)
+            for i in range(per):
+                if i % 2:
+                    with con:
+                        con.execute("insert into t values(?, ?)", (n, i))
+                else:
+                    con.execute("begin immediate; insert into t values(?, ?); commit", (n, i))
+            stats = con.writer_queue_stats()
+            con.close()
+            return stats
+
+        threads = [ThreadRunner(writer, n) for n in range(nthreads)]
+        for t in threads:
+            t.start()
+        results = [t.go() for t in threads]
+        self.assertEqual(1 + nthreads * per, self.db.execute("select count(*) from t").get)
+        for stats in results:
+            self.assertEqual(per, stats["acquired"])
+            self.assertEqual(0, stats["timeouts"])
+            self.assertGreaterEqual(stats["wait_ns"], stats["max_wait_ns"])
+
+        # first come first served, and close releases
+        self.db.execute("begin immediate")
+        order = []
+
+        def waiter(n):
+            con = apsw.Connection(self.db.filename)
+            con.set_writer_queue(60000)
+            con.execute("insert into t values(?, -1)", (n, ))
+            order.append(n)
+            con.close()
+
+        threads = [ThreadRunner(waiter, n) for n in range(4)]
+        for t in threads:
+            t.start()
+            time.sleep(0.1)
+        self.assertEqual([], order)
+        self.db.execute("rollback")
+        for t in threads:
+            t.go()
+        self.assertEqual([0, 1, 2, 3], order)
+
+        db2 = apsw.Connection(self.db.filename)
+        db2.set_writer_queue(60000)
+        db2.execute("begin immediate")
+        t = ThreadRunner(waiter, 9)
+        t.start()
+        time.sleep(0.1)
+        db2.close()
+        t.go()
+        self.assertEqual(9, order[-1])
+
+        # timeout falls back to busy handling
+        self.db.execute("begin; insert into t values(1, 1)")
+        db2 = apsw.Connection(self.db.filename)
+        db2.set_writer_queue(50)
+        b4 = time.monotonic()
+        self.assertRaises(apsw.BusyError, db2.execute, "insert into t values(2, 2)")
+        self.assertGreaterEqual(time.monotonic() - b4, 0.04)
+        stats = db2.writer_queue_stats()
+        self.assertEqual((1, 1, 0), (stats["waited"], stats["timeouts"], stats["acquired"]))
+        self.assertGreaterEqual(stats["max_wait_ns"], 40_000_000)
+        self.db.execute("commit")
+        db2.execute("insert into t values(2, 2)")
+        db2.set_writer_queue(0)
+        self.assertEqual(zero, db2.writer_queue_stats())
+        db2.close()
+
+    def testBusyBackoff(self):
+        "Connection.set_busy_backoff"
+        zero = {"busy": 0, "retries": 0, "timeouts": 0, "wait_ns": 0, "max_wait_ns": 0}
+        self.assertEqual(zero, self.db.busy_stats())
+        self.assertRaises(TypeError, self.db.set_busy_backoff, 0.1)
+        self.assertRaises(TypeError, self.db.set_busy_backoff, initial="x")
+        for kwargs in ({"initial": -1}, {"multiplier": 0.5}, {"initial": 2, "maximum": 1}, {"jitter": 1.5},
+                       {"timeout": -1}, {"jitter": float("nan")}):
+            self.assertRaises(ValueError, self.db.set_busy_backoff, **kwargs)
+
+        self.db.execute("create table foo(x)")
+        db2 = apsw.Connection(self.db.filename)
+        db2.execute("begin exclusive")
+
+        self.db.set_busy_backoff(initial=0.01, multiplier=2, maximum=0.04, jitter=0, timeout=0.2)
+        b4 = time.monotonic()
+        self.assertRaises(apsw.BusyError, self.db.execute, "insert into foo values(1)")
+        self.assertGreaterEqual(time.monotonic() - b4, 0.19)
+        stats = self.db.busy_stats()
+        self.assertEqual((1, 1), (stats["busy"], stats["timeouts"]))
+        # 10, 20, 40, 40, 40, 40, 10 ms
+        self.assertTrue(5 <= stats["retries"] <= 9, stats)
+        self.assertGreaterEqual(stats["wait_ns"], 190_000_000)
+        self.assertGreaterEqual(stats["max_wait_ns"], 190_000_000)
+
+        # succeeds once the other connection is done
+        self.db.set_busy_backoff(initial=0.001, jitter=1, timeout=30)
+
+        def release():
+            time.sleep(0.2)
+            db2.execute("commit")
+
+        t = ThreadRunner(release)
+        t.start()
+        self.db.execute("insert into foo values(1)")
+        t.go()
+        stats = self.db.busy_stats()
+        self.assertEqual((1, 0), (stats["busy"], stats["timeouts"]))
+        self.assertGreater(stats["retries"], 1)
+
+        # the final wait is counted
+        self.db.set_busy_backoff(initial=0.05, jitter=0, timeout=30)
+        db2.execute("begin exclusive")
+
+        def release():
+            time.sleep(0.01)
+            db2.execute("commit")
+
+        t = ThreadRunner(release)
+        t.start()
+        self.db.execute("insert into foo values(1)")
+        t.go()
+        stats = self.db.busy_stats()
+        self.assertEqual((1, 1), (stats["busy"], stats["retries"]))
+        self.assertGreaterEqual(stats["max_wait_ns"], 45_000_000)
+
+        # other busy handling replaces it
+        db2.execute("begin exclusive")
+        self.db.set_busy_timeout(0)
+        self.assertRaises(apsw.BusyError, self.db.execute, "insert into foo values(1)")
+        self.assertEqual(stats, self.db.busy_stats())
+        db2.close()
+
+    def testBackgroundCheckpoint(self):
+        "Connection.set_background_checkpoint"
+        zero = {
+            "passive": 0,
+            "idle": 0,
+            "busy": 0,
+            "checkpoint_ns": 0,
+            "max_checkpoint_ns": 0,
+            "wal_high_water": 0,
+            "wal_pages": 0
+        }
+        self.assertEqual(zero, self.db.background_checkpoint_stats())
+        self.assertRaises(TypeError, self.db.set_background_checkpoint)
+        self.assertRaises(ValueError, self.db.set_background_checkpoint, 10, idle=-1)
+        self.assertRaises(ValueError, self.db.set_background_checkpoint, 10, idle_mode=99)
+        mem = apsw.Connection("")
+        mem.set_background_checkpoint(10)
+        self.assertEqual(zero, mem.background_checkpoint_stats())
+        mem.close()
+
+        def wait_for(cond):
+            end = time.monotonic() + 10
+            while time.monotonic() < end:
+                stats = self.db.background_checkpoint_stats()
+                if cond(stats):
+                    return stats
+                time.sleep(0.01)
+            self.fail(f"Timed out with { stats }")
+
+        self.db.execute("pragma journal_mode=wal").get
+        self.db.execute("create table foo(x)")
+        hooked = []
+        self.db.set_wal_hook(lambda con, name, pages: hooked.append(pages) or apsw.SQLITE_OK)
+        self.db.set_background_checkpoint(50, idle=0.25)
+        db2 = apsw.Connection(self.db.filename)
+        db2.set_background_checkpoint(50, idle=0.25)
+        for con in (self.db, db2) * 3:
+            with con:
+                con.executemany("insert into foo values(randomblob(2048))", [tuple()] * 20)
+        self.assertEqual(3, len(hooked))
+        stats = wait_for(lambda s: s["passive"] >= 1 and s["idle"] >= 1)
+        self.assertEqual(stats, db2.background_checkpoint_stats())
+        self.assertGreaterEqual(stats["wal_high_water"], 100)
+        self.assertGreaterEqual(stats["checkpoint_ns"], stats["max_checkpoint_ns"])
+        self.assertGreater(stats["max_checkpoint_ns"], 0)
+        self.assertEqual(0, stats["wal_pages"])
+        self.assertEqual(0, os.path.getsize(self.db.filename_wal))
+
+        # idle checkpoint is retried while busy
+        self.db.set_wal_hook(None)
+        self.db.execute("insert into foo values(1)")
+        reader = apsw.Connection(self.db.filename)
+        reader.execute("begin; select count(*) from foo").get
+        db2.execute("insert into foo values(2)")
+        stats = wait_for(lambda s: s["busy"] >= 2)
+        reader.execute("commit")
+        idle = stats["idle"]
+        wait_for(lambda s: s["idle"] > idle)
+        self.assertEqual(0, os.path.getsize(self.db.filename_wal))
+        reader.close()
+
+        # disabling and closing stop it
+        self.db.set_background_checkpoint(0)
+        self.assertEqual(zero, self.db.background_checkpoint_stats())
+        self.assertNotEqual(zero, db2.background_checkpoint_stats())
+        db2.close()
+        self.db.execute("insert into foo values(3)")
+        self.assertNotEqual(0, os.path.getsize(self.db.filename_wal))
+        # automatic checkpointing is restored
+        self.assertEqual(1000, self.db.pragma("wal_autocheckpoint"))
+        self.db.wal_autocheckpoint(77)
+        self.db.set_background_checkpoint(50)
+        self.assertEqual(0, self.db.pragma("wal_autocheckpoint"))
+        self.db.set_background_checkpoint(0)
+        self.assertEqual(77, self.db.pragma("wal_autocheckpoint"))
+
+    def testScanStatus(self):
+        "Cursor.scanstatus and apsw.ext.format_scanstatus"
+        items = [
+            dict(id=2, parent=0, loops=1, visits=1000, estimated_rows=1048576.0, cycles=300, name="t", explain="SCAN t"),
+            dict(id=3, parent=2, loops=1000, visits=900, estimated_rows=10.0, cycles=0, name="i",
+                 explain="SEARCH u USING INDEX i (x=?)"),
+            dict(id=5, parent=0, loops=0, visits=0, estimated_rows=0.0, cycles=100, name=None,
+                 explain="USE TEMP B-TREE FOR ORDER BY"),
+        ]
+        self.assertEqual(
+            apsw.ext.format_scanstatus(items), """QUERY PLAN (cycles=400 [100%])
+|--SCAN t (loops=1 rows=1000 est=1048576 cycles=300 [75%])
+|  `--SEARCH u USING INDEX i (x=?) (loops=1000 rows=900 est=10 cycles=0 [0%])
+`--USE TEMP B-TREE FOR ORDER BY (cycles=100 [25%])""")
+        for item in items:
+            item["cycles"] = 0
+        self.assertEqual(apsw.ext.format_scanstatus(items).split("\n")[1], "|--SCAN t (loops=1 rows=1000 est=1048576)")
+        self.assertEqual("QUERY PLAN", apsw.ext.format_scanstatus([]))
+
+        if not hasattr(apsw.Cursor, "scanstatus"):
+            return
+
+        self.db.execute("create table t(x); create table u(x); create index ux on u(x)")
+        self.db.executemany("insert into t values(?)", ((i, ) for i in range(100)))
+        self.db.executemany("insert into u values(?)", ((i, ) for i in range(0, 100, 2)))
+        query = "select t.x from t, u where t.x = u.x order by t.x desc"
+        cur = self.db.execute(query)
+        next(cur)
+        status = cur.scanstatus()
+        self.assertTrue(any(s["name"] == "t" for s in status))
+        self.assertTrue(all(isinstance(s["explain"], str) for s in status))
+        cur.scanstatus_reset()
+        self.assertTrue(all(s["loops"] == 0 and s["visits"] == 0 for s in cur.scanstatus()))
+        cur.fetchall()
+        self.assertRaises(apsw.ExecutionCompleteError, cur.scanstatus)
+        self.assertRaises(apsw.ExecutionCompleteError, cur.scanstatus_reset)
+
+        profiles = []
+        self.db.trace_v2(apsw.SQLITE_TRACE_PROFILE, profiles.append)
+        for i in range(2):
+            self.db.execute(query).fetchall()
+        self.db.trace_v2(0)
+        # counters are reset for each execution
+        counts = [[(s["loops"], s["visits"]) for s in p["scanstatus"]] for p in profiles]
+        self.assertEqual(counts[0], counts[1])
+        self.assertTrue(any(visits >= 50 for loops, visits in counts[0]))
+        self.assertIn("SCAN t", apsw.ext.format_scanstatus(profiles[0]["scanstatus"]))
+
+        # but not by tracing without profiling
+        self.db.trace_v2(apsw.SQLITE_TRACE_STMT, lambda x: None)
+        for i in range(2):
+            self.db.execute(query).fetchall()
+        cur = self.db.execute(query)
+        next(cur)
+        self.assertTrue(any(s["name"] == "t" and s["visits"] >= 300 for s in cur.scanstatus()))
+        cur.fetchall()
+        self.db.trace_v2(0)
+
     def testWikipedia(self):
         "Use front page of wikipedia to check unicode handling"
         self.db.close()
@@ -5350,6 +6257,11 @@ class APSW(unittest.TestCase):
                         'match': re.compile(r"(sqlite3_[A-Za-z0-9_]+)\s*\("),
                         # what must also be on same or preceding line
                         'needs': re.compile("PYSQLITE(_|_BLOB_|_CON_|_CUR_|_SC_|_VOID_|_BACKUP_)CALL"),
+                        # these run without the GIL, on the background checkpoint
+                        # thread's own connection or with the database mutex
+                        # already held by the caller
+                        'skipfunctions': re.compile("^(checkpointer_run|checkpointer_thread"
+                                                    "|resultcache_signature|resultcache_analyse)$"),
 
            # except if match.group(1) matches this - these don't
            # acquire db mutex so no need to wrap (determined by
@@ -5363,12 +6275,13 @@ class APSW(unittest.TestCase):
                         'skipcalls': re.compile("^sqlite3_(blob_bytes|column_count|bind_parameter_count|data_count|vfs_.+|changes64|total_changes64"
                                                 "|get_" "autocommit|last_insert_rowid|complete|interrupt|limit|malloc64|free|threadsafe|value_.+"
                                                 "|libversion|enable_" "shared_cache|initialize|shutdown|config|memory_.+|soft_heap_limit64|hard_heap_limit64"
-                                                "|randomness|db_readonly|db_filename|release_" "memory|status64|result_.+|user_data|mprintf|aggregate_context"
-                                                "|declare_vtab|backup_remaining|backup_pagecount|mutex_enter|mutex_leave|sourceid|uri_.+"
+                                                "|randomness|db_readonly|db_filename|release_" "memory|status64|result_.+|user_data|mprintf|aggregate_context|realloc64"
+                                                "|declare_vtab|backup_remaining|backup_pagecount|mutex_alloc|mutex_free|mutex_enter|mutex_leave|sourceid|uri_.+"
                                                 "|column_name|column_decltype|column_database_name|column_table_name|column_origin_name"
-                                                "|stmt_isexplain|stmt_readonly|filename_journal|filename_wal|stmt_status|sql|log|vtab_collation"
+                                                "|bind_parameter_name|stmt_isexplain|stmt_readonly|filename_journal|filename_wal|stmt_status|stmt_scanstatus_v2"
+                                                "|stmt_scanstatus_reset|sql|log|vtab_collation"
                                                 "|vtab_rhs_value|vtab_distinct|vtab_config|vtab_on_conflict|vtab_in_first|vtab_in_next|vtab_in"
-                                                "|vtab_nochange|is_interrupted|extended_errcode)$"),
+                                                "|vtab_nochange|is_interrupted|extended_errcode|keyword_check)$"),
                         # error message
                         'desc': "sqlite3_ calls must wrap with PYSQLITE_CALL",
                         },
@@ -5388,6 +6301,8 @@ class APSW(unittest.TestCase):
             for k, v in self.calls.items():
                 if v.get('skipfiles', None) and v['skipfiles'].match(filename):
                     continue
+                if v.get('skipfunctions', None) and v['skipfunctions'].match(name):
+                    continue
                 mo = v['match'].search(line)
                 if mo:
                     func = mo.group(1)
@@ -5405,13 +6320,13 @@ class APSW(unittest.TestCase):
                     f"file { filename } function { name } calls PyGILState_Ensure but does not have MakeExistingException"
                 )
         # not further checked
-        if name.split("_")[0] in ("ZeroBlobBind", "APSWVFS", "APSWVFSFile", "APSWBuffer", "FunctionCBInfo"):
+        if name.split("_")[0] in ("ZeroBlobBind", "CArray", "APSWVFS", "APSWVFSFile", "APSWBuffer", "FunctionCBInfo"):
             return
 
         checks = {
             "APSWCursor": {
                 "skip": ("dealloc", "init", "dobinding", "dobindings", "do_exec_trace", "do_row_trace", "step", "close",
-                         "close_internal", "tp_traverse", "tp_str"),
+                         "close_internal", "tp_traverse", "tp_str", "limits_begin"),
                 "req": {
                     "use": "CHECK_USE",
                     "closed": "CHECK_CURSOR_CLOSED",
@@ -5421,7 +6336,7 @@ class APSW(unittest.TestCase):
             "Connection": {
                 "skip": ("internal_cleanup", "dealloc", "init", "close", "interrupt", "close_internal",
                          "remove_dependent", "readonly", "getmainfilename", "db_filename", "traverse", "clear",
-                         "tp_traverse", "get_cursor_factory", "set_cursor_factory", "tp_str"),
+                         "tp_traverse", "get_cursor_factory", "set_cursor_factory", "tp_str", "add_dependent"),
                 "req": {
                     "use": "CHECK_USE",
                     "closed": "CHECK_CLOSED",
@@ -5444,6 +6359,12 @@ class APSW(unittest.TestCase):
                 },
                 "order": ("use", "closed")
             },
+            "TraceRecorder": {
+                "skip": ("dealloc", "init", "close", "close_internal", "tp_str"),
+                "req": {
+                    "closed": "CHECK_RECORDER_CLOSED"
+                },
+            },
             "apswvfs": {
                 "req": {
                     "preamble": "VFSPREAMBLE",
@@ -5598,6 +6519,36 @@ class APSW(unittest.TestCase):
                     name2 = m.group(1)
                     continue
 
+    def testConnectionsList(self):
+        "apsw.connections tracking"
+        self.db.close()
+        self.db = None
+        gc.collect()
+        base = apsw.connections()
+        cons = [apsw.Connection("") for _ in range(5)]
+        self.assertEqual(base + cons, apsw.connections())
+        # remove from middle, head and tail
+        cons[2].close()
+        cons[2].close()
+        self.assertEqual(base + cons[:2] + cons[3:], apsw.connections())
+        del cons[2]
+        for i in (0, -1):
+            cons.pop(i)
+            gc.collect()
+            self.assertEqual(base + cons, apsw.connections())
+        # churn
+        for i in range(1000):
+            cons.append(apsw.Connection(""))
+            if i % 3:
+                cons.pop(i % len(cons)).close()
+        self.assertEqual(base + cons, apsw.connections())
+        for c in cons:
+            c.close()
+        self.assertEqual(base, apsw.connections())
+        # failed open is not included
+        self.assertRaises(apsw.CantOpenError, apsw.Connection, "/no/such/directory/db", flags=apsw.SQLITE_OPEN_READWRITE)
+        self.assertEqual(base, apsw.connections())
+
     def testConfig(self):
         "Verify sqlite3_config wrapper"
         # we need to ensure there are no outstanding sqlite objects
@@ -6193,6 +7144,191 @@ class APSW(unittest.TestCase):
         self.assertRaisesUnraisable(ZeroDivisionError, self.db.execute, query)
         self.assertEqual(0, len(results))
 
+    def testTraceRecorder(self):
+        "TraceRecorder and Connection.set_trace_recorder"
+        import apsw.trace
+        fname = TESTFILEPREFIX + "testfile"
+        self.assertRaises(TypeError, apsw.TraceRecorder)
+        self.assertRaises(TypeError, apsw.TraceRecorder, fname, "big")
+        self.assertRaises(TypeError, self.db.set_trace_recorder, 3)
+
+        rec = apsw.TraceRecorder(fname)
+        self.assertEqual(rec.filename, fname)
+
+        profiled = []
+        self.db.set_profile(lambda sql, ns: profiled.append(sql))
+        self.db.set_trace_recorder(rec)
+        self.db.execute("create table foo(x,y)")
+        vals = (None, 3, 3.25, "a\u1234b", b"\x00\x01", "x" * 5000)
+        for v in vals:
+            self.db.execute("insert into foo values(?, ?)", (v, v))
+        self.db.execute("insert into foo values(:x, $y)", {"x": apsw.zeroblob(7), "y": -1})
+        self.assertEqual(7, len(self.db.execute("select * from foo").fetchall()))
+        # profiling continues to work alongside
+        self.assertEqual(9, len(profiled))
+        self.db.set_trace_recorder(None)
+        self.db.execute("select 3").fetchall()
+        stats = rec.stats()
+        self.assertEqual(stats["overwritten"], 0)
+        self.assertGreater(stats["records"], 20)
+        rec.close()
+        rec.close()
+        self.assertRaises(ValueError, rec.stats)
+        self.assertIn("closed", str(rec))
+
+        records = list(apsw.trace.read_trace_recording(fname))
+        self.assertEqual(records[0]["type"], "open")
+        self.assertEqual(records[-1], {"type": "close", "connection": records[0]["connection"]})
+        execs = [r for r in records if r["type"] == "exec"]
+        self.assertEqual(len(execs), 9)
+        self.assertEqual(len(set(r["hash"] for r in execs)), 4)
+        self.assertEqual(len([r for r in records if r["type"] == "sql"]), 4)
+        self.assertEqual(execs[-1]["rows"], 7)
+        self.assertEqual(execs[-1]["sql"], "select * from foo")
+        for v, r in zip(vals, execs[1:]):
+            if isinstance(v, str) and len(v) > 4096:
+                v = v[:4096]
+            self.assertEqual(r["bindings"], (v, v))
+        self.assertEqual(execs[7]["bindings"][1], -1)
+        self.assertEqual(execs[7]["bindings"][0].length(), 7)
+        for r in execs:
+            self.assertEqual(r["thread"], threading.get_ident())
+            self.assertGreaterEqual(r["nanoseconds"], 0)
+            self.assertLess(abs(r["start"] - time.time()), 60)
+
+        # triggers starting don't restart the statement's timing and rows
+        rec = apsw.TraceRecorder(fname)
+        self.db.execute("create table trig(x); create trigger trig_t after insert on trig begin select 1; end")
+        self.db.create_scalar_function("slow", lambda x: time.sleep(0.02) or x)
+        self.db.set_trace_recorder(rec)
+        self.db.execute("""insert into trig with recursive c(x) as
+                (select 1 union all select x+1 from c where x<5) select slow(x) from c""")
+        self.assertEqual(5, len(self.db.execute("select x from trig").fetchall()))
+        self.db.set_trace_recorder(None)
+        rec.close()
+        execs = [r for r in apsw.trace.read_trace_recording(fname) if r["type"] == "exec"]
+        self.assertEqual(2, len(execs))
+        self.assertGreaterEqual(execs[0]["nanoseconds"], 5 * 20_000_000)
+        self.assertEqual(5, execs[1]["rows"])
+
+        # ring wrapping
+        rec = apsw.TraceRecorder(fname, 1)
+        self.assertEqual(rec.stats()["size"], 65536 - 64)
+        self.db.set_trace_recorder(rec)
+        for i in range(5000):
+            self.db.execute("select ?", (i, )).fetchall()
+        stats = rec.stats()
+        self.assertGreater(stats["overwritten"], 0)
+        self.assertLessEqual(stats["used"], stats["size"])
+        # closed recorder silently stops recording
+        rec.close()
+        self.db.execute("select 4").fetchall()
+        records = list(apsw.trace.read_trace_recording(fname))
+        self.assertEqual(records[-1]["bindings"], (4999, ))
+        self.assertEqual(records[-1]["sql"], "select ?")
+        self.db.set_trace_recorder(None)
+
+        # report generation
+        class options:
+            output = "-"
+            read = fname
+            report = True
+            reports = ("summary", "popular")
+            reportn = 5
+            length = 30
+
+        out = io.StringIO()
+        t = apsw.trace.APSWTracer(options)
+        t._writer = out.write
+        t.load_recording(fname)
+        t.report()
+        self.assertIn("select ?", out.getvalue())
+
+        with open(fname, "wb") as f:
+            f.write(b"not a trace" * 10)
+        self.assertRaises(ValueError, list, apsw.trace.read_trace_recording(fname))
+
+    def testReplay(self):
+        "apsw.replay capture and replay"
+        import apsw.replay
+        fname = TESTFILEPREFIX + "testfile"
+        capture = apsw.replay.Capture(fname)
+        try:
+            db = apsw.Connection(TESTFILEPREFIX + "testdb2")
+            db.execute("create table foo(x,y); create index fooy on foo(y)")
+            with db:
+                for i in range(20):
+                    db.execute("insert into foo values(?,?)", (i, b"\x00" * i))
+            db.execute("insert into foo values(:x, :y)", {"x": 99, "y": apsw.zeroblob(3)})
+            # can't be encoded, and must not stop the statement
+            self.assertEqual([1, 2], db.execute("select value from carray(?)", (apsw.carray([1, 2]), )).get)
+
+            def worker():
+                con = apsw.Connection(TESTFILEPREFIX + "testdb2")
+                for i in range(5):
+                    con.execute("select * from foo where x=?", (i, )).fetchall()
+                con.close()
+
+            t = ThreadRunner(worker)
+            t.start()
+            t.go()
+            db.close()
+        finally:
+            capture.close()
+
+        workload = apsw.replay.Workload.load(fname)
+        self.assertEqual(2, len(workload.connections))
+        self.assertEqual(2, len(set(e.thread for e in workload.executions)))
+        inserts = [e for e in workload.executions if e.sql.startswith("insert")]
+        self.assertEqual(21, len(inserts))
+        self.assertEqual((3, b"\x00\x00\x00"), inserts[3].bindings)
+        self.assertEqual(3, inserts[-1].bindings["y"].length())
+        self.assertTrue(all(e.nanoseconds is not None for e in inserts))
+        carrays = [e for e in workload.executions if "carray" in e.sql]
+        self.assertEqual(1, len(carrays))
+        self.assertIn("carray", carrays[0].bindings[0])
+
+        deletefile(TESTFILEPREFIX + "testdb2")
+        res = apsw.replay.replay(workload, TESTFILEPREFIX + "testdb2", paced=False)
+        self.assertEqual(len(workload.executions), res.executions)
+        self.assertEqual(0, res.errors)
+        h = apsw.replay.statement_hash("select * from foo where x=?")
+        self.assertEqual(5, res.statements[h].count)
+        self.assertIn(h, res.original)
+        self.assertLessEqual(res.statements[h].p50, res.statements[h].max)
+        self.assertIn(h, apsw.replay.format_result(res))
+        db = apsw.Connection(TESTFILEPREFIX + "testdb2")
+        self.assertEqual(21, db.execute("select count(*) from foo").get)
+        db.close()
+
+        # failing to open is counted as errors without stopping other threads
+        res = apsw.replay.replay(workload, "/no/such/directory/db", paced=False)
+        self.assertEqual(len(workload.executions), res.executions)
+        self.assertEqual(len(workload.executions), res.errors)
+
+        self.assertEqual(99, apsw.replay._percentile(list(range(1, 101)), 99))
+        self.assertEqual(5, apsw.replay._percentile(list(range(1, 11)), 50))
+        self.assertEqual(10, apsw.replay._percentile(list(range(1, 11)), 100))
+
+        # paced replay of a trace recording
+        deletefile(TESTFILEPREFIX + "testdb2")
+        rec = apsw.TraceRecorder(fname)
+        db = apsw.Connection(TESTFILEPREFIX + "testdb2")
+        db.set_trace_recorder(rec)
+        db.execute("create table bar(x)")
+        for i in range(3):
+            db.execute("insert into bar values(?)", (i, ))
+        db.close()
+        rec.close()
+        deletefile(TESTFILEPREFIX + "testdb2")
+        workload = apsw.replay.Workload.load(fname)
+        self.assertEqual(4, len(workload.executions))
+        res = apsw.replay.replay(workload, TESTFILEPREFIX + "testdb2", speed=10)
+        self.assertEqual(0, res.errors)
+        db = apsw.Connection(TESTFILEPREFIX + "testdb2")
+        self.assertEqual(3, db.execute("select sum(x) from bar").get)
+        db.close()
+
     def testURIFilenames(self):
         assertRaises = self.assertRaises
         assertEqual = self.assertEqual
@@ -6237,6 +7373,56 @@ class APSW(unittest.TestCase):
                           flags=apsw.SQLITE_OPEN_READWRITE | apsw.SQLITE_OPEN_CREATE | apsw.SQLITE_OPEN_URI,
                           vfs="uritest")
 
+    def testVFSMmap(self):
+        "Verify memory mapped reads pass through to inherited files"
+        reads = []
+
+        class CountingFile(apsw.VFSFile):
+
+            def __init__(self, name, flags):
+                super().__init__("", name, flags)
+                # an instance attribute is not seen as overriding the class
+                self.xRead = self.count_read
+
+            def count_read(self, amount, offset):
+                reads.append(offset)
+                return apsw.VFSFile.xRead(self, amount, offset)
+
+        class OverriddenFile(CountingFile):
+
+            def xRead(self, amount, offset):
+                return super().xRead(amount, offset)
+
+        class MmapVFS(apsw.VFS):
+
+            def __init__(self, name, filecls):
+                self.filecls = filecls
+                super().__init__(name, "")
+
+            def xOpen(self, name, flags):
+                return self.filecls(name, flags)
+
+        db = apsw.Connection(TESTFILEPREFIX + "testdb")
+        db.execute("create table foo(x); begin")
+        for i in range(500):
+            db.execute("insert into foo values(?)", (os.urandom(2000), ))
+        db.execute("commit")
+        db.close()
+
+        for name, filecls, mmapped in (("mmapinherit", CountingFile, True), ("mmapoverride", OverriddenFile, False)):
+            vfs = MmapVFS(name, filecls)
+            db = apsw.Connection(TESTFILEPREFIX + "testdb", vfs=name)
+            db.execute("pragma mmap_size=%d" % (16 * 1024 * 1024))
+            reads.clear()
+            self.assertEqual(500, len(db.execute("select x from foo").fetchall()))
+            # the header is still read via xRead
+            if mmapped:
+                self.assertLess(len(reads), 10)
+            else:
+                self.assertGreater(len(reads), 100)
+            db.close()
+            vfs.unregister()
+
     def testVFSWithWAL(self):
         "Verify VFS using WAL"
         apsw.connection_hooks.append(
@@ -10341,6 +11527,187 @@ SELECT group_concat(rtrim(t),x'0a') FROM a;
         # at time of writing it was 24 nodes
         self.assertGreater(count(qd.query_plan), 10)
 
+    def testExtGroupCommitWriter(self) -> None:
+        "apsw.ext.GroupCommitWriter"
+        self.assertRaises(apsw.CantOpenError,
+                          apsw.ext.GroupCommitWriter,
+                          "/no/such/directory/db",
+                          flags=apsw.SQLITE_OPEN_READWRITE)
+
+        fname = TESTFILEPREFIX + "testdb2"
+        writer = apsw.ext.GroupCommitWriter(fname,
+                                            max_delay=0.05,
+                                            setup=lambda con: con.execute("create table t(x unique)"))
+        futures = []
+
+        def submitter(n):
+            for i in range(50):
+                futures.append(writer.execute("insert into t values(?)", (n * 1000 + i, )))
+
+        threads = [ThreadRunner(submitter, n) for n in range(6)]
+        for t in threads:
+            t.go()
+
+        def multi(con):
+            con.execute("insert into t values(-1)")
+            with con:
+                con.execute("insert into t values(-2)")
+            return "multi"
+
+        def failing(con):
+            con.execute("insert into t values(-3)")
+            con.execute("insert into t values(0)")
+
+        fail = writer.submit(failing)
+        ok = writer.submit(multi)
+        self.assertEqual("multi", ok.result())
+        self.assertRaises(apsw.ConstraintError, fail.result)
+        for f in futures:
+            self.assertEqual([], f.result())
+
+        with writer:
+            pass
+        self.assertRaises(ValueError, writer.execute, "select 3")
+        writer.close()
+        self.assertEqual(302, writer.stats["submissions"])
+        self.assertEqual(1, writer.stats["failed"])
+        self.assertLess(writer.stats["commits"], 302)
+        self.assertGreater(writer.stats["largest_batch"], 1)
+
+        db = apsw.Connection(fname)
+        self.assertEqual(302, db.execute("select count(*) from t").get)
+        self.assertEqual(0, db.execute("select count(*) from t where x=-3").get)
+
+        # failing to start the transaction fails every submission
+        with apsw.ext.GroupCommitWriter(fname) as writer:
+            db.execute("begin immediate")
+            self.assertRaises(apsw.BusyError, writer.execute("insert into t values(-4)").result, 10)
+            self.assertEqual(0, writer.stats["commits"])
+            db.execute("rollback")
+            writer.execute("insert into t values(-4)").result(10)
+            self.assertEqual(1, writer.stats["commits"])
+        db.close()
+
+    def testExtConnectionCache(self) -> None:
+        "apsw.ext.ConnectionCache"
+        self.assertRaises(ValueError, apsw.ext.ConnectionCache, max_open=0)
+        names = [TESTFILEPREFIX + name for name in ("testdb2", "testdb3", "testdb2x", "testfile2")]
+        opened = []
+
+        def setup(con):
+            opened.append(con)
+            con.execute("create table if not exists t(x)")
+
+        cache = apsw.ext.ConnectionCache(max_open=3, setup=setup, statementcachesize=7)
+        self.assertRaises(apsw.CantOpenError, cache.checkout("/no/such/directory/db").__enter__)
+        self.assertEqual(0, len(cache))
+
+        with cache.checkout(names[0]) as con:
+            con.execute("insert into t values(1)")
+            # same database while checked out gets a different connection
+            with cache.checkout(names[0]) as con2:
+                self.assertIsNot(con, con2)
+                self.assertEqual(2, len(cache))
+        with cache.checkout(names[0]) as con3:
+            self.assertIn(con3, (con, con2))
+            self.assertEqual(7, con3.cache_stats()["size"])
+            # transactions left open are rolled back
+            con3.execute("begin; insert into t values(2)")
+        self.assertEqual(2, len(opened))
+        self.assertEqual(1, cache.stats["hits"])
+
+        # least recently used are closed
+        for name in names[1:]:
+            with cache.checkout(name) as con:
+                self.assertEqual(0, con.execute("select count(*) from t").get)
+                # closed before opening, not when returned
+                self.assertLessEqual(len(cache), 3)
+        self.assertEqual(3, len(cache))
+        self.assertEqual(2, cache.stats["closes"])
+        self.assertRaises(apsw.ConnectionClosedError, opened[0].execute, "select 3")
+        self.assertRaises(apsw.ConnectionClosedError, opened[1].execute, "select 3")
+        with cache.checkout(names[3]) as con:
+            self.assertIs(con, opened[-1])
+
+        # different flags are a different key
+        last = opened[-1]
+        with cache.checkout(names[3], flags=apsw.SQLITE_OPEN_READONLY) as con:
+            self.assertIsNot(con, last)
+            self.assertRaises(apsw.ReadOnlyError, con.execute, "insert into t values(3)")
+            self.assertEqual(3, len(cache))
+            # closed connections are discarded
+            con.close()
+        self.assertEqual(2, len(cache))
+
+        # idle timeout
+        cache.idle_timeout = 0
+        cache.prune()
+        self.assertEqual(0, len(cache))
+        cache.idle_timeout = 300
+
+        # many threads
+        def worker(n):
+            for i in range(50):
+                with cache.checkout(names[(n + i) % len(names)]) as con:
+                    con.execute("select count(*) from t").get
+                    self.assertLessEqual(len(cache), 3 + 6)
+
+        threads = [ThreadRunner(worker, n) for n in range(6)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.go()
+        self.assertLessEqual(len(cache), 3)
+
+        with cache.checkout(names[0]) as con:
+            cache.close()
+            self.assertEqual(1, len(cache))
+            self.assertEqual(1, con.execute("select count(*) from t").get)
+        self.assertEqual(0, len(cache))
+        self.assertRaises(apsw.ConnectionClosedError, con.execute, "select 3")
+        self.assertRaises(ValueError, cache.checkout(names[0]).__enter__)
+        self.assertEqual(cache.stats["opens"], cache.stats["closes"] + 1)
+
+    def testExtIndexAdvisor(self) -> None:
+        "apsw.ext.index_advisor"
+        self.db.execute("""create table t(a, b, c, "d e"); create index ta on t(a);
+                           create table u(x primary key, y); create view v as select * from t where c>3;
+                           insert into t values(1, 2, 3, 4)""")
+        schema = self.db.execute("select sql from sqlite_schema").fetchall()
+        queries = [
+            "select * from t where b=? and c>?",
+            "select * from t where a=1",
+            "select * from t where a=:a and b>3",
+            "select * from t join u on t.\"d e\"=u.y where u.x=3",
+            "update t set c=1 where c=?",
+            "select * from u order by y desc",
+            "select * from v where b=1",
+            "select * from nosuch",
+        ]
+        advice = apsw.ext.index_advisor(self.db, queries)
+        # nothing changed
+        self.assertEqual(schema, self.db.execute("select sql from sqlite_schema").fetchall())
+        self.assertEqual([q.query for q in advice.queries], queries)
+        by_query = {q.query: q for q in advice.queries}
+        self.assertIn("no such table", by_query["select * from nosuch"].error)
+        self.assertEqual([], by_query["select * from t where a=1"].indexes)
+        self.assertIn("SCAN", by_query[queries[0]].before.sub[0].detail)
+        self.assertIn(by_query[queries[0]].indexes[0], by_query[queries[0]].after.sub[0].detail)
+
+        columns = {r.columns: r for r in advice.recommendations}
+        self.assertEqual({("b", "c"), ("a", "b"), ("d e", ), ("c", ), ("y", )}, set(columns))
+        self.assertEqual(columns[("b", "c")].queries, [queries[0], "select * from v where b=1"])
+        self.assertIn('"y" DESC', columns[("y", )].sql)
+        for r in advice.recommendations:
+            self.db.execute(r.sql)
+            self.assertEqual(r.table, self.db.execute("select tbl_name from sqlite_schema where name=?", (r.name, )).get)
+
+        # generated columns
+        self.db.execute("create table g(a, b, c as (a + b), d as (a * b) stored)")
+        advice = apsw.ext.index_advisor(self.db, ["select * from g where c = 3 and b > 1", "select a from g where d = 2"])
+        self.assertEqual([None, None], [q.error for q in advice.queries])
+        self.assertEqual({("c", "b"), ("d", )}, {r.columns for r in advice.recommendations if r.table == "g"})
+
     def testVFSFcntlPragma(self):
         "Test wrapping fcntl pragmas"
 
@@ -6,6 +6,7 @@
 # using APSW without having to modify the program in any way.
 
 import time
+import struct
 import sys
 import weakref
 
@@ -29,7 +30,8 @@ class APSWTracer(object):
 
         try:
             import apsw
-            apsw.connection_hooks.append(self.connection_hook)
+            if not getattr(options, "read", None):
+                apsw.connection_hooks.append(self.connection_hook)
         except:
             sys.stderr.write(self.u + "Unable to import apsw\n")
             raise
@@ -46,6 +48,10 @@ class APSWTracer(object):
         self.numcursors = 0
         self.numconnections = 0
         self.timestart = time.time()
+        self.timeend = None
+        self.recorder = None
+        if getattr(options, "binary", None):
+            self.recorder = apsw.TraceRecorder(options.binary, options.binary_size)
 
     def writerpy3(self, s):
         self._writer(s + "\n")
@@ -158,6 +164,9 @@ class APSWTracer(object):
         return self.u + "|".join(op)
 
     def connection_hook(self, con):
+        if self.recorder:
+            con.set_trace_recorder(self.recorder)
+            return
         self.numconnections += 1
         if self.options.report:
             con.set_profile(self.profiler)
@@ -187,6 +196,31 @@ class APSWTracer(object):
         code = compile(open(sys.argv[0], "rb").read(), sys.argv[0], "exec")
         exec(code, d, d)
 
+    def load_recording(self, filename):
+        "Populates the report information from a :class:`apsw.TraceRecorder` file"
+        connections = set()
+        self.numcursors = None
+        self.timestart = self.timeend = None
+        for record in read_trace_recording(filename):
+            if record["type"] == "open":
+                connections.add(record["connection"])
+            if record["type"] != "exec":
+                continue
+            connections.add(record["connection"])
+            self.threadsused[record["thread"]] = True
+            sql = self.sanitizesql(record["sql"] if record["sql"] is not None else "<unknown %016x>" % record["hash"])
+            self.queries[sql] = self.queries.get(sql, 0) + 1
+            self.timings.setdefault(sql, []).append(record["nanoseconds"])
+            self.rowsreturned += record["rows"]
+            end = record["start"] + record["nanoseconds"] / 1000000000.0
+            if self.timestart is None or record["start"] < self.timestart:
+                self.timestart = record["start"]
+            if self.timeend is None or end > self.timeend:
+                self.timeend = end
+        self.numconnections = len(connections)
+        if self.timestart is None:
+            self.timestart = self.timeend = 0
+
     def mostpopular(self, howmany):
         all = [(v, k) for k, v in self.queries.items()]
         all.sort()
@@ -211,15 +245,20 @@ class APSWTracer(object):
 
     def report(self):
         import time
+        if self.recorder:
+            self.recorder.close()
+            if self.options.report:
+                self.load_recording(self.options.binary)
         if not self.options.report:
             return
         w = lambda *args: self.writer(self.u + " ".join(args))
         if "summary" in self.options.reports:
             w("APSW TRACE SUMMARY REPORT")
             w()
-            w("Program run time                   ", "%.03f seconds" % (time.time() - self.timestart, ))
+            w("Program run time                   ",
+              "%.03f seconds" % ((self.timeend if self.timeend is not None else time.time()) - self.timestart, ))
             w("Total connections                  ", str(self.numconnections))
-            w("Total cursors                      ", str(self.numcursors))
+            w("Total cursors                      ", str(self.numcursors) if self.numcursors is not None else "n/a")
             w("Number of threads used for queries ", str(len(self.threadsused)))
         total = 0
         for k, v in self.queries.items():
@@ -270,6 +309,107 @@ class APSWTracer(object):
                 w(fmtfloat(t / 1000000000.0, total=fmtt), self.formatstring(query, '', False))
 
 
+def read_trace_recording(filename):
+    """Yields each record in a :class:`apsw.TraceRecorder` file, oldest first.
+
+    Each record is a dict with a *type* key.  Other keys depend on the type:
+
+    * ``open`` - *connection* (an integer id) and *filename* when a connection starts recording
+    * ``close`` - *connection* when it stops recording
+    * ``sql`` - *hash* and *sql* text of a statement
+    * ``bindings`` - *connection*, *hash* and *bindings* (a tuple) for the next execution
+    * ``exec`` - *connection*, *hash*, *sql*, *bindings*, *thread*, *start*
+      (seconds since the epoch), *nanoseconds* and *rows* for a completed execution.
+      *sql* is None if the text is no longer in the ring, and *bindings* is None
+      if there were none.
+
+    Text and blob bindings longer than 4kb are truncated.
+    """
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    if len(data) < 64 or data[:8] != b"APSWTRC1":
+        raise ValueError(f"{ filename } is not a trace recording")
+    order = "<" if struct.unpack("<I", data[8:12])[0] == 0x01020304 else ">"
+    version, data_size, head, tail = struct.unpack(order + "IQQQ", data[12:40])
+    if version != 1:
+        raise ValueError(f"Unsupported trace recording version { version }")
+    ring = data[64:64 + data_size]
+
+    records = []
+    sql = {}
+    pos = tail
+    while pos < head:
+        offset = pos % data_size
+        length, rtype = struct.unpack(order + "II", ring[offset:offset + 8])
+        if length < 8:
+            raise ValueError(f"Corrupt record at offset { offset }")
+        body = ring[offset + 8:offset + length]
+        pos += length
+        if rtype == 0:
+            continue
+        if rtype == 1:
+            h, n = struct.unpack(order + "QQ", body[:16])
+            sql[h] = body[16:16 + n].decode("utf8", "replace")
+            records.append({"type": "sql", "hash": h, "sql": sql[h]})
+        elif rtype == 2:
+            c, n = struct.unpack(order + "QQ", body[:16])
+            records.append({"type": "open", "connection": c, "filename": body[16:16 + n].decode("utf8", "replace")})
+        elif rtype == 3:
+            records.append({"type": "close", "connection": struct.unpack(order + "Q", body[:8])[0]})
+        elif rtype == 4:
+            c, h, count = struct.unpack(order + "QQQ", body[:24])
+            records.append({"type": "bindings", "connection": c, "hash": h, "bindings": _decode_bindings(order, body[24:], count)})
+        elif rtype == 5:
+            c, h, thread, start, ns, rows = struct.unpack(order + "QQQqQQ", body[:48])
+            records.append({
+                "type": "exec",
+                "connection": c,
+                "hash": h,
+                "thread": thread,
+                "start": start / 1000000000.0,
+                "nanoseconds": ns,
+                "rows": rows
+            })
+        else:
+            raise ValueError(f"Unknown record type { rtype } at offset { offset }")
+
+    # the text may only appear after executions that use it if the ring wrapped
+    pending = {}
+    for record in records:
+        if record["type"] == "bindings":
+            pending[(record["connection"], record["hash"])] = record["bindings"]
+        elif record["type"] == "exec":
+            record["sql"] = sql.get(record["hash"])
+            record["bindings"] = pending.pop((record["connection"], record["hash"]), None)
+        yield record
+
+
+def _decode_bindings(order, data, count):
+    import apsw
+    res = []
+    pos = 0
+    for _ in range(count):
+        vtype = data[pos]
+        kind = vtype & 0x7f
+        pos += 1
+        if kind == 0:
+            res.append(None)
+        elif kind in (1, 5):
+            v = struct.unpack(order + "q", data[pos:pos + 8])[0]
+            res.append(v if kind == 1 else apsw.zeroblob(v))
+            pos += 8
+        elif kind == 2:
+            res.append(struct.unpack(order + "d", data[pos:pos + 8])[0])
+            pos += 8
+        else:
+            n = struct.unpack(order + "I", data[pos:pos + 4])[0]
+            v = data[pos + 4:pos + 4 + n]
+            res.append(v.decode("utf8", "replace") if kind == 3 else v)
+            pos += 4 + n
+    return tuple(res)
+
+
 def fmtfloat(n, decimals=3, total=None):
     "Work around borken python float formatting"
     s = "%0.*f" % (decimals, n)
@@ -345,7 +485,22 @@ def main():
                         dest="reports",
                         default=",".join(reports),
                         help="Which reports to show [%(default)s]")
-    parser.add_argument("python-script", help="Python script to run")
+    parser.add_argument("--binary",
+                        dest="binary",
+                        metavar="FILE",
+                        help="Record with a TraceRecorder into FILE instead of using Python tracers.  "
+                        "The report is generated from FILE at exit")
+    parser.add_argument("--binary-size",
+                        dest="binary_size",
+                        metavar="BYTES",
+                        default=64 * 1024 * 1024,
+                        type=int,
+                        help="Size of the --binary recording file [%(default)s]")
+    parser.add_argument("--read",
+                        dest="read",
+                        metavar="FILE",
+                        help="Generate the report from a TraceRecorder FILE instead of running a script")
+    parser.add_argument("python-script", nargs="?", help="Python script to run")
     parser.add_argument("script-args", nargs="*", help="Optional arguments for Python script")
 
     options = parser.parse_args()
@@ -361,6 +516,18 @@ def main():
     if options.rows:
         options.sql = True
 
+    if options.read:
+        t = APSWTracer(options)
+        t.load_recording(options.read)
+        t.report()
+        return
+
+    if options.binary and (options.sql or options.rows):
+        parser.error("--binary can't be used with --sql or --rows")
+
+    if not options.python_script:
+        parser.error("You must supply a Python script to run, or --read")
+
     if not os.path.exists(options.python_script):
         parser.error(f"Unable to find script { options.python_script }")
 
@@ -109,6 +109,23 @@ API Reference
 #ifdef _MSC_VER
 #include <malloc.h>
 #endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/* vector instructions for checking text is ASCII */
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define APSW_USE_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define APSW_USE_NEON
+#endif
 
 /* Get the version number */
 #include "apswversion.h"
@@ -193,6 +210,9 @@ static void apsw_write_unraisable(PyObject *hookobject);
 /* Augment tracebacks */
 #include "traceback.c"
 
+/* JSON parsing and encoding */
+#include "jsonconvert.c"
+
 /* various utility functions and macros */
 #include "util.c"
 
@@ -205,6 +225,21 @@ static void apsw_write_unraisable(PyObject *hookobject);
 /* The statement cache */
 #include "statementcache.c"
 
+/* Binary trace recorder */
+#include "tracerecorder.c"
+
+/* In process writer queue */
+#include "writerqueue.c"
+
+/* Background WAL checkpointing */
+#include "checkpointer.c"
+
+/* Result cache for read only queries */
+#include "resultcache.c"
+
+/* carray binding and table valued function */
+#include "carray.c"
+
 /* connections */
 #include "connection.c"
 
@@ -300,66 +335,61 @@ enable_shared_cache(PyObject *Py_UNUSED(self), PyObject *const *fast_args, Py_ss
   Returns a list of the connections
 
 */
-static PyObject *the_connections;
+/* Open connections are kept in a doubly linked list threaded through
+   the Connection objects so adding and removing are O(1) no matter
+   how many there are.  The list does not hold references - a
+   Connection removes itself when closed or deallocated.  The GIL
+   protects the list. */
+static Connection *the_connections_head, *the_connections_tail;
+
 static PyObject *
 apsw_connections(PyObject *Py_UNUSED(self))
 {
-  Py_ssize_t i;
-  PyObject *res = PyList_New(0), *item = NULL;
-  for (i = 0; i < PyList_GET_SIZE(the_connections); i++)
+  Connection *con;
+  PyObject *res = PyList_New(0);
+  if (!res)
+    return NULL;
+  for (con = the_connections_head; con; con = con->connections_next)
   {
-    if (PyWeakref_GetRef(PyList_GET_ITEM(the_connections, i), &item) < 0)
-      goto fail;
-    if (item)
+    if (PyList_Append(res, (PyObject *)con))
     {
-      if (PyList_Append(res, item))
-        goto fail;
-      Py_CLEAR(item);
+      Py_DECREF(res);
+      return NULL;
     }
   }
   return res;
-fail:
-  Py_XDECREF(res);
-  Py_XDECREF(item);
-  return NULL;
 }
 
 static void
 apsw_connection_remove(Connection *con)
 {
-  Py_ssize_t i;
-  for (i = 0; i < PyList_GET_SIZE(the_connections);)
-  {
-    PyObject *wr = PyList_GET_ITEM(the_connections, i);
-    PyObject *wo = NULL;
-    if (PyWeakref_GetRef(wr, &wo) < 0)
-    {
-      apsw_write_unraisable(NULL);
-      continue;
-    }
-    if (!wo || wo == (PyObject *)con)
-    {
-      if (PyList_SetSlice(the_connections, i, i + 1, NULL))
-        apsw_write_unraisable(NULL);
-      if (!wo)
-        continue;
-      Py_DECREF(wo);
-      return;
-    }
-    Py_DECREF(wo);
-    i++;
-  }
+  if (!con->connections_prev && the_connections_head != con)
+    return;
+
+  if (con->connections_prev)
+    con->connections_prev->connections_next = con->connections_next;
+  else
+    the_connections_head = con->connections_next;
+
+  if (con->connections_next)
+    con->connections_next->connections_prev = con->connections_prev;
+  else
+    the_connections_tail = con->connections_prev;
+
+  con->connections_prev = con->connections_next = NULL;
 }
 
 static int
 apsw_connection_add(Connection *con)
 {
-  PyObject *weakref = PyWeakref_NewRef((PyObject *)con, NULL);
-  if (!weakref)
-    return -1;
-  int res = PyList_Append(the_connections, weakref);
-  Py_DECREF(weakref);
-  return res;
+  assert(!con->connections_prev && !con->connections_next && the_connections_head != con);
+  con->connections_prev = the_connections_tail;
+  if (the_connections_tail)
+    the_connections_tail->connections_next = con;
+  else
+    the_connections_head = con;
+  the_connections_tail = con;
+  return 0;
 }
 
 /** .. method:: initialize() -> None
@@ -1768,6 +1798,34 @@ apsw_allow_missing_dict_bindings(PyObject *Py_UNUSED(module), PyObject *const *f
   Py_RETURN_FALSE;
 }
 
+/** .. method:: augment_tracebacks(value: bool) -> bool
+
+  When an exception passes through APSW's C code, a frame is added to
+  the traceback showing the C function and relevant values (see
+  :ref:`augmented stack traces <augmentedstacktraces>`).  This is
+  useful for debugging, but has a cost.  If your code deliberately
+  triggers errors at high rates, such as relying on constraint errors,
+  then call this with *False* to skip adding the frames.
+
+  The previous value is returned.
+*/
+static PyObject *
+apsw_augment_tracebacks(PyObject *Py_UNUSED(module), PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  int curval = augment_tracebacks;
+  int value;
+  {
+    Apsw_augment_tracebacks_CHECK;
+    ARG_PROLOG(1, Apsw_augment_tracebacks_KWNAMES);
+    ARG_MANDATORY ARG_bool(value);
+    ARG_EPILOG(NULL, Apsw_augment_tracebacks_USAGE, );
+  }
+  augment_tracebacks = value;
+  if (curval)
+    Py_RETURN_TRUE;
+  Py_RETURN_FALSE;
+}
+
 static PyObject *
 apsw_getattr(PyObject *Py_UNUSED(module), PyObject *name)
 {
@@ -1838,6 +1896,7 @@ static PyMethodDef module_methods[] = {
     {"set_default_vfs", (PyCFunction)apsw_set_default_vfs, METH_FASTCALL | METH_KEYWORDS, Apsw_set_default_vfs_DOC},
     {"unregister_vfs", (PyCFunction)apsw_unregister_vfs, METH_FASTCALL | METH_KEYWORDS, Apsw_unregister_vfs_DOC},
     {"allow_missing_dict_bindings", (PyCFunction)apsw_allow_missing_dict_bindings, METH_FASTCALL | METH_KEYWORDS, Apsw_allow_missing_dict_bindings_DOC},
+    {"augment_tracebacks", (PyCFunction)apsw_augment_tracebacks, METH_FASTCALL | METH_KEYWORDS, Apsw_augment_tracebacks_DOC},
 #ifdef APSW_TESTFIXTURES
     {"_fini", (PyCFunction)apsw_fini, METH_NOARGS,
      "Frees all caches and recycle lists"},
@@ -1899,7 +1958,7 @@ PyInit_apsw(void)
     goto fail;
   }
 
-  if (PyType_Ready(&ConnectionType) < 0 || PyType_Ready(&APSWCursorType) < 0 || PyType_Ready(&ZeroBlobBindType) < 0 || PyType_Ready(&APSWBlobType) < 0 || PyType_Ready(&APSWVFSType) < 0 || PyType_Ready(&APSWVFSFileType) < 0 || PyType_Ready(&apswfcntl_pragma_Type) < 0 || PyType_Ready(&APSWURIFilenameType) < 0 || PyType_Ready(&FunctionCBInfoType) < 0 || PyType_Ready(&APSWBackupType) < 0 || PyType_Ready(&SqliteIndexInfoType) < 0 || PyType_Ready(&apsw_no_change_object) < 0)
+  if (PyType_Ready(&ConnectionType) < 0 || PyType_Ready(&APSWCursorType) < 0 || PyType_Ready(&ZeroBlobBindType) < 0 || PyType_Ready(&APSWBlobType) < 0 || PyType_Ready(&APSWVFSType) < 0 || PyType_Ready(&APSWVFSFileType) < 0 || PyType_Ready(&apswfcntl_pragma_Type) < 0 || PyType_Ready(&APSWURIFilenameType) < 0 || PyType_Ready(&FunctionCBInfoType) < 0 || PyType_Ready(&APSWBackupType) < 0 || PyType_Ready(&SqliteIndexInfoType) < 0 || PyType_Ready(&apsw_no_change_object) < 0 || PyType_Ready(&TraceRecorderType) < 0 || PyType_Ready(&CArrayType) < 0)
     goto fail;
 
   /* PyStructSequence_NewType is broken in some Pythons
@@ -1921,10 +1980,6 @@ PyInit_apsw(void)
   if (!tls_errmsg)
     goto fail;
 
-  the_connections = PyList_New(0);
-  if (!the_connections)
-    goto fail;
-
   if (init_exceptions(m))
     goto fail;
 
@@ -1945,11 +2000,13 @@ PyInit_apsw(void)
   ADD(Blob, APSWBlobType);
   ADD(Backup, APSWBackupType);
   ADD(zeroblob, ZeroBlobBindType);
+  ADD(carray, CArrayType);
   ADD(VFS, APSWVFSType);
   ADD(VFSFile, APSWVFSFileType);
   ADD(VFSFcntlPragma, apswfcntl_pragma_Type);
   ADD(URIFilename, APSWURIFilenameType);
   ADD(IndexInfo, SqliteIndexInfoType);
+  ADD(TraceRecorder, TraceRecorderType);
 
 #undef ADD
 
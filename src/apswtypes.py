@@ -13,9 +13,9 @@ float, bytes, and str (unicode text)"""
 SQLiteValues = tuple[()] | tuple[SQLiteValue, ...]
 "A sequence of zero or more SQLiteValue"
 
-Bindings = Sequence[SQLiteValue | zeroblob] | Mapping[str, SQLiteValue | zeroblob]
+Bindings = Sequence[SQLiteValue | zeroblob | carray] | Mapping[str, SQLiteValue | zeroblob | carray]
 """Query bindings are either a sequence of SQLiteValue, or a dict mapping names
-to SQLiteValues.  You can also provide zeroblob in Bindings. You can use
+to SQLiteValues.  You can also provide zeroblob and carray in Bindings. You can use
 dict subclasses or any type registered with :class:`collections.abc.Mapping`
 for named bindings"""
 
@@ -126,6 +126,10 @@ Authorizer = Callable[[int, Optional[str], Optional[str], Optional[str], Optiona
 """Authorizers are called with an operation code and 4 strings (which could be None) depending
 on the operatation.  Return SQLITE_OK, SQLITE_DENY, or SQLITE_IGNORE"""
 
+AuthorizerRule = tuple[Optional[int], Optional[str], Optional[str], int]
+"""Operation code (None for any), patterns for the first two authorizer strings
+(None for any), and the result SQLITE_OK, SQLITE_DENY, or SQLITE_IGNORE"""
+
 CommitHook = Callable[[], bool]
 """Commit hook is called with no arguments and should return True to abort the commit and False
 to let it continue"""
@@ -225,6 +225,15 @@ ARG_WHICH_KEYWORD(PyObject *item, const char *kwlist[], size_t n_kwlist, const c
         argp_optindex++;                                     \
     } while (0)
 
+#define ARG_double(varname)                                 \
+    do                                                      \
+    {                                                       \
+        varname = PyFloat_AsDouble(useargs[argp_optindex]); \
+        if (varname == -1 && PyErr_Occurred())              \
+            goto param_error;                               \
+        argp_optindex++;                                    \
+    } while (0)
+
 #define ARG_TYPE_CHECK(varname, type, cast)                                                                              \
     do                                                                                                                   \
     {                                                                                                                    \
@@ -244,6 +253,18 @@ ARG_WHICH_KEYWORD(PyObject *item, const char *kwlist[], size_t n_kwlist, const c
 
 #define ARG_Connection(varname) ARG_TYPE_CHECK(varname, (PyObject *)&ConnectionType, Connection *)
 
+#define ARG_optional_TraceRecorder(varname)                                             \
+    do                                                                                  \
+    {                                                                                   \
+        if (Py_IsNone(useargs[argp_optindex]))                                          \
+        {                                                                               \
+            varname = NULL;                                                             \
+            argp_optindex++;                                                            \
+        }                                                                               \
+        else                                                                            \
+            ARG_TYPE_CHECK(varname, (PyObject *)&TraceRecorderType, TraceRecorder *);   \
+    } while (0)
+
 /* PySequence_Check is too strict and rejects things that are
     accepted by PySequence_Fast like sets and generators,
     so everything is accepted */
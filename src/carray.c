@@ -0,0 +1,452 @@
+/*
+  Array binding and the carray table valued function
+
+  See the accompanying LICENSE file.
+*/
+
+/**
+
+.. _carray:
+
+Array Binding
+*************
+
+Testing if a value is one of many is usually written as ``WHERE id IN
+(?, ?, ?)`` which needs different SQL for each number of values.
+That defeats the :ref:`statement cache <statementcache>`, and
+thousands of values make for very long SQL.
+
+Instead bind a :class:`carray` and use the ``carray`` `table valued
+function <https://sqlite.org/vtab.html#tabfunc2>`__ which is
+automatically available on every :class:`Connection`.  The same SQL
+works for any number of values.
+
+.. code-block:: python
+
+    ids = apsw.carray(array.array("q", [1, 7, 93, 4000]))
+    for row in connection.execute("SELECT * FROM items WHERE id IN carray(?)", (ids,)):
+        print(row)
+
+    for row in connection.execute("SELECT value FROM carray(?)",
+                                  (apsw.carray(["one", "two"]),)):
+        print(row)
+
+The binding is a `pointer <https://sqlite.org/bindptr.html>`__ to the
+values which are read directly by SQLite from C.  Buffers such as
+:class:`array.array` or numpy arrays are not copied, and are locked
+against resizing while the :class:`carray` exists.  Do not change
+their contents while a query using them is running.
+
+The table has a single column named ``value``.  Unlike the SQLite
+`carray extension <https://sqlite.org/carray.html>`__ the type and
+number of values come from the :class:`carray` so only one argument is
+given.  Anything other than a :class:`carray` binding gives zero rows.
+
+*/
+
+/** .. class:: carray
+
+  Values bound as a pointer for the ``carray`` table valued function.
+  See :ref:`carray`.
+*/
+
+#define CARRAY_POINTER_TYPE "apsw-carray"
+
+#define CARRAY_INT32 0
+#define CARRAY_INT64 1
+#define CARRAY_DOUBLE 2
+#define CARRAY_TEXT 3
+
+typedef struct
+{
+  const char *utf8;
+  Py_ssize_t length;
+} CArrayText;
+
+typedef struct
+{
+  PyObject_HEAD int type;
+  Py_ssize_t count;
+  const void *values;
+
+  /* when values is a buffer, otherwise has_view is zero */
+  Py_buffer view;
+  int has_view;
+
+  /* copied values, or the CArrayText for each str */
+  void *owned;
+  /* tuple of the str which keeps their UTF8 alive */
+  PyObject *strings;
+
+  int init_was_called;
+} CArray;
+
+static PyTypeObject CArrayType;
+
+/* destructor for sqlite3_bind_pointer which can be called without the GIL */
+static void
+carray_pointer_free(void *pointer)
+{
+  PyGILState_STATE gilstate = PyGILState_Ensure();
+  Py_DECREF((PyObject *)pointer);
+  PyGILState_Release(gilstate);
+}
+
+static PyObject *
+CArray_new(PyTypeObject *type, PyObject *Py_UNUSED(args), PyObject *Py_UNUSED(kwargs))
+{
+  CArray *self = (CArray *)type->tp_alloc(type, 0);
+  if (self)
+  {
+    self->type = CARRAY_INT64;
+    self->count = 0;
+    self->values = NULL;
+    self->has_view = 0;
+    self->owned = NULL;
+    self->strings = NULL;
+    self->init_was_called = 0;
+  }
+  return (PyObject *)self;
+}
+
+/* Uses a buffer in place if its format is supported */
+static int
+carray_init_buffer(CArray *array, PyObject *values)
+{
+  const char *format;
+
+  if (PyObject_GetBuffer(values, &array->view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS))
+    return -1;
+  array->has_view = 1;
+
+  format = array->view.format ? array->view.format : "B";
+  if (*format == '@' || *format == '=')
+    format++;
+
+  if (array->view.ndim > 1 || !*format || format[1])
+    goto unsupported;
+
+  if (strchr("bhilq", *format) && array->view.itemsize == 4)
+    array->type = CARRAY_INT32;
+  else if (strchr("bhilq", *format) && array->view.itemsize == 8)
+    array->type = CARRAY_INT64;
+  else if (*format == 'd' && array->view.itemsize == 8)
+    array->type = CARRAY_DOUBLE;
+  else
+    goto unsupported;
+
+  array->values = array->view.buf;
+  array->count = array->view.len / array->view.itemsize;
+  return 0;
+
+unsupported:
+  PyErr_Format(PyExc_TypeError,
+               "carray buffer must be one dimensional 32 or 64 bit signed integers or 64 bit floats, not format '%s' "
+               "itemsize %zd",
+               array->view.format ? array->view.format : "B", array->view.itemsize);
+  return -1;
+}
+
+/* Copies a sequence of int, float, or str */
+static int
+carray_init_sequence(CArray *array, PyObject *values)
+{
+  PyObject *tuple;
+  Py_ssize_t i;
+  int type = CARRAY_INT64;
+
+  tuple = PySequence_Tuple(values);
+  if (!tuple)
+    return -1;
+  array->strings = tuple;
+  array->count = PyTuple_GET_SIZE(tuple);
+
+  for (i = 0; i < array->count; i++)
+  {
+    PyObject *item = PyTuple_GET_ITEM(tuple, i);
+    int itemtype = PyUnicode_Check(item) ? CARRAY_TEXT
+                   : PyFloat_Check(item) ? CARRAY_DOUBLE
+                   : PyLong_Check(item)  ? CARRAY_INT64
+                                         : -1;
+    if (itemtype < 0 || (i && (itemtype == CARRAY_TEXT) != (type == CARRAY_TEXT)))
+    {
+      PyErr_Format(PyExc_TypeError, "carray values must be all int and float, or all str.  Item #%zd is %s", i,
+                   Py_TypeName(item));
+      return -1;
+    }
+    if (!i || itemtype == CARRAY_DOUBLE)
+      type = itemtype;
+  }
+  array->type = type;
+
+  array->owned = PyMem_Calloc(array->count ? array->count : 1,
+                             type == CARRAY_TEXT ? sizeof(CArrayText) : sizeof(long long));
+  if (!array->owned)
+  {
+    PyErr_NoMemory();
+    return -1;
+  }
+  array->values = array->owned;
+
+  for (i = 0; i < array->count; i++)
+  {
+    PyObject *item = PyTuple_GET_ITEM(tuple, i);
+    switch (type)
+    {
+    case CARRAY_TEXT:
+      ((CArrayText *)array->owned)[i].utf8 = PyUnicode_AsUTF8AndSize(item, &((CArrayText *)array->owned)[i].length);
+      if (!((CArrayText *)array->owned)[i].utf8)
+        return -1;
+      break;
+    case CARRAY_DOUBLE:
+      ((double *)array->owned)[i] = PyFloat_AsDouble(item);
+      break;
+    default:
+      ((long long *)array->owned)[i] = PyLong_AsLongLong(item);
+      break;
+    }
+    if (PyErr_Occurred())
+      return -1;
+  }
+
+  /* only str need to be kept */
+  if (type != CARRAY_TEXT)
+    Py_CLEAR(array->strings);
+  return 0;
+}
+
+/** .. method:: __init__(values: array.array[Any] | memoryview | Sequence[int | float] | Sequence[str])
+
+  :param values: A buffer of 32 or 64 bit signed integers or 64 bit
+      floats such as :class:`array.array` with typecode ``q`` or
+      ``d`` which is used in place without copying.  Alternately a
+      sequence of int and float (converted to 64 bit integers, or 64
+      bit floats if any are float), or a sequence of str.
+*/
+static int
+CArray_init(CArray *self, PyObject *args, PyObject *kwargs)
+{
+  PyObject *values;
+
+  {
+    Carray_init_CHECK;
+    PREVENT_INIT_MULTIPLE_CALLS;
+    ARG_CONVERT_VARARGS_TO_FASTCALL;
+    ARG_PROLOG(1, Carray_init_KWNAMES);
+    ARG_MANDATORY ARG_pyobject(values);
+    ARG_EPILOG(-1, Carray_init_USAGE, Py_XDECREF(fast_kwnames));
+  }
+
+  if (PyObject_CheckBuffer(values) && !PyUnicode_Check(values))
+    return carray_init_buffer(self, values);
+  if (PySequence_Check(values) && !PyUnicode_Check(values))
+    return carray_init_sequence(self, values);
+
+  PyErr_Format(PyExc_TypeError, "Expected a buffer or sequence of values, not %s", Py_TypeName(values));
+  return -1;
+}
+
+static void
+CArray_dealloc(CArray *self)
+{
+  if (self->has_view)
+    PyBuffer_Release(&self->view);
+  self->has_view = 0;
+  PyMem_Free(self->owned);
+  self->owned = NULL;
+  Py_CLEAR(self->strings);
+  Py_TpFree((PyObject *)self);
+}
+
+static Py_ssize_t
+CArray_len(CArray *self)
+{
+  return self->count;
+}
+
+static PyObject *
+CArray_tp_str(CArray *self)
+{
+  static const char *const names[] = {"int32", "int64", "float64", "str"};
+  return PyUnicode_FromFormat("<apsw.carray object %zd %s at %p>", self->count, names[self->type], self);
+}
+
+static PySequenceMethods CArray_as_sequence = {
+    .sq_length = (lenfunc)CArray_len,
+};
+
+static PyTypeObject CArrayType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        .tp_name = "apsw.carray",
+    .tp_basicsize = sizeof(CArray),
+    .tp_dealloc = (destructor)CArray_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = Carray_class_DOC,
+    .tp_as_sequence = &CArray_as_sequence,
+    .tp_init = (initproc)CArray_init,
+    .tp_new = CArray_new,
+    .tp_str = (reprfunc)CArray_tp_str,
+};
+
+/* The virtual table.  It is eponymous only, and everything runs
+   without the GIL */
+
+typedef struct
+{
+  sqlite3_vtab_cursor base;
+  CArray *array;
+  Py_ssize_t index;
+} carray_cursor;
+
+#define CARRAY_COLUMN_VALUE 0
+#define CARRAY_COLUMN_POINTER 1
+
+static int
+carray_connect(sqlite3 *db, void *Py_UNUSED(aux), int Py_UNUSED(argc), const char *const *Py_UNUSED(argv),
+               sqlite3_vtab **ppvtab, char **Py_UNUSED(errmsg))
+{
+  int res;
+
+  res = sqlite3_declare_vtab(db, "CREATE TABLE x(value, pointer hidden)");
+  if (res != SQLITE_OK)
+    return res;
+  *ppvtab = sqlite3_malloc64(sizeof(sqlite3_vtab));
+  if (!*ppvtab)
+    return SQLITE_NOMEM;
+  memset(*ppvtab, 0, sizeof(sqlite3_vtab));
+  sqlite3_vtab_config(db, SQLITE_VTAB_INNOCUOUS);
+  return SQLITE_OK;
+}
+
+static int
+carray_disconnect(sqlite3_vtab *vtab)
+{
+  sqlite3_free(vtab);
+  return SQLITE_OK;
+}
+
+static int
+carray_best_index(sqlite3_vtab *Py_UNUSED(vtab), sqlite3_index_info *info)
+{
+  int i, unusable = 0;
+
+  for (i = 0; i < info->nConstraint; i++)
+  {
+    if (info->aConstraint[i].iColumn != CARRAY_COLUMN_POINTER || info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)
+      continue;
+    if (!info->aConstraint[i].usable)
+    {
+      unusable = 1;
+      continue;
+    }
+    info->aConstraintUsage[i].argvIndex = 1;
+    info->aConstraintUsage[i].omit = 1;
+    info->idxNum = 1;
+    info->estimatedCost = 10;
+    info->estimatedRows = 100;
+    return SQLITE_OK;
+  }
+  /* make SQLite provide the pointer */
+  if (unusable)
+    return SQLITE_CONSTRAINT;
+  info->estimatedCost = 2147483647;
+  info->estimatedRows = 1;
+  return SQLITE_OK;
+}
+
+static int
+carray_open(sqlite3_vtab *Py_UNUSED(vtab), sqlite3_vtab_cursor **ppcursor)
+{
+  carray_cursor *cursor = sqlite3_malloc64(sizeof(carray_cursor));
+  if (!cursor)
+    return SQLITE_NOMEM;
+  memset(cursor, 0, sizeof(carray_cursor));
+  *ppcursor = &cursor->base;
+  return SQLITE_OK;
+}
+
+static int
+carray_close(sqlite3_vtab_cursor *cursor)
+{
+  sqlite3_free(cursor);
+  return SQLITE_OK;
+}
+
+static int
+carray_filter(sqlite3_vtab_cursor *pcursor, int idxnum, const char *Py_UNUSED(idxstr), int Py_UNUSED(argc),
+              sqlite3_value **argv)
+{
+  carray_cursor *cursor = (carray_cursor *)pcursor;
+
+  /* the binding holds a reference to the array for as long as the
+     statement can use it */
+  cursor->array = idxnum ? (CArray *)sqlite3_value_pointer(argv[0], CARRAY_POINTER_TYPE) : NULL;
+  cursor->index = 0;
+  return SQLITE_OK;
+}
+
+static int
+carray_next(sqlite3_vtab_cursor *pcursor)
+{
+  ((carray_cursor *)pcursor)->index++;
+  return SQLITE_OK;
+}
+
+static int
+carray_eof(sqlite3_vtab_cursor *pcursor)
+{
+  carray_cursor *cursor = (carray_cursor *)pcursor;
+  return !cursor->array || cursor->index >= cursor->array->count;
+}
+
+static int
+carray_column(sqlite3_vtab_cursor *pcursor, sqlite3_context *context, int column)
+{
+  carray_cursor *cursor = (carray_cursor *)pcursor;
+  CArray *array = cursor->array;
+  Py_ssize_t i = cursor->index;
+
+  if (column != CARRAY_COLUMN_VALUE)
+    return SQLITE_OK;
+
+  switch (array->type)
+  {
+  case CARRAY_INT32:
+    sqlite3_result_int(context, ((const int *)array->values)[i]);
+    break;
+  case CARRAY_INT64:
+    sqlite3_result_int64(context, ((const long long *)array->values)[i]);
+    break;
+  case CARRAY_DOUBLE:
+    sqlite3_result_double(context, ((const double *)array->values)[i]);
+    break;
+  case CARRAY_TEXT:
+    sqlite3_result_text64(context, ((const CArrayText *)array->values)[i].utf8,
+                          ((const CArrayText *)array->values)[i].length, SQLITE_STATIC, SQLITE_UTF8);
+    break;
+  }
+  return SQLITE_OK;
+}
+
+static int
+carray_rowid(sqlite3_vtab_cursor *pcursor, sqlite3_int64 *rowid)
+{
+  *rowid = ((carray_cursor *)pcursor)->index + 1;
+  return SQLITE_OK;
+}
+
+static sqlite3_module carray_module = {
+    .iVersion = 0,
+    .xCreate = NULL,
+    .xConnect = carray_connect,
+    .xBestIndex = carray_best_index,
+    .xDisconnect = carray_disconnect,
+    .xDestroy = carray_disconnect,
+    .xOpen = carray_open,
+    .xClose = carray_close,
+    .xFilter = carray_filter,
+    .xNext = carray_next,
+    .xEof = carray_eof,
+    .xColumn = carray_column,
+    .xRowid = carray_rowid,
+};
@@ -0,0 +1,326 @@
+/*
+  Background WAL checkpointing
+
+  See the accompanying LICENSE file.
+*/
+
+/* In WAL mode SQLite normally checkpoints automatically in whichever
+   connection commits when the WAL passes 1,000 pages, so that commit
+   takes much longer than usual.
+
+   A Checkpointer is shared by all connections in the process with it
+   enabled on the same database file (keyed by filename like the
+   writer queue).  It has its own SQLite connection and a thread that
+   does not use the GIL.  The connections' wal hooks tell it how big
+   the WAL is after each commit, and when the threshold is crossed it
+   does a PASSIVE checkpoint which never blocks readers or writers.
+   Once there have been no commits for the idle period it does a
+   checkpoint with the idle mode (default TRUNCATE) so the next writer
+   starts at the beginning of a small WAL.  If that is busy it will
+   try again after the next idle period.
+
+   The registry of checkpointers is only changed with the GIL held.
+   Everything else is protected by the checkpointer's SQLite mutex
+   because the wal hooks and the thread run without the GIL.  The
+   thread blocks on the wake lock, which is released to wake it.
+*/
+
+typedef struct Checkpointer
+{
+  char *filename;
+  int refcount;
+  struct Checkpointer *next;
+
+  /* owned by the thread */
+  sqlite3 *db;
+
+  sqlite3_mutex *mutex;
+  PyThread_type_lock wake;
+  PyThread_type_lock done;
+
+  /* all below protected by mutex */
+  int signalled;
+  int stopping;
+
+  /* configuration */
+  int pages;
+  long long idle; /* nanoseconds */
+  int idle_mode;
+
+  /* wal size from the most recent commit, frames already checkpointed,
+     and when the most recent commit was */
+  int wal_pages;
+  int checkpointed;
+  long long last_commit;
+  int dirty;
+
+  /* statistics */
+  long long passive;
+  long long idle_checkpoints;
+  long long busy;
+  long long checkpoint_ns;
+  long long max_checkpoint_ns;
+  long long wal_high_water;
+} Checkpointer;
+
+static Checkpointer *checkpointer_list;
+
+/* Wakes up the thread.  Must hold mutex */
+static void
+checkpointer_signal(Checkpointer *cp)
+{
+  if (!cp->signalled)
+  {
+    cp->signalled = 1;
+    PyThread_release_lock(cp->wake);
+  }
+}
+
+/* Called from the wal hook after each commit to the main database */
+static void
+checkpointer_notify(Checkpointer *cp, int npages)
+{
+  sqlite3_mutex_enter(cp->mutex);
+  cp->wal_pages = npages;
+  /* the WAL was restarted */
+  if (npages < cp->checkpointed)
+    cp->checkpointed = 0;
+  if (npages > cp->wal_high_water)
+    cp->wal_high_water = npages;
+  cp->last_commit = apsw_monotonic_ns();
+  /* the thread needs to start timing the idle period if it wasn't already */
+  if (!cp->dirty || npages - cp->checkpointed >= cp->pages)
+    checkpointer_signal(cp);
+  cp->dirty = 1;
+  sqlite3_mutex_leave(cp->mutex);
+}
+
+/* Runs a checkpoint returning non-zero if it completed.  Called without
+   holding mutex */
+static int
+checkpointer_run(Checkpointer *cp, int mode, int idle)
+{
+  int res, nlog = 0, nckpt = 0;
+  long long start = apsw_monotonic_ns(), elapsed;
+
+  res = sqlite3_wal_checkpoint_v2(cp->db, NULL, mode, &nlog, &nckpt);
+  if (res == SQLITE_OK && nlog == -1)
+  {
+    /* the connection only finds out it is in WAL mode once it has read
+       the database */
+    res = sqlite3_exec(cp->db, "PRAGMA schema_version", NULL, NULL, NULL);
+    if (res == SQLITE_OK)
+      res = sqlite3_wal_checkpoint_v2(cp->db, NULL, mode, &nlog, &nckpt);
+  }
+  elapsed = apsw_monotonic_ns() - start;
+
+  sqlite3_mutex_enter(cp->mutex);
+  if (res == SQLITE_OK)
+  {
+    if (idle)
+      cp->idle_checkpoints++;
+    else
+      cp->passive++;
+    /* these are -1 after the WAL is truncated */
+    cp->wal_pages = nlog > 0 ? nlog : 0;
+    cp->checkpointed = nckpt > 0 ? nckpt : 0;
+    cp->checkpoint_ns += elapsed;
+    if (elapsed > cp->max_checkpoint_ns)
+      cp->max_checkpoint_ns = elapsed;
+  }
+  else
+    cp->busy++;
+  sqlite3_mutex_leave(cp->mutex);
+
+  return res == SQLITE_OK;
+}
+
+static void
+checkpointer_thread(void *context)
+{
+  Checkpointer *cp = (Checkpointer *)context;
+  long long timeout = -1;
+
+  for (;;)
+  {
+    int acquired, passive = 0, idle = 0;
+    long long now;
+
+    acquired = PyThread_acquire_lock_timed(cp->wake, (PY_TIMEOUT_T)timeout, 0) == PY_LOCK_ACQUIRED;
+
+    sqlite3_mutex_enter(cp->mutex);
+    if (cp->signalled)
+    {
+      /* a signal after the timeout expired leaves wake released */
+      if (!acquired)
+        PyThread_acquire_lock(cp->wake, NOWAIT_LOCK);
+      cp->signalled = 0;
+    }
+    if (cp->stopping)
+    {
+      sqlite3_mutex_leave(cp->mutex);
+      break;
+    }
+    now = apsw_monotonic_ns();
+    if (cp->wal_pages - cp->checkpointed >= cp->pages)
+      passive = 1;
+    else if (cp->dirty && now - cp->last_commit >= cp->idle)
+    {
+      idle = 1;
+      cp->dirty = 0;
+    }
+    sqlite3_mutex_leave(cp->mutex);
+
+    if (passive)
+      checkpointer_run(cp, SQLITE_CHECKPOINT_PASSIVE, 0);
+    else if (idle && !checkpointer_run(cp, cp->idle_mode, 1))
+    {
+      /* try again next idle period unless there was a commit meanwhile */
+      sqlite3_mutex_enter(cp->mutex);
+      if (!cp->dirty)
+      {
+        cp->dirty = 1;
+        cp->last_commit = apsw_monotonic_ns();
+      }
+      sqlite3_mutex_leave(cp->mutex);
+    }
+
+    sqlite3_mutex_enter(cp->mutex);
+    timeout = cp->dirty ? (cp->last_commit + cp->idle - apsw_monotonic_ns()) / 1000 : -1;
+    if (cp->dirty && timeout < 0)
+      timeout = 0;
+    if (timeout > PY_TIMEOUT_MAX)
+      timeout = PY_TIMEOUT_MAX;
+    sqlite3_mutex_leave(cp->mutex);
+  }
+
+  sqlite3_close(cp->db);
+  cp->db = NULL;
+  PyThread_release_lock(cp->done);
+}
+
+static void
+checkpointer_configure(Checkpointer *cp, int pages, double idle, int idle_mode)
+{
+  sqlite3_mutex_enter(cp->mutex);
+  cp->pages = pages;
+  cp->idle = (long long)(idle * 1e9);
+  cp->idle_mode = idle_mode;
+  checkpointer_signal(cp);
+  sqlite3_mutex_leave(cp->mutex);
+}
+
+static void
+checkpointer_free(Checkpointer *cp)
+{
+  if (cp->wake)
+    PyThread_free_lock(cp->wake);
+  if (cp->done)
+    PyThread_free_lock(cp->done);
+  if (cp->mutex)
+    sqlite3_mutex_free(cp->mutex);
+  PyMem_Free(cp->filename);
+  PyMem_Free(cp);
+}
+
+/* Returns the checkpointer for filename, starting one if necessary, or
+   NULL with an exception set */
+static Checkpointer *
+checkpointer_attach(const char *filename, const char *vfsname, int pages, double idle, int idle_mode)
+{
+  Checkpointer *cp;
+  int res;
+
+  for (cp = checkpointer_list; cp; cp = cp->next)
+    if (0 == strcmp(cp->filename, filename))
+    {
+      cp->refcount++;
+      checkpointer_configure(cp, pages, idle, idle_mode);
+      return cp;
+    }
+
+  cp = PyMem_Calloc(1, sizeof(Checkpointer));
+  if (!cp)
+    return (Checkpointer *)PyErr_NoMemory();
+  cp->filename = apsw_strdup(filename);
+  cp->wake = PyThread_allocate_lock();
+  cp->done = PyThread_allocate_lock();
+  cp->mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+  if (!cp->filename || !cp->wake || !cp->done || !cp->mutex)
+  {
+    checkpointer_free(cp);
+    return (Checkpointer *)PyErr_NoMemory();
+  }
+  PyThread_acquire_lock(cp->wake, WAIT_LOCK);
+  PyThread_acquire_lock(cp->done, WAIT_LOCK);
+
+  _PYSQLITE_CALL_V(res = sqlite3_open_v2(filename, &cp->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, vfsname));
+  if (res != SQLITE_OK)
+  {
+    SET_EXC(res, cp->db);
+    _PYSQLITE_CALL_V(sqlite3_close(cp->db));
+    checkpointer_free(cp);
+    return NULL;
+  }
+
+  cp->refcount = 1;
+  cp->pages = pages;
+  cp->idle = (long long)(idle * 1e9);
+  cp->idle_mode = idle_mode;
+
+  if (PyThread_start_new_thread(checkpointer_thread, cp) == PYTHREAD_INVALID_THREAD_ID)
+  {
+    _PYSQLITE_CALL_V(sqlite3_close(cp->db));
+    checkpointer_free(cp);
+    PyErr_Format(PyExc_RuntimeError, "Unable to start checkpoint thread");
+    return NULL;
+  }
+
+  cp->next = checkpointer_list;
+  checkpointer_list = cp;
+  return cp;
+}
+
+/* Stops the thread when the last connection detaches */
+static void
+checkpointer_detach(Checkpointer *cp)
+{
+  Checkpointer **pcp;
+
+  if (--cp->refcount)
+    return;
+
+  for (pcp = &checkpointer_list; *pcp != cp; pcp = &(*pcp)->next)
+    ;
+  *pcp = cp->next;
+
+  sqlite3_mutex_enter(cp->mutex);
+  cp->stopping = 1;
+  checkpointer_signal(cp);
+  sqlite3_mutex_leave(cp->mutex);
+
+  /* the thread may need the GIL if the VFS is implemented in Python */
+  Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(cp->done, WAIT_LOCK);
+  Py_END_ALLOW_THREADS;
+
+  checkpointer_free(cp);
+}
+
+static PyObject *
+checkpointer_stats(Checkpointer *cp)
+{
+  Checkpointer copy = {0};
+
+  if (cp)
+  {
+    sqlite3_mutex_enter(cp->mutex);
+    copy = *cp;
+    sqlite3_mutex_leave(cp->mutex);
+  }
+
+  return Py_BuildValue("{s: L, s: L, s: L, s: L, s: L, s: L, s: i}", "passive", copy.passive, "idle",
+                       copy.idle_checkpoints, "busy", copy.busy, "checkpoint_ns", copy.checkpoint_ns,
+                       "max_checkpoint_ns", copy.max_checkpoint_ns, "wal_high_water", copy.wal_high_water,
+                       "wal_pages", copy.wal_pages);
+}
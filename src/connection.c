@@ -59,8 +59,71 @@ typedef struct
   PyObject *inversefunc; /* inverse function */
 } windowfunctioncontext;
 
+/* native busy handler configured by set_busy_backoff.  The handler runs
+   without the GIL with the database mutex held, which also protects
+   the statistics */
+typedef struct
+{
+  /* all times in nanoseconds */
+  double initial;
+  double multiplier;
+  double maximum;
+  double jitter;
+  long long timeout;
+  sqlite3_vfs *vfs;
+
+  /* when the current busy wait started */
+  long long started;
+
+  /* statistics */
+  long long busy;
+  long long retries;
+  long long timeouts;
+  long long wait_ns;
+  long long max_wait_ns;
+} BusyBackoff;
+
+/* a rule from set_authorizer_rules.  Patterns are NULL to match
+   anything */
+typedef struct
+{
+  int operation; /* -1 for any */
+  char *paramone;
+  char *paramtwo;
+  int result;
+} AuthorizerRule;
+
 /* CONNECTION TYPE */
 
+/* how many nesting levels of the context manager have prepared statements */
+#define SAVEPOINT_CACHE_LEVELS 8
+
+#define SAVEPOINT_OP_SAVEPOINT 0
+#define SAVEPOINT_OP_RELEASE 1
+#define SAVEPOINT_OP_ROLLBACK 2
+
+/* which per statement limit was exceeded */
+#define STATEMENT_LIMIT_VM_STEPS 1
+#define STATEMENT_LIMIT_ROWS 2
+
+/* how often in virtual machine instructions the limits are checked */
+#define STATEMENT_LIMIT_CHECK_STEPS 100
+
+typedef struct
+{
+  /* maximums from set_statement_limits, zero meaning no limit */
+  sqlite3_int64 vm_steps;
+  sqlite3_int64 rows;
+  /* statement a cursor is currently stepping, and its instruction
+     count.  SQLite only updates SQLITE_STMTSTATUS_VM_STEP when a step
+     returns so the count is kept here while stepping. */
+  sqlite3_stmt *stmt;
+  sqlite3_int64 *steps;
+  /* STATEMENT_LIMIT_ value if a limit was exceeded, and usage at the time */
+  int exceeded;
+  sqlite3_int64 used_vm_steps;
+} StatementLimits;
+
 struct Connection
 {
   PyObject_HEAD
@@ -69,30 +132,60 @@ struct Connection
 
   struct StatementCache *stmtcache; /* prepared statement cache */
 
-  PyObject *dependents; /* tracking cursors & blobs etc as weakrefs belonging to this connection */
+  PyObject *dependents; /* tracking cursors & blobs etc belonging to this connection.  dict of
+                           id -> weakref so removal doesn't need a scan */
 
   PyObject *cursor_factory;
 
   /* registered hooks/handlers (NULL or callable) */
   PyObject *busyhandler;
+  BusyBackoff busybackoff;
   PyObject *rollbackhook;
   PyObject *profile;
   PyObject *updatehook;
   PyObject *commithook;
   PyObject *walhook;
   PyObject *progresshandler;
+  int progresshandler_nsteps;
+  /* when limits are also checked, instructions since the handler was last called */
+  int progresshandler_count;
+  int progress_nsteps;
+  StatementLimits limits;
   PyObject *authorizer;
+  AuthorizerRule *authorizer_rules;
+  int authorizer_nrules;
   PyObject *collationneeded;
   PyObject *exectrace;
   PyObject *rowtrace;
   PyObject *tracehook;
   int tracemask;
+  PyObject *planmonitor;
+
+  /* parse JSON columns and encode dict/list bindings */
+  int convert_json;
+
+  /* binary trace recording (NULL if not recording) */
+  TraceRecorderAttachment *recorder;
+
+  /* in process writer queue (NULL if not enabled) */
+  WriterQueue *writerqueue;
+
+  /* background wal checkpointing (NULL if not enabled) */
+  Checkpointer *checkpointer;
+  /* wal_autocheckpoint pages to restore when it is disabled */
+  int checkpointer_autocheckpoint;
+
+  /* results for execute_cached (NULL if not enabled) */
+  ResultCache *resultcache;
 
   /* if we are using one of our VFS since sqlite doesn't reference count them */
   PyObject *vfs;
 
   /* used for nested with (contextmanager) statements */
   long savepointlevel;
+  /* prepared statements for the shallower levels, indexed by level
+     and SAVEPOINT_OP_* */
+  sqlite3_stmt *savepoint_stmts[SAVEPOINT_CACHE_LEVELS][3];
 
   /* informational attributes */
   PyObject *open_flags;
@@ -101,6 +194,9 @@ struct Connection
   /* weak reference support */
   PyObject *weakreflist;
 
+  /* apsw.connections() list membership */
+  struct Connection *connections_prev, *connections_next;
+
   /* limit calls to callbacks */
   CALL_TRACK(xConnect);
   CALL_TRACK(xUpdate);
@@ -133,14 +229,23 @@ static void APSWBackup_init(struct APSWBackup *self, Connection *dest, Connectio
 static PyTypeObject APSWBackupType;
 
 static PyTypeObject APSWCursorType;
+struct APSWCursor;
+static PyObject *APSWCursor_new_for_connection(Connection *connection);
+static int APSWCursor_has_own_tracer(PyObject *cursor);
+static PyObject *APSWCursor_execute(struct APSWCursor *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                                    PyObject *fast_kwnames);
 
 struct ZeroBlobBind;
 static PyTypeObject ZeroBlobBindType;
 
 static void apsw_connection_remove(Connection *con);
 
+static void connection_savepoints_finalize(Connection *self);
+
 static int apsw_connection_add(Connection *con);
 
+static int Connection_update_trace(Connection *self);
+
 static void
 FunctionCBInfo_dealloc(FunctionCBInfo *self)
 {
@@ -161,6 +266,19 @@ FunctionCBInfo_dealloc(FunctionCBInfo *self)
 
 /* CONNECTION CODE */
 
+static void
+authorizer_rules_free(AuthorizerRule *rules, int nrules)
+{
+  int i;
+
+  for (i = 0; i < nrules; i++)
+  {
+    PyMem_Free(rules[i].paramone);
+    PyMem_Free(rules[i].paramtwo);
+  }
+  PyMem_Free(rules);
+}
+
 static void
 Connection_internal_cleanup(Connection *self)
 {
@@ -173,42 +291,90 @@ Connection_internal_cleanup(Connection *self)
   Py_CLEAR(self->walhook);
   Py_CLEAR(self->progresshandler);
   Py_CLEAR(self->authorizer);
+  authorizer_rules_free(self->authorizer_rules, self->authorizer_nrules);
+  self->authorizer_rules = 0;
+  self->authorizer_nrules = 0;
   Py_CLEAR(self->collationneeded);
   Py_CLEAR(self->exectrace);
   Py_CLEAR(self->rowtrace);
   Py_CLEAR(self->tracehook);
+  Py_CLEAR(self->planmonitor);
   Py_CLEAR(self->vfs);
   Py_CLEAR(self->open_flags);
   Py_CLEAR(self->open_vfs);
+  if (self->recorder)
+  {
+    tracerecorder_detach(self->recorder);
+    self->recorder = NULL;
+  }
+}
+
+static int
+Connection_add_dependent(Connection *self, PyObject *o)
+{
+  int res = -1;
+  PyObject *key = PyLong_FromVoidPtr(o);
+  PyObject *weakref = key ? PyWeakref_NewRef(o, NULL) : NULL;
+  if (weakref)
+    res = PyDict_SetItem(self->dependents, key, weakref);
+  Py_XDECREF(key);
+  Py_XDECREF(weakref);
+  return res;
 }
 
 static void
 Connection_remove_dependent(Connection *self, PyObject *o)
 {
-  /* in addition to removing the dependent, we also remove any dead
-     weakrefs */
-  Py_ssize_t i;
+  /* o is removed directly by its id.  passing NULL instead removes
+     any dead weakrefs */
+  if (o)
+  {
+    PY_ERR_FETCH(exc_save);
+    PyObject *key = PyLong_FromVoidPtr(o);
+    if (!key || PyDict_DelItem(self->dependents, key) < 0)
+    {
+      if (PyErr_ExceptionMatches(PyExc_KeyError))
+        PyErr_Clear();
+      else
+        apsw_write_unraisable(NULL);
+    }
+    Py_XDECREF(key);
+    PY_ERR_RESTORE(exc_save);
+    return;
+  }
 
-  for (i = 0; i < PyList_GET_SIZE(self->dependents);)
+  /* the dict can't be modified while iterating so the dead keys are
+     collected first */
+  Py_ssize_t pos = 0, i;
+  PyObject *key, *wr, *dead = PyList_New(0);
+  if (!dead)
+  {
+    apsw_write_unraisable(NULL);
+    return;
+  }
+  while (PyDict_Next(self->dependents, &pos, &key, &wr))
   {
-    PyObject *wr = PyList_GET_ITEM(self->dependents, i);
     PyObject *wo = NULL;
     if (PyWeakref_GetRef(wr, &wo) < 0)
     {
       apsw_write_unraisable(NULL);
       continue;
     }
-    if (!wo || Py_Is(wo, o))
+    if (wo)
     {
-      PyList_SetSlice(self->dependents, i, i + 1, NULL);
-      if (!wo)
-        continue;
       Py_DECREF(wo);
-      return;
+      continue;
+    }
+    if (PyList_Append(dead, key))
+    {
+      apsw_write_unraisable(NULL);
+      break;
     }
-    Py_XDECREF(wo);
-    i++;
   }
+  for (i = 0; i < PyList_GET_SIZE(dead); i++)
+    if (PyDict_DelItem(self->dependents, PyList_GET_ITEM(dead, i)) < 0)
+      apsw_write_unraisable(NULL);
+  Py_DECREF(dead);
 }
 
 /* returns zero on success, non-zero on error */
@@ -220,16 +386,19 @@ Connection_close_internal(Connection *self, int force)
   PY_ERR_FETCH_IF(force == 2, exc_save);
 
   /* close out dependents by repeatedly processing first item until
-     list is empty.  note that closing an item will cause the list to
+     dict is empty.  note that closing an item will cause the dict to
      be perturbed as a side effect */
-  while (self->dependents && PyList_GET_SIZE(self->dependents))
+  while (self->dependents && PyDict_GET_SIZE(self->dependents))
   {
-    PyObject *closeres = NULL, *item = NULL, *wr = PyList_GET_ITEM(self->dependents, 0);
+    PyObject *closeres = NULL, *item = NULL, *key, *wr;
+    Py_ssize_t pos = 0;
+    PyDict_Next(self->dependents, &pos, &key, &wr);
     if (PyWeakref_GetRef(wr, &item) < 0)
       return 1;
     if (!item)
     {
-      Connection_remove_dependent(self, item);
+      if (PyDict_DelItem(self->dependents, key) < 0)
+        return 1;
       continue;
     }
 
@@ -253,6 +422,18 @@ Connection_close_internal(Connection *self, int force)
     statementcache_free(self->stmtcache);
   self->stmtcache = 0;
 
+  connection_savepoints_finalize(self);
+
+  writerqueue_free(self->writerqueue);
+  self->writerqueue = 0;
+
+  if (self->checkpointer)
+    checkpointer_detach(self->checkpointer);
+  self->checkpointer = 0;
+
+  resultcache_free(self->resultcache);
+  self->resultcache = 0;
+
   apsw_connection_remove(self);
 
   PYSQLITE_VOID_CALL(res = sqlite3_close(self->db));
@@ -341,11 +522,12 @@ Connection_dealloc(Connection *self)
   PyObject_GC_UnTrack(self);
   APSW_CLEAR_WEAKREFS;
 
+  apsw_connection_remove(self);
   Connection_close_internal(self, 2);
 
   /* Our dependents all hold a refcount on us, so they must have all
      released before this destructor could be called */
-  assert(!self->dependents || PyList_GET_SIZE(self->dependents) == 0);
+  assert(!self->dependents || PyDict_GET_SIZE(self->dependents) == 0);
   Py_CLEAR(self->dependents);
 
   Py_TpFree((PyObject *)self);
@@ -362,26 +544,42 @@ Connection_new(PyTypeObject *type, PyObject *Py_UNUSED(args), PyObject *Py_UNUSE
     self->db = 0;
     self->cursor_factory = Py_NewRef((PyObject *)&APSWCursorType);
     self->inuse = 0;
-    self->dependents = PyList_New(0);
+    self->dependents = PyDict_New();
     self->stmtcache = 0;
     self->busyhandler = 0;
+    memset(&self->busybackoff, 0, sizeof(self->busybackoff));
     self->rollbackhook = 0;
     self->profile = 0;
     self->updatehook = 0;
     self->commithook = 0;
     self->walhook = 0;
     self->progresshandler = 0;
+    self->progresshandler_nsteps = 0;
+    self->progresshandler_count = 0;
+    self->progress_nsteps = 0;
+    memset(&self->limits, 0, sizeof(self->limits));
     self->authorizer = 0;
+    self->authorizer_rules = 0;
+    self->authorizer_nrules = 0;
     self->collationneeded = 0;
     self->exectrace = 0;
     self->rowtrace = 0;
     self->tracehook = 0;
     self->tracemask = 0;
+    self->convert_json = 0;
+    self->planmonitor = 0;
+    self->recorder = 0;
+    self->writerqueue = 0;
+    self->checkpointer = 0;
+    self->checkpointer_autocheckpoint = 1000; /* SQLITE_DEFAULT_WAL_AUTOCHECKPOINT */
+    self->resultcache = 0;
     self->vfs = 0;
     self->savepointlevel = 0;
+    memset(self->savepoint_stmts, 0, sizeof(self->savepoint_stmts));
     self->open_flags = 0;
     self->open_vfs = 0;
     self->weakreflist = 0;
+    self->connections_prev = self->connections_next = 0;
     CALL_TRACK_INIT(xConnect);
     if (self->dependents)
       return (PyObject *)self;
@@ -475,6 +673,11 @@ Connection_init(Connection *self, PyObject *args, PyObject *kwargs)
   /* get detailed error codes */
   PYSQLITE_VOID_CALL(sqlite3_extended_result_codes(self->db, 1));
 
+  PYSQLITE_CON_CALL(res = sqlite3_create_module_v2(self->db, "carray", &carray_module, NULL, NULL));
+  SET_EXC(res, self->db);
+  if (res != SQLITE_OK)
+    goto pyexception;
+
   /* call connection hooks */
   hooks = PyObject_GetAttr(apswmodule, apst.connection_hooks);
   if (!hooks)
@@ -557,7 +760,6 @@ Connection_blob_open(Connection *self, PyObject *const *fast_args, Py_ssize_t fa
   long long rowid;
   int writeable = 0;
   int res;
-  PyObject *weakref;
 
   CHECK_USE(NULL);
   CHECK_CLOSED(self, NULL);
@@ -586,13 +788,11 @@ Connection_blob_open(Connection *self, PyObject *const *fast_args, Py_ssize_t fa
   }
 
   APSWBlob_init(apswblob, self, blob);
-  weakref = PyWeakref_NewRef((PyObject *)apswblob, NULL);
-  if (!weakref)
-    return NULL;
-  res = PyList_Append(self->dependents, weakref);
-  Py_DECREF(weakref);
-  if (res)
+  if (Connection_add_dependent(self, (PyObject *)apswblob))
+  {
+    Py_DECREF(apswblob);
     return NULL;
+  }
   return (PyObject *)apswblob;
 }
 
@@ -621,7 +821,6 @@ Connection_backup(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_
   sqlite3_backup *backup = 0;
   int res = -123456; /* stupid compiler */
   PyObject *result = NULL;
-  PyObject *weakref = NULL;
   Connection *sourceconnection = NULL;
   const char *databasename = NULL;
   const char *sourcedatabasename = NULL;
@@ -634,9 +833,9 @@ Connection_backup(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_
   Connection_remove_dependent(self, NULL);
 
   /* self (destination) can't be used if there are outstanding blobs, cursors or backups */
-  if (PyList_GET_SIZE(self->dependents))
+  if (PyDict_GET_SIZE(self->dependents))
   {
-    PyObject *args = NULL;
+    PyObject *args = NULL, *outstanding = NULL;
 
     args = PyTuple_New(2);
     if (!args)
@@ -645,7 +844,10 @@ Connection_backup(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_
     if (!s)
       goto thisfinally;
     PyTuple_SET_ITEM(args, 0, s);
-    PyTuple_SET_ITEM(args, 1, Py_NewRef(self->dependents));
+    outstanding = PyDict_Values(self->dependents);
+    if (!outstanding)
+      goto thisfinally;
+    PyTuple_SET_ITEM(args, 1, outstanding);
 
     PyErr_SetObject(ExcThreadingViolation, args);
 
@@ -706,22 +908,10 @@ Connection_backup(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_
   APSWBackup_init(apswbackup, (Connection *)Py_NewRef((PyObject *)self), (Connection *)Py_NewRef((PyObject *)sourceconnection), backup);
   backup = NULL;
 
-  /* add to dependent lists */
-  weakref = PyWeakref_NewRef((PyObject *)apswbackup, NULL);
-  if (!weakref)
-    goto finally;
-  res = PyList_Append(self->dependents, weakref);
-  if (res)
-    goto finally;
-  Py_DECREF(weakref);
-  weakref = PyWeakref_NewRef((PyObject *)apswbackup, NULL);
-  if (!weakref)
+  /* add to dependents */
+  if (Connection_add_dependent(self, (PyObject *)apswbackup)
+      || Connection_add_dependent(sourceconnection, (PyObject *)apswbackup))
     goto finally;
-  res = PyList_Append(sourceconnection->dependents, weakref);
-  if (res)
-    goto finally;
-  Py_DECREF(weakref);
-  weakref = 0;
 
   result = (PyObject *)apswbackup;
   apswbackup = NULL;
@@ -734,7 +924,6 @@ finally:
     PYSQLITE_VOID_CALL(sqlite3_backup_finish(backup));
 
   Py_XDECREF((PyObject *)apswbackup);
-  Py_XDECREF(weakref);
 
   /* if inuse is set then we must be returning result */
   assert((self->inuse) ? (!!result) : (result == NULL));
@@ -754,32 +943,34 @@ static PyObject *
 Connection_cursor(Connection *self)
 {
   PyObject *cursor = NULL;
-  PyObject *weakref;
 
   CHECK_USE(NULL);
   CHECK_CLOSED(self, NULL);
 
-  PyObject *vargs[] = {NULL, (PyObject *)self};
-  cursor = PyObject_Vectorcall(self->cursor_factory, vargs + 1, 1 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+  /* the default type skips the generic call machinery and can reuse
+     pooled memory */
+  if (Py_Is(self->cursor_factory, (PyObject *)&APSWCursorType))
+    cursor = APSWCursor_new_for_connection(self);
+  else
+  {
+    PyObject *vargs[] = {NULL, (PyObject *)self};
+    cursor = PyObject_Vectorcall(self->cursor_factory, vargs + 1, 1 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+  }
   if (!cursor)
   {
     AddTraceBackHere(__FILE__, __LINE__, "Connection.cursor", "{s: O}", "cursor_factory", OBJ(self->cursor_factory));
     return NULL;
   }
 
-  weakref = PyWeakref_NewRef((PyObject *)cursor, NULL);
-  if (!weakref)
+  if (Connection_add_dependent(self, cursor))
   {
     assert(PyErr_Occurred());
     AddTraceBackHere(__FILE__, __LINE__, "Connection.cursor", "{s: O}", "cursor", OBJ(cursor));
     Py_DECREF(cursor);
     return NULL;
   }
-  if (PyList_Append(self->dependents, weakref))
-    cursor = NULL;
-  Py_DECREF(weakref);
 
-  return (PyObject *)cursor;
+  return cursor;
 }
 
 /** .. method:: set_busy_timeout(milliseconds: int) -> None
@@ -1227,7 +1418,6 @@ finally:
 static PyObject *
 Connection_set_profile(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
 {
-  int res;
   PyObject *callable;
   CHECK_USE(NULL);
   CHECK_CLOSED(self, NULL);
@@ -1239,16 +1429,13 @@ Connection_set_profile(Connection *self, PyObject *const *fast_args, Py_ssize_t
     ARG_EPILOG(NULL, Connection_set_profile_USAGE, );
   }
 
-  PYSQLITE_CON_CALL(res = sqlite3_trace_v2(self->db, SQLITE_TRACE_PROFILE, callable ? profilecb : NULL, callable ? self : NULL));
-  if (res == SQLITE_OK)
-  {
-    Py_XDECREF(self->profile);
-    self->profile = callable ? Py_NewRef(callable) : NULL;
-    Py_RETURN_NONE;
-  }
+  Py_XDECREF(self->profile);
+  self->profile = callable ? Py_NewRef(callable) : NULL;
 
-  SET_EXC(res, self->db);
-  return NULL;
+  if (Connection_update_trace(self))
+    return NULL;
+
+  Py_RETURN_NONE;
 }
 
 static int
@@ -1282,6 +1469,11 @@ tracehook_cb(unsigned code, void *vconnection, void *one, void *two)
     V(SQLITE_STMTSTATUS_RUN);
     V(SQLITE_STMTSTATUS_FILTER_MISS);
     V(SQLITE_STMTSTATUS_FILTER_HIT);
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+    /* so the profile event only reports this execution */
+    if (connection->tracemask & SQLITE_TRACE_PROFILE)
+      sqlite3_stmt_scanstatus_reset(stmt);
+#endif
     if (connection->tracemask & SQLITE_TRACE_STMT)
       param = Py_BuildValue("{s: i, s: s, s: O}",
                             "code", code, "sql", sqlite3_sql(stmt), "connection", connection);
@@ -1324,6 +1516,15 @@ tracehook_cb(unsigned code, void *vconnection, void *one, void *two)
                             V(SQLITE_STMTSTATUS_FILTER_MISS),
                             V(SQLITE_STMTSTATUS_FILTER_HIT),
                             V(SQLITE_STMTSTATUS_MEMUSED));
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+      if (param)
+      {
+        PyObject *scanstatus = apsw_scanstatus(stmt);
+        if (!scanstatus || PyDict_SetItemString(param, "scanstatus", scanstatus))
+          Py_CLEAR(param);
+        Py_XDECREF(scanstatus);
+      }
+#endif
       sqlite3_mutex_leave(sqlite3_db_mutex(connection->db));
     }
     break;
@@ -1376,17 +1577,23 @@ finally:
         *"SQLITE_STMTSTATUS_VM_STEP"* and corresponding integer values.
         The counters are reset each time a statement
         starts execution.
+    * - scanstatus
+      - :class:`list`
+      - SQLITE_TRACE_PROFILE only, and only present if
+        SQLITE_ENABLE_STMT_SCANSTATUS was defined at compile time:
+        the same as :meth:`Cursor.scanstatus`.  The counters are
+        reset each time a statement starts execution.
 
   .. seealso::
 
     * :ref:`Example <example_trace_v2>`
 
-  -* sqlite3_trace_v2 sqlite3_stmt_status
+  -* sqlite3_trace_v2 sqlite3_stmt_status sqlite3_stmt_scanstatus_v2 sqlite3_stmt_scanstatus_reset
 */
 static PyObject *
 Connection_trace_v2(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
 {
-  int mask = 0, res = 0;
+  int mask = 0;
   PyObject *callback = NULL;
 
   CHECK_USE(NULL);
@@ -1412,24 +1619,264 @@ Connection_trace_v2(Connection *self, PyObject *const *fast_args, Py_ssize_t fas
   /* what was actually requested */
   self->tracemask = mask;
 
-  /* if profiling, we always want statement start to reset counters */
-  if (mask | SQLITE_TRACE_PROFILE)
-    mask |= SQLITE_TRACE_STMT;
-
   Py_CLEAR(self->tracehook);
   Py_XINCREF(callback);
   self->tracehook = callback;
 
-  PYSQLITE_CON_CALL(res = sqlite3_trace_v2(self->db, mask, tracehook_cb, self));
+  if (Connection_update_trace(self))
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+/* SQLite only has one trace callback per connection which is shared
+   by set_profile, trace_v2 and the trace recorder */
+static int
+connection_trace_cb(unsigned code, void *vconnection, void *one, void *two)
+{
+  Connection *connection = (Connection *)vconnection;
+
+  if (connection->recorder)
+    tracerecorder_event(connection->recorder, code, one, two);
+  if (code == SQLITE_TRACE_PROFILE && connection->profile)
+    profilecb(code, connection, one, two);
+  /* the recorder can ask for events trace_v2 didn't, which must not
+     take the GIL */
+  if (connection->tracehook
+      && ((code & connection->tracemask)
+          || (code == SQLITE_TRACE_STMT && (connection->tracemask & SQLITE_TRACE_PROFILE))))
+    tracehook_cb(code, connection, one, two);
+  return 0;
+}
+
+/* registers connection_trace_cb for the union of events currently wanted */
+static int
+Connection_update_trace(Connection *self)
+{
+  int res;
+  unsigned mask = 0;
+
+  CHECK_USE(-1);
+  CHECK_CLOSED(self, -1);
+
+  if (self->profile)
+    mask |= SQLITE_TRACE_PROFILE;
+  /* if profiling, we always want statement start to reset counters */
+  if (self->tracehook)
+    mask |= self->tracemask | ((self->tracemask & SQLITE_TRACE_PROFILE) ? SQLITE_TRACE_STMT : 0);
+  if (self->recorder)
+    mask |= SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE;
+
+  PYSQLITE_CON_CALL(res = sqlite3_trace_v2(self->db, mask, mask ? connection_trace_cb : NULL, mask ? self : NULL));
   if (res != SQLITE_OK)
   {
     SET_EXC(res, self->db);
+    return -1;
+  }
+  return 0;
+}
+
+/** .. method:: set_trace_recorder(recorder: Optional[TraceRecorder]) -> None
+
+  Starts recording statement executions on this connection into the
+  :class:`TraceRecorder`, or stops if *recorder* is *None*.  A
+  recorder can be shared by any number of connections, across
+  threads.  Recording is independent of :meth:`set_profile` and
+  :meth:`trace_v2` which can be used at the same time.
+
+  .. seealso::
+
+    * :ref:`tracerecorder`
+
+  -* sqlite3_trace_v2
+*/
+static PyObject *
+Connection_set_trace_recorder(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  TraceRecorder *recorder = NULL;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_trace_recorder_CHECK;
+    ARG_PROLOG(1, Connection_set_trace_recorder_KWNAMES);
+    ARG_MANDATORY ARG_optional_TraceRecorder(recorder);
+    ARG_EPILOG(NULL, Connection_set_trace_recorder_USAGE, );
+  }
+
+  if (self->recorder)
+  {
+    tracerecorder_detach(self->recorder);
+    self->recorder = NULL;
+  }
+
+  if (recorder)
+  {
+    const char *filename = NULL;
+    PYSQLITE_VOID_CALL(filename = sqlite3_db_filename(self->db, "main"));
+    self->recorder = tracerecorder_attach(recorder, filename);
+    if (!self->recorder)
+      return NULL;
+  }
+
+  if (Connection_update_trace(self))
     return NULL;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: set_plan_monitor(callable: Optional[Callable[[str, str, str], None]]) -> None
+
+  Records the `query plan <https://sqlite.org/eqp.html>`__ of each
+  statement as it is added to the :meth:`statement cache
+  <cache_stats>`.  SQLite automatically reprepares statements when the
+  schema changes or `ANALYZE <https://sqlite.org/lang_analyze.html>`__
+  statistics are updated, which can result in a different plan such
+  as a full table scan instead of using an index.  When a reprepared
+  statement returns to the cache its plan is compared, and if
+  different *callable* is called with the query, old plan, and new
+  plan.  The plans are the same text as the ``.eqp`` output in the
+  SQLite shell.
+
+  Use *None* to stop monitoring.  The reprepares and plan_changes
+  counters in :meth:`cache_stats` are only updated while monitoring.
+
+  Getting the plan prepares and runs a separate ``EXPLAIN QUERY
+  PLAN`` of the statement each time one is added to the cache, and
+  when a reprepared statement returns to the cache.  That roughly
+  doubles the cost of preparing, which matters if the cache has a low
+  hit rate.  Statements that aren't cached are not monitored.
+
+  *callable* is called while the statement is returning to the cache,
+  so using this connection from it raises
+  :exc:`ThreadingViolationError`.  Any exception it raises is reported
+  via :func:`sys.unraisablehook`.
+
+  -* sqlite3_stmt_status
+*/
+static PyObject *
+Connection_set_plan_monitor(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  PyObject *callable;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_plan_monitor_CHECK;
+    ARG_PROLOG(1, Connection_set_plan_monitor_KWNAMES);
+    ARG_MANDATORY ARG_optional_Callable(callable);
+    ARG_EPILOG(NULL, Connection_set_plan_monitor_USAGE, );
+  }
+
+  Py_XDECREF(self->planmonitor);
+  self->planmonitor = callable ? Py_NewRef(callable) : NULL;
+  self->stmtcache->plan_monitor = self->planmonitor;
+  self->stmtcache->plan_monitor_inuse = &self->inuse;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: set_writer_queue(milliseconds: int) -> None
+
+  Makes this connection take its turn in an in process queue before
+  writing, which gives first come first served fairness amongst the
+  connections in this process writing to the same database file.
+
+  SQLite only allows one writer at a time.  Normally a connection that
+  wants to write while another is writing gets a busy error, and
+  :ref:`busy handling <busyhandling>` sleeps and retries.  A waiter
+  can sleep past the point the other writer finished, and an unlucky
+  waiter can keep losing.  With the queue, the connection waits before
+  executing its first statement that writes (including ``BEGIN
+  IMMEDIATE``) and is woken as soon as the previous writer's
+  transaction ends.  The queue is released when this connection's
+  write transaction commits or rolls back.
+
+  Only connections that have called this method take part, and
+  connections in other processes are not affected.  Files are
+  identified by :attr:`filename`, so in memory and temporary databases
+  are not queued.
+
+  :param milliseconds: Maximum thousandths of a second to wait in the
+     queue.  If exceeded then the statement runs anyway with the usual
+     busy handling.  Zero or less stops using the queue.
+
+  Do not use the queue if this connection holds a read transaction
+  in rollback journal mode while waiting for the queue, since the
+  writer ahead of it can't commit until the read transaction ends.
+  The timeout will resolve that, but only after waiting.
+
+  .. seealso::
+
+     * :meth:`writer_queue_stats`
+     * :meth:`set_busy_timeout`
+
+  -* sqlite3_txn_state sqlite3_stmt_readonly
+*/
+static PyObject *
+Connection_set_writer_queue(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  int milliseconds;
+  const char *filename;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_writer_queue_CHECK;
+    ARG_PROLOG(1, Connection_set_writer_queue_KWNAMES);
+    ARG_MANDATORY ARG_int(milliseconds);
+    ARG_EPILOG(NULL, Connection_set_writer_queue_USAGE, );
+  }
+
+  writerqueue_free(self->writerqueue);
+  self->writerqueue = 0;
+
+  filename = sqlite3_db_filename(self->db, "main");
+  if (milliseconds > 0 && filename && *filename)
+  {
+    self->writerqueue = writerqueue_new(filename, milliseconds);
+    if (!self->writerqueue)
+      return NULL;
   }
 
   Py_RETURN_NONE;
 }
 
+/** .. method:: writer_queue_stats() -> dict[str, int]
+
+  Returns statistics about this connection's use of the queue from
+  :meth:`set_writer_queue`.  They are reset each time that method is
+  called.
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - acquired
+      - How many times this connection got its turn to write
+    * - waited
+      - How many times another connection was ahead in the queue
+    * - timeouts
+      - How many of those waits exceeded the timeout
+    * - wait_ns
+      - Total nanoseconds spent waiting
+    * - max_wait_ns
+      - Longest single wait in nanoseconds
+*/
+static PyObject *
+Connection_writer_queue_stats(Connection *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  return writerqueue_stats(self->writerqueue);
+}
+
 static int
 commithookcb(void *context)
 {
@@ -1529,10 +1976,15 @@ walhookcb(void *context, sqlite3 *db, const char *dbname, int npages)
   Connection *self = (Connection *)context;
 
   assert(self);
-  assert(self->walhook);
-  assert(!Py_IsNone(self->walhook));
   assert(self->db == db);
 
+  if (self->checkpointer && 0 == strcmp(dbname, "main"))
+    checkpointer_notify(self->checkpointer, npages);
+
+  if (!self->walhook)
+    return SQLITE_OK;
+  assert(!Py_IsNone(self->walhook));
+
   gilstate = PyGILState_Ensure();
 
   MakeExistingException();
@@ -1600,14 +2052,14 @@ Connection_set_wal_hook(Connection *self, PyObject *const *fast_args, Py_ssize_t
     ARG_EPILOG(NULL, Connection_set_wal_hook_USAGE, );
   }
 
-  if (!callable)
+  if (!callable && !self->checkpointer)
   {
     PYSQLITE_VOID_CALL(sqlite3_wal_hook(self->db, NULL, NULL));
   }
   else
   {
     PYSQLITE_VOID_CALL(sqlite3_wal_hook(self->db, walhookcb, self));
-    Py_INCREF(callable);
+    Py_XINCREF(callable);
   }
   Py_XDECREF(self->walhook);
   self->walhook = callable;
@@ -1615,6 +2067,150 @@ Connection_set_wal_hook(Connection *self, PyObject *const *fast_args, Py_ssize_t
   Py_RETURN_NONE;
 }
 
+/** .. method:: set_background_checkpoint(pages: int, *, idle: float = 1.0, idle_mode: int = apsw.SQLITE_CHECKPOINT_TRUNCATE) -> None
+
+  Does :ref:`wal` checkpoints in a background thread instead of
+  during commits.
+
+  Normally SQLite automatically checkpoints when a commit makes the
+  WAL larger than :meth:`wal_autocheckpoint` pages, and that commit
+  takes considerably longer while the checkpoint runs.  With
+  background checkpointing the size of the WAL is checked after each
+  commit, and when at least *pages* have been added since the last
+  checkpoint a `PASSIVE <https://sqlite.org/c3ref/wal_checkpoint_v2.html>`__
+  checkpoint is started in a background thread using its own
+  connection.  Passive checkpoints do not interfere with readers or
+  writers.  Once there have been no commits for *idle* seconds a
+  checkpoint is done using *idle_mode*, with the default of TRUNCATE
+  resetting the WAL to zero bytes.
+
+  The background thread and its connection are shared by all
+  connections in this process with background checkpointing enabled on
+  the same database, and the most recent settings are used.  The
+  thread is stopped when the last of them is closed or disables it.
+  The thread does not use the GIL unless the :doc:`VFS <vfs>` is
+  implemented in Python.
+
+  :param pages: Checkpoint when this many pages have been added to the
+     WAL.  Zero or less disables background checkpointing for this
+     connection.
+
+  This replaces automatic checkpointing on this connection, which
+  :meth:`wal_autocheckpoint` will turn back on, replacing this.
+  Disabling background checkpointing restores the automatic
+  checkpointing that was in effect when it was enabled.  A
+  :meth:`wal hook <set_wal_hook>` is still called.
+
+  .. seealso::
+
+     * :meth:`background_checkpoint_stats`
+
+  -* sqlite3_wal_hook sqlite3_wal_checkpoint_v2
+*/
+static PyObject *
+Connection_set_background_checkpoint(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                                     PyObject *fast_kwnames)
+{
+  int pages, idle_mode = SQLITE_CHECKPOINT_TRUNCATE, res;
+  double idle = 1.0;
+  const char *filename;
+  sqlite3_vfs *vfs = NULL;
+  Checkpointer *checkpointer = NULL;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_background_checkpoint_CHECK;
+    ARG_PROLOG(1, Connection_set_background_checkpoint_KWNAMES);
+    ARG_MANDATORY ARG_int(pages);
+    ARG_OPTIONAL ARG_double(idle);
+    ARG_OPTIONAL ARG_int(idle_mode);
+    ARG_EPILOG(NULL, Connection_set_background_checkpoint_USAGE, );
+  }
+
+  if (!(idle >= 0))
+    return PyErr_Format(PyExc_ValueError, "idle must be zero or more seconds, not %f", idle);
+  if (idle_mode < SQLITE_CHECKPOINT_PASSIVE || idle_mode > SQLITE_CHECKPOINT_TRUNCATE)
+    return PyErr_Format(PyExc_ValueError, "Unknown checkpoint mode %d", idle_mode);
+
+  filename = sqlite3_db_filename(self->db, "main");
+  if (pages > 0 && filename && *filename)
+  {
+    PYSQLITE_CON_CALL(res = sqlite3_file_control(self->db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs));
+    if (res != SQLITE_OK || !vfs)
+    {
+      SET_EXC(res == SQLITE_OK ? SQLITE_ERROR : res, self->db);
+      return NULL;
+    }
+    checkpointer = checkpointer_attach(filename, vfs->zName, pages, idle, idle_mode);
+    if (!checkpointer)
+      return NULL;
+  }
+
+  if (checkpointer && !self->checkpointer && !self->walhook)
+  {
+    /* remember the automatic checkpointing being replaced */
+    sqlite3_stmt *stmt = NULL;
+    PYSQLITE_CON_CALL(res = sqlite3_prepare_v3(self->db, "pragma main.wal_autocheckpoint", -1, 0, &stmt, NULL));
+    if (res == SQLITE_OK)
+    {
+      PYSQLITE_CON_CALL(res = sqlite3_step(stmt);
+                        if (res == SQLITE_ROW) self->checkpointer_autocheckpoint = sqlite3_column_int(stmt, 0));
+      PYSQLITE_VOID_CALL(sqlite3_finalize(stmt));
+    }
+  }
+  if (!checkpointer && self->checkpointer && !self->walhook)
+  {
+    PYSQLITE_CON_CALL(res = sqlite3_wal_autocheckpoint(self->db, self->checkpointer_autocheckpoint));
+  }
+  else
+    PYSQLITE_VOID_CALL(sqlite3_wal_hook(self->db, (self->walhook || checkpointer) ? walhookcb : NULL, self));
+
+  if (self->checkpointer)
+    checkpointer_detach(self->checkpointer);
+  self->checkpointer = checkpointer;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: background_checkpoint_stats() -> dict[str, int]
+
+  Returns statistics from :meth:`set_background_checkpoint`, covering
+  all connections to the same database.  They are reset when the
+  background thread is stopped.
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - passive
+      - Number of PASSIVE checkpoints after *pages* were added
+    * - idle
+      - Number of *idle_mode* checkpoints after there were no commits
+    * - busy
+      - Number of checkpoints that could not be completed because
+        the database was busy
+    * - checkpoint_ns
+      - Total nanoseconds spent checkpointing
+    * - max_checkpoint_ns
+      - Longest checkpoint in nanoseconds
+    * - wal_high_water
+      - Largest WAL size in pages seen after a commit
+    * - wal_pages
+      - WAL size in pages after the most recent commit or checkpoint
+*/
+static PyObject *
+Connection_background_checkpoint_stats(Connection *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  return checkpointer_stats(self->checkpointer);
+}
+
 static int
 progresshandlercb(void *context)
 {
@@ -1659,6 +2255,94 @@ finally:
   return ok;
 }
 
+static int
+progresslimitscb(void *context)
+{
+  /* Runs without the GIL while a statement is being stepped.  Limits
+     are checked first, then the Python handler is called if it is
+     due */
+  Connection *self = (Connection *)context;
+  sqlite3_stmt *stmt = self->limits.stmt;
+
+  if (stmt)
+  {
+    sqlite3_int64 vm_steps = (*self->limits.steps += self->progress_nsteps);
+    if (self->limits.vm_steps && vm_steps > self->limits.vm_steps)
+    {
+      self->limits.exceeded = STATEMENT_LIMIT_VM_STEPS;
+      self->limits.used_vm_steps = vm_steps;
+      return 1;
+    }
+  }
+
+  if (self->progresshandler)
+  {
+    self->progresshandler_count += self->progress_nsteps;
+    if (self->progresshandler_count >= self->progresshandler_nsteps)
+    {
+      self->progresshandler_count = 0;
+      return progresshandlercb(self);
+    }
+  }
+  return 0;
+}
+
+/* registers with SQLite what the progress handler and limits need */
+static int
+Connection_update_progress(Connection *self)
+{
+  CHECK_USE(-1);
+  CHECK_CLOSED(self, -1);
+
+  if (self->limits.vm_steps)
+  {
+    int nsteps = STATEMENT_LIMIT_CHECK_STEPS;
+    if (self->limits.vm_steps && self->limits.vm_steps < nsteps)
+      nsteps = (int)self->limits.vm_steps;
+    if (self->progresshandler && self->progresshandler_nsteps > 0 && self->progresshandler_nsteps < nsteps)
+      nsteps = self->progresshandler_nsteps;
+    self->progress_nsteps = nsteps;
+    self->progresshandler_count = 0;
+    PYSQLITE_VOID_CALL(sqlite3_progress_handler(self->db, nsteps, progresslimitscb, self));
+  }
+  else if (self->progresshandler)
+    PYSQLITE_VOID_CALL(sqlite3_progress_handler(self->db, self->progresshandler_nsteps, progresshandlercb, self));
+  else
+    PYSQLITE_VOID_CALL(sqlite3_progress_handler(self->db, 0, NULL, NULL));
+  return 0;
+}
+
+/* Replaces the current exception (the interrupt from SQLite) with
+   ResourceLimitError for the exceeded limit */
+static void
+statement_limits_raise(Connection *connection, sqlite3_int64 rows)
+{
+  static const char *const names[] = {"", "vm_steps", "rows"};
+  int which = connection->limits.exceeded;
+  sqlite3_int64 maximum
+      = (which == STATEMENT_LIMIT_VM_STEPS) ? connection->limits.vm_steps : connection->limits.rows;
+  PyObject *name = NULL, *usage = NULL;
+
+  assert(which);
+  connection->limits.exceeded = 0;
+
+  PyErr_Clear();
+  PyErr_Format(ExcResourceLimit, "ResourceLimitError: statement exceeded the %s limit of %lld", names[which],
+               maximum);
+  PY_ERR_FETCH(exc);
+  PY_ERR_NORMALIZE(exc);
+
+  name = PyUnicode_FromString(names[which]);
+  if (name)
+    usage = Py_BuildValue("{s: L, s: L}", "vm_steps", connection->limits.used_vm_steps, "rows", rows);
+  if (!usage || PyObject_SetAttr(exc, apst.limit, name) || PyObject_SetAttr(exc, apst.usage, usage))
+    apsw_write_unraisable(NULL);
+  Py_XDECREF(name);
+  Py_XDECREF(usage);
+
+  PY_ERR_RESTORE(exc);
+}
+
 /** .. method:: set_progress_handler(callable: Optional[Callable[[], bool]], nsteps: int = 20) -> None
 
   Sets a callable which is invoked every *nsteps* SQLite
@@ -1689,22 +2373,111 @@ Connection_set_progress_handler(Connection *self, PyObject *const *fast_args, Py
     ARG_OPTIONAL ARG_int(nsteps);
     ARG_EPILOG(NULL, Connection_set_progress_handler_USAGE, );
   }
-  if (!callable)
-  {
-    PYSQLITE_VOID_CALL(sqlite3_progress_handler(self->db, 0, NULL, NULL));
-  }
-  else
+  Py_XINCREF(callable);
+  Py_XDECREF(self->progresshandler);
+  self->progresshandler = callable;
+  self->progresshandler_nsteps = nsteps;
+
+  if (Connection_update_progress(self))
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: set_statement_limits(vm_steps: int = 0, rows: int = 0) -> None
+
+  Limits the resources each statement run by a :class:`Cursor` on
+  this connection can use, such as when running queries supplied by
+  users.  Zero means no limit, and calling with no arguments removes
+  all limits.
+
+  :param vm_steps: Maximum virtual machine instructions run by the statement
+     (`SQLITE_STMTSTATUS_VM_STEP <https://sqlite.org/c3ref/c_stmtstatus_counter.html>`__)
+  :param rows: Maximum number of rows the statement returns
+
+  The statement is stopped with :exc:`ResourceLimitError` when a limit
+  is exceeded.  Its :attr:`~ResourceLimitError.usage` gives how much
+  of each resource was used.
+
+  *vm_steps* is checked from the progress handler every 100
+  instructions so the statement can run slightly past it.  A handler
+  from :meth:`set_progress_handler` is still called at approximately
+  its *nsteps*.
+
+  SQLite doesn't track memory or temporary files per statement.
+  :func:`apsw.hard_heap_limit` limits memory for the whole process,
+  and with `pragma temp_store=memory
+  <https://sqlite.org/pragma.html#pragma_temp_store>`__ temporary
+  storage counts towards it.
+
+  -* sqlite3_progress_handler sqlite3_stmt_status
+*/
+static PyObject *
+Connection_set_statement_limits(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                                PyObject *fast_kwnames)
+{
+  long long vm_steps = 0, rows = 0;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
   {
-    PYSQLITE_VOID_CALL(sqlite3_progress_handler(self->db, nsteps, progresshandlercb, self));
-    Py_INCREF(callable);
+    Connection_set_statement_limits_CHECK;
+    ARG_PROLOG(2, Connection_set_statement_limits_KWNAMES);
+    ARG_OPTIONAL ARG_int64(vm_steps);
+    ARG_OPTIONAL ARG_int64(rows);
+    ARG_EPILOG(NULL, Connection_set_statement_limits_USAGE, );
   }
+  if (vm_steps < 0 || rows < 0)
+    return PyErr_Format(PyExc_ValueError, "Limits can't be negative");
 
-  Py_XDECREF(self->progresshandler);
-  self->progresshandler = callable;
+  self->limits.vm_steps = vm_steps;
+  self->limits.rows = rows;
+
+  if (Connection_update_progress(self))
+    return NULL;
 
   Py_RETURN_NONE;
 }
 
+/* Matches text against a pattern where * matches zero or more
+   characters and ? matches one, ignoring ASCII case like SQLite does
+   for identifiers.  A NULL pattern matches anything, while NULL text
+   only matches a NULL pattern */
+static int
+authorizer_rule_match(const char *pattern, const char *text)
+{
+  const char *star = NULL, *resume = NULL;
+
+  if (!pattern)
+    return 1;
+  if (!text)
+    return 0;
+
+  while (*text)
+  {
+    if (*pattern == '*')
+    {
+      star = pattern++;
+      resume = text;
+    }
+    else if (*pattern && (*pattern == '?' || Py_TOLOWER(*pattern) == Py_TOLOWER(*text)))
+    {
+      pattern++;
+      text++;
+    }
+    else if (star)
+    {
+      pattern = star + 1;
+      text = ++resume;
+    }
+    else
+      return 0;
+  }
+  while (*pattern == '*')
+    pattern++;
+  return !*pattern;
+}
+
 static int
 authorizercb(void *context, int operation, const char *paramone, const char *paramtwo, const char *databasename, const char *triggerview)
 {
@@ -1715,10 +2488,22 @@ authorizercb(void *context, int operation, const char *paramone, const char *par
   PyObject *retval = NULL;
   int result = SQLITE_DENY; /* default to deny */
   Connection *self = (Connection *)context;
+  int i;
 
   assert(self);
-  assert(self->authorizer);
-  assert(!Py_IsNone(self->authorizer));
+
+  /* the rules can't change while SQLite is preparing a statement
+     because the connection is in use, so no GIL is needed */
+  for (i = 0; i < self->authorizer_nrules; i++)
+  {
+    AuthorizerRule *rule = self->authorizer_rules + i;
+    if ((rule->operation < 0 || rule->operation == operation) && authorizer_rule_match(rule->paramone, paramone)
+        && authorizer_rule_match(rule->paramtwo, paramtwo))
+      return rule->result;
+  }
+
+  if (!self->authorizer)
+    return SQLITE_OK;
 
   gilstate = PyGILState_Ensure();
 
@@ -1771,7 +2556,8 @@ Connection_internal_set_authorizer(Connection *self, PyObject *callable)
 
   assert(!Py_IsNone(callable));
 
-  PYSQLITE_CON_CALL(res = sqlite3_set_authorizer(self->db, callable ? authorizercb : NULL, callable ? self : NULL));
+  PYSQLITE_CON_CALL(res = sqlite3_set_authorizer(self->db, (callable || self->authorizer_rules) ? authorizercb : NULL,
+                                                  (callable || self->authorizer_rules) ? self : NULL));
 
   if (res != SQLITE_OK)
   {
@@ -1791,24 +2577,180 @@ Connection_internal_set_authorizer(Connection *self, PyObject *callable)
   Sets the :attr:`authorizer`
 */
 
-static PyObject *
-Connection_set_authorizer(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
-{
-  PyObject *callable;
+static PyObject *
+Connection_set_authorizer(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  PyObject *callable;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_authorizer_CHECK;
+    ARG_PROLOG(1, Connection_set_authorizer_KWNAMES);
+    ARG_MANDATORY ARG_optional_Callable(callable);
+    ARG_EPILOG(NULL, Connection_set_authorizer_USAGE, );
+  }
+
+  if (Connection_internal_set_authorizer(self, callable))
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+/** .. method:: set_authorizer_rules(rules: Optional[Sequence[AuthorizerRule]]) -> None
+
+  Sets rules checked by the authorizer in C, without calling any
+  Python code or needing the GIL.  This is considerably faster than
+  an :attr:`authorizer` callback which is called for every table and
+  column access, function call etc in every statement prepared.
+
+  Each rule is a tuple of the operation code (or *None* for any
+  operation), patterns for the two operation dependent strings
+  described in :attr:`authorizer`, and the result which is one of
+  *SQLITE_OK*, *SQLITE_DENY*, or *SQLITE_IGNORE*.  A pattern of *None*
+  matches anything, and otherwise `*` matches zero or more characters
+  and `?` matches exactly one, ignoring ASCII case.  For example the
+  table and column for *SQLITE_READ*, or the function name for
+  *SQLITE_FUNCTION* which is the second string.
+
+  The rules are checked in order with the first match deciding the
+  result.  If no rule matches then the :attr:`authorizer` callback is
+  called if there is one, else the action is allowed.  End with
+  `(None, None, None, apsw.SQLITE_DENY)` to deny everything not
+  explicitly allowed.
+
+  .. code-block:: python
+
+    connection.set_authorizer_rules([
+      (apsw.SQLITE_READ, "users", "password", apsw.SQLITE_IGNORE),
+      (apsw.SQLITE_READ, None, None, apsw.SQLITE_OK),
+      (apsw.SQLITE_SELECT, None, None, apsw.SQLITE_OK),
+      (apsw.SQLITE_FUNCTION, None, "json*", apsw.SQLITE_OK),
+      (None, None, None, apsw.SQLITE_DENY),
+    ])
+
+  Use *None* to remove all rules.
+
+  -* sqlite3_set_authorizer
+*/
+static PyObject *
+Connection_set_authorizer_rules(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                                PyObject *fast_kwnames)
+{
+  PyObject *rules, *sequence = NULL;
+  AuthorizerRule *newrules = NULL;
+  Py_ssize_t nrules = 0, i;
+  int res;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_authorizer_rules_CHECK;
+    ARG_PROLOG(1, Connection_set_authorizer_rules_KWNAMES);
+    ARG_MANDATORY ARG_pyobject(rules);
+    ARG_EPILOG(NULL, Connection_set_authorizer_rules_USAGE, );
+  }
+
+  if (!Py_IsNone(rules))
+  {
+    sequence = PySequence_Fast(rules, "expected a sequence for " Connection_set_authorizer_rules_USAGE);
+    if (!sequence)
+      goto error;
+    nrules = PySequence_Fast_GET_SIZE(sequence);
+    if (nrules > INT_MAX)
+    {
+      PyErr_Format(PyExc_ValueError, "Too many rules");
+      goto error;
+    }
+    if (nrules)
+    {
+      newrules = PyMem_Calloc(nrules, sizeof(AuthorizerRule));
+      if (!newrules)
+      {
+        PyErr_NoMemory();
+        goto error;
+      }
+    }
+    for (i = 0; i < nrules; i++)
+    {
+      PyObject *item = PySequence_Fast_GET_ITEM(sequence, i);
+      AuthorizerRule *rule = newrules + i;
+      char **patterns[] = {&rule->paramone, &rule->paramtwo};
+      int j;
+
+      if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 4)
+      {
+        PyErr_Format(PyExc_TypeError, "Expected rule #%zd to be a tuple of 4 items, not %s", i, Py_TypeName(item));
+        goto error;
+      }
+
+      if (Py_IsNone(PyTuple_GET_ITEM(item, 0)))
+        rule->operation = -1;
+      else
+      {
+        rule->operation = PyLong_Check(PyTuple_GET_ITEM(item, 0)) ? PyLong_AsInt(PyTuple_GET_ITEM(item, 0)) : -1;
+        if (PyErr_Occurred() || rule->operation < 0)
+        {
+          if (!PyErr_Occurred())
+            PyErr_Format(PyExc_ValueError, "Expected rule #%zd operation to be None or an operation code", i);
+          goto error;
+        }
+      }
+
+      for (j = 0; j < 2; j++)
+      {
+        PyObject *pattern = PyTuple_GET_ITEM(item, j + 1);
+        const char *utf8;
+        if (Py_IsNone(pattern))
+          continue;
+        if (!PyUnicode_Check(pattern))
+        {
+          PyErr_Format(PyExc_TypeError, "Expected rule #%zd pattern to be None or str, not %s", i,
+                       Py_TypeName(pattern));
+          goto error;
+        }
+        utf8 = PyUnicode_AsUTF8(pattern);
+        if (!utf8)
+          goto error;
+        *patterns[j] = apsw_strdup(utf8);
+        if (!*patterns[j])
+        {
+          PyErr_NoMemory();
+          goto error;
+        }
+      }
 
-  CHECK_USE(NULL);
-  CHECK_CLOSED(self, NULL);
+      rule->result = PyLong_Check(PyTuple_GET_ITEM(item, 3)) ? PyLong_AsInt(PyTuple_GET_ITEM(item, 3)) : -1;
+      if (PyErr_Occurred())
+        goto error;
+      if (rule->result != SQLITE_OK && rule->result != SQLITE_DENY && rule->result != SQLITE_IGNORE)
+      {
+        PyErr_Format(PyExc_ValueError, "Expected rule #%zd result to be SQLITE_OK, SQLITE_DENY, or SQLITE_IGNORE", i);
+        goto error;
+      }
+    }
+  }
 
+  PYSQLITE_CON_CALL(res = sqlite3_set_authorizer(self->db, (self->authorizer || newrules) ? authorizercb : NULL,
+                                                  (self->authorizer || newrules) ? self : NULL));
+  if (res != SQLITE_OK)
   {
-    Connection_set_authorizer_CHECK;
-    ARG_PROLOG(1, Connection_set_authorizer_KWNAMES);
-    ARG_MANDATORY ARG_optional_Callable(callable);
-    ARG_EPILOG(NULL, Connection_set_authorizer_USAGE, );
+    SET_EXC(res, self->db);
+    goto error;
   }
 
-  if (Connection_internal_set_authorizer(self, callable))
-    return NULL;
+  authorizer_rules_free(self->authorizer_rules, self->authorizer_nrules);
+  self->authorizer_rules = newrules;
+  self->authorizer_nrules = (int)nrules;
+
+  Py_XDECREF(sequence);
   Py_RETURN_NONE;
+
+error:
+  authorizer_rules_free(newrules, (int)nrules);
+  Py_XDECREF(sequence);
+  return NULL;
 }
 
 static void
@@ -2115,6 +3057,162 @@ finally:
   Py_RETURN_NONE;
 }
 
+static int
+busybackoffcb(void *context, int ncall)
+{
+  BusyBackoff *bb = &((Connection *)context)->busybackoff;
+  long long now = apsw_monotonic_ns(), elapsed, delay;
+  double wait;
+
+  if (ncall == 0)
+  {
+    bb->started = now;
+    bb->busy++;
+  }
+  elapsed = now - bb->started;
+  if (elapsed > bb->max_wait_ns)
+    bb->max_wait_ns = elapsed;
+  if (elapsed >= bb->timeout)
+  {
+    bb->timeouts++;
+    return 0;
+  }
+
+  wait = bb->initial * pow(bb->multiplier, ncall);
+  if (wait > bb->maximum)
+    wait = bb->maximum;
+  if (bb->jitter)
+  {
+    unsigned int r;
+    sqlite3_randomness(sizeof(r), &r);
+    wait *= 1.0 + bb->jitter * (2.0 * r / UINT_MAX - 1.0);
+  }
+  delay = (long long)wait;
+  if (delay > bb->timeout - elapsed)
+    delay = bb->timeout - elapsed;
+
+  bb->retries++;
+  bb->vfs->xSleep(bb->vfs, (int)((delay + 999) / 1000));
+  /* this sleep could be the last if the retry succeeds */
+  elapsed = apsw_monotonic_ns();
+  bb->wait_ns += elapsed - now;
+  elapsed -= bb->started;
+  if (elapsed > bb->max_wait_ns)
+    bb->max_wait_ns = elapsed;
+  return 1;
+}
+
+/** .. method:: set_busy_backoff(*, initial: float = 0.001, multiplier: float = 2.0, maximum: float = 0.1, jitter: float = 0.25, timeout: float = 5.0) -> None
+
+  Installs a busy handler implemented in C that retries with
+  exponential backoff.  Unlike :meth:`set_busy_handler` no Python code
+  runs while waiting, and unlike :meth:`set_busy_timeout` the delays
+  can be tuned.  The GIL is released while sleeping.
+
+  The first retry waits *initial* seconds, and each subsequent retry
+  waits *multiplier* times longer than the previous, up to *maximum*.
+  Each wait is randomly varied by up to *jitter* times its length in
+  either direction, which stops multiple waiters retrying in lock
+  step.  :class:`BusyError` is returned once *timeout* seconds have
+  been spent waiting.  Sleeping is done by this connection's
+  :doc:`VFS <vfs>`, as SQLite's own busy handler does.
+
+  Calling :meth:`set_busy_handler` or :meth:`set_busy_timeout`
+  replaces this handler.
+
+  .. seealso::
+
+     * :meth:`busy_stats`
+     * :ref:`Busy handling <busyhandling>`
+
+  -* sqlite3_busy_handler sqlite3_file_control
+*/
+static PyObject *
+Connection_set_busy_backoff(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs, PyObject *fast_kwnames)
+{
+  double initial = 0.001, multiplier = 2.0, maximum = 0.1, jitter = 0.25, timeout = 5.0;
+  sqlite3_vfs *vfs = NULL;
+  int res;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_busy_backoff_CHECK;
+    ARG_PROLOG(0, Connection_set_busy_backoff_KWNAMES);
+    ARG_OPTIONAL ARG_double(initial);
+    ARG_OPTIONAL ARG_double(multiplier);
+    ARG_OPTIONAL ARG_double(maximum);
+    ARG_OPTIONAL ARG_double(jitter);
+    ARG_OPTIONAL ARG_double(timeout);
+    ARG_EPILOG(NULL, Connection_set_busy_backoff_USAGE, );
+  }
+
+  if (!(initial >= 0 && multiplier >= 1 && maximum >= initial && jitter >= 0 && jitter <= 1 && timeout >= 0))
+    return PyErr_Format(PyExc_ValueError,
+                        "Need 0 <= initial <= maximum, multiplier >= 1, 0 <= jitter <= 1, and timeout >= 0");
+
+  PYSQLITE_CON_CALL(res = sqlite3_file_control(self->db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs));
+  if (res != SQLITE_OK || !vfs)
+    PYSQLITE_VOID_CALL(vfs = sqlite3_vfs_find(NULL));
+
+  PYSQLITE_CON_CALL(res = sqlite3_busy_handler(self->db, busybackoffcb, self));
+  SET_EXC(res, self->db);
+  if (res != SQLITE_OK)
+    return NULL;
+
+  Py_CLEAR(self->busyhandler);
+
+  memset(&self->busybackoff, 0, sizeof(self->busybackoff));
+  self->busybackoff.initial = initial * 1e9;
+  self->busybackoff.multiplier = multiplier;
+  self->busybackoff.maximum = maximum * 1e9;
+  self->busybackoff.jitter = jitter;
+  self->busybackoff.timeout = (timeout * 1e9 > (double)LLONG_MAX) ? LLONG_MAX : (long long)(timeout * 1e9);
+  self->busybackoff.vfs = vfs;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: busy_stats() -> dict[str, int]
+
+  Returns statistics from the busy handler installed by
+  :meth:`set_busy_backoff`.  They are reset each time that method is
+  called.
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - busy
+      - How many times a lock was busy, starting a wait
+    * - retries
+      - How many times SQLite was told to retry after sleeping
+    * - timeouts
+      - How many waits exceeded the timeout, returning :class:`BusyError`
+    * - wait_ns
+      - Total nanoseconds spent sleeping
+    * - max_wait_ns
+      - Longest single wait in nanoseconds, from the lock first being
+        busy until the final sleep ended
+*/
+static PyObject *
+Connection_busy_stats(Connection *self)
+{
+  BusyBackoff bb;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  _PYSQLITE_CALL_V(sqlite3_mutex_enter(sqlite3_db_mutex(self->db)); bb = self->busybackoff;
+                   sqlite3_mutex_leave(sqlite3_db_mutex(self->db)));
+
+  return Py_BuildValue("{s: L, s: L, s: L, s: L, s: L}", "busy", bb.busy, "retries", bb.retries, "timeouts", bb.timeouts,
+                       "wait_ns", bb.wait_ns, "max_wait_ns", bb.max_wait_ns);
+}
+
 #ifndef SQLITE_OMIT_DESERIALZE
 /** .. method:: serialize(name: str) -> bytes
 
@@ -2314,6 +3412,7 @@ Connection_load_extension(Connection *self, PyObject *const *fast_args, Py_ssize
     ARG_EPILOG(NULL, Connection_load_extension_USAGE, );
   }
   PYSQLITE_CON_CALL(res = sqlite3_load_extension(self->db, filename, entrypoint, &errmsg));
+  resultcache_clear(self->resultcache);
 
   /* load_extension doesn't set the error message on the db so we have to make exception manually */
   if (res != SQLITE_OK)
@@ -3117,6 +4216,7 @@ Connection_create_window_function(Connection *self, PyObject *const *fast_args,
                                            cbinfo ? cbw_value : NULL,
                                            cbinfo ? cbw_inverse : NULL,
                                            apsw_free_func));
+  resultcache_clear(self->resultcache);
   SET_EXC(res, self->db);
 finally:
   if (PyErr_Occurred())
@@ -3207,6 +4307,7 @@ Connection_create_scalar_function(Connection *self, PyObject *const *fast_args,
                                        NULL,
                                        NULL,
                                        apsw_free_func));
+  resultcache_clear(self->resultcache);
   if (res)
   {
     /* Note: On error sqlite3_create_function_v2 calls the destructor (apsw_free_func)! */
@@ -3310,6 +4411,7 @@ Connection_create_aggregate_function(Connection *self, PyObject *const *fast_arg
                                        cbinfo ? cbdispatch_step : NULL,
                                        cbinfo ? cbdispatch_final : NULL,
                                        apsw_free_func));
+  resultcache_clear(self->resultcache);
 
   if (res)
   {
@@ -3446,6 +4548,7 @@ Connection_create_collation(Connection *self, PyObject *const *fast_args, Py_ssi
                                         callback ? callback : NULL,
                                         callback ? collation_cb : NULL,
                                         callback ? collation_destroy : NULL));
+  resultcache_clear(self->resultcache);
 
   if (res != SQLITE_OK)
   {
@@ -3714,6 +4817,7 @@ Connection_create_module(Connection *self, PyObject *const *fast_args, Py_ssize_
   /* SQLite is really finnicky.  Note that it calls the destructor on
      failure  */
   PYSQLITE_CON_CALL(res = sqlite3_create_module_v2(self->db, name, vti ? vti->sqlite3_module_def : NULL, vti, apswvtabFree));
+  resultcache_clear(self->resultcache);
   SET_EXC(res, self->db);
 
   if (res != SQLITE_OK)
@@ -3817,6 +4921,7 @@ Connection_overload_function(Connection *self, PyObject *const *fast_args, Py_ss
   }
 
   PYSQLITE_CON_CALL(res = sqlite3_overload_function(self->db, name, nargs));
+  resultcache_clear(self->resultcache);
   SET_EXC(res, self->db);
 
   if (res)
@@ -3935,6 +5040,61 @@ Connection_get_row_trace(Connection *self)
   Behind the scenes `savepoints <https://sqlite.org/lang_savepoint.html>`__
    are used to provide nested transactions.
 */
+static const char *const savepoint_formats[] = {
+    "SAVEPOINT \"_apsw-%ld\"",
+    "RELEASE SAVEPOINT \"_apsw-%ld\"",
+    "ROLLBACK TO SAVEPOINT \"_apsw-%ld\"",
+};
+
+/* Runs a context manager savepoint operation, returning a SQLite error
+   code.  The shallower levels keep prepared statements on the
+   connection so the SQL doesn't have to be parsed on every with
+   block.  sql is the statement text if already formatted, else NULL */
+static int connection_savepoint_exec(Connection *self, int op, long level, const char *sql)
+{
+  int res;
+  char *formatted = NULL;
+  sqlite3_stmt *stmt = (level < SAVEPOINT_CACHE_LEVELS) ? self->savepoint_stmts[level][op] : NULL;
+
+  if (!stmt)
+  {
+    if (!sql)
+    {
+      sql = formatted = sqlite3_mprintf(savepoint_formats[op], level);
+      if (!sql)
+        return SQLITE_NOMEM;
+    }
+    if (level >= SAVEPOINT_CACHE_LEVELS)
+    {
+      PYSQLITE_CON_CALL(res = sqlite3_exec(self->db, sql, 0, 0, 0));
+      sqlite3_free(formatted);
+      writerqueue_update(self->writerqueue, self->db);
+      return res;
+    }
+    PYSQLITE_CON_CALL(res = sqlite3_prepare_v3(self->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL));
+    sqlite3_free(formatted);
+    if (res != SQLITE_OK)
+      return res;
+    self->savepoint_stmts[level][op] = stmt;
+  }
+
+  PYSQLITE_CON_CALL(res = sqlite3_step(stmt); if (res == SQLITE_DONE) res = SQLITE_OK; sqlite3_reset(stmt));
+  writerqueue_update(self->writerqueue, self->db);
+  return res;
+}
+
+static void connection_savepoints_finalize(Connection *self)
+{
+  int level, op;
+  for (level = 0; level < SAVEPOINT_CACHE_LEVELS; level++)
+    for (op = 0; op < 3; op++)
+      if (self->savepoint_stmts[level][op])
+      {
+        PYSQLITE_VOID_CALL(sqlite3_finalize(self->savepoint_stmts[level][op]));
+        self->savepoint_stmts[level][op] = NULL;
+      }
+}
+
 static PyObject *
 Connection_enter(Connection *self)
 {
@@ -3944,15 +5104,15 @@ Connection_enter(Connection *self)
   CHECK_USE(NULL);
   CHECK_CLOSED(self, NULL);
 
-  sql = sqlite3_mprintf("SAVEPOINT \"_apsw-%ld\"", self->savepointlevel);
-  if (!sql)
-    return PyErr_NoMemory();
-
   /* exec tracing - we allow it to prevent */
   if (self->exectrace && !Py_IsNone(self->exectrace))
   {
     int result;
     PyObject *retval = NULL;
+
+    sql = sqlite3_mprintf(savepoint_formats[SAVEPOINT_OP_SAVEPOINT], self->savepointlevel);
+    if (!sql)
+      return PyErr_NoMemory();
     PyObject *vargs[] = {NULL, (PyObject *)self, PyUnicode_FromString(sql), Py_None};
     if (vargs[2])
       retval = PyObject_Vectorcall(self->exectrace, vargs + 1, 3 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
@@ -3974,7 +5134,7 @@ Connection_enter(Connection *self)
     assert(result == 1);
   }
 
-  PYSQLITE_CON_CALL(res = sqlite3_exec(self->db, sql, 0, 0, 0));
+  res = connection_savepoint_exec(self, SAVEPOINT_OP_SAVEPOINT, self->savepointlevel, sql);
   sqlite3_free(sql);
   SET_EXC(res, self->db);
   if (res)
@@ -4004,21 +5164,21 @@ error:
 static int connection_trace_and_exec(Connection *self, int release, int sp, int continue_on_trace_error)
 {
 #include "faultinject.h"
-  char *sql;
+  char *sql = NULL;
   int res;
-
-  sql = sqlite3_mprintf(release ? "RELEASE SAVEPOINT \"_apsw-%ld\"" : "ROLLBACK TO SAVEPOINT \"_apsw-%ld\"",
-                        sp);
-  if (!sql)
-  {
-    PyErr_NoMemory();
-    return -1;
-  }
+  int op = release ? SAVEPOINT_OP_RELEASE : SAVEPOINT_OP_ROLLBACK;
 
   if (self->exectrace && !Py_IsNone(self->exectrace))
   {
     PyObject *result = NULL;
 
+    sql = sqlite3_mprintf(savepoint_formats[op], (long)sp);
+    if (!sql)
+    {
+      PyErr_NoMemory();
+      return -1;
+    }
+
     CHAIN_EXC_BEGIN
     PyObject *vargs[] = {NULL, (PyObject *)self, PyUnicode_FromString(sql), Py_None};
     if (vargs[2])
@@ -4036,7 +5196,7 @@ static int connection_trace_and_exec(Connection *self, int release, int sp, int
     }
   }
 
-  PYSQLITE_CON_CALL(res = sqlite3_exec(self->db, sql, 0, 0, 0));
+  res = connection_savepoint_exec(self, op, sp, sql);
   SET_EXC(res, self->db);
   sqlite3_free(sql);
   assert(res == SQLITE_OK || PyErr_Occurred());
@@ -4319,6 +5479,18 @@ Connection_execute(Connection *self, PyObject *const *args, Py_ssize_t nargs, Py
   CHECK_USE(NULL);
   CHECK_CLOSED(self, NULL);
 
+  /* nothing can have overridden cursor() or Cursor.execute so call
+     them directly */
+  if (Py_IS_TYPE(self, &ConnectionType) && Py_Is(self->cursor_factory, (PyObject *)&APSWCursorType))
+  {
+    cursor = Connection_cursor(self);
+    if (!cursor)
+      return NULL;
+    res = APSWCursor_execute((struct APSWCursor *)cursor, args, nargs, kwnames);
+    Py_DECREF(cursor);
+    return res;
+  }
+
   PyObject *vargs[] = {NULL, (PyObject *)self};
   cursor = PyObject_VectorcallMethod(apst.cursor, vargs + 1, 1 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
   if (!cursor)
@@ -4378,6 +5550,214 @@ fail:
   return res;
 }
 
+/** .. method:: execute_cached(statements: str, bindings: Optional[Bindings] = None) -> tuple[SQLiteValues, ...]
+
+  Executes the query returning all the rows.  If the result cache has
+  been enabled with :meth:`set_result_cache` then the rows are kept,
+  and returned again for the same *statements* and *bindings* without
+  running the query as long as no database has changed.  This is
+  intended for dashboards and similar that issue the same queries
+  repeatedly.
+
+  Changes are detected with `data versions
+  <https://sqlite.org/c3ref/c_fcntl_begin_atomic_write.html#sqlitefcntldataversion>`__
+  which cover changes made by this connection, and by other
+  connections and processes.  Any change discards all the cached
+  results.
+
+  Results are only cached outside of a transaction, and when there is
+  no :attr:`exec_trace` or :attr:`row_trace` on the connection or on
+  the cursor returned by :attr:`cursor_factory`, which must be a
+  :class:`Cursor`.  The query must be a
+  single statement that is read only, is not a pragma, does not use
+  virtual tables, and all its functions must be deterministic (see
+  :meth:`create_scalar_function`) or builtin aggregate and window
+  functions.  The date and time functions are not deterministic
+  because they can use ``'now'``.  Bindings must be ``None``, a
+  :class:`tuple`, :class:`list`, or :class:`dict` of the basic
+  :class:`SQLiteValue` types.
+
+  The same tuple can be returned to multiple callers so results should
+  be treated as read only.  Registering or removing a function,
+  collation, or virtual table module, or changing
+  :attr:`cursor_factory` discards all the cached results.
+
+  .. seealso::
+
+     * :meth:`result_cache_stats`
+
+  -* sqlite3_file_control sqlite3_stmt_readonly sqlite3_stmt_explain
+*/
+static PyObject *
+Connection_execute_cached(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                          PyObject *fast_kwnames)
+{
+  PyObject *statements, *bindings = NULL, *key = NULL, *cursor = NULL, *rows = NULL;
+  unsigned long long signature = 0;
+  int res, cacheable = 0;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_execute_cached_CHECK;
+    ARG_PROLOG(2, Connection_execute_cached_KWNAMES);
+    ARG_MANDATORY ARG_PyUnicode(statements);
+    ARG_OPTIONAL ARG_optional_Bindings(bindings);
+    ARG_EPILOG(NULL, Connection_execute_cached_USAGE, );
+  }
+
+  if (self->resultcache && !self->exectrace && !self->rowtrace && sqlite3_get_autocommit(self->db))
+  {
+    key = resultcache_key(statements, bindings);
+    if (!key && PyErr_Occurred())
+      return NULL;
+  }
+
+  if (key)
+  {
+    PYSQLITE_CON_CALL(res = resultcache_signature(self->db, &signature));
+    if (res != SQLITE_OK)
+    {
+      SET_EXC(res, self->db);
+      goto finally;
+    }
+    resultcache_validate(self->resultcache, signature);
+
+    rows = resultcache_get(self->resultcache, key);
+    if (rows || PyErr_Occurred())
+    {
+      if (rows)
+        self->resultcache->hits++;
+      goto finally;
+    }
+
+    cacheable = resultcache_decision(self->resultcache, statements);
+    if (cacheable < 0)
+    {
+      const char *utf8;
+      Py_ssize_t length;
+
+      if (PyErr_Occurred())
+        goto finally;
+      utf8 = PyUnicode_AsUTF8AndSize(statements, &length);
+      if (!utf8)
+        goto finally;
+      PYSQLITE_VOID_CALL(resultcache_analyse(self->db, utf8, length, &cacheable));
+      if (PyDict_SetItem(self->resultcache->decisions, statements, cacheable ? Py_True : Py_False))
+        goto finally;
+    }
+  }
+
+  {
+    PyObject *vargs[] = { NULL, (PyObject *)self, statements, bindings ? bindings : Py_None };
+    cursor = PyObject_VectorcallMethod(apst.execute, vargs + 1, 3 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+  }
+  if (!cursor)
+    goto finally;
+  rows = PySequence_Tuple(cursor);
+  if (!rows)
+    goto finally;
+
+  if (self->resultcache)
+  {
+    if (key && cacheable && !APSWCursor_has_own_tracer(cursor))
+    {
+      self->resultcache->misses++;
+      if (resultcache_put(self->resultcache, key, rows))
+        Py_CLEAR(rows);
+    }
+    else
+      self->resultcache->uncacheable++;
+  }
+
+finally:
+  Py_XDECREF(cursor);
+  Py_XDECREF(key);
+  return rows;
+}
+
+/** .. method:: set_result_cache(max_entries: int, max_bytes: int = 16777216) -> None
+
+  Enables caching the results of :meth:`execute_cached`.  Calling this
+  again discards the existing results and statistics.
+
+  :param max_entries: Maximum number of results kept.  Zero or less
+     disables the cache.
+  :param max_bytes: Maximum estimated memory used by the results.  A
+     result larger than this is not cached.
+
+  The least recently used results are discarded to keep within the
+  limits.
+*/
+static PyObject *
+Connection_set_result_cache(Connection *self, PyObject *const *fast_args, Py_ssize_t fast_nargs,
+                            PyObject *fast_kwnames)
+{
+  long long max_entries, max_bytes = 16 * 1024 * 1024;
+  ResultCache *rc = NULL;
+
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  {
+    Connection_set_result_cache_CHECK;
+    ARG_PROLOG(2, Connection_set_result_cache_KWNAMES);
+    ARG_MANDATORY ARG_int64(max_entries);
+    ARG_OPTIONAL ARG_int64(max_bytes);
+    ARG_EPILOG(NULL, Connection_set_result_cache_USAGE, );
+  }
+
+  if (max_entries > 0)
+  {
+    if (max_entries > PY_SSIZE_T_MAX || max_bytes > PY_SSIZE_T_MAX || max_bytes < 0)
+      return PyErr_Format(PyExc_ValueError, "max_entries and max_bytes are out of range");
+    rc = resultcache_new((Py_ssize_t)max_entries, (Py_ssize_t)max_bytes);
+    if (!rc)
+      return NULL;
+  }
+
+  resultcache_free(self->resultcache);
+  self->resultcache = rc;
+
+  Py_RETURN_NONE;
+}
+
+/** .. method:: result_cache_stats() -> dict[str, int]
+
+  Returns statistics about :meth:`execute_cached` since
+  :meth:`set_result_cache` was called.
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - entries
+      - Number of results currently cached
+    * - bytes
+      - Estimated memory used by the cached results
+    * - hits
+      - Results returned from the cache
+    * - misses
+      - Queries run whose results were then cached
+    * - uncacheable
+      - Queries run whose results could not be cached
+    * - invalidations
+      - Times cached results were discarded because a database changed
+    * - evictions
+      - Results discarded to keep within the limits
+*/
+static PyObject *
+Connection_result_cache_stats(Connection *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  return resultcache_stats(self->resultcache);
+}
+
 static PyObject *formatsqlvalue(PyObject *Py_UNUSED(self), PyObject *value);
 /** .. method:: pragma(name: str, value: Optional[SQLiteValue] = None) -> Any
 
@@ -4480,6 +5860,17 @@ The returned dictionary has the following information.
   * - too_big
     - UTF8 query size was larger than considered for caching.  These are also included
       in the misses count.
+  * - reprepares
+    - While :meth:`plan monitoring <set_plan_monitor>`, how many times
+      cached statements were found to have been reprepared by SQLite
+  * - plan_changes
+    - How many of the reprepares resulted in a different query plan
+  * - normalized
+    - With :attr:`auto_parameterize`, misses that were prepared with
+      literals replaced by parameters
+  * - normalized_hits
+    - With :attr:`auto_parameterize`, hits found after literals were
+      replaced by parameters
   * - max_cacheable_bytes
     - Maximum size of query (in bytes of utf8) that will be considered for caching
   * - entries
@@ -4506,6 +5897,9 @@ If `entries` is present, then each list entry is a dict with the following infor
   * - has_more
     - Boolean indicating if there was more query text than
       the first statement
+  * - plan
+    - The query plan as text if recorded by :meth:`set_plan_monitor`,
+      else None
 
 */
 static PyObject *
@@ -4725,6 +6119,7 @@ Connection_drop_modules(Connection *self, PyObject *const *fast_args, Py_ssize_t
   }
 
   PYSQLITE_CON_CALL(res = sqlite3_drop_modules(self->db, array));
+  resultcache_clear(self->resultcache);
   SET_EXC(res, self->db);
 
 finally:
@@ -4910,6 +6305,8 @@ Connection_set_cursor_factory(Connection *self, PyObject *value)
   }
   Py_CLEAR(self->cursor_factory);
   self->cursor_factory = Py_NewRef(value);
+  /* cached results don't go through the factory */
+  resultcache_clear(self->resultcache);
   return 0;
 }
 
@@ -5049,6 +6446,7 @@ Connection_set_row_trace_attr(Connection *self, PyObject *value)
 
     * :ref:`Example <example_authorizer>`
     * :ref:`statementcache`
+    * :meth:`set_authorizer_rules`
 
   -* sqlite3_set_authorizer
 */
@@ -5109,6 +6507,114 @@ Connection_is_interrupted(Connection *self)
   return Py_NewRef(sqlite3_is_interrupted(self->db) ? Py_True : Py_False);
 }
 
+/** .. attribute:: convert_json
+   :type: bool
+
+   When True, JSON is converted directly between SQLite and Python
+   objects in C, without intermediate strings or calling
+   :func:`json.loads` and :func:`json.dumps`.  Default is False.
+
+   Column values are returned as :class:`dict`, :class:`list`,
+   :class:`str`, :class:`int`, :class:`float`, :class:`bool`, or None
+   when the column is declared as ``JSON`` or ``JSONB`` in the table
+   definition, or the value comes from a SQLite `JSON function
+   <https://sqlite.org/json1.html>`__ that returns JSON text.  Text
+   is parsed as strict JSON, while blobs are parsed as `JSONB
+   <https://sqlite.org/jsonb.html>`__.  :exc:`ValueError` is raised
+   for values that are not valid.
+
+   :class:`dict` and :class:`list` bindings are encoded as JSON text.
+   Nested tuples are encoded as arrays, and dictionary keys must be
+   :class:`str`.
+
+   .. code-block:: python
+
+     connection.convert_json = True
+     connection.execute("create table config(name, settings JSON)")
+     connection.execute("insert into config values(?, ?)",
+                        ("main", {"retries": 3, "hosts": ["a", "b"]}))
+
+     # {'retries': 3, 'hosts': ['a', 'b']}
+     connection.execute("select settings from config").get
+*/
+static PyObject *
+Connection_get_convert_json(Connection *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  return Py_NewRef(self->convert_json ? Py_True : Py_False);
+}
+
+static int
+Connection_set_convert_json(Connection *self, PyObject *value)
+{
+  int convert;
+
+  CHECK_USE(-1);
+  CHECK_CLOSED(self, -1);
+
+  convert = PyObject_IsTrueStrict(value);
+  if (convert < 0)
+    return -1;
+  /* cached results were converted with the previous setting */
+  if (self->resultcache && convert != self->convert_json)
+    resultcache_clear(self->resultcache);
+  self->convert_json = convert;
+  return 0;
+}
+
+/** .. attribute:: auto_parameterize
+  :type: bool
+
+  When True, :meth:`Cursor.execute` without bindings replaces numeric
+  and string literals in the query with parameters, and binds the
+  values.  Queries that differ only in their literal values then
+  share one :meth:`statement cache <cache_stats>` entry instead of
+  each being prepared.  This is intended for code that builds
+  queries with the values inline such as ``WHERE id = 123``.
+
+  Only single ``SELECT``, ``VALUES``, ``WITH``, ``INSERT``,
+  ``REPLACE``, ``UPDATE``, and ``DELETE`` statements are changed.
+  Literals in result columns and ``ORDER BY`` / ``GROUP BY`` are
+  left alone, since they determine column names and column numbers.
+  Function arguments are left alone too.  If the changed query can't
+  be prepared then the original is used.  :attr:`exec_trace` sees the
+  changed query and the values as bindings.
+
+  An `index on an expression <https://sqlite.org/expridx.html>`__ is
+  only used when the query contains the same expression, including
+  its literals.  Function arguments are kept for that reason (eg
+  ``json_extract(j, '$.a')``), but other expressions such as
+  ``a + 1`` become ``a + ?`` and no longer match an index on
+  ``a + 1``.  (Bound values can still select a `partial index
+  <https://sqlite.org/partialindex.html>`__ because SQLite reprepares
+  the statement when a binding could change the plan.)
+*/
+static PyObject *
+Connection_get_auto_parameterize(Connection *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CLOSED(self, NULL);
+
+  return Py_NewRef(self->stmtcache->normalize ? Py_True : Py_False);
+}
+
+static int
+Connection_set_auto_parameterize(Connection *self, PyObject *value)
+{
+  int normalize;
+
+  CHECK_USE(-1);
+  CHECK_CLOSED(self, -1);
+
+  normalize = PyObject_IsTrueStrict(value);
+  if (normalize < 0)
+    return -1;
+  self->stmtcache->normalize = normalize;
+  return 0;
+}
+
 static PyGetSetDef Connection_getseters[] = {
     /* name getter setter doc closure */
     {"filename",
@@ -5125,6 +6631,10 @@ static PyGetSetDef Connection_getseters[] = {
     {"authorizer", (getter)Connection_get_authorizer_attr, (setter)Connection_set_authorizer_attr, Connection_authorizer_DOC},
     {"system_errno", (getter)Connection_get_system_errno, NULL, Connection_system_errno_DOC},
     {"is_interrupted", (getter)Connection_is_interrupted, NULL, Connection_is_interrupted_DOC},
+    {"convert_json", (getter)Connection_get_convert_json, (setter)Connection_set_convert_json,
+     Connection_convert_json_DOC},
+    {"auto_parameterize", (getter)Connection_get_auto_parameterize, (setter)Connection_set_auto_parameterize,
+     Connection_auto_parameterize_DOC},
 #ifndef APSW_OMIT_OLD_NAMES
     {Connection_exec_trace_OLDNAME, (getter)Connection_get_exec_trace_attr, (setter)Connection_set_exec_trace_attr, Connection_exec_trace_OLDDOC},
     {Connection_row_trace_OLDNAME, (getter)Connection_get_row_trace_attr, (setter)Connection_set_row_trace_attr, Connection_row_trace_OLDDOC},
@@ -5160,6 +6670,7 @@ Connection_tp_traverse(Connection *self, visitproc visit, void *arg)
   Py_VISIT(self->exectrace);
   Py_VISIT(self->rowtrace);
   Py_VISIT(self->tracehook);
+  Py_VISIT(self->planmonitor);
   Py_VISIT(self->vfs);
   Py_VISIT(self->dependents);
   Py_VISIT(self->cursor_factory);
@@ -5213,6 +6724,8 @@ static PyMethodDef Connection_methods[] = {
      Connection_collation_needed_DOC},
     {"set_authorizer", (PyCFunction)Connection_set_authorizer, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_authorizer_DOC},
+    {"set_authorizer_rules", (PyCFunction)Connection_set_authorizer_rules, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_authorizer_rules_DOC},
     {"set_update_hook", (PyCFunction)Connection_set_update_hook, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_update_hook_DOC},
     {"set_rollback_hook", (PyCFunction)Connection_set_rollback_hook, METH_FASTCALL | METH_KEYWORDS,
@@ -5221,12 +6734,31 @@ static PyMethodDef Connection_methods[] = {
      Connection_blob_open_DOC},
     {"set_progress_handler", (PyCFunction)Connection_set_progress_handler, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_progress_handler_DOC},
+    {"set_statement_limits", (PyCFunction)Connection_set_statement_limits, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_statement_limits_DOC},
     {"set_commit_hook", (PyCFunction)Connection_set_commit_hook, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_commit_hook_DOC},
     {"set_wal_hook", (PyCFunction)Connection_set_wal_hook, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_wal_hook_DOC},
     {"limit", (PyCFunction)Connection_limit, METH_FASTCALL | METH_KEYWORDS,
      Connection_limit_DOC},
+    {"set_plan_monitor", (PyCFunction)Connection_set_plan_monitor, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_plan_monitor_DOC},
+    {"set_writer_queue", (PyCFunction)Connection_set_writer_queue, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_writer_queue_DOC},
+    {"set_busy_backoff", (PyCFunction)Connection_set_busy_backoff, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_busy_backoff_DOC},
+    {"busy_stats", (PyCFunction)Connection_busy_stats, METH_NOARGS, Connection_busy_stats_DOC},
+    {"set_background_checkpoint", (PyCFunction)Connection_set_background_checkpoint, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_background_checkpoint_DOC},
+    {"background_checkpoint_stats", (PyCFunction)Connection_background_checkpoint_stats, METH_NOARGS,
+     Connection_background_checkpoint_stats_DOC},
+    {"writer_queue_stats", (PyCFunction)Connection_writer_queue_stats, METH_NOARGS, Connection_writer_queue_stats_DOC},
+    {"set_result_cache", (PyCFunction)Connection_set_result_cache, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_result_cache_DOC},
+    {"result_cache_stats", (PyCFunction)Connection_result_cache_stats, METH_NOARGS, Connection_result_cache_stats_DOC},
+    {"execute_cached", (PyCFunction)Connection_execute_cached, METH_FASTCALL | METH_KEYWORDS,
+     Connection_execute_cached_DOC},
     {"set_profile", (PyCFunction)Connection_set_profile, METH_FASTCALL | METH_KEYWORDS,
      Connection_set_profile_DOC},
 #ifndef SQLITE_OMIT_LOAD_EXTENSION
@@ -5287,6 +6819,8 @@ static PyMethodDef Connection_methods[] = {
     {"table_exists", (PyCFunction)Connection_table_exists, METH_FASTCALL | METH_KEYWORDS, Connection_table_exists_DOC},
     {"column_metadata", (PyCFunction)Connection_column_metadata, METH_FASTCALL | METH_KEYWORDS, Connection_column_metadata_DOC},
     {"trace_v2", (PyCFunction)Connection_trace_v2, METH_FASTCALL | METH_KEYWORDS, Connection_trace_v2_DOC},
+    {"set_trace_recorder", (PyCFunction)Connection_set_trace_recorder, METH_FASTCALL | METH_KEYWORDS,
+     Connection_set_trace_recorder_DOC},
     {"cache_flush", (PyCFunction)Connection_cache_flush, METH_NOARGS, Connection_cache_flush_DOC},
     {"release_memory", (PyCFunction)Connection_release_memory, METH_FASTCALL | METH_KEYWORDS, Connection_release_memory_DOC},
     {"drop_modules", (PyCFunction)Connection_drop_modules, METH_FASTCALL | METH_KEYWORDS, Connection_drop_modules_DOC},
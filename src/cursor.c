@@ -86,6 +86,11 @@ struct APSWCursor
 
   PyObject *description_cache[3];
 
+  /* instructions run and rows returned by the current statement for
+     Connection.set_statement_limits */
+  sqlite3_int64 limit_steps;
+  sqlite3_int64 limit_rows;
+
   int init_was_called;
 };
 
@@ -128,6 +133,8 @@ resetcursor(APSWCursor *self, int force)
         SET_EXC(res, self->connection->db);
     }
     self->statement = 0;
+    /* finalizing can end an autocommit write transaction */
+    writerqueue_update(self->connection->writerqueue, self->connection->db);
   }
 
   Py_CLEAR(self->bindings);
@@ -259,12 +266,39 @@ APSWCursor_new(PyTypeObject *type, PyObject *Py_UNUSED(args), PyObject *Py_UNUSE
     self->description_cache[0] = 0;
     self->description_cache[1] = 0;
     self->description_cache[2] = 0;
+    self->limit_steps = 0;
+    self->limit_rows = 0;
     self->init_was_called = 0;
   }
 
   return (PyObject *)self;
 }
 
+/* Equivalent to APSWCursorType(connection) without the generic call
+   and argument parsing */
+static PyObject *
+APSWCursor_new_for_connection(Connection *connection)
+{
+  APSWCursor *cursor = (APSWCursor *)APSWCursor_new(&APSWCursorType, NULL, NULL);
+
+  if (!cursor)
+    return NULL;
+  cursor->connection = (Connection *)Py_NewRef((PyObject *)connection);
+  cursor->init_was_called = 1;
+  return (PyObject *)cursor;
+}
+
+/* Used by Connection.execute_cached which can't skip tracers on later
+   calls.  Anything that isn't a Cursor could be doing its own
+   tracing */
+static int
+APSWCursor_has_own_tracer(PyObject *cursor)
+{
+  if (!PyObject_TypeCheck(cursor, &APSWCursorType))
+    return 1;
+  return ((APSWCursor *)cursor)->exectrace || ((APSWCursor *)cursor)->rowtrace;
+}
+
 /** .. method:: __init__(connection: Connection)
 
  Use :meth:`Connection.cursor` to make a new cursor.
@@ -523,6 +557,20 @@ APSWCursor_dobinding(APSWCursor *self, int arg, PyObject *obj)
   {
     PYSQLITE_CUR_CALL(res = sqlite3_bind_zeroblob64(self->statement->vdbestatement, arg, ((ZeroBlobBind *)obj)->blobsize));
   }
+  else if (self->connection->convert_json && (PyDict_Check(obj) || PyList_Check(obj)))
+  {
+    size_t len;
+    char *json = json_encode(obj, &len);
+    if (!json)
+      return -1;
+    PYSQLITE_CUR_CALL(res = sqlite3_bind_text64(self->statement->vdbestatement, arg, json, len, sqlite3_free, SQLITE_UTF8));
+  }
+  else if (PyObject_TypeCheck(obj, &CArrayType) == 1)
+  {
+    /* the reference is released by carray_pointer_free, even if binding fails */
+    Py_INCREF(obj);
+    PYSQLITE_CUR_CALL(res = sqlite3_bind_pointer(self->statement->vdbestatement, arg, obj, CARRAY_POINTER_TYPE, carray_pointer_free));
+  }
   else
   {
     PyErr_Format(PyExc_TypeError, "Bad binding argument type supplied - argument #%d: type %s", (int)(arg + self->bindingsoffset), Py_TypeName(obj));
@@ -604,6 +652,9 @@ APSWCursor_dobindings(APSWCursor *self)
       Py_DECREF(obj);
     }
 
+    if (self->connection->recorder)
+      tracerecorder_bindings(self->connection->recorder, self->statement->vdbestatement, self->bindings, 1, 0, nargs);
+
     return 0;
   }
 
@@ -639,6 +690,9 @@ APSWCursor_dobindings(APSWCursor *self)
     }
   }
 
+  if (self->connection->recorder)
+    tracerecorder_bindings(self->connection->recorder, self->statement->vdbestatement, self->bindings, 0, self->bindingsoffset, nargs);
+
   self->bindingsoffset += nargs;
   assert(res == 0);
   return 0;
@@ -723,23 +777,79 @@ APSWCursor_do_row_trace(APSWCursor *self, PyObject *retval)
   return PyObject_Vectorcall(rowtrace, vargs + 1, 2 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
 }
 
+/* Called as each statement is about to start */
+static void
+APSWCursor_limits_begin(APSWCursor *self)
+{
+  StatementLimits *limits = &self->connection->limits;
+
+  self->limit_steps = 0;
+  self->limit_rows = 0;
+  /* statements are reused from the cache so the count has to start over */
+  if ((limits->vm_steps || limits->rows) && self->statement->vdbestatement)
+    PYSQLITE_VOID_CALL(sqlite3_stmt_status(self->statement->vdbestatement, SQLITE_STMTSTATUS_VM_STEP, 1));
+}
+
 /* Returns a borrowed reference to self if all is ok, else NULL on error */
 static PyObject *
 APSWCursor_step(APSWCursor *self)
 {
   int res;
   int savedbindingsoffset = 0; /* initialised to stop stupid compiler from whining */
+  WriterQueue *wq = self->connection->writerqueue;
+  StatementLimits *limits = &self->connection->limits;
 
   for (;;)
   {
     assert(!PyErr_Occurred());
-    PYSQLITE_CUR_CALL(res = (self->statement->vdbestatement) ? (sqlite3_step(self->statement->vdbestatement)) : (SQLITE_DONE));
+    if (wq && !wq->owned && self->statement->vdbestatement && !sqlite3_stmt_readonly(self->statement->vdbestatement))
+    {
+      INUSE_CALL(res = writerqueue_acquire(wq));
+      if (res)
+        return NULL;
+    }
+
+    /* the progress handler checks the statement being stepped, and
+       this can be nested by functions running queries.  Nothing may
+       return until the saved values are restored. */
+    sqlite3_stmt *limits_saved_stmt = limits->stmt;
+    sqlite3_int64 *limits_saved_steps = limits->steps;
+    limits->stmt = self->statement->vdbestatement;
+    limits->steps = &self->limit_steps;
+    limits->exceeded = 0;
+    if (wq && wq->owned)
+    {
+      int txnstate;
+      PYSQLITE_CUR_CALL(res = (self->statement->vdbestatement) ? (sqlite3_step(self->statement->vdbestatement)) : (SQLITE_DONE);
+                        txnstate = sqlite3_txn_state(self->connection->db, NULL));
+      if (txnstate != SQLITE_TXN_WRITE)
+        writerqueue_release(wq);
+    }
+    else
+      PYSQLITE_CUR_CALL(res = (self->statement->vdbestatement) ? (sqlite3_step(self->statement->vdbestatement)) : (SQLITE_DONE));
+
+    limits->stmt = limits_saved_stmt;
+    limits->steps = limits_saved_steps;
+    /* now exact */
+    if ((limits->vm_steps || limits->rows) && self->statement->vdbestatement)
+      PYSQLITE_VOID_CALL(self->limit_steps = sqlite3_stmt_status(self->statement->vdbestatement, SQLITE_STMTSTATUS_VM_STEP, 0));
 
     switch (res & 0xff)
     {
     case SQLITE_ROW:
       self->status = C_ROW;
-      return (PyErr_Occurred()) ? (NULL) : ((PyObject *)self);
+      if (PyErr_Occurred())
+        return NULL;
+      if (limits->rows && ++self->limit_rows > limits->rows)
+      {
+        limits->exceeded = STATEMENT_LIMIT_ROWS;
+        limits->used_vm_steps = self->limit_steps;
+        self->status = C_DONE;
+        resetcursor(self, 1);
+        statement_limits_raise(self->connection, self->limit_rows);
+        return NULL;
+      }
+      return (PyObject *)self;
 
     case SQLITE_DONE:
       if (PyErr_Occurred())
@@ -761,6 +871,8 @@ APSWCursor_step(APSWCursor *self)
       {
         res = resetcursor(self, 0); /* this will get the error code for us */
         assert(res != SQLITE_OK);
+        if (limits->exceeded)
+          statement_limits_raise(self->connection, self->limit_rows);
       }
       return NULL;
     }
@@ -821,7 +933,7 @@ APSWCursor_step(APSWCursor *self)
     {
       /* we are going again in executemany mode */
       assert(self->emiter);
-      INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, self->emoriginalquery, &self->emoptions));
+      INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, self->emoriginalquery, &self->emoptions, NULL));
       res = (self->statement) ? SQLITE_OK : SQLITE_ERROR;
     }
     else
@@ -864,6 +976,7 @@ APSWCursor_step(APSWCursor *self)
     }
     assert(self->status == C_DONE);
     self->status = C_BEGIN;
+    APSWCursor_limits_begin(self);
   }
 
   /* you can't actually get here */
@@ -892,7 +1005,7 @@ APSWCursor_step(APSWCursor *self)
     :raises BindingsError: You supplied too many or too few bindings for the statements
     :raises IncompleteExecutionError: There are remaining unexecuted queries from your last execute
 
-    -* sqlite3_prepare_v3 sqlite3_step sqlite3_bind_int64 sqlite3_bind_null sqlite3_bind_text64 sqlite3_bind_double sqlite3_bind_blob64 sqlite3_bind_zeroblob
+    -* sqlite3_prepare_v3 sqlite3_step sqlite3_bind_int64 sqlite3_bind_null sqlite3_bind_text64 sqlite3_bind_double sqlite3_bind_blob64 sqlite3_bind_zeroblob sqlite3_bind_pointer
 
     .. seealso::
 
@@ -909,7 +1022,7 @@ APSWCursor_execute(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t fast
   int can_cache = 1;
   int explain = -1;
   PyObject *retval = NULL;
-  PyObject *statements, *bindings = NULL;
+  PyObject *statements, *bindings = NULL, *literals = NULL;
   APSWStatementOptions options;
 
   CHECK_USE(NULL);
@@ -953,7 +1066,8 @@ APSWCursor_execute(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t fast
 
   assert(!self->statement);
   assert(!PyErr_Occurred());
-  INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, statements, &options));
+  INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, statements, &options,
+                                                      self->bindings ? NULL : &literals));
   if (!self->statement)
   {
     AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_execute.sqlite3_prepare_v3", "{s: O, s: O}",
@@ -963,6 +1077,10 @@ APSWCursor_execute(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t fast
   }
   assert(!PyErr_Occurred());
 
+  /* auto parameterization extracted literals */
+  if (literals)
+    self->bindings = literals;
+
   self->bindingsoffset = 0;
   savedbindingsoffset = 0;
 
@@ -982,6 +1100,7 @@ APSWCursor_execute(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t fast
   }
 
   self->status = C_BEGIN;
+  APSWCursor_limits_begin(self);
 
   retval = APSWCursor_step(self);
   if (!retval)
@@ -1076,7 +1195,7 @@ APSWCursor_executemany(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t
   assert(!self->statement);
   assert(!PyErr_Occurred());
   assert(!self->statement);
-  INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, statements, &self->emoptions));
+  INUSE_CALL(self->statement = statementcache_prepare(self->connection->stmtcache, statements, &self->emoptions, NULL));
   if (!self->statement)
   {
     AddTraceBackHere(__FILE__, __LINE__, "APSWCursor_executemany.sqlite3_prepare_v3", "{s: O, s: O}",
@@ -1107,6 +1226,7 @@ APSWCursor_executemany(APSWCursor *self, PyObject *const *fast_args, Py_ssize_t
   }
 
   self->status = C_BEGIN;
+  APSWCursor_limits_begin(self);
 
   retval = APSWCursor_step(self);
   if (!retval)
@@ -1197,7 +1317,7 @@ again:
 
   for (i = 0; i < numcols; i++)
   {
-    INUSE_CALL(item = convert_column_to_pyobject(self->statement->vdbestatement, i));
+    INUSE_CALL(item = convert_column_to_pyobject(self->statement->vdbestatement, i, self->connection->convert_json));
     if (!item)
       goto error;
     PyTuple_SET_ITEM(retval, i, item);
@@ -1574,6 +1694,90 @@ APSWCursor_expanded_sql(APSWCursor *self)
   return res;
 }
 
+/** .. method:: scanstatus() -> list[dict[str, int | float | str | None]]
+
+  Only present if SQLITE_ENABLE_STMT_SCANSTATUS was defined at
+  compile time.
+
+  Returns `scan status <https://sqlite.org/c3ref/stmt_scanstatus.html>`__
+  counters for each element of the query plan of the currently
+  executing statement, showing where the time went.  Each element is
+  a dict:
+
+  .. list-table::
+    :header-rows: 1
+    :widths: auto
+
+    * - Key
+      - Meaning
+    * - id
+      - Identifier of this element
+    * - parent
+      - *id* of the parent element, or zero for top level elements
+    * - loops
+      - How many times the loop was run
+    * - visits
+      - How many rows were visited
+    * - estimated_rows
+      - How many rows the query planner estimated each loop would visit
+    * - cycles
+      - CPU cycles spent in this element (not all platforms)
+    * - name
+      - Table or index name, or None
+    * - explain
+      - Query plan text for this element as shown by EXPLAIN QUERY PLAN
+
+  Counters accumulate across executions of a statement until
+  :meth:`scanstatus_reset` is called.  When :meth:`Connection.trace_v2`
+  is used with :attr:`SQLITE_TRACE_PROFILE` they are instead reset as
+  each execution starts, so they cover only that execution.
+  Statements are completed and returned to the statement cache as soon
+  as their last row has been read, so call this before then, or use
+  :meth:`Connection.trace_v2` which includes the counters when each
+  statement completes.
+  :func:`apsw.ext.format_scanstatus` shows them as a tree.
+
+  -* sqlite3_stmt_scanstatus_v2
+*/
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+static PyObject *
+APSWCursor_scanstatus(APSWCursor *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+
+  if (!self->statement || !self->statement->vdbestatement)
+    return PyErr_Format(ExcComplete, "Can't get scan status for statements that have completed execution");
+
+  return apsw_scanstatus(self->statement->vdbestatement);
+}
+#endif
+
+/** .. method:: scanstatus_reset() -> None
+
+  Only present if SQLITE_ENABLE_STMT_SCANSTATUS was defined at
+  compile time.
+
+  Zeroes the :meth:`scanstatus` counters for the currently executing
+  statement.
+
+  -* sqlite3_stmt_scanstatus_reset
+*/
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+static PyObject *
+APSWCursor_scanstatus_reset(APSWCursor *self)
+{
+  CHECK_USE(NULL);
+  CHECK_CURSOR_CLOSED(NULL);
+
+  if (!self->statement || !self->statement->vdbestatement)
+    return PyErr_Format(ExcComplete, "Can't reset scan status for statements that have completed execution");
+
+  sqlite3_stmt_scanstatus_reset(self->statement->vdbestatement);
+  Py_RETURN_NONE;
+}
+#endif
+
 /** .. attribute:: get
  :type: Any
 
@@ -1629,7 +1833,7 @@ APSWCursor_get(APSWCursor *self)
     numcols = sqlite3_data_count(self->statement->vdbestatement);
     if (numcols == 1)
     {
-      INUSE_CALL(the_row = convert_column_to_pyobject(self->statement->vdbestatement, 0));
+      INUSE_CALL(the_row = convert_column_to_pyobject(self->statement->vdbestatement, 0, self->connection->convert_json));
       if (!the_row)
         goto error;
     }
@@ -1640,7 +1844,7 @@ APSWCursor_get(APSWCursor *self)
         goto error;
       for (i = 0; i < numcols; i++)
       {
-        INUSE_CALL(item = convert_column_to_pyobject(self->statement->vdbestatement, i));
+        INUSE_CALL(item = convert_column_to_pyobject(self->statement->vdbestatement, i, self->connection->convert_json));
         if (!item)
           goto error;
         PyTuple_SET_ITEM(the_row, i, item);
@@ -1700,6 +1904,10 @@ static PyMethodDef APSWCursor_methods[] = {
      Cursor_fetchall_DOC},
     {"fetchone", (PyCFunction)APSWCursor_fetchone, METH_NOARGS,
      Cursor_fetchone_DOC},
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+    {"scanstatus", (PyCFunction)APSWCursor_scanstatus, METH_NOARGS, Cursor_scanstatus_DOC},
+    {"scanstatus_reset", (PyCFunction)APSWCursor_scanstatus_reset, METH_NOARGS, Cursor_scanstatus_reset_DOC},
+#endif
 #ifndef APSW_OMIT_OLD_NAMES
     {Cursor_set_exec_trace_OLDNAME, (PyCFunction)APSWCursor_set_exec_trace, METH_FASTCALL | METH_KEYWORDS,
      Cursor_set_exec_trace_OLDDOC},
@@ -18,6 +18,7 @@ static PyObject *ExcConnectionClosed;    /* connection was closed when function
 static PyObject *ExcVFSNotImplemented;   /* base vfs doesn't implement function */
 static PyObject *ExcVFSFileClosed;       /* attempted operation on closed file */
 static PyObject *ExcForkingViolation;    /* used object across a fork */
+static PyObject *ExcResourceLimit;       /* statement exceeded a limit */
 
 static void make_exception(int res, sqlite3 *db);
 
@@ -163,7 +164,8 @@ static int init_exceptions(PyObject *m)
       {&ExcCursorClosed, "CursorClosedError", CursorClosedError_exc_DOC},
       {&ExcVFSNotImplemented, "VFSNotImplementedError", VFSNotImplementedError_exc_DOC},
       {&ExcVFSFileClosed, "VFSFileClosedError", VFSFileClosedError_exc_DOC},
-      {&ExcForkingViolation, "ForkingViolationError", ForkingViolationError_exc_DOC}};
+      {&ExcForkingViolation, "ForkingViolationError", ForkingViolationError_exc_DOC},
+      {&ExcResourceLimit, "ResourceLimitError", ResourceLimitError_exc_DOC}};
 
   /* PyModule_AddObject uses borrowed reference so we incref whatever
      we give to it, so we still have a copy to use */
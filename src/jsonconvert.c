@@ -0,0 +1,810 @@
+/*
+  JSON conversion between SQLite and Python objects
+
+  See the accompanying LICENSE file.
+*/
+
+/* When Connection.convert_json is set, column values declared as JSON
+   or JSONB (or returned by SQLite JSON functions) are parsed directly
+   from SQLite's buffer into Python objects, and dict and list bindings
+   are encoded into JSON text bound without another copy.  This
+   avoids building an intermediate str and then calling json.loads or
+   json.dumps.
+
+   JSON text is parsed strictly per RFC 8259, which is what SQLite's
+   JSON functions output.  JSONB is SQLite's binary format documented
+   at https://sqlite.org/jsonb.html including its JSON5 extensions.
+*/
+
+/* the subtype SQLite JSON functions give their text results */
+#define JSON_SUBTYPE 74
+
+/* Returns non-zero if the declared type is JSON or JSONB */
+static int
+json_is_decltype(const char *decltype)
+{
+  return decltype && (0 == PyOS_stricmp(decltype, "JSON") || 0 == PyOS_stricmp(decltype, "JSONB"));
+}
+
+static PyObject *
+json_error(const char *what, Py_ssize_t offset)
+{
+  return PyErr_Format(PyExc_ValueError, "Invalid %s at offset %zd", what, offset);
+}
+
+/* Parses an integer or float from text which is not nul terminated.
+   JSON5 integers can be hex, and floats can be Infinity and NaN */
+static PyObject *
+json_number(const char *text, Py_ssize_t len, int isfloat, int json5)
+{
+  char small[64], *buf = small, *end = NULL;
+  PyObject *res = NULL;
+  Py_ssize_t i;
+
+  /* the common case of a short integer */
+  if (!isfloat && len > 0 && len < 19)
+  {
+    long long val = 0;
+    int negative = text[0] == '-';
+    for (i = negative; i < len && text[i] >= '0' && text[i] <= '9'; i++)
+      val = val * 10 + (text[i] - '0');
+    if (i == len && i > negative)
+      return PyLong_FromLongLong(negative ? -val : val);
+  }
+
+  if (len >= (Py_ssize_t)sizeof(small))
+  {
+    buf = PyMem_Malloc(len + 1);
+    if (!buf)
+      return PyErr_NoMemory();
+  }
+  memcpy(buf, text, len);
+  buf[len] = 0;
+
+  if (isfloat)
+  {
+    double d = PyOS_string_to_double(buf, &end, NULL);
+    if (!PyErr_Occurred() && end == buf + len)
+      res = PyFloat_FromDouble(d);
+  }
+  else
+  {
+    res = PyLong_FromString(buf, &end, json5 ? 0 : 10);
+    if (res && end != buf + len)
+      Py_CLEAR(res);
+  }
+  if (!res)
+  {
+    PyErr_Clear();
+    PyErr_Format(PyExc_ValueError, "Invalid JSON number '%s'", buf);
+  }
+
+  if (buf != small)
+    PyMem_Free(buf);
+  return res;
+}
+
+static int
+json_hex(const char *text, int count)
+{
+  int i, val = 0;
+  for (i = 0; i < count; i++)
+  {
+    char c = text[i];
+    val <<= 4;
+    if (c >= '0' && c <= '9')
+      val += c - '0';
+    else if (c >= 'a' && c <= 'f')
+      val += c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      val += c - 'A' + 10;
+    else
+      return -1;
+  }
+  return val;
+}
+
+static char *
+json_put_utf8(char *out, unsigned codepoint)
+{
+  if (codepoint < 0x80)
+    *out++ = (char)codepoint;
+  else if (codepoint < 0x800)
+  {
+    *out++ = (char)(0xC0 | (codepoint >> 6));
+    *out++ = (char)(0x80 | (codepoint & 0x3F));
+  }
+  else if (codepoint < 0x10000)
+  {
+    *out++ = (char)(0xE0 | (codepoint >> 12));
+    *out++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (codepoint & 0x3F));
+  }
+  else
+  {
+    *out++ = (char)(0xF0 | (codepoint >> 18));
+    *out++ = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    *out++ = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (codepoint & 0x3F));
+  }
+  return out;
+}
+
+/* Makes a str from UTF8 string contents which may contain escapes.
+   The decoded form is never longer than the escaped form */
+static PyObject *
+json_string(const char *text, Py_ssize_t len, int json5)
+{
+  char *buf, *out;
+  PyObject *res;
+  Py_ssize_t i;
+  int ascii = 1, escapes = 0;
+
+  for (i = 0; i < len; i++)
+  {
+    unsigned char c = (unsigned char)text[i];
+    if (c == '\\')
+      escapes = 1;
+    else if (c & 0x80)
+      ascii = 0;
+  }
+
+  if (!escapes)
+  {
+    if (ascii)
+    {
+      res = PyUnicode_New(len, 127);
+      if (res)
+        memcpy(PyUnicode_DATA(res), text, len);
+      return res;
+    }
+    return PyUnicode_DecodeUTF8(text, len, "surrogatepass");
+  }
+
+  buf = out = PyMem_Malloc(len ? len : 1);
+  if (!buf)
+    return PyErr_NoMemory();
+
+  for (i = 0; i < len; i++)
+  {
+    char c = text[i];
+    int codepoint;
+    if (c != '\\')
+    {
+      *out++ = c;
+      continue;
+    }
+    if (++i == len)
+      goto error;
+    switch (text[i])
+    {
+    case '"':
+    case '\\':
+    case '/':
+      *out++ = text[i];
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u':
+      if (i + 4 >= len || (codepoint = json_hex(text + i + 1, 4)) < 0)
+        goto error;
+      i += 4;
+      /* combine surrogate pairs, leaving lone surrogates as is */
+      if (codepoint >= 0xD800 && codepoint <= 0xDBFF && i + 6 < len && text[i + 1] == '\\' && text[i + 2] == 'u')
+      {
+        int low = json_hex(text + i + 3, 4);
+        if (low >= 0xDC00 && low <= 0xDFFF)
+        {
+          codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+          i += 6;
+        }
+      }
+      out = json_put_utf8(out, (unsigned)codepoint);
+      break;
+    default:
+      if (!json5)
+        goto error;
+      switch (text[i])
+      {
+      case '\'':
+        *out++ = '\'';
+        break;
+      case 'v':
+        *out++ = '\v';
+        break;
+      case '0':
+        *out++ = 0;
+        break;
+      case 'x':
+        if (i + 2 >= len || (codepoint = json_hex(text + i + 1, 2)) < 0)
+          goto error;
+        i += 2;
+        out = json_put_utf8(out, (unsigned)codepoint);
+        break;
+      /* line continuations */
+      case '\r':
+        if (i + 1 < len && text[i + 1] == '\n')
+          i++;
+        break;
+      case '\n':
+        break;
+      default:
+        /* U+2028 and U+2029 line continuations */
+        if (i + 2 < len && (unsigned char)text[i] == 0xE2 && (unsigned char)text[i + 1] == 0x80
+            && ((unsigned char)text[i + 2] == 0xA8 || (unsigned char)text[i + 2] == 0xA9))
+        {
+          i += 2;
+          break;
+        }
+        goto error;
+      }
+    }
+  }
+
+  res = PyUnicode_DecodeUTF8(buf, out - buf, "surrogatepass");
+  PyMem_Free(buf);
+  return res;
+
+error:
+  PyMem_Free(buf);
+  return json_error("JSON string escape", i);
+}
+
+/* JSON text */
+
+typedef struct
+{
+  const char *start;
+  const char *end;
+  const char *pos;
+} JsonParser;
+
+static void
+json_skip_whitespace(JsonParser *p)
+{
+  while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n' || *p->pos == '\r'))
+    p->pos++;
+}
+
+static PyObject *json_parse_value(JsonParser *p);
+
+/* pos is just after the opening quote, and is left after the closing quote */
+static PyObject *
+json_parse_string(JsonParser *p)
+{
+  const char *start = p->pos;
+
+  while (p->pos < p->end && *p->pos != '"')
+  {
+    if ((unsigned char)*p->pos < 0x20)
+      return json_error("JSON string", p->pos - p->start);
+    if (*p->pos == '\\')
+      p->pos++;
+    p->pos++;
+  }
+  if (p->pos >= p->end)
+    return json_error("JSON string", start - p->start);
+  p->pos++;
+  return json_string(start, p->pos - 1 - start, 0);
+}
+
+static PyObject *
+json_parse_container(JsonParser *p, int isobject)
+{
+  PyObject *res = isobject ? PyDict_New() : PyList_New(0);
+  PyObject *key = NULL, *value = NULL;
+
+  if (!res)
+    return NULL;
+  if (Py_EnterRecursiveCall(" decoding JSON"))
+  {
+    Py_DECREF(res);
+    return NULL;
+  }
+
+  p->pos++;
+  json_skip_whitespace(p);
+  if (p->pos < p->end && *p->pos == (isobject ? '}' : ']'))
+  {
+    p->pos++;
+    goto finally;
+  }
+
+  for (;;)
+  {
+    if (isobject)
+    {
+      json_skip_whitespace(p);
+      if (p->pos >= p->end || *p->pos != '"')
+      {
+        json_error("JSON object key", p->pos - p->start);
+        goto error;
+      }
+      p->pos++;
+      key = json_parse_string(p);
+      if (!key)
+        goto error;
+      json_skip_whitespace(p);
+      if (p->pos >= p->end || *p->pos != ':')
+      {
+        json_error("JSON object", p->pos - p->start);
+        goto error;
+      }
+      p->pos++;
+    }
+    value = json_parse_value(p);
+    if (!value)
+      goto error;
+    if (isobject ? PyDict_SetItem(res, key, value) : PyList_Append(res, value))
+      goto error;
+    Py_CLEAR(key);
+    Py_CLEAR(value);
+
+    json_skip_whitespace(p);
+    if (p->pos < p->end && *p->pos == ',')
+    {
+      p->pos++;
+      continue;
+    }
+    if (p->pos < p->end && *p->pos == (isobject ? '}' : ']'))
+    {
+      p->pos++;
+      break;
+    }
+    json_error(isobject ? "JSON object" : "JSON array", p->pos - p->start);
+    goto error;
+  }
+
+finally:
+  Py_LeaveRecursiveCall();
+  return res;
+
+error:
+  Py_LeaveRecursiveCall();
+  Py_XDECREF(key);
+  Py_XDECREF(value);
+  Py_DECREF(res);
+  return NULL;
+}
+
+static PyObject *
+json_parse_value(JsonParser *p)
+{
+  const char *start;
+  int isfloat = 0;
+
+  json_skip_whitespace(p);
+  if (p->pos >= p->end)
+    return json_error("JSON", p->pos - p->start);
+
+  switch (*p->pos)
+  {
+  case '{':
+    return json_parse_container(p, 1);
+  case '[':
+    return json_parse_container(p, 0);
+  case '"':
+    p->pos++;
+    return json_parse_string(p);
+  case 't':
+    if (p->end - p->pos >= 4 && 0 == memcmp(p->pos, "true", 4))
+    {
+      p->pos += 4;
+      Py_RETURN_TRUE;
+    }
+    break;
+  case 'f':
+    if (p->end - p->pos >= 5 && 0 == memcmp(p->pos, "false", 5))
+    {
+      p->pos += 5;
+      Py_RETURN_FALSE;
+    }
+    break;
+  case 'n':
+    if (p->end - p->pos >= 4 && 0 == memcmp(p->pos, "null", 4))
+    {
+      p->pos += 4;
+      Py_RETURN_NONE;
+    }
+    break;
+  default:
+    start = p->pos;
+    if (p->pos < p->end && *p->pos == '-')
+      p->pos++;
+    if (p->pos >= p->end || *p->pos < '0' || *p->pos > '9' || (*p->pos == '0' && p->pos + 1 < p->end && p->pos[1] >= '0' && p->pos[1] <= '9'))
+      break;
+    while (p->pos < p->end && *p->pos >= '0' && *p->pos <= '9')
+      p->pos++;
+    if (p->pos < p->end && *p->pos == '.')
+    {
+      isfloat = 1;
+      p->pos++;
+      if (p->pos >= p->end || *p->pos < '0' || *p->pos > '9')
+        break;
+      while (p->pos < p->end && *p->pos >= '0' && *p->pos <= '9')
+        p->pos++;
+    }
+    if (p->pos < p->end && (*p->pos == 'e' || *p->pos == 'E'))
+    {
+      isfloat = 1;
+      p->pos++;
+      if (p->pos < p->end && (*p->pos == '+' || *p->pos == '-'))
+        p->pos++;
+      if (p->pos >= p->end || *p->pos < '0' || *p->pos > '9')
+        break;
+      while (p->pos < p->end && *p->pos >= '0' && *p->pos <= '9')
+        p->pos++;
+    }
+    return json_number(start, p->pos - start, isfloat, 0);
+  }
+  return json_error("JSON", p->pos - p->start);
+}
+
+/* Parses JSON text returning a new reference */
+static PyObject *
+json_decode_text(const char *text, Py_ssize_t len)
+{
+  JsonParser p = {.start = text, .end = text + len, .pos = text};
+  PyObject *res = json_parse_value(&p);
+
+  if (res)
+  {
+    json_skip_whitespace(&p);
+    if (p.pos != p.end)
+    {
+      Py_DECREF(res);
+      return json_error("JSON", p.pos - p.start);
+    }
+  }
+  return res;
+}
+
+/* JSONB */
+
+#define JSONB_NULL 0
+#define JSONB_TRUE 1
+#define JSONB_FALSE 2
+#define JSONB_INT 3
+#define JSONB_INT5 4
+#define JSONB_FLOAT 5
+#define JSONB_FLOAT5 6
+#define JSONB_TEXT 7
+#define JSONB_TEXTJ 8
+#define JSONB_TEXT5 9
+#define JSONB_TEXTRAW 10
+#define JSONB_ARRAY 11
+#define JSONB_OBJECT 12
+
+/* Reads the element header at offset, setting the type and the
+   payload location.  Returns -1 if it is invalid */
+static int
+jsonb_header(const unsigned char *data, size_t len, size_t offset, int *type, size_t *payload, size_t *size)
+{
+  static const unsigned char extra[] = {1, 2, 4, 8};
+  size_t nbytes = 0, i;
+
+  if (offset >= len)
+    return -1;
+  *type = data[offset] & 0x0F;
+  *size = data[offset] >> 4;
+  if (*size > 11)
+  {
+    nbytes = extra[*size - 12];
+    if (offset + 1 + nbytes > len)
+      return -1;
+    *size = 0;
+    for (i = 0; i < nbytes; i++)
+      *size = (*size << 8) | data[offset + 1 + i];
+  }
+  *payload = offset + 1 + nbytes;
+  if (*size > len - *payload)
+    return -1;
+  return 0;
+}
+
+static PyObject *
+jsonb_decode_element(const unsigned char *data, size_t len, size_t offset, size_t *next)
+{
+  int type;
+  size_t payload, size;
+  const char *text;
+  PyObject *res = NULL;
+
+  if (jsonb_header(data, len, offset, &type, &payload, &size))
+    return json_error("JSONB", (Py_ssize_t)offset);
+  *next = payload + size;
+  text = (const char *)data + payload;
+
+  switch (type)
+  {
+  case JSONB_NULL:
+    Py_RETURN_NONE;
+  case JSONB_TRUE:
+    Py_RETURN_TRUE;
+  case JSONB_FALSE:
+    Py_RETURN_FALSE;
+  case JSONB_INT:
+  case JSONB_FLOAT:
+    return json_number(text, size, type == JSONB_FLOAT, 0);
+  case JSONB_INT5:
+  case JSONB_FLOAT5:
+    return json_number(text, size, type == JSONB_FLOAT5, 1);
+  case JSONB_TEXT:
+  case JSONB_TEXTRAW:
+    return PyUnicode_DecodeUTF8(text, size, "surrogatepass");
+  case JSONB_TEXTJ:
+  case JSONB_TEXT5:
+    return json_string(text, size, type == JSONB_TEXT5);
+  case JSONB_ARRAY:
+  case JSONB_OBJECT:
+  {
+    PyObject *key = NULL, *value = NULL;
+    size_t pos = payload, end = payload + size;
+
+    res = (type == JSONB_OBJECT) ? PyDict_New() : PyList_New(0);
+    if (!res)
+      return NULL;
+    if (Py_EnterRecursiveCall(" decoding JSONB"))
+    {
+      Py_DECREF(res);
+      return NULL;
+    }
+    while (pos < end)
+    {
+      if (type == JSONB_OBJECT)
+      {
+        if ((data[pos] & 0x0F) < JSONB_TEXT || (data[pos] & 0x0F) > JSONB_TEXTRAW)
+        {
+          json_error("JSONB object key", (Py_ssize_t)pos);
+          break;
+        }
+        key = jsonb_decode_element(data, end, pos, &pos);
+        if (!key)
+          break;
+        if (pos >= end)
+        {
+          json_error("JSONB object", (Py_ssize_t)pos);
+          break;
+        }
+      }
+      value = jsonb_decode_element(data, end, pos, &pos);
+      if (!value)
+        break;
+      if (type == JSONB_OBJECT ? PyDict_SetItem(res, key, value) : PyList_Append(res, value))
+        break;
+      Py_CLEAR(key);
+      Py_CLEAR(value);
+    }
+    Py_LeaveRecursiveCall();
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    if (PyErr_Occurred())
+      Py_CLEAR(res);
+    return res;
+  }
+  default:
+    return json_error("JSONB element type", (Py_ssize_t)offset);
+  }
+}
+
+/* Parses JSONB returning a new reference */
+static PyObject *
+json_decode_jsonb(const void *data, size_t len)
+{
+  size_t next = 0;
+  PyObject *res = jsonb_decode_element((const unsigned char *)data, len, 0, &next);
+
+  if (res && next != len)
+  {
+    Py_DECREF(res);
+    return json_error("JSONB", (Py_ssize_t)next);
+  }
+  return res;
+}
+
+/* Encoding into memory from sqlite3_malloc so it can be bound without
+   copying */
+
+typedef struct
+{
+  char *data;
+  size_t len;
+  size_t allocated;
+} JsonBuffer;
+
+static int
+json_buffer_append(JsonBuffer *b, const char *text, size_t len)
+{
+  if (b->len + len > b->allocated)
+  {
+    size_t allocated = (b->allocated + len) * 2 + 64;
+    char *data = sqlite3_realloc64(b->data, allocated);
+    if (!data)
+    {
+      PyErr_NoMemory();
+      return -1;
+    }
+    b->data = data;
+    b->allocated = allocated;
+  }
+  memcpy(b->data + b->len, text, len);
+  b->len += len;
+  return 0;
+}
+
+static int
+json_encode_string(JsonBuffer *b, PyObject *str)
+{
+  Py_ssize_t len, i, run = 0;
+  const char *utf8 = PyUnicode_AsUTF8AndSize(str, &len);
+
+  if (!utf8 || json_buffer_append(b, "\"", 1))
+    return -1;
+  for (i = 0; i < len; i++)
+  {
+    unsigned char c = (unsigned char)utf8[i];
+    char escape[7];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    if (json_buffer_append(b, utf8 + run, i - run))
+      return -1;
+    run = i + 1;
+    switch (c)
+    {
+    case '"':
+    case '\\':
+      escape[0] = '\\';
+      escape[1] = c;
+      escape[2] = 0;
+      break;
+    case '\n':
+      strcpy(escape, "\\n");
+      break;
+    case '\r':
+      strcpy(escape, "\\r");
+      break;
+    case '\t':
+      strcpy(escape, "\\t");
+      break;
+    default:
+      PyOS_snprintf(escape, sizeof(escape), "\\u%04x", c);
+      break;
+    }
+    if (json_buffer_append(b, escape, strlen(escape)))
+      return -1;
+  }
+  if (json_buffer_append(b, utf8 + run, len - run))
+    return -1;
+  return json_buffer_append(b, "\"", 1);
+}
+
+static int
+json_encode_value(JsonBuffer *b, PyObject *obj)
+{
+  int res = -1;
+
+  if (Py_IsNone(obj))
+    return json_buffer_append(b, "null", 4);
+  if (Py_IsTrue(obj))
+    return json_buffer_append(b, "true", 4);
+  if (Py_IsFalse(obj))
+    return json_buffer_append(b, "false", 5);
+  if (PyUnicode_Check(obj))
+    return json_encode_string(b, obj);
+  if (PyLong_Check(obj))
+  {
+    int overflow = 0;
+    long long v = PyLong_AsLongLongAndOverflow(obj, &overflow);
+    char buf[32];
+    if (v == -1 && PyErr_Occurred())
+      return -1;
+    if (!overflow)
+    {
+      PyOS_snprintf(buf, sizeof(buf), "%lld", v);
+      return json_buffer_append(b, buf, strlen(buf));
+    }
+    else
+    {
+      PyObject *text = PyLong_Type.tp_repr(obj);
+      const char *utf8;
+      Py_ssize_t len;
+      if (!text)
+        return -1;
+      utf8 = PyUnicode_AsUTF8AndSize(text, &len);
+      res = utf8 ? json_buffer_append(b, utf8, len) : -1;
+      Py_DECREF(text);
+      return res;
+    }
+  }
+  if (PyFloat_Check(obj))
+  {
+    double d = PyFloat_AS_DOUBLE(obj);
+    char *text;
+    if (!isfinite(d))
+    {
+      PyErr_Format(PyExc_ValueError, "JSON can't represent %R", obj);
+      return -1;
+    }
+    text = PyOS_double_to_string(d, 'r', 0, Py_DTSF_ADD_DOT_0, NULL);
+    if (!text)
+      return -1;
+    res = json_buffer_append(b, text, strlen(text));
+    PyMem_Free(text);
+    return res;
+  }
+  if (PyList_Check(obj) || PyTuple_Check(obj) || PyDict_Check(obj))
+  {
+    Py_ssize_t i = 0;
+    int isdict = PyDict_Check(obj);
+
+    if (Py_EnterRecursiveCall(" encoding JSON"))
+      return -1;
+    if (json_buffer_append(b, isdict ? "{" : "[", 1))
+      goto finally;
+    if (isdict)
+    {
+      PyObject *key, *value;
+      int first = 1;
+      while (PyDict_Next(obj, &i, &key, &value))
+      {
+        if (!PyUnicode_Check(key))
+        {
+          PyErr_Format(PyExc_TypeError, "JSON object keys must be str not %s", Py_TypeName(key));
+          goto finally;
+        }
+        if ((!first && json_buffer_append(b, ",", 1)) || json_encode_string(b, key) || json_buffer_append(b, ":", 1)
+            || json_encode_value(b, value))
+          goto finally;
+        first = 0;
+      }
+    }
+    else
+    {
+      PyObject *sequence = PySequence_Fast(obj, "");
+      if (!sequence)
+        goto finally;
+      for (i = 0; i < PySequence_Fast_GET_SIZE(sequence); i++)
+        if ((i && json_buffer_append(b, ",", 1)) || json_encode_value(b, PySequence_Fast_GET_ITEM(sequence, i)))
+          break;
+      Py_DECREF(sequence);
+      if (PyErr_Occurred())
+        goto finally;
+    }
+    res = json_buffer_append(b, isdict ? "}" : "]", 1);
+  finally:
+    Py_LeaveRecursiveCall();
+    return res;
+  }
+
+  PyErr_Format(PyExc_TypeError, "Can't convert %s to JSON", Py_TypeName(obj));
+  return -1;
+}
+
+/* Encodes obj as JSON text in memory from sqlite3_malloc, which the
+   caller must free.  Returns NULL with an exception on failure */
+static char *
+json_encode(PyObject *obj, size_t *len)
+{
+  JsonBuffer b = {0};
+
+  if (json_encode_value(&b, obj))
+  {
+    sqlite3_free(b.data);
+    return NULL;
+  }
+  *len = b.len;
+  return b.data;
+}
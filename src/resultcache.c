@@ -0,0 +1,470 @@
+/*
+  Result cache for read only queries
+
+  See the accompanying LICENSE file.
+*/
+
+/* Connection.execute_cached returns all the rows from a query.  With
+   the result cache enabled the rows are kept, keyed by the query text
+   and bindings, and returned again without running the query as long
+   as no database on the connection has changed.
+
+   Changes are detected with the data version of each database
+   (SQLITE_FCNTL_DATA_VERSION) which covers changes made by this
+   connection as well as by other connections and processes.  The
+   pager only notices changes made elsewhere when it starts a read
+   transaction, so "pragma data_version" is run against each database
+   first.  Any change discards all the cached results.
+
+   Only queries that are a single statement, are read only, are not
+   pragmas, and do not use virtual tables or non-deterministic
+   functions are cached.  That is determined once per query text by
+   examining the bytecode.  Functions are acceptable if they are
+   registered as deterministic or are builtin aggregate and window
+   functions.  The date and time functions are excluded because they
+   can use 'now'.  Registering or removing a function, collation, or
+   module discards everything.
+
+   The rows are kept as a tuple of tuples which is returned as is on a
+   hit.  A more compact encoding of the values would use less memory
+   but each hit would then have to create all the Python objects
+   again, which is most of the cost of running a small query.  Entries
+   are evicted least recently used first when over the entry or byte
+   limits, which relies on dicts keeping insertion order.
+
+   Everything is only accessed with the GIL held, except the
+   signature and analysis functions which are called with the GIL
+   released.
+*/
+
+typedef struct ResultCache
+{
+  PyObject *entries;            /* dict of key -> (rows, size) */
+  PyObject *decisions;          /* dict of query text -> bool if it can be cached */
+  unsigned long long signature; /* data versions the entries are valid for */
+  Py_ssize_t max_entries;
+  Py_ssize_t max_bytes;
+  Py_ssize_t bytes;
+
+  /* statistics */
+  long long hits;
+  long long misses;
+  long long uncacheable;
+  long long invalidations;
+  long long evictions;
+} ResultCache;
+
+static void
+resultcache_free(ResultCache *rc)
+{
+  if (rc)
+  {
+    Py_XDECREF(rc->entries);
+    Py_XDECREF(rc->decisions);
+    PyMem_Free(rc);
+  }
+}
+
+/* Returns NULL with an exception set on failure */
+static ResultCache *
+resultcache_new(Py_ssize_t max_entries, Py_ssize_t max_bytes)
+{
+  ResultCache *rc = PyMem_Calloc(1, sizeof(ResultCache));
+  if (!rc)
+    return (ResultCache *)PyErr_NoMemory();
+
+  rc->entries = PyDict_New();
+  rc->decisions = PyDict_New();
+  if (!rc->entries || !rc->decisions)
+  {
+    resultcache_free(rc);
+    return NULL;
+  }
+  rc->max_entries = max_entries;
+  rc->max_bytes = max_bytes;
+  return rc;
+}
+
+/* Computes a value that changes whenever any database changes.  Called
+   without the GIL and with the database mutex held */
+static int
+resultcache_signature(sqlite3 *db, unsigned long long *signature)
+{
+  unsigned long long sig = 14695981039346656037ULL;
+  const char *name;
+  int i, res = SQLITE_OK;
+
+  for (i = 0;; i++)
+  {
+    sqlite3_stmt *stmt = NULL;
+    unsigned int version = 0;
+    char *sql;
+
+    name = sqlite3_db_name(db, i);
+    if (!name)
+      break;
+    sql = sqlite3_mprintf("pragma \"%w\".data_version", name);
+    if (!sql)
+      return SQLITE_NOMEM;
+    res = sqlite3_prepare_v3(db, sql, -1, 0, &stmt, NULL);
+    sqlite3_free(sql);
+    if (res == SQLITE_OK)
+      res = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (res != SQLITE_ROW)
+      return res;
+    res = SQLITE_OK;
+
+    res = sqlite3_file_control(db, name, SQLITE_FCNTL_DATA_VERSION, &version);
+    if (res != SQLITE_OK)
+      version = 0;
+    res = SQLITE_OK;
+
+    /* the filename pointer distinguishes a different database attached
+       with the same name */
+    sig = (sig ^ (unsigned long long)i) * 1099511628211ULL;
+    sig = (sig ^ version) * 1099511628211ULL;
+    sig = (sig ^ (unsigned long long)(uintptr_t)sqlite3_db_filename(db, name)) * 1099511628211ULL;
+  }
+
+  *signature = sig;
+  return res;
+}
+
+/* Functions using 'now' give different results each time */
+static const char *const resultcache_time_functions[]
+    = { "date", "time", "datetime", "julianday", "unixepoch", "strftime", "timediff", NULL };
+
+/* Returns true if the first keyword of sql is PRAGMA.  Pragmas report
+   and change connection state that is not covered by the data
+   version */
+static int
+resultcache_is_pragma(const char *sql)
+{
+  for (;;)
+  {
+    while (*sql == ' ' || *sql == '\t' || *sql == '\r' || *sql == '\n' || *sql == ';')
+      sql++;
+    if (sql[0] == '-' && sql[1] == '-')
+    {
+      while (*sql && *sql != '\n')
+        sql++;
+    }
+    else if (sql[0] == '/' && sql[1] == '*')
+    {
+      for (sql += 2; *sql && !(sql[0] == '*' && sql[1] == '/'); sql++)
+        ;
+      if (*sql)
+        sql += 2;
+    }
+    else
+      break;
+  }
+  return 0 == PyOS_strnicmp(sql, "pragma", 6);
+}
+
+/* Determines if results from sql can be cached by examining its
+   bytecode.  Errors such as invalid SQL mean it can't be.  Called
+   without the GIL */
+static void
+resultcache_analyse(sqlite3 *db, const char *sql, Py_ssize_t length, int *cacheable)
+{
+  sqlite3_stmt *stmt = NULL, *lookup = NULL;
+  const char *tail = NULL;
+  int res;
+
+  *cacheable = 0;
+  if (length > INT32_MAX || resultcache_is_pragma(sql))
+    return;
+
+  res = sqlite3_prepare_v3(db, sql, (int)length, 0, &stmt, &tail);
+  if (res != SQLITE_OK || !stmt)
+    goto finally;
+
+  /* only whitespace and semicolons can follow */
+  for (; tail && *tail; tail++)
+    if (!(*tail == ';' || *tail == ' ' || *tail == '\t' || *tail == '\r' || *tail == '\n'))
+      goto finally;
+
+  if (!sqlite3_stmt_readonly(stmt) || sqlite3_stmt_isexplain(stmt) || !sqlite3_column_count(stmt))
+    goto finally;
+
+  res = sqlite3_prepare_v3(db,
+                           "SELECT 1 FROM pragma_function_list WHERE name = ?1 COLLATE NOCASE "
+                           "AND (flags & ?2 OR (builtin AND type = 'w'))",
+                           -1, 0, &lookup, NULL);
+  if (res != SQLITE_OK)
+    goto finally;
+  sqlite3_bind_int(lookup, 2, SQLITE_DETERMINISTIC);
+
+  res = sqlite3_stmt_explain(stmt, 1);
+  if (res != SQLITE_OK)
+    goto finally;
+
+  *cacheable = 1;
+  for (;;)
+  {
+    const char *opcode, *p4;
+    int i, namelen;
+
+    res = sqlite3_step(stmt);
+    if (res != SQLITE_ROW)
+      break;
+
+    opcode = (const char *)sqlite3_column_text(stmt, 1);
+    if (!opcode)
+      continue;
+
+    /* virtual tables can return anything */
+    if (opcode[0] == 'V' && opcode[1] >= 'A' && opcode[1] <= 'Z')
+    {
+      *cacheable = 0;
+      break;
+    }
+
+    if (strcmp(opcode, "Function") && strcmp(opcode, "PureFunc") && strncmp(opcode, "Agg", 3))
+      continue;
+
+    /* p4 is name(nargs) */
+    p4 = (const char *)sqlite3_column_text(stmt, 5);
+    if (!p4)
+      continue;
+    for (namelen = 0; p4[namelen] && p4[namelen] != '('; namelen++)
+      ;
+
+    for (i = 0; resultcache_time_functions[i]; i++)
+      if (0 == PyOS_strnicmp(p4, resultcache_time_functions[i], namelen)
+          && 0 == resultcache_time_functions[i][namelen])
+        *cacheable = 0;
+
+    if (*cacheable)
+    {
+      sqlite3_bind_text(lookup, 1, p4, namelen, SQLITE_TRANSIENT);
+      res = sqlite3_step(lookup);
+      sqlite3_reset(lookup);
+      if (res != SQLITE_ROW)
+        *cacheable = 0;
+    }
+    if (!*cacheable)
+      break;
+  }
+  if (res != SQLITE_ROW && res != SQLITE_DONE)
+    *cacheable = 0;
+
+finally:
+  sqlite3_finalize(lookup);
+  sqlite3_finalize(stmt);
+}
+
+/* Makes the key for a query and its bindings.  The type of each value
+   is included because 1, 1.0, and True are equal in Python but bind
+   differently.  Returns NULL without an exception if the bindings
+   can't be used in a key */
+static PyObject *
+resultcache_key(PyObject *query, PyObject *bindings)
+{
+  PyObject *items = NULL, *key = NULL;
+  Py_ssize_t i, nitems;
+  int isdict;
+
+  if (!bindings || Py_IsNone(bindings))
+    return PyTuple_Pack(1, query);
+
+  isdict = PyDict_CheckExact(bindings);
+  if (isdict)
+  {
+    items = PyDict_Items(bindings);
+    if (items && PyList_Sort(items))
+    {
+      /* keys that can't be sorted */
+      PyErr_Clear();
+      Py_CLEAR(items);
+      return NULL;
+    }
+  }
+  else if (PyTuple_CheckExact(bindings) || PyList_CheckExact(bindings))
+    items = PySequence_List(bindings);
+  else
+    return NULL;
+  if (!items)
+    return NULL;
+
+  nitems = PyList_GET_SIZE(items);
+  key = PyTuple_New(2 + 2 * nitems);
+  if (!key)
+    goto error;
+  PyTuple_SET_ITEM(key, 0, Py_NewRef(query));
+  PyTuple_SET_ITEM(key, 1, Py_NewRef(isdict ? Py_True : Py_False));
+  for (i = 0; i < nitems; i++)
+  {
+    PyObject *item = PyList_GET_ITEM(items, i), *value = item;
+
+    if (isdict)
+    {
+      if (!PyUnicode_CheckExact(PyTuple_GET_ITEM(item, 0)))
+        goto unusable;
+      value = PyTuple_GET_ITEM(item, 1);
+    }
+    if (!(Py_IsNone(value) || PyLong_CheckExact(value) || PyBool_Check(value) || PyFloat_CheckExact(value)
+          || PyUnicode_CheckExact(value) || PyBytes_CheckExact(value)))
+      goto unusable;
+    PyTuple_SET_ITEM(key, 2 + 2 * i, Py_NewRef(item));
+    PyTuple_SET_ITEM(key, 3 + 2 * i, Py_NewRef((PyObject *)Py_TYPE(value)));
+  }
+  Py_DECREF(items);
+  return key;
+
+unusable:
+  Py_DECREF(items);
+  Py_DECREF(key);
+  return NULL;
+
+error:
+  Py_XDECREF(items);
+  return NULL;
+}
+
+/* Discards all the results and decisions.  Used when the databases
+   have changed, and when functions, collations, and modules are
+   registered or removed because that can change both the results and
+   whether a query can be cached.  rc can be NULL */
+static void
+resultcache_clear(ResultCache *rc)
+{
+  if (!rc)
+    return;
+  if (PyDict_GET_SIZE(rc->entries))
+    rc->invalidations++;
+  PyDict_Clear(rc->entries);
+  PyDict_Clear(rc->decisions);
+  rc->bytes = 0;
+}
+
+/* Discards everything if the databases have changed since the entries
+   were added */
+static void
+resultcache_validate(ResultCache *rc, unsigned long long signature)
+{
+  if (rc->signature == signature)
+    return;
+  resultcache_clear(rc);
+  rc->signature = signature;
+}
+
+/* Returns a new reference to the cached rows, or NULL with or without
+   an exception */
+static PyObject *
+resultcache_get(ResultCache *rc, PyObject *key)
+{
+  PyObject *entry = PyDict_GetItemWithError(rc->entries, key), *rows = NULL;
+
+  if (!entry)
+    return NULL;
+
+  /* move to the end as most recently used */
+  Py_INCREF(entry);
+  if (0 == PyDict_DelItem(rc->entries, key) && 0 == PyDict_SetItem(rc->entries, key, entry))
+    rows = Py_NewRef(PyTuple_GET_ITEM(entry, 0));
+  Py_DECREF(entry);
+  return rows;
+}
+
+/* Estimated memory used by the rows */
+static Py_ssize_t
+resultcache_rows_size(PyObject *rows)
+{
+  Py_ssize_t size = (Py_ssize_t)sizeof(PyTupleObject), i, j;
+
+  for (i = 0; i < PyTuple_GET_SIZE(rows); i++)
+  {
+    PyObject *row = PyTuple_GET_ITEM(rows, i);
+
+    size += (Py_ssize_t)sizeof(PyObject *);
+    if (!PyTuple_Check(row))
+    {
+      size += 64;
+      continue;
+    }
+    size += (Py_ssize_t)sizeof(PyTupleObject);
+    for (j = 0; j < PyTuple_GET_SIZE(row); j++)
+    {
+      PyObject *value = PyTuple_GET_ITEM(row, j);
+
+      size += (Py_ssize_t)sizeof(PyObject *) + 32;
+      if (PyBytes_Check(value))
+        size += PyBytes_GET_SIZE(value);
+      else if (PyUnicode_Check(value))
+        size += PyUnicode_GET_LENGTH(value) * PyUnicode_KIND(value);
+    }
+  }
+  return size;
+}
+
+/* Evicts the least recently used entry */
+static int
+resultcache_evict(ResultCache *rc)
+{
+  PyObject *key, *entry;
+  Py_ssize_t pos = 0;
+  int res;
+
+  if (!PyDict_Next(rc->entries, &pos, &key, &entry))
+    return 0;
+  Py_INCREF(key);
+  rc->bytes -= PyLong_AsSsize_t(PyTuple_GET_ITEM(entry, 1));
+  res = PyDict_DelItem(rc->entries, key);
+  Py_DECREF(key);
+  rc->evictions++;
+  return res;
+}
+
+/* Returns -1 with an exception on failure */
+static int
+resultcache_put(ResultCache *rc, PyObject *key, PyObject *rows)
+{
+  Py_ssize_t size = resultcache_rows_size(rows);
+  PyObject *entry;
+  int res;
+
+  if (size > rc->max_bytes)
+    return 0;
+
+  while (PyDict_GET_SIZE(rc->entries)
+         && (PyDict_GET_SIZE(rc->entries) >= rc->max_entries || rc->bytes + size > rc->max_bytes))
+    if (resultcache_evict(rc))
+      return -1;
+
+  entry = Py_BuildValue("(On)", rows, size);
+  if (!entry)
+    return -1;
+  res = PyDict_SetItem(rc->entries, key, entry);
+  Py_DECREF(entry);
+  if (res == 0)
+    rc->bytes += size;
+  return res;
+}
+
+/* Returns 1 if query can be cached, 0 if not, and -1 if not known yet */
+static int
+resultcache_decision(ResultCache *rc, PyObject *query)
+{
+  PyObject *decision = PyDict_GetItemWithError(rc->decisions, query);
+
+  if (!decision)
+    return -1;
+  return Py_IsTrue(decision);
+}
+
+static PyObject *
+resultcache_stats(ResultCache *rc)
+{
+  ResultCache empty = { 0 };
+
+  if (!rc)
+    rc = &empty;
+
+  return Py_BuildValue("{s: n, s: n, s: L, s: L, s: L, s: L, s: L}", "entries",
+                       rc->entries ? PyDict_GET_SIZE(rc->entries) : 0, "bytes", rc->bytes, "hits", rc->hits, "misses",
+                       rc->misses, "uncacheable", rc->uncacheable, "invalidations", rc->invalidations, "evictions",
+                       rc->evictions);
+}
@@ -31,6 +31,23 @@
    A copy of the query has to be kept around for doing equality
    comparisons when looking in the cache.  But sqlite also keeps a
    copy of the query, so we try to use that if possible.
+
+   When a plan monitor is set, the query plan of each cacheable
+   statement is recorded when it is prepared.  SQLite transparently
+   reprepares statements when the schema or statistics change, which
+   we detect via SQLITE_STMTSTATUS_REPREPARE as the statement goes
+   back into the cache, and compare the new plan against the old.
+
+   Lookups hash the whole query text, which for long queries was a
+   visible fraction of execution time with Python's SipHash.  A fast
+   non-cryptographic hash is used instead since all candidates are
+   compared in full anyway.  The hash of the most recent query object
+   is remembered, so executing the same str again skips hashing.
+
+   When auto parameterization is enabled, a single statement executed
+   without bindings has its numeric and string literals replaced by ?
+   parameters, so queries that only differ in literal values share a
+   cache entry.  The values are then bound like regular bindings.
 */
 
 typedef struct APSWStatementOptions
@@ -51,6 +68,8 @@ typedef struct APSWStatement
   Py_hash_t hash;              /* hash of all of utf8 */
   APSWStatementOptions options;
   unsigned uses; /* how many times the prepared statement has been (re)used */
+  PyObject *plan; /* query plan text when plan monitoring, else NULL */
+  int reprepares; /* SQLITE_STMTSTATUS_REPREPARE when plan was recorded */
 } APSWStatement;
 
 typedef struct StatementCache
@@ -68,6 +87,18 @@ typedef struct StatementCache
   unsigned misses;    /* not found in cache */
   unsigned no_vdbe;   /* no bytecode emitted */
   unsigned too_big;   /* query was bigger than SC_MAX_ITEM_SIZE */
+  /* plan monitoring */
+  PyObject *plan_monitor; /* borrowed from the Connection, NULL if not monitoring */
+  unsigned *plan_monitor_inuse; /* the Connection's inuse, set while calling plan_monitor */
+  unsigned reprepares;    /* monitored statements found to have been reprepared */
+  unsigned plan_changes;  /* reprepares where the plan changed */
+  /* hash of the most recently prepared query object */
+  PyObject *last_query;
+  Py_hash_t last_hash;
+  /* auto parameterization */
+  int normalize;             /* replace literals with parameters */
+  unsigned normalized;       /* misses prepared with literals replaced */
+  unsigned normalized_hits;  /* hits with literals replaced */
 } StatementCache;
 
 /* we don't bother caching larger than this many bytes */
@@ -90,6 +121,7 @@ statementcache_free_statement(StatementCache *sc, APSWStatement *s)
   int res;
 
   Py_CLEAR(s->query);
+  Py_CLEAR(s->plan);
 
   PYSQLITE_SC_CALL(res = sqlite3_finalize(s->vdbestatement));
 
@@ -104,6 +136,492 @@ statementcache_free_statement(StatementCache *sc, APSWStatement *s)
   return res;
 }
 
+/* returns the query plan as text, one line per step indented by
+   depth, or NULL with an exception.  A separate EXPLAIN QUERY PLAN
+   statement is prepared because changing the explain mode of stmt
+   would reprepare it twice. */
+static PyObject *
+statementcache_plan(StatementCache *sc, sqlite3_stmt *stmt)
+{
+  static const char indent[] = "                                                                ";
+  static const char prefix[] = "EXPLAIN QUERY PLAN ";
+  int ids[32], depths[32], nids = 0;
+  int res = SQLITE_OK, id, parent, depth, i;
+  const char *detail = NULL, *sql;
+  char *eqp_sql = NULL;
+  size_t sql_len;
+  sqlite3_stmt *eqp = NULL;
+  PyObject *lines = NULL, *line = NULL, *sep = NULL, *result = NULL;
+
+  lines = PyList_New(0);
+  if (!lines)
+    return NULL;
+
+  sql = sqlite3_sql(stmt);
+  sql_len = sql ? strlen(sql) : 0;
+  eqp_sql = PyMem_Malloc(sizeof(prefix) + sql_len);
+  if (!eqp_sql)
+  {
+    PyErr_NoMemory();
+    goto finally;
+  }
+  memcpy(eqp_sql, prefix, sizeof(prefix) - 1);
+  memcpy(eqp_sql + sizeof(prefix) - 1, sql ? sql : "", sql_len + 1);
+
+  PYSQLITE_SC_CALL(res = sqlite3_prepare_v3(sc->db, eqp_sql, -1, 0, &eqp, NULL));
+  while (res == SQLITE_OK || res == SQLITE_ROW)
+  {
+    PYSQLITE_SC_CALL(res = sqlite3_step(eqp));
+    if (res != SQLITE_ROW)
+      break;
+    PYSQLITE_SC_CALL(id = sqlite3_column_int(eqp, 0); parent = sqlite3_column_int(eqp, 1);
+                     detail = (const char *)sqlite3_column_text(eqp, 3));
+    depth = 0;
+    for (i = 0; i < nids; i++)
+      if (ids[i] == parent)
+      {
+        depth = depths[i] + 1;
+        break;
+      }
+    if (nids < (int)(sizeof(ids) / sizeof(ids[0])))
+    {
+      ids[nids] = id;
+      depths[nids++] = depth;
+    }
+    depth = Py_MIN(depth * 2, (int)sizeof(indent) - 1);
+    line = PyUnicode_FromFormat("%s%s", indent + sizeof(indent) - 1 - depth, detail ? detail : "");
+    if (!line || PyList_Append(lines, line))
+      goto finally;
+    Py_CLEAR(line);
+  }
+  if (res != SQLITE_DONE)
+  {
+    SET_EXC(res, sc->db);
+    goto finally;
+  }
+  sep = PyUnicode_FromString("\n");
+  if (sep)
+    result = PyUnicode_Join(sep, lines);
+
+finally:
+  PYSQLITE_SC_CALL(sqlite3_finalize(eqp));
+  PyMem_Free(eqp_sql);
+  if (PyErr_Occurred())
+    Py_CLEAR(result);
+  Py_XDECREF(line);
+  Py_XDECREF(sep);
+  Py_DECREF(lines);
+  return result;
+}
+
+/* records the plan of a statement being prepared for the cache */
+static void
+statementcache_record_plan(StatementCache *sc, APSWStatement *statement)
+{
+  int res = SQLITE_OK, isexplain;
+
+  PYSQLITE_SC_CALL(isexplain = sqlite3_stmt_isexplain(statement->vdbestatement));
+  if (isexplain || statement->options.explain >= 0)
+    return;
+  statement->plan = statementcache_plan(sc, statement->vdbestatement);
+  if (!statement->plan)
+  {
+    apsw_write_unraisable(NULL);
+    return;
+  }
+  statement->reprepares = sqlite3_stmt_status(statement->vdbestatement, SQLITE_STMTSTATUS_REPREPARE, 0);
+}
+
+/* checks if a statement returning to the cache was reprepared with a
+   different plan, calling the plan monitor if so */
+static void
+statementcache_check_plan(StatementCache *sc, APSWStatement *statement)
+{
+  PyObject *plan = NULL, *query = NULL, *retval = NULL;
+  int changed;
+
+  if (statement->reprepares == sqlite3_stmt_status(statement->vdbestatement, SQLITE_STMTSTATUS_REPREPARE, 0))
+    return;
+
+  sc->reprepares++;
+  plan = statementcache_plan(sc, statement->vdbestatement);
+  if (!plan)
+    goto error;
+  statement->reprepares = sqlite3_stmt_status(statement->vdbestatement, SQLITE_STMTSTATUS_REPREPARE, 0);
+
+  changed = PyUnicode_Compare(statement->plan, plan);
+  if (changed == -1 && PyErr_Occurred())
+    goto error;
+  if (changed)
+  {
+    sc->plan_changes++;
+    query = PyUnicode_FromStringAndSize(statement->utf8, statement->query_size);
+    if (!query)
+      goto error;
+    /* the cache is part way through finalizing so the connection
+       can't be used */
+    unsigned saved_inuse = *sc->plan_monitor_inuse;
+    *sc->plan_monitor_inuse = 1;
+    PyObject *vargs[] = {NULL, query, statement->plan, plan};
+    retval = PyObject_Vectorcall(sc->plan_monitor, vargs + 1, 3 | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+    *sc->plan_monitor_inuse = saved_inuse;
+    if (!retval)
+    {
+      AddTraceBackHere(__FILE__, __LINE__, "statementcache_check_plan", "{s: O, s: O, s: O}",
+                       "query", query, "old", statement->plan, "new", plan);
+      goto error;
+    }
+  }
+  Py_XSETREF(statement->plan, plan);
+  plan = NULL;
+  goto finally;
+
+error:
+  apsw_write_unraisable(NULL);
+finally:
+  Py_XDECREF(plan);
+  Py_XDECREF(query);
+  Py_XDECREF(retval);
+}
+
+/* Literals are left alone where a parameter would change the meaning
+   or isn't allowed.  That is in result columns (the column names
+   would change), ORDER BY and GROUP BY (integers are column numbers),
+   and in statements other than DML.  Parentheses inherit from the
+   enclosing level so the text of result columns is never changed.
+   Function arguments are also left alone because an expression index
+   such as on json_extract(j, '$.a') is only used when the query
+   has the same literals. */
+#define SC_NORMALIZE_MAX_DEPTH 64
+
+typedef struct
+{
+  unsigned char inherited; /* enclosing level keeps literals */
+  unsigned char result;    /* in result columns */
+  unsigned char by;        /* in ORDER/GROUP BY */
+} SCNormalizeLevel;
+
+static int
+statementcache_keyword(const char *token, Py_ssize_t length, const char *keyword)
+{
+  return (Py_ssize_t)strlen(keyword) == length && 0 == PyOS_strnicmp(token, keyword, length);
+}
+
+#define SC_IS_IDCHAR(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9') || (c) == '_' || (c) == '$' || (unsigned char)(c) >= 0x80)
+#define SC_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/* Tokenizes utf8 following SQLite's rules, replacing literals with
+   parameters.  Returns 1 with the new query and list of literal
+   values, 0 if it can't or doesn't need to be done, and -1 with an
+   exception on error */
+static int
+statementcache_normalize(StatementCache *sc, const char *utf8, Py_ssize_t size, PyObject **query_out,
+                         PyObject **literals_out)
+{
+  SCNormalizeLevel levels[SC_NORMALIZE_MAX_DEPTH];
+  int depth = 0, first = 1, prev_order_group = 0, prev_function = 0, result = 0, max_literals;
+  Py_ssize_t i = 0, outlen = 0;
+  char *out = NULL;
+  PyObject *literals = NULL, *value = NULL;
+
+  *query_out = *literals_out = NULL;
+
+  max_literals = sqlite3_limit(sc->db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+
+  out = PyMem_Malloc(size + 1);
+  literals = PyList_New(0);
+  if (!out || !literals)
+  {
+    if (!out)
+      PyErr_NoMemory();
+    result = -1;
+    goto finally;
+  }
+  memset(levels, 0, sizeof(levels));
+
+  while (i < size)
+  {
+    char c = utf8[i];
+    Py_ssize_t start = i;
+    int keep;
+
+    keep = levels[depth].inherited || levels[depth].result || levels[depth].by;
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f')
+      i++;
+    else if (c == '-' && i + 1 < size && utf8[i + 1] == '-')
+    {
+      while (i < size && utf8[i] != '\n')
+        i++;
+    }
+    else if (c == '/' && i + 1 < size && utf8[i + 1] == '*')
+    {
+      for (i += 2; i < size && !(utf8[i] == '*' && i + 1 < size && utf8[i + 1] == '/'); i++)
+        ;
+      i = Py_MIN(i + 2, size);
+    }
+    else if (c == '\'' || c == '"' || c == '`' || c == '[')
+    {
+      char end = (c == '[') ? ']' : c;
+      int escaped = 0;
+
+      for (i++;; i++)
+      {
+        if (i >= size)
+          goto unusable;
+        if (utf8[i] == end)
+        {
+          if (end != ']' && i + 1 < size && utf8[i + 1] == end)
+          {
+            escaped = 1;
+            i++;
+            continue;
+          }
+          break;
+        }
+      }
+      i++;
+      first = 0;
+      prev_order_group = 0;
+      /* quoted identifiers can be function names */
+      prev_function = c != '\'';
+      if (c == '\'' && !keep)
+      {
+        if (!escaped)
+          value = PyUnicode_DecodeUTF8(utf8 + start + 1, i - start - 2, NULL);
+        else
+        {
+          /* collapse doubled quotes */
+          Py_ssize_t j, n = 0;
+          char *text = PyMem_Malloc(i - start);
+          if (!text)
+          {
+            PyErr_NoMemory();
+            result = -1;
+            goto finally;
+          }
+          for (j = start + 1; j < i - 1; j++)
+          {
+            text[n++] = utf8[j];
+            if (utf8[j] == '\'')
+              j++;
+          }
+          value = PyUnicode_DecodeUTF8(text, n, NULL);
+          PyMem_Free(text);
+        }
+        if (!value)
+        {
+          result = -1;
+          goto finally;
+        }
+        goto literal;
+      }
+    }
+    else if (SC_IS_DIGIT(c) || (c == '.' && i + 1 < size && SC_IS_DIGIT(utf8[i + 1])))
+    {
+      int isfloat = 0, separators = 0, hex = 0;
+
+      if (c == '0' && i + 2 < size && (utf8[i + 1] == 'x' || utf8[i + 1] == 'X') && isxdigit((unsigned char)utf8[i + 2]))
+      {
+        hex = 1;
+        for (i += 2; i < size && (isxdigit((unsigned char)utf8[i]) || utf8[i] == '_'); i++)
+          ;
+      }
+      else
+      {
+        for (; i < size && (SC_IS_DIGIT(utf8[i]) || utf8[i] == '_'); i++)
+          separators |= utf8[i] == '_';
+        if (i < size && utf8[i] == '.')
+        {
+          isfloat = 1;
+          for (i++; i < size && (SC_IS_DIGIT(utf8[i]) || utf8[i] == '_'); i++)
+            separators |= utf8[i] == '_';
+        }
+        if (i + 1 < size && (utf8[i] == 'e' || utf8[i] == 'E')
+            && (SC_IS_DIGIT(utf8[i + 1])
+                || (i + 2 < size && (utf8[i + 1] == '+' || utf8[i + 1] == '-') && SC_IS_DIGIT(utf8[i + 2]))))
+        {
+          isfloat = 1;
+          for (i += 2; i < size && SC_IS_DIGIT(utf8[i]); i++)
+            ;
+        }
+      }
+      /* SQLite rejects these */
+      if (i < size && SC_IS_IDCHAR(utf8[i]))
+        goto unusable;
+      first = 0;
+      prev_order_group = 0;
+      prev_function = 0;
+      if (!keep && !hex && !separators)
+      {
+        if (isfloat)
+        {
+          char buffer[64];
+          double d;
+          if (i - start >= (Py_ssize_t)sizeof(buffer))
+            goto copy;
+          memcpy(buffer, utf8 + start, i - start);
+          buffer[i - start] = 0;
+          d = PyOS_string_to_double(buffer, NULL, NULL);
+          value = (d == -1.0 && PyErr_Occurred()) ? NULL : PyFloat_FromDouble(d);
+        }
+        else
+        {
+          unsigned long long v = 0;
+          Py_ssize_t j;
+          for (j = start; j < i; j++)
+          {
+            if (v > (9223372036854775807ULL - (utf8[j] - '0')) / 10)
+              /* too big for 64 bits so SQLite makes it a float */
+              goto copy;
+            v = v * 10 + (utf8[j] - '0');
+          }
+          value = PyLong_FromLongLong((long long)v);
+        }
+        if (!value)
+        {
+          result = -1;
+          goto finally;
+        }
+        goto literal;
+      }
+    }
+    else if (c == '?' || c == ':' || c == '@' || c == '$' || c == '#')
+      /* already has parameters */
+      goto unusable;
+    else if (SC_IS_IDCHAR(c))
+    {
+      Py_ssize_t length;
+
+      if ((c == 'x' || c == 'X') && i + 1 < size && utf8[i + 1] == '\'')
+      {
+        /* blob literal - left as is */
+        for (i += 2; i < size && utf8[i] != '\''; i++)
+          ;
+        if (i >= size)
+          goto unusable;
+        i++;
+        first = 0;
+        prev_function = 0;
+        goto copy;
+      }
+      for (; i < size && SC_IS_IDCHAR(utf8[i]); i++)
+        ;
+      length = i - start;
+      /* some keywords are also function names */
+      prev_function = length > INT32_MAX || !sqlite3_keyword_check(utf8 + start, (int)length)
+                      || statementcache_keyword(utf8 + start, length, "REPLACE")
+                      || statementcache_keyword(utf8 + start, length, "LIKE")
+                      || statementcache_keyword(utf8 + start, length, "GLOB");
+      if (first)
+      {
+        if (!(statementcache_keyword(utf8 + start, length, "SELECT")
+              || statementcache_keyword(utf8 + start, length, "VALUES")
+              || statementcache_keyword(utf8 + start, length, "WITH")
+              || statementcache_keyword(utf8 + start, length, "INSERT")
+              || statementcache_keyword(utf8 + start, length, "REPLACE")
+              || statementcache_keyword(utf8 + start, length, "UPDATE")
+              || statementcache_keyword(utf8 + start, length, "DELETE")))
+          goto unusable;
+        first = 0;
+      }
+      if (statementcache_keyword(utf8 + start, length, "SELECT")
+          || statementcache_keyword(utf8 + start, length, "RETURNING"))
+      {
+        levels[depth].result = 1;
+        levels[depth].by = 0;
+      }
+      else if (statementcache_keyword(utf8 + start, length, "BY"))
+      {
+        if (prev_order_group)
+          levels[depth].by = 1;
+      }
+      else if (statementcache_keyword(utf8 + start, length, "FROM")
+               || statementcache_keyword(utf8 + start, length, "WHERE")
+               || statementcache_keyword(utf8 + start, length, "HAVING")
+               || statementcache_keyword(utf8 + start, length, "LIMIT")
+               || statementcache_keyword(utf8 + start, length, "WINDOW")
+               || statementcache_keyword(utf8 + start, length, "UNION")
+               || statementcache_keyword(utf8 + start, length, "EXCEPT")
+               || statementcache_keyword(utf8 + start, length, "INTERSECT")
+               || statementcache_keyword(utf8 + start, length, "VALUES")
+               || statementcache_keyword(utf8 + start, length, "SET"))
+        levels[depth].result = levels[depth].by = 0;
+      prev_order_group = statementcache_keyword(utf8 + start, length, "ORDER")
+                         || statementcache_keyword(utf8 + start, length, "GROUP");
+    }
+    else if (c == ';')
+    {
+      /* only whitespace and semicolons can follow */
+      for (; i < size; i++)
+        if (!(utf8[i] == ';' || utf8[i] == ' ' || utf8[i] == '\t' || utf8[i] == '\r' || utf8[i] == '\n'))
+          goto unusable;
+    }
+    else
+    {
+      i++;
+      prev_order_group = 0;
+      if (c == '(')
+      {
+        if (++depth == SC_NORMALIZE_MAX_DEPTH)
+          goto unusable;
+        levels[depth].inherited = keep || prev_function;
+        levels[depth].result = levels[depth].by = 0;
+      }
+      else if (c == ')')
+      {
+        if (--depth < 0)
+          goto unusable;
+      }
+      prev_function = 0;
+    }
+
+  copy:
+    memcpy(out + outlen, utf8 + start, i - start);
+    outlen += i - start;
+    continue;
+
+  literal:
+    if (PyList_GET_SIZE(literals) >= max_literals || PyList_Append(literals, value))
+    {
+      Py_CLEAR(value);
+      if (PyErr_Occurred())
+      {
+        result = -1;
+        goto finally;
+      }
+      goto unusable;
+    }
+    Py_CLEAR(value);
+    out[outlen++] = '?';
+    /* a following digit would become part of the parameter */
+    if (i < size && SC_IS_DIGIT(utf8[i]))
+      goto unusable;
+  }
+
+  if (!PyList_GET_SIZE(literals))
+    goto unusable;
+
+  *query_out = PyUnicode_DecodeUTF8(out, outlen, NULL);
+  if (!*query_out)
+  {
+    result = -1;
+    goto finally;
+  }
+  *literals_out = literals;
+  literals = NULL;
+  result = 1;
+  goto finally;
+
+unusable:
+  result = 0;
+
+finally:
+  PyMem_Free(out);
+  Py_XDECREF(literals);
+  return result;
+}
+
 static int
 statementcache_hasmore(APSWStatement *statement)
 {
@@ -122,7 +640,9 @@ statementcache_finalize(StatementCache *sc, APSWStatement *statement)
   {
     APSWStatement *evictee = NULL;
 
-    PYSQLITE_SC_CALL(res = sqlite3_reset(statement->vdbestatement));
+    /* bindings are cleared now rather than on reuse so that values such
+       as a carray are not kept alive by the cache */
+    PYSQLITE_SC_CALL(res = sqlite3_reset(statement->vdbestatement); sqlite3_clear_bindings(statement->vdbestatement));
 
     /*
       https://sqlite.org/forum/forumpost/d72cba6ff7
@@ -133,6 +653,9 @@ statementcache_finalize(StatementCache *sc, APSWStatement *statement)
     if (res == SQLITE_OK && PyErr_Occurred())
       res = SQLITE_ERROR;
 
+    if (res == SQLITE_OK && statement->plan && sc->plan_monitor)
+      statementcache_check_plan(sc, statement);
+
     if (sc->caches[sc->next_eviction])
     {
       assert(sc->hashes[sc->next_eviction] != SC_SENTINEL_HASH);
@@ -160,10 +683,64 @@ statementcache_finalize(StatementCache *sc, APSWStatement *statement)
   return res;
 }
 
+static inline uint64_t
+statementcache_read64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+statementcache_mix(uint64_t h, uint64_t v)
+{
+  h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+/* Hashes 32 bytes at a time in four independent lanes so the
+   multiplies overlap, finishing with the murmur3 finalizer */
+static Py_hash_t
+statementcache_hash(const char *utf8, Py_ssize_t size)
+{
+  const unsigned char *p = (const unsigned char *)utf8, *end = p + size;
+  uint64_t h0 = 0x243F6A8885A308D3ULL ^ (uint64_t)size, h1 = 0x13198A2E03707344ULL, h2 = 0xA4093822299F31D0ULL,
+           h3 = 0x082EFA98EC4E6C89ULL;
+  uint64_t tail = 0;
+
+  for (; end - p >= 32; p += 32)
+  {
+    h0 = statementcache_mix(h0, statementcache_read64(p));
+    h1 = statementcache_mix(h1, statementcache_read64(p + 8));
+    h2 = statementcache_mix(h2, statementcache_read64(p + 16));
+    h3 = statementcache_mix(h3, statementcache_read64(p + 24));
+  }
+  for (; end - p >= 8; p += 8)
+    h0 = statementcache_mix(h0, statementcache_read64(p));
+  if (p < end)
+  {
+    memcpy(&tail, p, end - p);
+    h1 = statementcache_mix(h1, tail);
+  }
+
+  h0 ^= h1 * 0xC2B2AE3D27D4EB4FULL;
+  h0 ^= h2 * 0x165667B19E3779F9ULL;
+  h0 ^= h3 * 0x85EBCA77C2B2AE63ULL;
+  h0 ^= h0 >> 33;
+  h0 *= 0xFF51AFD7ED558CCDULL;
+  h0 ^= h0 >> 33;
+  h0 *= 0xC4CEB9FE1A85EC53ULL;
+  h0 ^= h0 >> 33;
+
+  return ((Py_hash_t)h0 == SC_SENTINEL_HASH) ? (Py_hash_t)(SC_SENTINEL_HASH - 1) : (Py_hash_t)h0;
+}
+
+/* hash is of utf8 if already known, else SC_SENTINEL_HASH.  If
+   sqlite_error is not NULL it is set to 1 when SQLite failed to prepare
+   the query without a Python exception having happened, else 0 */
 static int
-statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t utf8size, PyObject *query, APSWStatement **statement_out, APSWStatementOptions *options)
+statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t utf8size, PyObject *query, APSWStatement **statement_out, APSWStatementOptions *options, Py_hash_t hash, int *sqlite_error)
 {
-  Py_hash_t hash = SC_SENTINEL_HASH;
   APSWStatement *statement = NULL;
   const char *tail = NULL;
   const char *orig_tail = NULL;
@@ -171,14 +748,13 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
   int res = SQLITE_OK;
 
   *statement_out = NULL;
+  if (sqlite_error)
+    *sqlite_error = 0;
   if (sc->maxentries && utf8size < SC_MAX_ITEM_SIZE && options->can_cache)
   {
     unsigned i;
-#ifdef PYPY_VERSION
-    hash = utf8size;
-#else
-    hash = _Py_HashBytes(utf8, utf8size);
-#endif
+    if (hash == SC_SENTINEL_HASH)
+      hash = statementcache_hash(utf8, utf8size);
     for (i = 0; i <= sc->highest_used; i++)
     {
       if (sc->hashes[i] == hash && sc->caches[i]->utf8_size == utf8size && 0 == memcmp(utf8, sc->caches[i]->utf8, utf8size) && 0 == memcmp(&sc->caches[i]->options, options, sizeof(APSWStatementOptions)))
@@ -187,13 +763,6 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
         sc->hashes[i] = SC_SENTINEL_HASH;
         statement = sc->caches[i];
         sc->caches[i] = NULL;
-        PYSQLITE_SC_CALL(res = sqlite3_clear_bindings(statement->vdbestatement));
-        if (res)
-        {
-          SET_EXC(res, sc->db);
-          statementcache_finalize(sc, statement);
-          return res;
-        }
         *statement_out = statement;
         statement->uses++;
         sc->hits++;
@@ -202,6 +771,9 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
       }
     }
   }
+  else
+    hash = SC_SENTINEL_HASH;
+
   /* cache miss */
 
   /* Undocumented stuff alert:  if the size passed to sqlite3_prepare_v3
@@ -221,6 +793,8 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
   PYSQLITE_SC_CALL(res = sqlite3_prepare_v3(sc->db, utf8, utf8size + 1, options->prepare_flags, &vdbestatement, &tail));
   if (res != SQLITE_OK || PyErr_Occurred())
   {
+    if (sqlite_error)
+      *sqlite_error = !PyErr_Occurred();
     SET_EXC(res, sc->db);
     PYSQLITE_SC_CALL(sqlite3_finalize(vdbestatement));
     return res ? res : SQLITE_ERROR;
@@ -281,6 +855,8 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
   statement->query_size = tail - utf8;
   statement->utf8_size = utf8size;
   statement->uses = 1;
+  statement->plan = NULL;
+  statement->reprepares = 0;
   memcpy(&statement->options, options, sizeof(APSWStatementOptions));
 
   if (vdbestatement && tail == orig_tail && !statementcache_hasmore(statement))
@@ -299,18 +875,25 @@ statementcache_prepare_internal(StatementCache *sc, const char *utf8, Py_ssize_t
   if (!statement->utf8)
     statement->query_size = statement->utf8_size = 0;
 
+  if (sc->plan_monitor && hash != SC_SENTINEL_HASH)
+    statementcache_record_plan(sc, statement);
+
   *statement_out = statement;
   if (!vdbestatement)
     sc->no_vdbe++;
   return SQLITE_OK;
 }
 
+/* If literals is not NULL and auto parameterization applies, then
+   the statement is prepared with literals replaced by parameters and
+   literals is set to the values to bind */
 static APSWStatement *
-statementcache_prepare(StatementCache *sc, PyObject *query, APSWStatementOptions *options)
+statementcache_prepare(StatementCache *sc, PyObject *query, APSWStatementOptions *options, PyObject **literals)
 {
   const char *utf8 = NULL;
   Py_ssize_t utf8size = 0;
   APSWStatement *statement = NULL;
+  Py_hash_t hash = SC_SENTINEL_HASH;
   int res;
 
   assert(options->can_cache == 0 || options->can_cache == 1);
@@ -319,7 +902,56 @@ statementcache_prepare(StatementCache *sc, PyObject *query, APSWStatementOptions
   if (!utf8)
     return NULL;
 
-  res = statementcache_prepare_internal(sc, utf8, utf8size, query, &statement, options);
+  if (literals && sc->normalize && sc->maxentries && options->can_cache)
+  {
+    PyObject *normalized = NULL;
+    unsigned hits = sc->hits;
+
+    res = statementcache_normalize(sc, utf8, utf8size, &normalized, literals);
+    if (res < 0)
+      return NULL;
+    if (res)
+    {
+      const char *nutf8;
+      Py_ssize_t nutf8size;
+      int sqlite_error = 0;
+
+      nutf8 = PyUnicode_AsUTF8AndSize(normalized, &nutf8size);
+      res = nutf8 ? statementcache_prepare_internal(sc, nutf8, nutf8size, normalized, &statement, options,
+                                                    SC_SENTINEL_HASH, &sqlite_error)
+                  : SQLITE_ERROR;
+      Py_DECREF(normalized);
+      if (res == SQLITE_OK)
+      {
+        if (sc->hits != hits)
+          sc->normalized_hits++;
+        else
+          sc->normalized++;
+        return statement;
+      }
+      /* some literals can't be parameters so SQLite rejects the
+         query and the original is used instead.  Python exceptions
+         such as from an authorizer are reported */
+      Py_CLEAR(*literals);
+      if (!sqlite_error)
+        return NULL;
+      PyErr_Clear();
+    }
+  }
+
+  /* executing the same query object again is common so its hash is
+     remembered */
+  if (sc->maxentries && utf8size < SC_MAX_ITEM_SIZE && options->can_cache)
+  {
+    if (query != sc->last_query)
+    {
+      Py_XSETREF(sc->last_query, Py_NewRef(query));
+      sc->last_hash = statementcache_hash(utf8, utf8size);
+    }
+    hash = sc->last_hash;
+  }
+
+  res = statementcache_prepare_internal(sc, utf8, utf8size, query, &statement, options, hash, NULL);
   assert((res == SQLITE_OK && statement && !PyErr_Occurred()) || (res != SQLITE_OK && !statement));
   if (res)
     SET_EXC(res, sc->db);
@@ -338,7 +970,7 @@ statementcache_next(StatementCache *sc, APSWStatement **statement)
   assert(statementcache_hasmore(old));
 
   /* we have to prepare the new one ... */
-  res = statementcache_prepare_internal(sc, old->utf8 + old->query_size, old->utf8_size - old->query_size, old->query, &new, &old->options);
+  res = statementcache_prepare_internal(sc, old->utf8 + old->query_size, old->utf8_size - old->query_size, old->query, &new, &old->options, SC_SENTINEL_HASH, NULL);
   assert((res == SQLITE_OK && new) || (res != SQLITE_OK && !new));
 
   /* ... before finalizing the old */
@@ -371,6 +1003,7 @@ statementcache_free(StatementCache *sc)
         }
     }
     PyMem_Free(sc->caches);
+    Py_XDECREF(sc->last_query);
     PyMem_Free(sc);
   }
 }
@@ -409,7 +1042,7 @@ statementcache_stats(StatementCache *sc, int include_entries)
      update this */
   PyObject *res = NULL, *entries = NULL, *entry = NULL;
 
-  res = Py_BuildValue("{s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I}",
+  res = Py_BuildValue("{s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: I}",
                       "size", sc->maxentries,
                       "evictions", sc->evictions,
                       "no_cache", sc->no_cache,
@@ -418,6 +1051,10 @@ statementcache_stats(StatementCache *sc, int include_entries)
                       "misses", sc->misses,
                       "too_big", sc->too_big,
                       "no_cache", sc->no_cache,
+                      "reprepares", sc->reprepares,
+                      "plan_changes", sc->plan_changes,
+                      "normalized", sc->normalized,
+                      "normalized_hits", sc->normalized_hits,
                       "max_cacheable_bytes", SC_MAX_ITEM_SIZE);
   if (res && include_entries)
   {
@@ -432,12 +1069,13 @@ statementcache_stats(StatementCache *sc, int include_entries)
       if (sc->hashes[i] != SC_SENTINEL_HASH)
       {
         APSWStatement *stmt = sc->caches[i];
-        entry = Py_BuildValue("{s: s#, s: O, s: i, s: i, s: I}",
+        entry = Py_BuildValue("{s: s#, s: O, s: i, s: i, s: I, s: O}",
                               "query", stmt->utf8, stmt->query_size,
                               "has_more", (stmt->query_size == stmt->utf8_size) ? Py_False : Py_True,
                               "prepare_flags", stmt->options.prepare_flags,
                               "explain", stmt->options.explain,
-                              "uses", stmt->uses);
+                              "uses", stmt->uses,
+                              "plan", stmt->plan ? stmt->plan : Py_None);
         if (!entry)
           goto fail;
         pycres = PyList_Append(entries, entry);
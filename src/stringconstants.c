@@ -52,8 +52,10 @@ static struct _apsw_string_table
     PyObject *final;
     PyObject *get;
     PyObject *inverse;
+    PyObject *limit;
     PyObject *result;
     PyObject *step;
+    PyObject *usage;
     PyObject *value;
     PyObject *xAccess;
     PyObject *xCheckReservedLock;
@@ -134,8 +136,10 @@ fini_apsw_strings(void)
     Py_CLEAR(apst.final);
     Py_CLEAR(apst.get);
     Py_CLEAR(apst.inverse);
+    Py_CLEAR(apst.limit);
     Py_CLEAR(apst.result);
     Py_CLEAR(apst.step);
+    Py_CLEAR(apst.usage);
     Py_CLEAR(apst.value);
     Py_CLEAR(apst.xAccess);
     Py_CLEAR(apst.xCheckReservedLock);
@@ -171,7 +175,7 @@ fini_apsw_strings(void)
 static int
 init_apsw_strings()
 {
-    if ((0 == (apst.closed = PyUnicode_FromString("(closed)"))) || (0 == (apst.s_1e999 = PyUnicode_FromString("-1e999"))) || (0 == (apst.s0_0 = PyUnicode_FromString("0.0"))) || (0 == (apst.s1e999 = PyUnicode_FromString("1e999"))) || (0 == (apst.Begin = PyUnicode_FromString("Begin"))) || (0 == (apst.BestIndex = PyUnicode_FromString("BestIndex"))) || (0 == (apst.BestIndexObject = PyUnicode_FromString("BestIndexObject"))) || (0 == (apst.Close = PyUnicode_FromString("Close"))) || (0 == (apst.Column = PyUnicode_FromString("Column"))) || (0 == (apst.ColumnNoChange = PyUnicode_FromString("ColumnNoChange"))) || (0 == (apst.Commit = PyUnicode_FromString("Commit"))) || (0 == (apst.Connect = PyUnicode_FromString("Connect"))) || (0 == (apst.Create = PyUnicode_FromString("Create"))) || (0 == (apst.Destroy = PyUnicode_FromString("Destroy"))) || (0 == (apst.Disconnect = PyUnicode_FromString("Disconnect"))) || (0 == (apst.Eof = PyUnicode_FromString("Eof"))) || (0 == (apst.Filter = PyUnicode_FromString("Filter"))) || (0 == (apst.FindFunction = PyUnicode_FromString("FindFunction"))) || (0 == (apst.Integrity = PyUnicode_FromString("Integrity"))) || (0 == (apst.Mapping = PyUnicode_FromString("Mapping"))) || (0 == (apst.sNULL = PyUnicode_FromString("NULL"))) || (0 == (apst.Next = PyUnicode_FromString("Next"))) || (0 == (apst.Open = PyUnicode_FromString("Open"))) || (0 == (apst.Release = PyUnicode_FromString("Release"))) || (0 == (apst.Rename = PyUnicode_FromString("Rename"))) || (0 == (apst.Rollback = PyUnicode_FromString("Rollback"))) || (0 == (apst.RollbackTo = PyUnicode_FromString("RollbackTo"))) || (0 == (apst.Rowid = PyUnicode_FromString("Rowid"))) || (0 == (apst.Savepoint = PyUnicode_FromString("Savepoint"))) || (0 == (apst.ShadowName = PyUnicode_FromString("ShadowName"))) || (0 == (apst.Sync = PyUnicode_FromString("Sync"))) || (0 == (apst.UpdateChangeRow = PyUnicode_FromString("UpdateChangeRow"))) || (0 == (apst.UpdateDeleteRow = PyUnicode_FromString("UpdateDeleteRow"))) || (0 == (apst.UpdateInsertRow = PyUnicode_FromString("UpdateInsertRow"))) || (0 == (apst.add_note = PyUnicode_FromString("add_note"))) || (0 == (apst.close = PyUnicode_FromString("close"))) || (0 == (apst.connection_hooks = PyUnicode_FromString("connection_hooks"))) || (0 == (apst.cursor = PyUnicode_FromString("cursor"))) || (0 == (apst.error_offset = PyUnicode_FromString("error_offset"))) || (0 == (apst.excepthook = PyUnicode_FromString("excepthook"))) || (0 == (apst.execute = PyUnicode_FromString("execute"))) || (0 == (apst.executemany = PyUnicode_FromString("executemany"))) || (0 == (apst.extendedresult = PyUnicode_FromString("extendedresult"))) || (0 == (apst.final = PyUnicode_FromString("final"))) || (0 == (apst.get = PyUnicode_FromString("get"))) || (0 == (apst.inverse = PyUnicode_FromString("inverse"))) || (0 == (apst.result = PyUnicode_FromString("result"))) || (0 == (apst.step = PyUnicode_FromString("step"))) || (0 == (apst.value = PyUnicode_FromString("value"))) || (0 == (apst.xAccess = PyUnicode_FromString("xAccess"))) || (0 == (apst.xCheckReservedLock = PyUnicode_FromString("xCheckReservedLock"))) || (0 == (apst.xClose = PyUnicode_FromString("xClose"))) || (0 == (apst.xCurrentTime = PyUnicode_FromString("xCurrentTime"))) || (0 == (apst.xCurrentTimeInt64 = PyUnicode_FromString("xCurrentTimeInt64"))) || (0 == (apst.xDelete = PyUnicode_FromString("xDelete"))) || (0 == (apst.xDeviceCharacteristics = PyUnicode_FromString("xDeviceCharacteristics"))) || (0 == (apst.xDlClose = PyUnicode_FromString("xDlClose"))) || (0 == (apst.xDlError = PyUnicode_FromString("xDlError"))) || (0 == (apst.xDlOpen = PyUnicode_FromString("xDlOpen"))) || (0 == (apst.xDlSym = PyUnicode_FromString("xDlSym"))) || (0 == (apst.xFileControl = PyUnicode_FromString("xFileControl"))) || (0 == (apst.xFileSize = PyUnicode_FromString("xFileSize"))) || (0 == (apst.xFullPathname = PyUnicode_FromString("xFullPathname"))) || (0 == (apst.xGetLastError = PyUnicode_FromString("xGetLastError"))) || (0 == (apst.xGetSystemCall = PyUnicode_FromString("xGetSystemCall"))) || (0 == (apst.xLock = PyUnicode_FromString("xLock"))) || (0 == (apst.xNextSystemCall = PyUnicode_FromString("xNextSystemCall"))) || (0 == (apst.xOpen = PyUnicode_FromString("xOpen"))) || (0 == (apst.xRandomness = PyUnicode_FromString("xRandomness"))) || (0 == (apst.xRead = PyUnicode_FromString("xRead"))) || (0 == (apst.xSectorSize = PyUnicode_FromString("xSectorSize"))) || (0 == (apst.xSetSystemCall = PyUnicode_FromString("xSetSystemCall"))) || (0 == (apst.xSleep = PyUnicode_FromString("xSleep"))) || (0 == (apst.xSync = PyUnicode_FromString("xSync"))) || (0 == (apst.xTruncate = PyUnicode_FromString("xTruncate"))) || (0 == (apst.xUnlock = PyUnicode_FromString("xUnlock"))) || (0 == (apst.xWrite = PyUnicode_FromString("xWrite"))))
+    if ((0 == (apst.closed = PyUnicode_FromString("(closed)"))) || (0 == (apst.s_1e999 = PyUnicode_FromString("-1e999"))) || (0 == (apst.s0_0 = PyUnicode_FromString("0.0"))) || (0 == (apst.s1e999 = PyUnicode_FromString("1e999"))) || (0 == (apst.Begin = PyUnicode_FromString("Begin"))) || (0 == (apst.BestIndex = PyUnicode_FromString("BestIndex"))) || (0 == (apst.BestIndexObject = PyUnicode_FromString("BestIndexObject"))) || (0 == (apst.Close = PyUnicode_FromString("Close"))) || (0 == (apst.Column = PyUnicode_FromString("Column"))) || (0 == (apst.ColumnNoChange = PyUnicode_FromString("ColumnNoChange"))) || (0 == (apst.Commit = PyUnicode_FromString("Commit"))) || (0 == (apst.Connect = PyUnicode_FromString("Connect"))) || (0 == (apst.Create = PyUnicode_FromString("Create"))) || (0 == (apst.Destroy = PyUnicode_FromString("Destroy"))) || (0 == (apst.Disconnect = PyUnicode_FromString("Disconnect"))) || (0 == (apst.Eof = PyUnicode_FromString("Eof"))) || (0 == (apst.Filter = PyUnicode_FromString("Filter"))) || (0 == (apst.FindFunction = PyUnicode_FromString("FindFunction"))) || (0 == (apst.Integrity = PyUnicode_FromString("Integrity"))) || (0 == (apst.Mapping = PyUnicode_FromString("Mapping"))) || (0 == (apst.sNULL = PyUnicode_FromString("NULL"))) || (0 == (apst.Next = PyUnicode_FromString("Next"))) || (0 == (apst.Open = PyUnicode_FromString("Open"))) || (0 == (apst.Release = PyUnicode_FromString("Release"))) || (0 == (apst.Rename = PyUnicode_FromString("Rename"))) || (0 == (apst.Rollback = PyUnicode_FromString("Rollback"))) || (0 == (apst.RollbackTo = PyUnicode_FromString("RollbackTo"))) || (0 == (apst.Rowid = PyUnicode_FromString("Rowid"))) || (0 == (apst.Savepoint = PyUnicode_FromString("Savepoint"))) || (0 == (apst.ShadowName = PyUnicode_FromString("ShadowName"))) || (0 == (apst.Sync = PyUnicode_FromString("Sync"))) || (0 == (apst.UpdateChangeRow = PyUnicode_FromString("UpdateChangeRow"))) || (0 == (apst.UpdateDeleteRow = PyUnicode_FromString("UpdateDeleteRow"))) || (0 == (apst.UpdateInsertRow = PyUnicode_FromString("UpdateInsertRow"))) || (0 == (apst.add_note = PyUnicode_FromString("add_note"))) || (0 == (apst.close = PyUnicode_FromString("close"))) || (0 == (apst.connection_hooks = PyUnicode_FromString("connection_hooks"))) || (0 == (apst.cursor = PyUnicode_FromString("cursor"))) || (0 == (apst.error_offset = PyUnicode_FromString("error_offset"))) || (0 == (apst.excepthook = PyUnicode_FromString("excepthook"))) || (0 == (apst.execute = PyUnicode_FromString("execute"))) || (0 == (apst.executemany = PyUnicode_FromString("executemany"))) || (0 == (apst.extendedresult = PyUnicode_FromString("extendedresult"))) || (0 == (apst.final = PyUnicode_FromString("final"))) || (0 == (apst.get = PyUnicode_FromString("get"))) || (0 == (apst.inverse = PyUnicode_FromString("inverse"))) || (0 == (apst.limit = PyUnicode_FromString("limit"))) || (0 == (apst.result = PyUnicode_FromString("result"))) || (0 == (apst.step = PyUnicode_FromString("step"))) || (0 == (apst.usage = PyUnicode_FromString("usage"))) || (0 == (apst.value = PyUnicode_FromString("value"))) || (0 == (apst.xAccess = PyUnicode_FromString("xAccess"))) || (0 == (apst.xCheckReservedLock = PyUnicode_FromString("xCheckReservedLock"))) || (0 == (apst.xClose = PyUnicode_FromString("xClose"))) || (0 == (apst.xCurrentTime = PyUnicode_FromString("xCurrentTime"))) || (0 == (apst.xCurrentTimeInt64 = PyUnicode_FromString("xCurrentTimeInt64"))) || (0 == (apst.xDelete = PyUnicode_FromString("xDelete"))) || (0 == (apst.xDeviceCharacteristics = PyUnicode_FromString("xDeviceCharacteristics"))) || (0 == (apst.xDlClose = PyUnicode_FromString("xDlClose"))) || (0 == (apst.xDlError = PyUnicode_FromString("xDlError"))) || (0 == (apst.xDlOpen = PyUnicode_FromString("xDlOpen"))) || (0 == (apst.xDlSym = PyUnicode_FromString("xDlSym"))) || (0 == (apst.xFileControl = PyUnicode_FromString("xFileControl"))) || (0 == (apst.xFileSize = PyUnicode_FromString("xFileSize"))) || (0 == (apst.xFullPathname = PyUnicode_FromString("xFullPathname"))) || (0 == (apst.xGetLastError = PyUnicode_FromString("xGetLastError"))) || (0 == (apst.xGetSystemCall = PyUnicode_FromString("xGetSystemCall"))) || (0 == (apst.xLock = PyUnicode_FromString("xLock"))) || (0 == (apst.xNextSystemCall = PyUnicode_FromString("xNextSystemCall"))) || (0 == (apst.xOpen = PyUnicode_FromString("xOpen"))) || (0 == (apst.xRandomness = PyUnicode_FromString("xRandomness"))) || (0 == (apst.xRead = PyUnicode_FromString("xRead"))) || (0 == (apst.xSectorSize = PyUnicode_FromString("xSectorSize"))) || (0 == (apst.xSetSystemCall = PyUnicode_FromString("xSetSystemCall"))) || (0 == (apst.xSleep = PyUnicode_FromString("xSleep"))) || (0 == (apst.xSync = PyUnicode_FromString("xSync"))) || (0 == (apst.xTruncate = PyUnicode_FromString("xTruncate"))) || (0 == (apst.xUnlock = PyUnicode_FromString("xUnlock"))) || (0 == (apst.xWrite = PyUnicode_FromString("xWrite"))))
     {
         fini_apsw_strings();
         return -1;
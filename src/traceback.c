@@ -4,6 +4,43 @@
 #include "frameobject.h"
 #include "faultinject.h"
 
+/* apsw.augment_tracebacks sets this to zero to skip adding frames */
+static int augment_tracebacks = 1;
+
+/* Making the dummy code object is the most expensive part, so they
+   are kept in a small cache keyed by call site.  The function name is
+   compared too because a few callers use a formatted name. */
+#define TRACEBACK_CODE_CACHE_SIZE 128
+
+static struct
+{
+  const char *filename;
+  int lineno;
+  PyCodeObject *code;
+} traceback_code_cache[TRACEBACK_CODE_CACHE_SIZE];
+
+/* returns a new reference */
+static PyCodeObject *
+traceback_code(const char *filename, int lineno, const char *functionname)
+{
+  unsigned slot = ((unsigned)(uintptr_t)filename ^ ((unsigned)lineno * 2654435761u)) % TRACEBACK_CODE_CACHE_SIZE;
+
+  if (traceback_code_cache[slot].code && traceback_code_cache[slot].filename == filename
+      && traceback_code_cache[slot].lineno == lineno
+      && 0 == PyUnicode_CompareWithASCIIString(traceback_code_cache[slot].code->co_name, functionname))
+    return (PyCodeObject *)Py_NewRef((PyObject *)traceback_code_cache[slot].code);
+
+  PyCodeObject *code = PyCode_NewEmpty(filename, functionname, lineno);
+  if (!code)
+    return NULL;
+
+  Py_XDECREF(traceback_code_cache[slot].code);
+  traceback_code_cache[slot].filename = filename;
+  traceback_code_cache[slot].lineno = lineno;
+  traceback_code_cache[slot].code = (PyCodeObject *)Py_NewRef((PyObject *)code);
+  return code;
+}
+
 /* Add a dummy frame to the traceback so the developer has a better idea of what C code was doing
 
    @param filename: Use __FILE__ for this - it will be the filename reported in the frame
@@ -25,6 +62,9 @@ static void AddTraceBackHere(const char *filename, int lineno, const char *funct
   PyFrameObject *frame = 0;
   va_list localargsva;
 
+  if (!augment_tracebacks)
+    return;
+
   va_start(localargsva, localsformat);
 
   /* we have to save and restore the error indicators otherwise intermediate code has no effect! */
@@ -41,8 +81,8 @@ static void AddTraceBackHere(const char *filename, int lineno, const char *funct
   if (PyErr_Occurred())
     goto end;
 
-  /* make the dummy code object */
-  code = PyCode_NewEmpty(filename, functionname, lineno);
+  /* get the dummy code object */
+  code = traceback_code(filename, lineno, functionname);
   if (!code)
     goto end;
 
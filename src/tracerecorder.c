@@ -0,0 +1,810 @@
+/*
+  Binary trace recorder
+
+  See the accompanying LICENSE file.
+*/
+
+/**
+
+.. _tracerecorder:
+
+Trace Recorder
+**************
+
+A :class:`TraceRecorder` writes a compact binary record of the
+statements executed on the :class:`connections <Connection>` it is
+attached to via :meth:`Connection.set_trace_recorder`.  The recording
+is done in C directly from the SQLite `trace
+<https://sqlite.org/c3ref/trace_v2.html>`__ callbacks without
+acquiring the GIL, and without building any Python objects other than
+reading the bindings you supplied.  The overhead is low enough to
+leave on in production, unlike the Python level :ref:`tracers
+<tracing>`.
+
+The recording is written to a fixed size file that is memory mapped
+and used as a ring.  When it fills up the oldest records are
+overwritten.  Because the file is memory mapped, the records survive
+the process exiting or crashing.  Use :ref:`apsw.trace <apswtrace>`
+with ``--read`` to produce the usual reports from the file, or
+:func:`apsw.trace.read_trace_recording` to process the records
+yourself.
+
+The following is recorded:
+
+* The SQL text of each distinct statement, once per statement hash
+  while it remains in the ring
+* The bindings for each execution.  Strings and blobs longer than 4kb
+  are truncated.
+* A completed execution with the statement hash, start time, duration
+  in nanoseconds, rows returned and thread id.  Like
+  :meth:`Connection.set_profile` executions are only recorded when
+  they complete.
+* The connection being attached and detached
+
+*/
+
+/** .. class:: TraceRecorder
+
+  Records statement execution into a memory mapped ring file.
+*/
+
+#define TR_MAGIC "APSWTRC1"
+#define TR_VERSION 1
+#define TR_BYTEORDER 0x01020304u
+/* smallest file we will create */
+#define TR_MIN_SIZE 65536
+/* longest text or blob binding value that is recorded */
+#define TR_MAX_VALUE 4096
+/* concurrently executing statements tracked per connection for row counts */
+#define TR_ACTIVE_SLOTS 8
+
+/* record types */
+enum
+{
+  TR_PAD = 0,
+  TR_SQL = 1,
+  TR_OPEN = 2,
+  TR_CLOSE = 3,
+  TR_BIND = 4,
+  TR_EXEC = 5
+};
+
+/* binding value types */
+enum
+{
+  TRV_NULL = 0,
+  TRV_INT = 1,
+  TRV_FLOAT = 2,
+  TRV_TEXT = 3,
+  TRV_BLOB = 4,
+  TRV_ZEROBLOB = 5,
+  TRV_TRUNCATED = 0x80
+};
+
+/* start of the file - 64 bytes */
+typedef struct
+{
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t version;
+  sqlite3_uint64 data_size;   /* ring size following this header */
+  sqlite3_uint64 head;        /* logical offset of next record */
+  sqlite3_uint64 tail;        /* logical offset of oldest record */
+  sqlite3_uint64 records;     /* total records written */
+  sqlite3_uint64 overwritten; /* records lost to the ring wrapping */
+  sqlite3_uint64 reserved;
+} TraceRecorderHeader;
+
+/* each record starts with this, and is a multiple of 8 bytes long */
+typedef struct
+{
+  uint32_t length;
+  uint32_t type;
+} TraceRecordHeader;
+
+typedef struct TraceRecorder
+{
+  PyObject_HEAD
+      PyThread_type_lock lock;
+  TraceRecorderHeader *header; /* start of mapping, NULL when closed */
+  unsigned char *data;         /* ring following the header */
+  size_t size;                 /* size of mapping */
+  PyObject *filename;
+  sqlite3_uint64 next_connection_id;
+
+  /* open addressing set of statement hashes whose SQL is in the ring */
+  sqlite3_uint64 *sql_seen;
+  unsigned sql_seen_size;
+  unsigned sql_seen_used;
+
+#ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+
+  PyObject *weakreflist;
+  int init_was_called;
+} TraceRecorder;
+
+static PyTypeObject TraceRecorderType;
+static PyTypeObject ZeroBlobBindType;
+
+/* per connection state, owned by the Connection */
+typedef struct TraceRecorderAttachment
+{
+  TraceRecorder *recorder;
+  sqlite3_uint64 connection_id;
+  struct
+  {
+    sqlite3_stmt *stmt;
+    sqlite3_int64 start;
+    sqlite3_uint64 rows;
+  } active[TR_ACTIVE_SLOTS];
+  /* reused for encoding bindings */
+  unsigned char *bind_buf;
+  size_t bind_buf_size;
+} TraceRecorderAttachment;
+
+/* hash values 0 and 1 are used for empty and deleted in sql_seen */
+static sqlite3_uint64
+tracerecorder_hash(const char *sql)
+{
+  sqlite3_uint64 hash = 0xcbf29ce484222325ull;
+  const unsigned char *p = (const unsigned char *)sql;
+  while (*p)
+  {
+    hash ^= *p++;
+    hash *= 0x100000001b3ull;
+  }
+  return (hash < 2) ? hash + 2 : hash;
+}
+
+static sqlite3_int64
+tracerecorder_now(void)
+{
+#ifdef _WIN32
+  FILETIME ft;
+  ULARGE_INTEGER ul;
+  GetSystemTimePreciseAsFileTime(&ft);
+  ul.LowPart = ft.dwLowDateTime;
+  ul.HighPart = ft.dwHighDateTime;
+  /* 100ns units since 1601 */
+  return (sqlite3_int64)(ul.QuadPart - 116444736000000000ull) * 100;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (sqlite3_int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* returns non-zero if hash is in sql_seen, adding it if not and add
+   is set (when possible) */
+static int
+tracerecorder_sql_seen(TraceRecorder *rec, sqlite3_uint64 hash, int add)
+{
+  unsigned i, mask;
+
+  if (rec->sql_seen_used * 2 >= rec->sql_seen_size)
+  {
+    /* grow and drop deleted entries */
+    unsigned newsize = rec->sql_seen_size ? rec->sql_seen_size * 2 : 256, j;
+    sqlite3_uint64 *newseen = PyMem_RawCalloc(newsize, sizeof(sqlite3_uint64));
+    if (!newseen)
+      return 0;
+    rec->sql_seen_used = 0;
+    for (j = 0; j < rec->sql_seen_size; j++)
+    {
+      if (rec->sql_seen[j] < 2)
+        continue;
+      for (i = (unsigned)rec->sql_seen[j] & (newsize - 1); newseen[i]; i = (i + 1) & (newsize - 1))
+        ;
+      newseen[i] = rec->sql_seen[j];
+      rec->sql_seen_used++;
+    }
+    PyMem_RawFree(rec->sql_seen);
+    rec->sql_seen = newseen;
+    rec->sql_seen_size = newsize;
+  }
+
+  mask = rec->sql_seen_size - 1;
+  for (i = (unsigned)hash & mask; rec->sql_seen[i]; i = (i + 1) & mask)
+    if (rec->sql_seen[i] == hash)
+      return 1;
+  if (add)
+  {
+    rec->sql_seen[i] = hash;
+    rec->sql_seen_used++;
+  }
+  return 0;
+}
+
+static void
+tracerecorder_sql_forget(TraceRecorder *rec, sqlite3_uint64 hash)
+{
+  unsigned i, mask = rec->sql_seen_size - 1;
+
+  if (!rec->sql_seen)
+    return;
+  for (i = (unsigned)hash & mask; rec->sql_seen[i]; i = (i + 1) & mask)
+    if (rec->sql_seen[i] == hash)
+    {
+      /* deleted marker keeps probe chains intact */
+      rec->sql_seen[i] = 1;
+      return;
+    }
+}
+
+/* Reserves len bytes (a multiple of 8) in the ring, discarding the
+   oldest records as needed.  Returns where to write or NULL if the
+   record can't be recorded.  Lock must be held. */
+static unsigned char *
+tracerecorder_reserve(TraceRecorder *rec, uint32_t type, size_t len)
+{
+  TraceRecorderHeader *hdr = rec->header;
+  sqlite3_uint64 pos, size;
+  unsigned char *dest;
+  int pass;
+
+  assert(len % 8 == 0);
+
+  if (!hdr || len > hdr->data_size / 4)
+    return NULL;
+
+  size = hdr->data_size;
+
+  /* pass 0 pads out the end of the ring if needed, pass 1 makes room for the record */
+  for (pass = 0; pass < 2; pass++)
+  {
+    sqlite3_uint64 need = len;
+    pos = hdr->head % size;
+    if (pass == 0)
+    {
+      if (size - pos >= len)
+        continue;
+      need = size - pos;
+    }
+    while (hdr->head + need - hdr->tail > size)
+    {
+      TraceRecordHeader *old = (TraceRecordHeader *)(rec->data + hdr->tail % size);
+      if (old->type == TR_SQL)
+        tracerecorder_sql_forget(rec, *(sqlite3_uint64 *)(old + 1));
+      if (old->type != TR_PAD)
+        hdr->overwritten++;
+      hdr->tail += old->length;
+    }
+    if (pass == 0)
+    {
+      TraceRecordHeader *pad = (TraceRecordHeader *)(rec->data + pos);
+      pad->length = (uint32_t)need;
+      pad->type = TR_PAD;
+      hdr->head += need;
+    }
+  }
+
+  pos = hdr->head % size;
+  dest = rec->data + pos;
+  memset(dest, 0, len);
+  ((TraceRecordHeader *)dest)->length = (uint32_t)len;
+  ((TraceRecordHeader *)dest)->type = type;
+  hdr->head += len;
+  hdr->records++;
+  return dest + sizeof(TraceRecordHeader);
+}
+
+#define TR_ROUND8(n) (((n) + 7) & ~(size_t)7)
+
+/* writes a record consisting of nfixed 64 bit values followed by
+   optional variable length data, returning non-zero if it was
+   written.  Lock must be held */
+static int
+tracerecorder_write(TraceRecorder *rec, uint32_t type, const sqlite3_uint64 *fixed, size_t nfixed, const void *extra, size_t extralen)
+{
+  unsigned char *dest = tracerecorder_reserve(rec, type, sizeof(TraceRecordHeader) + nfixed * 8 + TR_ROUND8(extralen));
+  if (!dest)
+    return 0;
+  memcpy(dest, fixed, nfixed * 8);
+  if (extralen)
+    memcpy(dest + nfixed * 8, extra, extralen);
+  return 1;
+}
+
+/* writes the statement SQL unless already present in the ring.  Lock must be held */
+static void
+tracerecorder_write_sql(TraceRecorder *rec, sqlite3_uint64 hash, const char *sql)
+{
+  sqlite3_uint64 fixed[2];
+
+  if (tracerecorder_sql_seen(rec, hash, 0))
+    return;
+  fixed[0] = hash;
+  fixed[1] = strlen(sql);
+  /* only marked as seen once written so too large SQL is tried again */
+  if (tracerecorder_write(rec, TR_SQL, fixed, 2, sql, (size_t)fixed[1]))
+    tracerecorder_sql_seen(rec, hash, 1);
+}
+
+/* called from the SQLite trace callback with the database mutex
+   held and without the GIL */
+static void
+tracerecorder_event(TraceRecorderAttachment *att, unsigned code, void *one, void *two)
+{
+  sqlite3_stmt *stmt = (sqlite3_stmt *)one;
+  int i;
+
+  switch (code)
+  {
+  case SQLITE_TRACE_STMT:
+    /* each trigger subprogram starting is reported with its name as a
+       comment, but the statement is still the one running */
+    if (two && ((const char *)two)[0] == '-' && ((const char *)two)[1] == '-')
+      break;
+    for (i = 0; i < TR_ACTIVE_SLOTS; i++)
+      if (att->active[i].stmt == stmt || !att->active[i].stmt)
+        break;
+    /* all slots busy - reuse the first */
+    if (i == TR_ACTIVE_SLOTS)
+      i = 0;
+    att->active[i].stmt = stmt;
+    att->active[i].start = tracerecorder_now();
+    att->active[i].rows = 0;
+    break;
+
+  case SQLITE_TRACE_ROW:
+    for (i = 0; i < TR_ACTIVE_SLOTS; i++)
+      if (att->active[i].stmt == stmt)
+      {
+        att->active[i].rows++;
+        break;
+      }
+    break;
+
+  case SQLITE_TRACE_PROFILE:
+  {
+    TraceRecorder *rec = att->recorder;
+    const char *sql = sqlite3_sql(stmt);
+    sqlite3_uint64 fixed[6];
+    sqlite3_int64 now = tracerecorder_now();
+
+    fixed[0] = att->connection_id;
+    fixed[1] = tracerecorder_hash(sql ? sql : "");
+    fixed[2] = (sqlite3_uint64)PyThread_get_thread_ident();
+    /* SQLite's elapsed time only has millisecond resolution so we
+       prefer our own measurement from statement start */
+    fixed[3] = (sqlite3_uint64)(now - (sqlite3_int64)(*(sqlite3_uint64 *)two));
+    fixed[5] = 0;
+    for (i = 0; i < TR_ACTIVE_SLOTS; i++)
+      if (att->active[i].stmt == stmt)
+      {
+        fixed[3] = (sqlite3_uint64)att->active[i].start;
+        fixed[5] = att->active[i].rows;
+        att->active[i].stmt = NULL;
+        break;
+      }
+    fixed[4] = (sqlite3_uint64)(now - (sqlite3_int64)fixed[3]);
+
+    PyThread_acquire_lock(rec->lock, WAIT_LOCK);
+    tracerecorder_write_sql(rec, fixed[1], sql ? sql : "");
+    tracerecorder_write(rec, TR_EXEC, fixed, 6, NULL, 0);
+    PyThread_release_lock(rec->lock);
+    break;
+  }
+  }
+}
+
+/* appends one binding value to buf, returning the new offset or -1 if
+   the value can't be encoded */
+static Py_ssize_t
+tracerecorder_encode_value(unsigned char *buf, Py_ssize_t offset, PyObject *obj)
+{
+  unsigned char *p = buf + offset;
+
+  if (Py_IsNone(obj))
+  {
+    *p = TRV_NULL;
+    return offset + 1;
+  }
+  if (PyLong_Check(obj) || PyFloat_Check(obj) || PyObject_TypeCheck(obj, &ZeroBlobBindType))
+  {
+    if (PyFloat_Check(obj))
+    {
+      double d = PyFloat_AS_DOUBLE(obj);
+      *p = TRV_FLOAT;
+      memcpy(p + 1, &d, 8);
+    }
+    else
+    {
+      long long v = PyLong_Check(obj) ? PyLong_AsLongLong(obj) : ((ZeroBlobBind *)obj)->blobsize;
+      if (v == -1 && PyErr_Occurred())
+        return -1;
+      *p = PyLong_Check(obj) ? TRV_INT : TRV_ZEROBLOB;
+      memcpy(p + 1, &v, 8);
+    }
+    return offset + 9;
+  }
+  if (PyUnicode_Check(obj) || PyObject_CheckBuffer(obj))
+  {
+    Py_buffer buffer;
+    const char *data;
+    Py_ssize_t len;
+    uint32_t len32;
+    int is_text = PyUnicode_Check(obj);
+
+    if (is_text)
+      data = PyUnicode_AsUTF8AndSize(obj, &len);
+    else
+    {
+      if (PyObject_GetBufferContiguous(obj, &buffer, PyBUF_SIMPLE))
+        return -1;
+      data = buffer.buf;
+      len = buffer.len;
+    }
+    if (!data)
+      return -1;
+    *p = is_text ? TRV_TEXT : TRV_BLOB;
+    if (len > TR_MAX_VALUE)
+    {
+      *p |= TRV_TRUNCATED;
+      len = TR_MAX_VALUE;
+    }
+    len32 = (uint32_t)len;
+    memcpy(p + 1, &len32, 4);
+    memcpy(p + 5, data, len);
+    if (!is_text)
+      PyBuffer_Release(&buffer);
+    return offset + 5 + len;
+  }
+  return -1;
+}
+
+/* Records the bindings used for the next execution of stmt.  Called
+   with the GIL held after the bindings have been successfully
+   applied.  Problems are ignored because recording must not affect
+   execution. */
+static void
+tracerecorder_bindings(TraceRecorderAttachment *att, sqlite3_stmt *stmt, PyObject *bindings, int is_dict, Py_ssize_t offset, int nargs)
+{
+  TraceRecorder *rec = att->recorder;
+  Py_ssize_t used = 0;
+  sqlite3_uint64 fixed[3];
+  int arg;
+
+  if (!nargs || !rec->header)
+    return;
+
+  for (arg = 1; arg <= nargs; arg++)
+  {
+    PyObject *obj;
+
+    /* room for the largest possible encoding of a value */
+    if (att->bind_buf_size < (size_t)used + 5 + TR_MAX_VALUE)
+    {
+      size_t newsize = (size_t)used + 5 + TR_MAX_VALUE + att->bind_buf_size;
+      unsigned char *newbuf = PyMem_Realloc(att->bind_buf, newsize);
+      if (!newbuf)
+        goto error;
+      att->bind_buf = newbuf;
+      att->bind_buf_size = newsize;
+    }
+    if (is_dict)
+    {
+      const char *key = sqlite3_bind_parameter_name(stmt, arg);
+      obj = key ? PyMapping_GetItemString(bindings, key + 1) : NULL;
+      if (!obj)
+      {
+        /* missing dict bindings are allowed and bound as null */
+        PyErr_Clear();
+        obj = Py_NewRef(Py_None);
+      }
+    }
+    else
+      obj = Py_NewRef(PySequence_Fast_GET_ITEM(bindings, offset + arg - 1));
+    used = tracerecorder_encode_value(att->bind_buf, used, obj);
+    Py_DECREF(obj);
+    if (used < 0)
+      goto error;
+  }
+
+  fixed[0] = att->connection_id;
+  fixed[1] = tracerecorder_hash(sqlite3_sql(stmt));
+  fixed[2] = (sqlite3_uint64)nargs;
+  PyThread_acquire_lock(rec->lock, WAIT_LOCK);
+  tracerecorder_write(rec, TR_BIND, fixed, 3, att->bind_buf, (size_t)used);
+  PyThread_release_lock(rec->lock);
+  return;
+
+error:
+  PyErr_Clear();
+}
+
+/* returns new attachment or NULL with exception set */
+static TraceRecorderAttachment *
+tracerecorder_attach(TraceRecorder *rec, const char *filename)
+{
+  TraceRecorderAttachment *att = PyMem_Calloc(1, sizeof(TraceRecorderAttachment));
+  sqlite3_uint64 fixed[2];
+
+  if (!att)
+  {
+    PyErr_NoMemory();
+    return NULL;
+  }
+  att->recorder = (TraceRecorder *)Py_NewRef((PyObject *)rec);
+
+  PyThread_acquire_lock(rec->lock, WAIT_LOCK);
+  att->connection_id = ++rec->next_connection_id;
+  fixed[0] = att->connection_id;
+  fixed[1] = filename ? strlen(filename) : 0;
+  tracerecorder_write(rec, TR_OPEN, fixed, 2, filename, (size_t)fixed[1]);
+  PyThread_release_lock(rec->lock);
+
+  return att;
+}
+
+static void
+tracerecorder_detach(TraceRecorderAttachment *att)
+{
+  TraceRecorder *rec = att->recorder;
+
+  PyThread_acquire_lock(rec->lock, WAIT_LOCK);
+  tracerecorder_write(rec, TR_CLOSE, &att->connection_id, 1, NULL, 0);
+  PyThread_release_lock(rec->lock);
+
+  Py_DECREF((PyObject *)rec);
+  PyMem_Free(att->bind_buf);
+  PyMem_Free(att);
+}
+
+#define CHECK_RECORDER_CLOSED(e)                                                \
+  do                                                                            \
+  {                                                                             \
+    if (!self->header)                                                          \
+    {                                                                           \
+      PyErr_Format(PyExc_ValueError, "The trace recorder has been closed");     \
+      return e;                                                                 \
+    }                                                                           \
+  } while (0)
+
+static void
+TraceRecorder_close_internal(TraceRecorder *self)
+{
+  if (self->lock)
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+  if (self->header)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(self->header);
+#else
+    munmap(self->header, self->size);
+#endif
+  }
+  self->header = NULL;
+  self->data = NULL;
+#ifdef _WIN32
+  if (self->mapping)
+    CloseHandle(self->mapping);
+  if (self->file != INVALID_HANDLE_VALUE)
+    CloseHandle(self->file);
+  self->mapping = NULL;
+  self->file = INVALID_HANDLE_VALUE;
+#else
+  if (self->fd >= 0)
+    close(self->fd);
+  self->fd = -1;
+#endif
+  PyMem_RawFree(self->sql_seen);
+  self->sql_seen = NULL;
+  self->sql_seen_size = self->sql_seen_used = 0;
+  if (self->lock)
+    PyThread_release_lock(self->lock);
+}
+
+static void
+TraceRecorder_dealloc(TraceRecorder *self)
+{
+  APSW_CLEAR_WEAKREFS;
+  TraceRecorder_close_internal(self);
+  if (self->lock)
+    PyThread_free_lock(self->lock);
+  Py_CLEAR(self->filename);
+  Py_TpFree((PyObject *)self);
+}
+
+static PyObject *
+TraceRecorder_new(PyTypeObject *type, PyObject *Py_UNUSED(args), PyObject *Py_UNUSED(kwds))
+{
+  TraceRecorder *self = (TraceRecorder *)type->tp_alloc(type, 0);
+  if (self)
+  {
+    self->lock = NULL;
+    self->header = NULL;
+    self->data = NULL;
+    self->size = 0;
+    self->filename = NULL;
+    self->next_connection_id = 0;
+    self->sql_seen = NULL;
+    self->sql_seen_size = 0;
+    self->sql_seen_used = 0;
+#ifdef _WIN32
+    self->file = INVALID_HANDLE_VALUE;
+    self->mapping = NULL;
+#else
+    self->fd = -1;
+#endif
+    self->weakreflist = NULL;
+    self->init_was_called = 0;
+  }
+  return (PyObject *)self;
+}
+
+/** .. method:: __init__(filename: str, size: int = 16777216)
+
+  Creates (or truncates) *filename* and memory maps it as the ring.
+
+  :param filename: File to record into
+  :param size: Size of the file in bytes.  It is rounded up to a multiple
+     of 8 and has a minimum of 64kb.  Larger sizes keep more history.
+
+  .. seealso::
+
+    * :meth:`Connection.set_trace_recorder`
+    * :func:`apsw.trace.read_trace_recording`
+*/
+static int
+TraceRecorder_init(TraceRecorder *self, PyObject *args, PyObject *kwargs)
+{
+  const char *filename = NULL;
+  long long size = 16777216;
+  void *map = NULL;
+
+  {
+    TraceRecorder_init_CHECK;
+    PREVENT_INIT_MULTIPLE_CALLS;
+    ARG_CONVERT_VARARGS_TO_FASTCALL;
+    ARG_PROLOG(2, TraceRecorder_init_KWNAMES);
+    ARG_MANDATORY ARG_str(filename);
+    ARG_OPTIONAL ARG_int64(size);
+    ARG_EPILOG(-1, TraceRecorder_init_USAGE, Py_XDECREF(fast_kwnames));
+  }
+
+  if (size < TR_MIN_SIZE)
+    size = TR_MIN_SIZE;
+  size = (long long)TR_ROUND8((size_t)size);
+
+  self->lock = PyThread_allocate_lock();
+  if (!self->lock)
+  {
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  self->filename = PyUnicode_FromString(filename);
+  if (!self->filename)
+    return -1;
+
+#ifdef _WIN32
+  {
+    wchar_t *wfilename = PyUnicode_AsWideCharString(self->filename, NULL);
+    LARGE_INTEGER li;
+    if (!wfilename)
+      return -1;
+    Py_BEGIN_ALLOW_THREADS;
+    self->file = CreateFileW(wfilename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    li.QuadPart = size;
+    if (self->file != INVALID_HANDLE_VALUE)
+      self->mapping = CreateFileMappingW(self->file, NULL, PAGE_READWRITE, li.HighPart, li.LowPart, NULL);
+    if (self->mapping)
+      map = MapViewOfFile(self->mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+    Py_END_ALLOW_THREADS;
+    PyMem_Free(wfilename);
+    if (!map)
+    {
+      PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, self->filename);
+      TraceRecorder_close_internal(self);
+      return -1;
+    }
+  }
+#else
+  Py_BEGIN_ALLOW_THREADS;
+  self->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (self->fd >= 0 && ftruncate(self->fd, (off_t)size) == 0)
+  {
+    map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+    if (map == MAP_FAILED)
+      map = NULL;
+  }
+  Py_END_ALLOW_THREADS;
+  if (!map)
+  {
+    PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, self->filename);
+    TraceRecorder_close_internal(self);
+    return -1;
+  }
+#endif
+
+  self->size = (size_t)size;
+  self->header = (TraceRecorderHeader *)map;
+  self->data = (unsigned char *)map + sizeof(TraceRecorderHeader);
+  memset(self->header, 0, sizeof(TraceRecorderHeader));
+  memcpy(self->header->magic, TR_MAGIC, 8);
+  self->header->byteorder = TR_BYTEORDER;
+  self->header->version = TR_VERSION;
+  self->header->data_size = self->size - sizeof(TraceRecorderHeader);
+
+  return 0;
+}
+
+/** .. method:: close() -> None
+
+  Stops recording and unmaps the file.  Connections still attached
+  silently stop recording.  It is ok to call this method multiple
+  times.
+*/
+static PyObject *
+TraceRecorder_close(TraceRecorder *self)
+{
+  TraceRecorder_close_internal(self);
+  Py_RETURN_NONE;
+}
+
+/** .. method:: stats() -> dict[str, int]
+
+  Returns a dictionary with the *size* of the ring, bytes *used*,
+  number of *records* written, and how many have been *overwritten*
+  because the ring wrapped.
+*/
+static PyObject *
+TraceRecorder_stats(TraceRecorder *self)
+{
+  PyObject *res;
+
+  CHECK_RECORDER_CLOSED(NULL);
+
+  PyThread_acquire_lock(self->lock, WAIT_LOCK);
+  res = Py_BuildValue("{s: K, s: K, s: K, s: K}",
+                      "size", self->header->data_size,
+                      "used", self->header->head - self->header->tail,
+                      "records", self->header->records,
+                      "overwritten", self->header->overwritten);
+  PyThread_release_lock(self->lock);
+  return res;
+}
+
+static PyObject *
+TraceRecorder_tp_str(TraceRecorder *self)
+{
+  return PyUnicode_FromFormat("<apsw.TraceRecorder object \"%S\"%s at %p>",
+                              self->filename ? self->filename : apst.closed,
+                              self->header ? "" : " (closed)", self);
+}
+
+/** .. attribute:: filename
+  :type: str
+
+  The file being recorded into.
+*/
+static PyMemberDef TraceRecorder_members[] = {
+    /* name type offset flags doc */
+    {"filename", T_OBJECT, offsetof(TraceRecorder, filename), READONLY, TraceRecorder_filename_DOC},
+    {0, 0, 0, 0, 0}};
+
+static PyMethodDef TraceRecorder_methods[] = {
+    {"close", (PyCFunction)TraceRecorder_close, METH_NOARGS, TraceRecorder_close_DOC},
+    {"stats", (PyCFunction)TraceRecorder_stats, METH_NOARGS, TraceRecorder_stats_DOC},
+    {0, 0, 0, 0}};
+
+static PyTypeObject TraceRecorderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+        .tp_name = "apsw.TraceRecorder",
+    .tp_basicsize = sizeof(TraceRecorder),
+    .tp_dealloc = (destructor)TraceRecorder_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = TraceRecorder_class_DOC,
+    .tp_weaklistoffset = offsetof(TraceRecorder, weakreflist),
+    .tp_methods = TraceRecorder_methods,
+    .tp_members = TraceRecorder_members,
+    .tp_init = (initproc)TraceRecorder_init,
+    .tp_new = TraceRecorder_new,
+    .tp_str = (reprfunc)TraceRecorder_tp_str,
+};
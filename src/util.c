@@ -253,6 +253,53 @@ finally:
   PyErr_Clear(); /* being paranoid - make sure no errors on return */
 }
 
+/* Returns non-zero if there are no bytes with the top bit set, checking
+   16 bytes at a time where vector instructions are available */
+static int
+apsw_is_ascii(const char *data, size_t len)
+{
+  size_t i = 0;
+  uint64_t word;
+
+#if defined(APSW_USE_SSE2)
+  for (; i + 16 <= len; i += 16)
+    if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i))))
+      return 0;
+#elif defined(APSW_USE_NEON)
+  for (; i + 16 <= len; i += 16)
+    if (vmaxvq_u8(vld1q_u8((const uint8_t *)(data + i))) & 0x80)
+      return 0;
+#endif
+  for (; i + 8 <= len; i += 8)
+  {
+    memcpy(&word, data + i, sizeof(word));
+    if (word & 0x8080808080808080ULL)
+      return 0;
+  }
+  for (; i < len; i++)
+    if ((unsigned char)data[i] & 0x80)
+      return 0;
+  return 1;
+}
+
+/* Makes a str from SQLite text.  ASCII (most text) is copied directly
+   into a compact string skipping the UTF-8 decoder. */
+static PyObject *
+convert_text_to_pyobject(const char *data, size_t len)
+{
+#include "faultinject.h"
+
+  PyObject *res;
+
+  if (len > PY_SSIZE_T_MAX || !apsw_is_ascii(data, len))
+    return PyUnicode_FromStringAndSize(data, len);
+
+  res = PyUnicode_New(len, 127);
+  if (res)
+    memcpy(PyUnicode_DATA(res), data, len);
+  return res;
+}
+
 #undef convert_value_to_pyobject
 /* Converts sqlite3_value to PyObject.  Returns a new reference. */
 static PyObject *
@@ -279,7 +326,7 @@ convert_value_to_pyobject(sqlite3_value *value, int in_constraint_possible, int
 
   case SQLITE_TEXT:
     assert(sqlite3_value_text(value));
-    return PyUnicode_FromStringAndSize((const char *)sqlite3_value_text(value), sqlite3_value_bytes(value));
+    return convert_text_to_pyobject((const char *)sqlite3_value_text(value), sqlite3_value_bytes(value));
 
   default:
   case SQLITE_NULL:
@@ -325,16 +372,21 @@ convert_value_to_pyobject_not_in(sqlite3_value *value)
 
 /* Converts column to PyObject.  Returns a new reference. Almost identical to above
    but we cannot just use sqlite3_column_value and then call the above function as
-   SQLite doesn't allow that ("unprotected values") */
+   SQLite doesn't allow that ("unprotected values").  If convert_json is set then
+   JSON text and JSONB are parsed into Python objects */
 #undef convert_column_to_pyobject
 static PyObject *
-convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
+convert_column_to_pyobject(sqlite3_stmt *stmt, int col, int convert_json)
 {
 #include "faultinject.h"
-  int coltype;
+  int coltype, isjson = 0;
 
   _PYSQLITE_CALL_V(coltype = sqlite3_column_type(stmt, col));
 
+  if (convert_json && (coltype == SQLITE_TEXT || coltype == SQLITE_BLOB))
+    _PYSQLITE_CALL_V(isjson = json_is_decltype(sqlite3_column_decltype(stmt, col))
+                              || (coltype == SQLITE_TEXT && sqlite3_value_subtype(sqlite3_column_value(stmt, col)) == JSON_SUBTYPE));
+
   switch (coltype)
   {
   case SQLITE_INTEGER:
@@ -355,7 +407,9 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
     const char *data;
     size_t len;
     _PYSQLITE_CALL_V((data = (const char *)sqlite3_column_text(stmt, col), len = sqlite3_column_bytes(stmt, col)));
-    return PyUnicode_FromStringAndSize(data, len);
+    if (isjson)
+      return json_decode_text(data, len);
+    return convert_text_to_pyobject(data, len);
   }
 
   default:
@@ -367,6 +421,8 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
     const void *data;
     size_t len;
     _PYSQLITE_CALL_V((data = sqlite3_column_blob(stmt, col), len = sqlite3_column_bytes(stmt, col)));
+    if (isjson)
+      return json_decode_jsonb(data, len);
     return PyBytes_FromStringAndSize(data, len);
   }
   }
@@ -414,6 +470,66 @@ convert_column_to_pyobject(sqlite3_stmt *stmt, int col)
   } while (0)
 
 #undef apsw_strdup
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+/* Returns a list of dicts, one per query plan element, with the
+   scan status counters.  Used by Cursor.scanstatus and trace_v2 */
+static PyObject *
+apsw_scanstatus(sqlite3_stmt *stmt)
+{
+  PyObject *res = PyList_New(0), *item;
+  int idx, id, parent;
+  sqlite3_int64 loops, visits, cycles;
+  double estimate;
+  const char *name, *explain;
+
+#define SS(op, out) sqlite3_stmt_scanstatus_v2(stmt, idx, op, SQLITE_SCANSTAT_COMPLEX, (void *)out)
+
+  for (idx = 0; res; idx++)
+  {
+    if (SS(SQLITE_SCANSTAT_SELECTID, &id))
+      break;
+    loops = visits = cycles = 0;
+    estimate = 0;
+    parent = 0;
+    name = explain = NULL;
+    SS(SQLITE_SCANSTAT_PARENTID, &parent);
+    SS(SQLITE_SCANSTAT_NLOOP, &loops);
+    SS(SQLITE_SCANSTAT_NVISIT, &visits);
+    SS(SQLITE_SCANSTAT_EST, &estimate);
+    SS(SQLITE_SCANSTAT_NCYCLE, &cycles);
+    SS(SQLITE_SCANSTAT_NAME, &name);
+    SS(SQLITE_SCANSTAT_EXPLAIN, &explain);
+
+    item = Py_BuildValue("{s: i, s: i, s: L, s: L, s: d, s: L, s: s, s: s}", "id", id, "parent", parent, "loops", loops,
+                         "visits", visits, "estimated_rows", estimate, "cycles", cycles, "name", name, "explain",
+                         explain);
+    if (!item || PyList_Append(res, item))
+      Py_CLEAR(res);
+    Py_XDECREF(item);
+  }
+#undef SS
+  return res;
+}
+#endif
+
+/* Monotonic clock in nanoseconds for measuring waits */
+static long long
+apsw_monotonic_ns(void)
+{
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER count;
+  if (!freq.QuadPart)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (long long)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 /* This adds double nulls on the end - needed if string is a filename
    used near vfs as SQLite puts extra info after the first null */
 static char *apsw_strdup(const char *source)
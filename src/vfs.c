@@ -314,6 +314,7 @@ static PyTypeObject APSWURIFilenameType;
 
 static const struct sqlite3_io_methods apsw_io_methods_v1;
 static const struct sqlite3_io_methods apsw_io_methods_v2;
+static const struct sqlite3_io_methods apsw_io_methods_v3;
 
 typedef struct
 {
@@ -606,6 +607,20 @@ apswvfspy_xFullPathname(APSWVFS *self, PyObject *const *fast_args, Py_ssize_t fa
   return result;
 }
 
+/* Returns non-zero if the class of file has not overridden name */
+static int
+apswvfsfile_inherits(PyObject *file, PyObject *name)
+{
+  PyObject *method = PyObject_GetAttr((PyObject *)Py_TYPE(file), name);
+  PyObject *base = PyObject_GetAttr((PyObject *)&APSWVFSFileType, name);
+  int res = method && method == base;
+
+  Py_XDECREF(method);
+  Py_XDECREF(base);
+  PyErr_Clear();
+  return res;
+}
+
 static int
 apswvfs_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int inflags, int *pOutFlags)
 {
@@ -663,13 +678,20 @@ apswvfs_xOpen(sqlite3_vfs *vfs, const char *zName, sqlite3_file *file, int infla
   /* If we are inheriting from another file object, and that file
      object supports version 2 io_methods (Shm* family of functions)
      then we need to allocate an io_methods dupe of our own and fill
-     in their shm methods. */
+     in their shm methods.  Version 3 adds memory mapped reads
+     (xFetch/xUnfetch) which are passed through too, but only if
+     xRead and xWrite have not been overridden in Python because the
+     mapped pages would bypass them. */
   if (PyObject_IsInstance(pyresult, (PyObject *)&APSWVFSFileType))
   {
     APSWVFSFile *f = (APSWVFSFile *)pyresult;
     if (!f->base || !f->base->pMethods || !f->base->pMethods->xShmMap)
       goto version1;
-    apswfile->pMethods = &apsw_io_methods_v2;
+    if (f->base->pMethods->iVersion >= 3 && f->base->pMethods->xFetch && f->base->pMethods->xUnfetch
+        && apswvfsfile_inherits(pyresult, apst.xRead) && apswvfsfile_inherits(pyresult, apst.xWrite))
+      apswfile->pMethods = &apsw_io_methods_v3;
+    else
+      apswfile->pMethods = &apsw_io_methods_v2;
   }
   else
   {
@@ -1956,6 +1978,11 @@ static int is_apsw_vfs(sqlite3_vfs *vfs)
     if you want the file object returned from :meth:`VFS.xOpen` to
     inherit from an existing VFS implementation.
 
+    If your class does not override :meth:`~VFSFile.xRead` and
+    :meth:`~VFSFile.xWrite` then `memory mapped I/O
+    <https://sqlite.org/mmap.html>`__ is passed through to the
+    inherited file when enabled with ``pragma mmap_size``.
+
 */
 
 /** .. method:: excepthook(etype: type[BaseException], evalue: BaseException, etraceback: Optional[types.TracebackType]) ->None
@@ -2953,6 +2980,20 @@ apswproxyxShmUnmap(sqlite3_file *file, int deleteFlag)
   return f->base->pMethods->xShmUnmap(f->base, deleteFlag);
 }
 
+static int
+apswproxyxFetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **pp)
+{
+  APSWPROXYBASE;
+  return f->base->pMethods->xFetch(f->base, offset, amount, pp);
+}
+
+static int
+apswproxyxUnfetch(sqlite3_file *file, sqlite3_int64 offset, void *p)
+{
+  APSWPROXYBASE;
+  return f->base->pMethods->xUnfetch(f->base, offset, p);
+}
+
 static const struct sqlite3_io_methods apsw_io_methods_v1 =
     {
         1,                                  /* version */
@@ -2995,6 +3036,29 @@ static const struct sqlite3_io_methods apsw_io_methods_v2 =
         apswproxyxShmUnmap                  /* shmunmap */
 };
 
+static const struct sqlite3_io_methods apsw_io_methods_v3 =
+    {
+        3,                                  /* version */
+        apswvfsfile_xClose,                 /* close */
+        apswvfsfile_xRead,                  /* read */
+        apswvfsfile_xWrite,                 /* write */
+        apswvfsfile_xTruncate,              /* truncate */
+        apswvfsfile_xSync,                  /* sync */
+        apswvfsfile_xFileSize,              /* filesize */
+        apswvfsfile_xLock,                  /* lock */
+        apswvfsfile_xUnlock,                /* unlock */
+        apswvfsfile_xCheckReservedLock,     /* checkreservedlock */
+        apswvfsfile_xFileControl,           /* filecontrol */
+        apswvfsfile_xSectorSize,            /* sectorsize */
+        apswvfsfile_xDeviceCharacteristics, /* device characteristics */
+        apswproxyxShmMap,                   /* shmmap */
+        apswproxyxShmLock,                  /* shmlock */
+        apswproxyxShmBarrier,               /* shmbarrier */
+        apswproxyxShmUnmap,                 /* shmunmap */
+        apswproxyxFetch,                    /* fetch */
+        apswproxyxUnfetch                   /* unfetch */
+};
+
 static PyMethodDef APSWVFSFile_methods[] = {
     {"xRead", (PyCFunction)apswvfsfilepy_xRead, METH_FASTCALL | METH_KEYWORDS, VFSFile_xRead_DOC},
     {"xUnlock", (PyCFunction)apswvfsfilepy_xUnlock, METH_FASTCALL | METH_KEYWORDS, VFSFile_xUnlock_DOC},
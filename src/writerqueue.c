@@ -0,0 +1,240 @@
+/*
+  In process writer queue
+
+  See the accompanying LICENSE file.
+*/
+
+/* SQLite only allows one writer per database at a time.  When several
+   connections in the same process want to write, the losers get
+   SQLITE_BUSY and then sleep and retry in the busy handler.  The
+   sleeps mean the database can sit idle after a commit while
+   waiters are still sleeping, and there is no fairness - a waiter can
+   lose every race.
+
+   The writer queue is an in process lock per database file.  A
+   connection acquires it before running its first statement that
+   writes, and releases it when the write transaction ends.  Waiters
+   are kept in first come first served order, and ownership is handed
+   directly to the head waiter on release, which wakes it immediately.
+
+   Files are identified by the main database filename as returned by
+   sqlite3_db_filename, which is the full pathname from the VFS.
+
+   All the data structures are only read and modified while holding
+   the GIL, so no additional locking is needed.  Each waiter has its
+   own lock it blocks on with the GIL released.
+*/
+
+typedef struct WriterQueue WriterQueue;
+
+typedef struct WriterQueueWaiter
+{
+  PyThread_type_lock lock;
+  WriterQueue *wq;
+  int granted;
+  struct WriterQueueWaiter *next;
+} WriterQueueWaiter;
+
+typedef struct WriterQueueFile
+{
+  char *filename;
+  int refcount;
+  WriterQueue *owner;
+  WriterQueueWaiter *head, *tail;
+  struct WriterQueueFile *next;
+} WriterQueueFile;
+
+/* one per connection that has the queue enabled */
+struct WriterQueue
+{
+  WriterQueueFile *file;
+  int owned;
+  /* microseconds */
+  long long timeout;
+
+  /* statistics */
+  long long acquired;
+  long long waited;
+  long long timeouts;
+  long long wait_ns;
+  long long max_wait_ns;
+};
+
+static WriterQueueFile *writerqueue_files;
+
+/* Returns a new queue handle for filename, or NULL with an exception set */
+static WriterQueue *
+writerqueue_new(const char *filename, int milliseconds)
+{
+  WriterQueueFile *file;
+  WriterQueue *wq = PyMem_Calloc(1, sizeof(WriterQueue));
+  if (!wq)
+  {
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  for (file = writerqueue_files; file; file = file->next)
+    if (0 == strcmp(file->filename, filename))
+      break;
+
+  if (!file)
+  {
+    file = PyMem_Calloc(1, sizeof(WriterQueueFile));
+    if (file)
+      file->filename = apsw_strdup(filename);
+    if (!file || !file->filename)
+    {
+      PyMem_Free(file);
+      PyMem_Free(wq);
+      PyErr_NoMemory();
+      return NULL;
+    }
+    file->next = writerqueue_files;
+    writerqueue_files = file;
+  }
+
+  file->refcount++;
+  wq->file = file;
+  wq->timeout = (long long)milliseconds * 1000;
+  if (wq->timeout > PY_TIMEOUT_MAX)
+    wq->timeout = PY_TIMEOUT_MAX;
+  return wq;
+}
+
+/* Gives the queue to the next waiter if any */
+static void
+writerqueue_release(WriterQueue *wq)
+{
+  WriterQueueFile *file = wq->file;
+  WriterQueueWaiter *waiter = file->head;
+
+  assert(wq->owned && file->owner == wq);
+  wq->owned = 0;
+  file->owner = NULL;
+
+  if (waiter)
+  {
+    file->head = waiter->next;
+    if (!file->head)
+      file->tail = NULL;
+    file->owner = waiter->wq;
+    waiter->wq->owned = 1;
+    waiter->granted = 1;
+    PyThread_release_lock(waiter->lock);
+  }
+}
+
+/* Waits for the queue in first come first served order.  If the
+   timeout expires then it returns without owning the queue, and SQLite
+   busy handling takes over as though there was no queue.  Returns -1
+   with an exception set on failure */
+static int
+writerqueue_acquire(WriterQueue *wq)
+{
+  WriterQueueFile *file = wq->file;
+  WriterQueueWaiter waiter, **pw;
+  long long start, elapsed;
+
+  assert(!wq->owned);
+
+  if (!file->owner)
+  {
+    file->owner = wq;
+    wq->owned = 1;
+    wq->acquired++;
+    return 0;
+  }
+
+  waiter.lock = PyThread_allocate_lock();
+  if (!waiter.lock)
+  {
+    PyErr_NoMemory();
+    return -1;
+  }
+  /* take it so the wait below blocks until the owner releases it */
+  PyThread_acquire_lock(waiter.lock, WAIT_LOCK);
+  waiter.wq = wq;
+  waiter.granted = 0;
+  waiter.next = NULL;
+  if (file->tail)
+    file->tail->next = &waiter;
+  else
+    file->head = &waiter;
+  file->tail = &waiter;
+
+  start = apsw_monotonic_ns();
+  Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock_timed(waiter.lock, (PY_TIMEOUT_T)wq->timeout, 0);
+  Py_END_ALLOW_THREADS;
+  elapsed = apsw_monotonic_ns() - start;
+
+  /* granted is only changed with the GIL held, so this check is
+     reliable even if the timeout and the release raced */
+  if (!waiter.granted)
+  {
+    WriterQueueWaiter *prev = NULL;
+    for (pw = &file->head; *pw != &waiter; pw = &(*pw)->next)
+      prev = *pw;
+    *pw = waiter.next;
+    if (file->tail == &waiter)
+      file->tail = prev;
+    wq->timeouts++;
+  }
+  else
+    wq->acquired++;
+
+  PyThread_free_lock(waiter.lock);
+
+  wq->waited++;
+  wq->wait_ns += elapsed;
+  if (elapsed > wq->max_wait_ns)
+    wq->max_wait_ns = elapsed;
+  return 0;
+}
+
+/* Releases the queue if the connection no longer has a write transaction */
+static void
+writerqueue_update(WriterQueue *wq, sqlite3 *db)
+{
+  int state;
+
+  if (!wq || !wq->owned)
+    return;
+  _PYSQLITE_CALL_V(state = sqlite3_txn_state(db, NULL));
+  if (state != SQLITE_TXN_WRITE)
+    writerqueue_release(wq);
+}
+
+static void
+writerqueue_free(WriterQueue *wq)
+{
+  WriterQueueFile *file, **pf;
+
+  if (!wq)
+    return;
+  file = wq->file;
+  if (wq->owned)
+    writerqueue_release(wq);
+  if (0 == --file->refcount)
+  {
+    assert(!file->head && !file->owner);
+    for (pf = &writerqueue_files; *pf != file; pf = &(*pf)->next)
+      ;
+    *pf = file->next;
+    PyMem_Free(file->filename);
+    PyMem_Free(file);
+  }
+  PyMem_Free(wq);
+}
+
+static PyObject *
+writerqueue_stats(WriterQueue *wq)
+{
+  WriterQueue empty = {0};
+
+  if (!wq)
+    wq = &empty;
+  return Py_BuildValue("{s: L, s: L, s: L, s: L, s: L}", "acquired", wq->acquired, "waited", wq->waited, "timeouts",
+                       wq->timeouts, "wait_ns", wq->wait_ns, "max_wait_ns", wq->max_wait_ns);
+}
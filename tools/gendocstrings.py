@@ -387,6 +387,12 @@ type_overrides = {
     "Connection.drop_modules": {
         "keep": "PyObject"
     },
+    "carray.__init__": {
+        "values": "PyObject"
+    },
+    "Connection.set_authorizer_rules": {
+        "rules": "PyObject"
+    },
     "Connection.file_control": {
         "pointer": "pointer"
     },
@@ -396,6 +402,18 @@ type_overrides = {
     "Connection.set_last_insert_rowid": {
         "rowid": "int64"
     },
+    "Connection.execute_cached": {
+        "statements": "strtype"
+    },
+    "Connection.set_result_cache": {
+        "max_entries": "int64",
+        "max_bytes": "int64"
+    },
+    "Connection.set_statement_limits": {
+        "vm_steps": "int64",
+        "memory": "int64",
+        "rows": "int64"
+    },
     "Cursor.execute": {
         "statements": "strtype"
     },
@@ -403,6 +421,9 @@ type_overrides = {
         "statements": "strtype",
         "sequenceofbindings": "Sequence"
     },
+    "TraceRecorder.__init__": {
+        "size": "int64"
+    },
     "URIFilename.uri_int": {
         "default": "int64",
     },
@@ -541,6 +562,11 @@ def do_argparse(item):
                 except ValueError:
                     val = param['default'].replace("apsw.", "")
                 default_check = f"{ pname } == ({ val })"
+        elif param["type"] == "float":
+            type = "double"
+            kind = "double"
+            if param["default"]:
+                default_check = f"{ pname } == { float(param['default']) }"
         elif param["type"] == "int64":
             type = "long long"
             kind = "int64"
@@ -623,6 +649,12 @@ def do_argparse(item):
             if param["default"]:
                 breakpoint()
                 pass
+        elif param["type"] == "Optional[TraceRecorder]":
+            type = "TraceRecorder *"
+            kind = "optional_TraceRecorder"
+            if param["default"]:
+                breakpoint()
+                pass
         elif param["type"] == "strtype":
             type = "PyObject *"
             kind = "PyUnicode"